@@ -0,0 +1,74 @@
+#ifndef ECS_AGGREGATE_H
+#define ECS_AGGREGATE_H
+
+#include "Defines.h"
+#include "Utils.h"
+
+namespace ecs{
+
+///---------------------------------------------------------------------
+/// An Aggregate is a value computed from every component of a type,
+/// that is kept up to date as components change
+///---------------------------------------------------------------------
+///
+/// Aggregates are created with EntityManager::aggregate. The value is
+/// updated when a component is added, set, removed or destroyed, so it
+/// can be read at any time without iterating through the entities.
+///
+/// @usage auto &strength = entities.aggregate_sum<Strength>();
+///        strength.value();
+///---------------------------------------------------------------------
+template<typename T>
+class Aggregate: details::forbid_copies {
+ public:
+  /// The current value
+  inline T const &value() const { return value_; }
+
+ protected:
+  Aggregate(T init) : init_(init), value_(init) { }
+
+  /// The value when no entity has the component
+  T init_;
+  T value_;
+};
+
+namespace details{
+
+///---------------------------------------------------------------------
+/// Helper class, all aggregates of a component of type C are a
+/// ComponentAggregate<C>, so that its ComponentManager can update them
+///---------------------------------------------------------------------
+template<typename C>
+class ComponentAggregate {
+ public:
+  virtual ~ComponentAggregate() { }
+  /// The component of the entity at index is added or removed
+  virtual void add(index_t index, C const &component) = 0;
+  virtual void remove(index_t index, C const &component) = 0;
+  /// Go back to the value when no entity has the component
+  virtual void reset() = 0;
+};
+
+///---------------------------------------------------------------------
+/// An Aggregate that uses add(T &, C const &) and remove(T &, C const &)
+/// to update its value
+///---------------------------------------------------------------------
+template<typename C, typename T, typename Add, typename Remove>
+class AggregateOf: public Aggregate<T>, public ComponentAggregate<C> {
+ public:
+  AggregateOf(T init, Add add, Remove remove) : Aggregate<T>(init), add_(add), remove_(remove) { }
+
+  void add(index_t, C const &component) override { add_(this->value_, component); }
+  void remove(index_t, C const &component) override { remove_(this->value_, component); }
+  void reset() override { this->value_ = this->init_; }
+
+ private:
+  Add add_;
+  Remove remove_;
+};
+
+} // namespace details
+
+} // namespace ecs
+
+#endif //ECS_AGGREGATE_H
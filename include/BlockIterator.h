@@ -0,0 +1,96 @@
+#ifndef ECS_BLOCKITERATOR_H
+#define ECS_BLOCKITERATOR_H
+
+namespace ecs{
+
+template<typename T>
+class View;
+
+///---------------------------------------------------------------------
+/// BlockIterator is an iterator through the blocks of a View
+///---------------------------------------------------------------------
+///
+/// Each block is ECS_CACHE_LINE_SIZE entity indexes, and dereferencing
+/// the iterator gives a View of the entities within that block. Blocks
+/// without any matching entity give an empty View.
+///
+/// The View is returned by value, so BlockIterator is a proxy iterator,
+/// and only an input iterator to the standard library. It still has the
+/// operators of a random access iterator, so the blocks can be divided
+/// between threads by hand, in constant time.
+///
+/// @usage for (View<T> block : view.blocks()) {
+///          for (auto entity : block) { }
+///        }
+///---------------------------------------------------------------------
+template<typename T>
+class BlockIterator: public std::iterator<std::input_iterator_tag, View<T>, std::ptrdiff_t, void, View<T>> {
+ public:
+  using difference_type = std::ptrdiff_t;
+
+  BlockIterator() : manager_(nullptr), first_(0), last_(0), block_(0) { }
+  BlockIterator(EntityManager *manager, details::ComponentMask mask, index_t first, index_t last, index_t block);
+
+  /// The View of the current block
+  View<T> operator*() const;
+  View<T> operator[](difference_type n) const { return *(*this + n); }
+
+  /// The index of the current block
+  index_t block() const { return block_; }
+
+  BlockIterator &operator++() { ++block_; return *this; }
+  BlockIterator &operator--() { --block_; return *this; }
+  BlockIterator operator++(int) { BlockIterator it(*this); ++block_; return it; }
+  BlockIterator operator--(int) { BlockIterator it(*this); --block_; return it; }
+  BlockIterator &operator+=(difference_type n) { block_ = index_t(block_ + n); return *this; }
+  BlockIterator &operator-=(difference_type n) { block_ = index_t(block_ - n); return *this; }
+  BlockIterator operator+(difference_type n) const { return BlockIterator(*this) += n; }
+  BlockIterator operator-(difference_type n) const { return BlockIterator(*this) -= n; }
+  difference_type operator-(BlockIterator const &rhs) const { return difference_type(block_) - difference_type(rhs.block_); }
+
+  bool operator==(BlockIterator const &rhs) const { return block_ == rhs.block_; }
+  bool operator!=(BlockIterator const &rhs) const { return block_ != rhs.block_; }
+  bool operator<(BlockIterator const &rhs) const { return block_ < rhs.block_; }
+  bool operator>(BlockIterator const &rhs) const { return block_ > rhs.block_; }
+  bool operator<=(BlockIterator const &rhs) const { return block_ <= rhs.block_; }
+  bool operator>=(BlockIterator const &rhs) const { return block_ >= rhs.block_; }
+
+ private:
+  EntityManager         *manager_;
+  details::ComponentMask mask_;
+  /// The range of entity indexes of the View
+  index_t                first_;
+  index_t                last_;
+  index_t                block_;
+}; //BlockIterator
+
+template<typename T>
+inline BlockIterator<T> operator+(typename BlockIterator<T>::difference_type n, BlockIterator<T> const &it) {
+  return it + n;
+}
+
+///---------------------------------------------------------------------
+/// The blocks of a View, that can be iterated with BlockIterators
+///---------------------------------------------------------------------
+template<typename T>
+class BlockRange {
+ public:
+  using iterator = BlockIterator<T>;
+
+  BlockRange(iterator begin, iterator end) : begin_(begin), end_(end) { }
+
+  iterator begin() const { return begin_; }
+  iterator end() const { return end_; }
+  size_t size() const { return size_t(end_ - begin_); }
+  bool empty() const { return begin_ == end_; }
+
+ private:
+  iterator begin_;
+  iterator end_;
+}; //BlockRange
+
+} // namespace ecs
+
+#include "BlockIterator.inl"
+
+#endif //ECS_BLOCKITERATOR_H
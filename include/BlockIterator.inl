@@ -0,0 +1,19 @@
+namespace ecs{
+
+template<typename T>
+BlockIterator<T>::BlockIterator(EntityManager *manager, details::ComponentMask mask,
+                                index_t first, index_t last, index_t block) :
+    manager_(manager),
+    mask_(mask),
+    first_(first),
+    last_(last),
+    block_(block) { }
+
+template<typename T>
+View<T> BlockIterator<T>::operator*() const {
+  index_t begin = std::max<index_t>(first_, block_ * ECS_CACHE_LINE_SIZE);
+  index_t end = index_t(std::min<size_t>(last_, size_t(block_ + 1) * ECS_CACHE_LINE_SIZE));
+  return View<T>(manager_, mask_, begin, end);
+}
+
+} // namespace ecs
@@ -0,0 +1,188 @@
+#ifndef ECS_COLUMNS_H
+#define ECS_COLUMNS_H
+
+#include "EntityManager.h"
+
+namespace ecs{
+
+namespace details{
+
+///---------------------------------------------------------------------
+/// The layout of exported columns
+///---------------------------------------------------------------------
+///
+/// A ColumnsHeader is followed by one ColumnHeader per component. Then
+/// follows the index and the version of the entity in each row, and the
+/// validity bitmap and the values of each component. Each buffer starts
+/// at an offset that is a multiple of 64 bytes, and is padded with zeros
+/// to the next multiple. Numbers are written with the byte order of the
+/// machine.
+///
+/// Bit i of a validity bitmap is byte i / 8, bit i % 8, like in Apache
+/// Arrow, and is set if the entity in row i has the component. Values of
+/// entities without the component are zero.
+///---------------------------------------------------------------------
+struct ColumnsHeader {
+  char magic[8];
+  uint64_t rows;
+  uint64_t columns;
+  /// Offsets from the start of the ColumnsHeader
+  uint64_t indexes_offset;
+  uint64_t versions_offset;
+};
+
+struct ColumnHeader {
+  uint64_t element_size;
+  /// How many rows that do not have the component
+  uint64_t null_count;
+  uint64_t validity_offset;
+  uint64_t data_offset;
+};
+
+static const char columns_magic[8] = {'E', 'C', 'S', 'C', 'O', 'L', 'S', '1'};
+static const uint64_t columns_alignment = 64;
+
+/// Round size up to a multiple of columns_alignment
+inline uint64_t align_column(uint64_t size) {
+  return (size + columns_alignment - 1) / columns_alignment * columns_alignment;
+}
+
+///---------------------------------------------------------------------
+/// Used to write Components of entities as columns, and to create
+/// entities from them. Used by EntityManager::export_columns and
+/// EntityManager::import_columns.
+///---------------------------------------------------------------------
+///
+/// The entities are scanned a block of 64 at a time. Consecutive rows
+/// with a component are written straight from the memory of the
+/// ComponentManager, without copying them anywhere first.
+///
+/// Rows are read in batches. Entities with the same components in a
+/// batch are given indexes together, and components of rows that get
+/// consecutive indexes are copied into the pool at once.
+///
+///---------------------------------------------------------------------
+template<typename ...Components>
+struct columns_t {
+  static_assert(sizeof...(Components) > 0, "At least 1 component must be exported.");
+  static_assert(ECS_IMPORT_BATCH_SIZE % ECS_CACHE_LINE_SIZE == 0,
+                "ECS_IMPORT_BATCH_SIZE must be a multiple of ECS_CACHE_LINE_SIZE");
+
+  static const index_t block_size = 64;
+  static const size_t column_count = sizeof...(Components);
+
+  /// Write every entity within [first, last) that has every component in
+  /// mask, and any component in any, as a row
+  static inline void write(EntityManager const &manager, ComponentMask const &mask, ComponentMask const &any,
+                           index_t first, index_t last, std::ostream &out);
+
+  /// Create an entity for each row read from in, calling progress(imported,
+  /// total) after each batch. Returns the number of rows
+  template<typename Progress>
+  static inline size_t read(EntityManager &manager, std::istream &in, Progress progress);
+
+ private:
+  /// Keeps track of the offset, so that buffers can be aligned
+  struct Writer {
+    std::ostream &out;
+    uint64_t offset;
+
+    inline void write(void const *data, size_t size);
+    inline void zeros(size_t size);
+    /// Write the lowest bits as bytes, lowest byte first
+    inline void bits(uint64_t bits, size_t bytes);
+    /// Pad with zeros up to the next multiple of columns_alignment
+    inline void align() { zeros(size_t(align_column(offset) - offset)); }
+  };
+
+  /// Bit i is set if entity first + i is a row
+  static inline uint64_t block_rows(EntityManager const &manager, ComponentMask const &mask,
+                                    ComponentMask const &any, index_t first, index_t end);
+
+  /// Bit i is set if entity first + i has component C
+  template<typename C>
+  static inline uint64_t block_has(EntityManager const &manager, index_t first, index_t end);
+
+  /// Write the validity bitmap and the values of component C
+  template<typename C>
+  static inline bool write_column(EntityManager const &manager, std::vector<uint64_t> const &rows,
+                                  index_t begin, index_t end, Writer &writer);
+
+  /// The rows of a batch that is read
+  struct Batch {
+    std::vector<char> values[column_count];
+    std::vector<uint8_t> validity[column_count];
+    std::vector<ComponentMask> masks;
+    /// The index of the entity of each row
+    std::vector<index_t> indexes;
+    /// Which of the distinct masks each row has, and the indexes given to each mask
+    std::vector<size_t> groups;
+    std::vector<index_t> allocated;
+  };
+
+  /// Give each row of the batch an index, for an entity with its mask
+  static inline void allocate(EntityManager &manager, Batch &batch);
+
+  /// Copy component C of each row that has it into its entity
+  template<typename C>
+  static inline bool read_column(EntityManager &manager, Batch const &batch, index_t end);
+};
+
+} // namespace details
+
+///---------------------------------------------------------------------
+/// Columns reads components that are exported with
+/// EntityManager::export_columns
+///---------------------------------------------------------------------
+///
+/// Nothing is copied, the values are read where they are, so a memory
+/// mapped file can be read without loading it first. The columns are in
+/// the same order as the components were given to export_columns.
+///
+/// @usage std::ostringstream out;
+///        entities.export_columns<Position, Health>(out);
+///        ...
+///        ecs::Columns columns(data, size);
+///        Health const *health = columns.values<Health>(1);
+///        for (size_t row = 0; row < columns.rows(); ++row) {
+///          if (columns.is_valid(1, row)) total += health[row];
+///        }
+///---------------------------------------------------------------------
+class Columns {
+ public:
+  /// data must be aligned to 8 bytes, and stay valid while Columns is used
+  inline Columns(void const *data, size_t size);
+
+  inline size_t rows() const { return size_t(header().rows); }
+  inline size_t columns() const { return size_t(header().columns); }
+
+  /// The index and version of the entity in each row
+  inline index_t const *indexes() const;
+  inline version_t const *versions() const;
+  inline Id id(size_t row) const { return Id(indexes()[row], versions()[row]); }
+
+  /// The validity bitmap of a column
+  inline uint8_t const *validity(size_t column) const;
+  /// Check if the entity in row has the component of column
+  inline bool is_valid(size_t column, size_t row) const;
+  /// How many rows that do not have the component of column
+  inline size_t null_count(size_t column) const { return size_t(column_header(column).null_count); }
+
+  /// The value in each row of a column. C must be the exported component
+  template<typename C>
+  inline C const *values(size_t column) const;
+
+ private:
+  inline details::ColumnsHeader const &header() const;
+  inline details::ColumnHeader const &column_header(size_t column) const;
+  inline void const *at(uint64_t offset) const { return data_ + offset; }
+
+  char const *data_;
+  size_t size_;
+};
+
+} // namespace ecs
+
+#include "Columns.inl"
+
+#endif //ECS_COLUMNS_H
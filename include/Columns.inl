@@ -0,0 +1,338 @@
+namespace ecs{
+
+namespace details{
+
+template<typename ...Components>
+void columns_t<Components...>::write(EntityManager const &manager, ComponentMask const &mask,
+                                     ComponentMask const &any, index_t first, index_t last, std::ostream &out) {
+  index_t end = index_t(std::min<size_t>(manager.entity_versions_.size(), last));
+  first = std::min(first, end);
+  // Blocks start at multiples of block_size, and the rows of each block are kept as bits
+  index_t begin = first / block_size * block_size;
+  std::vector<uint64_t> rows;
+  rows.reserve((end - begin + block_size - 1) / block_size);
+  ColumnHeader columns[] = {ColumnHeader{sizeof(Components), 0, 0, 0}...};
+  uint64_t row_count = 0;
+  for (index_t block = begin; block < end; block += block_size) {
+    index_t block_first = std::max(block, first);
+    uint64_t bits = block_rows(manager, mask, any, block_first, std::min<index_t>(block + block_size, end));
+    rows.push_back(bits << (block_first - block));
+    row_count += count_bits(rows.back());
+    uint64_t valid[] = {block_has<Components>(manager, block, std::min<index_t>(block + block_size, end))...};
+    for (size_t i = 0; i < column_count; ++i) {
+      columns[i].null_count += count_bits(rows.back() & ~valid[i]);
+    }
+  }
+
+  ColumnsHeader header;
+  std::memcpy(header.magic, columns_magic, sizeof(header.magic));
+  header.rows = row_count;
+  header.columns = column_count;
+  header.indexes_offset = align_column(sizeof(ColumnsHeader) + sizeof(columns));
+  header.versions_offset = align_column(header.indexes_offset + row_count * sizeof(index_t));
+  uint64_t offset = align_column(header.versions_offset + row_count * sizeof(version_t));
+  for (size_t i = 0; i < column_count; ++i) {
+    columns[i].validity_offset = offset;
+    columns[i].data_offset = align_column(offset + (row_count + 7) / 8);
+    offset = align_column(columns[i].data_offset + row_count * columns[i].element_size);
+  }
+
+  Writer writer{out, 0};
+  writer.write(&header, sizeof(header));
+  writer.write(columns, sizeof(columns));
+  writer.align();
+
+  index_t indexes[block_size];
+  for (size_t i = 0; i < rows.size(); ++i) {
+    size_t count = 0;
+    for (uint64_t bits = rows[i]; bits; bits &= bits - 1) {
+      indexes[count++] = index_t(begin + i * block_size + count_trailing_zeros(bits));
+    }
+    writer.write(indexes, count * sizeof(index_t));
+  }
+  writer.align();
+  version_t versions[block_size];
+  for (size_t i = 0; i < rows.size(); ++i) {
+    size_t count = 0;
+    for (uint64_t bits = rows[i]; bits; bits &= bits - 1) {
+      versions[count++] = manager.entity_versions_[begin + i * block_size + count_trailing_zeros(bits)];
+    }
+    writer.write(versions, count * sizeof(version_t));
+  }
+  writer.align();
+
+  // A braced list is evaluated in order, so the columns are written in the order of Components
+  bool written[] = {write_column<Components>(manager, rows, begin, end, writer)...};
+  (void) written;
+}
+
+template<typename ...Components>
+template<typename Progress>
+size_t columns_t<Components...>::read(EntityManager &manager, std::istream &in, Progress progress) {
+  std::streampos base = in.tellg();
+  ColumnsHeader header;
+  ColumnHeader columns[column_count];
+  in.read(reinterpret_cast<char *>(&header), sizeof(header));
+  ECS_ASSERT(in && std::memcmp(header.magic, columns_magic, sizeof(columns_magic)) == 0,
+             "Stream does not contain exported columns");
+  ECS_ASSERT(header.columns == column_count, "Exported columns are not the same as the components");
+  in.read(reinterpret_cast<char *>(columns), sizeof(columns));
+  size_t element_sizes[] = {sizeof(Components)...};
+  for (size_t i = 0; i < column_count; ++i) {
+    ECS_ASSERT(in && columns[i].element_size == element_sizes[i], "Exported columns are not the same as the components");
+  }
+  // Created before any entity, since creating a ComponentManager is not possible while iterating
+  int expand[] = {(manager.get_component_manager<Components>(), 0)...};
+  (void) expand;
+
+  // Room for every row is made at once, instead of growing batch by batch
+  size_t capacity = manager.entity_versions_.size() + size_t(header.rows) + block_size;
+  manager.entity_versions_.reserve(capacity);
+  manager.component_masks_.reserve(capacity);
+
+  Batch batch;
+  ComponentMask masks[] = {component_mask<Components>()...};
+  for (uint64_t first = 0; first < header.rows; first += ECS_IMPORT_BATCH_SIZE) {
+    size_t rows = size_t(std::min<uint64_t>(ECS_IMPORT_BATCH_SIZE, header.rows - first));
+    batch.masks.assign(rows, ComponentMask(0));
+    for (size_t i = 0; i < column_count; ++i) {
+      std::vector<uint8_t> &validity = batch.validity[i];
+      validity.resize((rows + 7) / 8);
+      in.seekg(base + std::streamoff(columns[i].validity_offset + first / 8));
+      in.read(reinterpret_cast<char *>(validity.data()), std::streamsize(validity.size()));
+      batch.values[i].resize(rows * columns[i].element_size);
+      in.seekg(base + std::streamoff(columns[i].data_offset + first * columns[i].element_size));
+      in.read(batch.values[i].data(), std::streamsize(batch.values[i].size()));
+      ECS_ASSERT(in, "Exported columns are truncated");
+      for (size_t row = 0; row < rows; ++row) {
+        if ((validity[row / 8] >> (row % 8)) & 1) batch.masks[row] |= masks[i];
+      }
+    }
+    allocate(manager, batch);
+    index_t end = *std::max_element(batch.indexes.begin(), batch.indexes.end()) + 1;
+    bool copied[] = {read_column<Components>(manager, batch, end)...};
+    (void) copied;
+    for (size_t row = 0; row < rows; ++row) {
+      manager.component_masks_[batch.indexes[row]] = batch.masks[row];
+    }
+    progress(size_t(first + rows), size_t(header.rows));
+  }
+  // Leave the stream after the columns, in case more data follows them
+  ColumnHeader const &last = columns[column_count - 1];
+  in.seekg(base + std::streamoff(align_column(last.data_offset + header.rows * last.element_size)));
+  return size_t(header.rows);
+}
+
+template<typename ...Components>
+void columns_t<Components...>::allocate(EntityManager &manager, Batch &batch) {
+  // There are few different masks in a batch, so they are found by comparing with each
+  std::vector<ComponentMask> masks;
+  std::vector<size_t> counts;
+  std::vector<size_t> &group_of = batch.groups;
+  group_of.resize(batch.masks.size());
+  for (size_t row = 0; row < batch.masks.size(); ++row) {
+    size_t group = 0;
+    while (group < masks.size() && masks[group] != batch.masks[row]) ++group;
+    if (group == masks.size()) {
+      masks.push_back(batch.masks[row]);
+      counts.push_back(0);
+    }
+    ++counts[group];
+    group_of[row] = group;
+  }
+  // Indexes of each group follow each other
+  std::vector<size_t> next(masks.size());
+  batch.allocated.clear();
+  for (size_t group = 0; group < masks.size(); ++group) {
+    next[group] = batch.allocated.size();
+    manager.allocate_indexes(masks[group], counts[group], batch.allocated);
+  }
+  // Rows with the same mask get their indexes in order
+  batch.indexes.resize(batch.masks.size());
+  for (size_t row = 0; row < batch.masks.size(); ++row) {
+    batch.indexes[row] = batch.allocated[next[group_of[row]]++];
+  }
+}
+
+template<typename ...Components>
+template<typename C>
+bool columns_t<Components...>::read_column(EntityManager &manager, Batch const &batch, index_t end) {
+  static_assert(std::is_trivially_copyable<C>::value, "Only trivially copyable components can be imported");
+  const size_t column = index_of<C, Components...>::value;
+  ComponentManager<C> &component_manager = manager.get_component_manager_fast<C>();
+  component_manager.ensure_min_size(end);
+  size_t chunk_size = component_manager.pool().chunk_size();
+  std::vector<index_t> const &indexes = batch.indexes;
+  uint8_t const *validity = batch.validity[column].data();
+  char const *values = batch.values[column].data();
+  auto has = [validity](size_t row) { return ((validity[row / 8] >> (row % 8)) & 1) != 0; };
+  for (size_t row = 0; row < indexes.size();) {
+    if (!has(row)) {
+      ++row;
+      continue;
+    }
+    // Rows that get consecutive indexes within the same chunk are copied at once
+    size_t length = 1;
+    while (row + length < indexes.size() && has(row + length) && indexes[row + length] == indexes[row] + length &&
+        (indexes[row] + length) % chunk_size != 0) {
+      ++length;
+    }
+    std::memcpy(static_cast<void *>(component_manager.get_ptr(indexes[row])), values + row * sizeof(C),
+                length * sizeof(C));
+    for (size_t i = 0; i < length; ++i) {
+      component_manager.aggregate_added(indexes[row + i]);
+    }
+    row += length;
+  }
+  return true;
+}
+
+template<typename ...Components>
+void columns_t<Components...>::Writer::write(void const *data, size_t size) {
+  out.write(static_cast<char const *>(data), std::streamsize(size));
+  offset += size;
+}
+
+template<typename ...Components>
+void columns_t<Components...>::Writer::zeros(size_t size) {
+  static const char zero[256] = {};
+  offset += size;
+  while (size > 0) {
+    size_t count = std::min(size, sizeof(zero));
+    out.write(zero, std::streamsize(count));
+    size -= count;
+  }
+}
+
+template<typename ...Components>
+void columns_t<Components...>::Writer::bits(uint64_t bits, size_t bytes) {
+  uint8_t data[sizeof(bits)];
+  for (size_t i = 0; i < bytes; ++i) {
+    data[i] = uint8_t(bits >> (8 * i));
+  }
+  write(data, bytes);
+}
+
+template<typename ...Components>
+uint64_t columns_t<Components...>::block_rows(EntityManager const &manager, ComponentMask const &mask,
+                                              ComponentMask const &any, index_t first, index_t end) {
+  uint64_t matches = match_masks(&manager.component_masks_[first], end - first, mask);
+  for (uint64_t bits = matches; bits; bits &= bits - 1) {
+    unsigned i = count_trailing_zeros(bits);
+    if ((manager.component_masks_[first + i] & any).none()) matches &= ~(uint64_t(1) << i);
+  }
+  return matches;
+}
+
+template<typename ...Components>
+template<typename C>
+uint64_t columns_t<Components...>::block_has(EntityManager const &manager, index_t first, index_t end) {
+  if (!manager.has_component_manager<C>()) return 0;
+  return match_masks(&manager.component_masks_[first], end - first, component_mask<C>());
+}
+
+template<typename ...Components>
+template<typename C>
+bool columns_t<Components...>::write_column(EntityManager const &manager, std::vector<uint64_t> const &rows,
+                                            index_t begin, index_t end, Writer &writer) {
+  static_assert(std::is_trivially_copyable<C>::value, "Only trivially copyable components can be exported");
+  // Bits are added to the validity bitmap in the order of the rows
+  uint64_t validity = 0;
+  unsigned used = 0;
+  for (size_t i = 0; i < rows.size(); ++i) {
+    index_t block = index_t(begin + i * block_size);
+    uint64_t valid = rows[i] & block_has<C>(manager, block, std::min<index_t>(block + block_size, end));
+    for (uint64_t bits = rows[i]; bits; bits &= bits - 1) {
+      validity |= ((valid >> count_trailing_zeros(bits)) & 1) << used;
+      if (++used == 64) {
+        writer.bits(validity, sizeof(validity));
+        validity = 0;
+        used = 0;
+      }
+    }
+  }
+  // Only the bytes with bits of rows are written, the rest is padding
+  writer.bits(validity, (used + 7) / 8);
+  writer.align();
+
+  size_t zeros = 0;
+  for (size_t i = 0; i < rows.size(); ++i) {
+    index_t block = index_t(begin + i * block_size);
+    uint64_t valid = rows[i] & block_has<C>(manager, block, std::min<index_t>(block + block_size, end));
+    for (uint64_t bits = rows[i]; bits;) {
+      unsigned row = count_trailing_zeros(bits);
+      if (!((valid >> row) & 1)) {
+        zeros += sizeof(C);
+        bits &= bits - 1;
+        continue;
+      }
+      // The run of consecutive entities from row that has C
+      uint64_t run = ~(valid >> row);
+      unsigned length = run ? count_trailing_zeros(run) : 64 - row;
+      writer.zeros(zeros);
+      zeros = 0;
+      // A block is within a single chunk, so the run is in contiguous memory
+      if (C const *run_ptr = manager.get_block_ptr<C>(block + row, block_size)) {
+        writer.write(run_ptr, length * sizeof(C));
+      } else {
+        for (unsigned j = 0; j < length; ++j) {
+          writer.write(&manager.get_component_fast<C>(block + row + j), sizeof(C));
+        }
+      }
+      bits = row + length < 64 ? bits & ~((uint64_t(1) << (row + length)) - 1) : 0;
+    }
+  }
+  writer.zeros(zeros);
+  writer.align();
+  return true;
+}
+
+} // namespace details
+
+Columns::Columns(void const *data, size_t size) :
+    data_(static_cast<char const *>(data)),
+    size_(size) {
+  ECS_ASSERT(size_ >= sizeof(details::ColumnsHeader) &&
+                 std::memcmp(header().magic, details::columns_magic, sizeof(details::columns_magic)) == 0,
+             "Data is not exported columns");
+  ECS_ASSERT(sizeof(details::ColumnsHeader) + columns() * sizeof(details::ColumnHeader) <= size_ &&
+                 header().versions_offset + rows() * sizeof(version_t) <= size_ &&
+                 (columns() == 0 ||
+                     column_header(columns() - 1).data_offset +
+                         rows() * column_header(columns() - 1).element_size <= size_),
+             "Exported columns are truncated");
+}
+
+index_t const *Columns::indexes() const {
+  return static_cast<index_t const *>(at(header().indexes_offset));
+}
+
+version_t const *Columns::versions() const {
+  return static_cast<version_t const *>(at(header().versions_offset));
+}
+
+uint8_t const *Columns::validity(size_t column) const {
+  return static_cast<uint8_t const *>(at(column_header(column).validity_offset));
+}
+
+bool Columns::is_valid(size_t column, size_t row) const {
+  ECS_ASSERT(row < rows(), "Row out of range");
+  return (validity(column)[row / 8] >> (row % 8)) & 1;
+}
+
+template<typename C>
+C const *Columns::values(size_t column) const {
+  ECS_ASSERT(column_header(column).element_size == sizeof(C), "Column has another component type");
+  return static_cast<C const *>(at(column_header(column).data_offset));
+}
+
+details::ColumnsHeader const &Columns::header() const {
+  return *reinterpret_cast<details::ColumnsHeader const *>(data_);
+}
+
+details::ColumnHeader const &Columns::column_header(size_t column) const {
+  ECS_ASSERT(column < columns(), "Column out of range");
+  return reinterpret_cast<details::ColumnHeader const *>(data_ + sizeof(details::ColumnsHeader))[column];
+}
+
+} // namespace ecs
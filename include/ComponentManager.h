@@ -2,6 +2,7 @@
 #define ECS_COMPONENTMANAGER_H
 
 #include "Defines.h"
+#include "Aggregate.h"
 namespace ecs{
 
 // Forward declarations
@@ -33,6 +34,19 @@ typename std::enable_if<
         std::is_base_of<details::BaseProperty, C>::value, C&>::type;
 
 
+///-----------------------------------------------------------------------
+/// global function for copying a component to a specific location
+///-----------------------------------------------------------------------
+template<typename C>
+auto copy_component(void* ptr, C const &component) ->
+typename std::enable_if<std::is_copy_constructible<C>::value, void>::type;
+
+// Component can't be copied -> error when trying to
+template<typename C>
+auto copy_component(void* ptr, C const &component) ->
+typename std::enable_if<!std::is_copy_constructible<C>::value, void>::type;
+
+
 ///---------------------------------------------------------------------
 /// Helper class, all ComponentManager are a BaseManager
 ///---------------------------------------------------------------------
@@ -44,11 +58,40 @@ class BaseManager {
   virtual void* get_void_ptr(index_t index) = 0;
   virtual void const* get_void_ptr(index_t index) const = 0;
   virtual void ensure_min_size(index_t size) = 0;
+  virtual BasePool &pool() = 0;
+  /// Create an empty ComponentManager for the same component type, owned by another EntityManager
+  virtual BaseManager *create_manager(EntityManager &manager) const = 0;
+  /// Move a component to another ComponentManager of the same type. Does not change any component mask
+  virtual void move(index_t index, BaseManager &target, index_t target_index) = 0;
+  /// Destroy every component that is not shared with a fork, and release all memory
+  virtual void clear() = 0;
+  /// Share the memory of another ComponentManager of the same type. Only chunks that differ are
+  /// released, and only their components that are not shared with a fork are destroyed
+  virtual void share(BaseManager &other) = 0;
+  /// Make the current components readable as previous values, if double buffered
+  virtual void swap_buffers() = 0;
+  /// Add the component at index to every aggregate, after it is written to directly
+  virtual void aggregate_added(index_t index) = 0;
+  /// Remove the component at index from every aggregate, before it is moved away
+  virtual void aggregate_removed(index_t index) = 0;
+  /// Compute every aggregate from the start, after components are moved in bulk
+  virtual void recompute_aggregates() = 0;
 };
 
 ///---------------------------------------------------------------------
 /// Helper class, This is the main class for holding many Component of
 /// a specified type. It uses a memory pool to store the components
+///
+/// Memory may be shared with a fork of the EntityManager. Any non-const
+/// access to a component copies the shared chunk it is located in.
+///
+/// A double buffered ComponentManager also keeps the value every
+/// component had at the last swap_buffers. The previous values share
+/// memory with the current ones, so only chunks that are modified after
+/// a swap are copied.
+///
+/// Aggregates of the components are updated when a component is created,
+/// set or removed.
 ///---------------------------------------------------------------------
 template<typename C>
 class ComponentManager: public BaseManager, details::forbid_copies {
@@ -62,6 +105,10 @@ class ComponentManager: public BaseManager, details::forbid_copies {
   /// Remove component at specific index and call destructor
   void remove(index_t index);
 
+  /// Assign a new value to the component at specific index
+  template<typename T>
+  C& set(index_t index, T &&value);
+
   /// Access a component given a specific index
   C& operator[](index_t index);
   C& get(index_t index);
@@ -81,9 +128,64 @@ class ComponentManager: public BaseManager, details::forbid_copies {
   /// Get the bitmask for the component this ComponentManger handles
   ComponentMask mask();
 
+  /// Access the memory pool where components are stored
+  details::Pool<C> &pool() { return pool_; }
+  details::Pool<C> const &pool() const { return pool_; }
+
+  /// Create an empty ComponentManager for the same component type, owned by another EntityManager
+  BaseManager *create_manager(EntityManager &manager) const;
+
+  /// Move a component to another ComponentManager of the same type. Does not change any component
+  /// mask, or any aggregate
+  void move(index_t index, BaseManager &target, index_t target_index);
+
+  /// Destroy every component that is not shared with a fork, and release all memory
+  void clear();
+
+  /// Share the memory of another ComponentManager of the same type. Only chunks that differ are
+  /// released, and only their components that are not shared with a fork are destroyed
+  void share(BaseManager &other);
+
+  /// Start keeping the previous value of each component. Component must be trivially copyable
+  void double_buffer();
+  bool is_double_buffered() const { return previous_ != nullptr; }
+
+  /// Make the current components readable as previous values. Does nothing if not double buffered
+  void swap_buffers();
+
+  /// Access the value a component had at the last swap_buffers. The
+  /// current value is returned if the entity at index did not have the
+  /// component at the last swap
+  C const &previous(index_t index) const;
+
+  /// Start keeping an aggregate up to date. Every existing component is added to it
+  template<typename T, typename Add, typename Remove>
+  Aggregate<T> const &aggregate(T init, Add add, Remove remove);
+
+  /// Start keeping any ComponentAggregate up to date, and take ownership of it
+  void add_aggregate(ComponentAggregate<C> *aggregate);
+
+  void aggregate_added(index_t index);
+  void aggregate_removed(index_t index);
+  void recompute_aggregates();
+
  private:
+  /// If the chunk where index is located is shared with another EntityManager,
+  /// make it unique by copying every component in it
+  void unshare(index_t index);
+
+  /// Remember which entities have the component, when previous values are taken
+  void record_previous_owners();
+
   EntityManager &manager_;
   details::Pool<C> pool_;
+  /// Shares chunks with pool_, that are not modified since last swap_buffers
+  std::unique_ptr<details::Pool<C>> previous_;
+  /// The version of the entity at each index at the last swap_buffers, and
+  /// whether it had the component then
+  std::vector<version_t> previous_versions_;
+  std::vector<bool> previous_owned_;
+  std::vector<std::unique_ptr<ComponentAggregate<C>>> aggregates_;
 }; //ComponentManager
 
 } // namespace details
@@ -37,19 +37,43 @@ typename std::enable_if<
   return *reinterpret_cast<C*>(new(ptr) typename C::ValueType(std::forward<Args>(args)...));
 }
 
+template<typename C>
+auto copy_component(void* ptr, C const &component) ->
+typename std::enable_if<std::is_copy_constructible<C>::value, void>::type {
+  new(ptr) C(component);
+}
+
+template<typename C>
+auto copy_component(void* ptr, C const &component) ->
+typename std::enable_if<!std::is_copy_constructible<C>::value, void>::type {
+  ECS_ASSERT(false, "Component can't be copied, and can't be modified while shared with a fork");
+}
+
 template<typename C> template<typename ...Args>
 C& ComponentManager<C>::create(index_t index, Args &&... args) {
   pool_.ensure_min_size(index + 1);
-  create_component<C>(get_ptr(index), std::forward<Args>(args)...);
-  return get(index);
+  C &component = create_component<C>(get_ptr(index), std::forward<Args>(args)...);
+  for (auto &aggregate : aggregates_) aggregate->add(index, component);
+  return component;
 }
 
 template<typename C>
 void ComponentManager<C>::remove(index_t index) {
+  C const *component = get_ptr(index);
+  for (auto &aggregate : aggregates_) aggregate->remove(index, *component);
   pool_.destroy(index);
   manager_.mask(index).reset(component_index<C>());
 }
 
+template<typename C> template<typename T>
+C& ComponentManager<C>::set(index_t index, T &&value) {
+  C &component = get(index);
+  for (auto &aggregate : aggregates_) aggregate->remove(index, component);
+  component = std::forward<T>(value);
+  for (auto &aggregate : aggregates_) aggregate->add(index, component);
+  return component;
+}
+
 template<typename C>
 C &ComponentManager<C>::operator[](index_t index){
   return get(index);
@@ -67,6 +91,9 @@ C const &ComponentManager<C>::get(index_t index) const {
 
 template<typename C>
 C *ComponentManager<C>::get_ptr(index_t index)  {
+  if (pool_.has_shared()) {
+    unshare(index);
+  }
   return pool_.get_ptr(index);
 }
 
@@ -77,7 +104,7 @@ C const *ComponentManager<C>::get_ptr(index_t index) const {
 
 template<typename C>
 void *ComponentManager<C>::get_void_ptr(index_t index)  {
-  return pool_.get_ptr(index);
+  return get_ptr(index);
 }
 
 template<typename C>
@@ -90,6 +117,157 @@ void ComponentManager<C>::ensure_min_size(index_t size){
   pool_.ensure_min_size(size);
 }
 
+template<typename C>
+BaseManager *ComponentManager<C>::create_manager(EntityManager &manager) const {
+  ComponentManager<C> *created = new ComponentManager<C>(manager, pool_.chunk_size());
+  // Only trivially copyable components are double buffered, so double_buffer is not instantiated for others
+  if (previous_) {
+    created->previous_.reset(new details::Pool<C>(pool_.chunk_size()));
+    created->previous_->share_chunks(created->pool_);
+  }
+  return created;
+}
+
+template<typename C>
+void ComponentManager<C>::move(index_t index, BaseManager &target, index_t target_index) {
+  ComponentManager<C> &target_manager = static_cast<ComponentManager<C> &>(target);
+  target_manager.pool_.ensure_min_size(target_index + 1);
+  new(target_manager.get_ptr(target_index)) C(std::move(get(index)));
+  pool_.destroy(index);
+}
+
+template<typename C>
+void ComponentManager<C>::clear() {
+  if (!std::is_trivially_destructible<C>::value) {
+    size_t chunk_size = pool_.chunk_size();
+    index_t size = std::min<index_t>(pool_.size(), index_t(manager_.component_masks_.size()));
+    for (index_t index = 0; index < size; ++index) {
+      if (manager_.component_masks_[index].test(component_index<C>()) && !pool_.is_shared(index / chunk_size)) {
+        pool_.destroy(index);
+      }
+    }
+  }
+  pool_.clear();
+  if (previous_) previous_->clear();
+  previous_versions_.clear();
+  previous_owned_.clear();
+  for (auto &aggregate : aggregates_) aggregate->reset();
+}
+
+template<typename C>
+void ComponentManager<C>::share(BaseManager &other) {
+  details::Pool<C> &other_pool = static_cast<ComponentManager<C> &>(other).pool_;
+  if (!std::is_trivially_destructible<C>::value) {
+    size_t chunk_size = pool_.chunk_size();
+    index_t size = std::min<index_t>(pool_.size(), index_t(manager_.component_masks_.size()));
+    for (size_t chunk = 0; chunk * chunk_size < size; ++chunk) {
+      // Chunks that are already shared with other are kept as they are
+      if (!pool_.chunk(chunk) || pool_.is_shared(chunk)) continue;
+      if (chunk < other_pool.chunks() && pool_.chunk(chunk) == other_pool.chunk(chunk)) continue;
+      index_t end = std::min<index_t>(size, index_t((chunk + 1) * chunk_size));
+      for (index_t index = index_t(chunk * chunk_size); index < end; ++index) {
+        if (manager_.component_masks_[index].test(component_index<C>())) pool_.destroy(index);
+      }
+    }
+  }
+  pool_.share_chunks(other_pool);
+  if (previous_) previous_->clear();
+  previous_versions_.clear();
+  previous_owned_.clear();
+}
+
+template<typename C>
+void ComponentManager<C>::double_buffer() {
+  // Previous values are released without calling any destructor
+  static_assert(std::is_trivially_copyable<C>::value, "Only trivially copyable components can be double buffered");
+  if (previous_) return;
+  previous_.reset(new details::Pool<C>(pool_.chunk_size()));
+  previous_->share_chunks(pool_);
+  record_previous_owners();
+}
+
+template<typename C>
+void ComponentManager<C>::swap_buffers() {
+  if (!previous_) return;
+  previous_->share_chunks(pool_);
+  record_previous_owners();
+}
+
+template<typename C>
+void ComponentManager<C>::record_previous_owners() {
+  previous_versions_ = manager_.entity_versions_;
+  size_t size = manager_.component_masks_.size();
+  previous_owned_.resize(size);
+  for (size_t index = 0; index < size; ++index) {
+    previous_owned_[index] = manager_.component_masks_[index].test(component_index<C>());
+  }
+}
+
+template<typename C>
+C const &ComponentManager<C>::previous(index_t index) const {
+  ECS_ASSERT(is_double_buffered(), "Component is not double buffered");
+  // Entities created, or given the component, after the last swap have no previous value yet
+  bool owned = index < previous_owned_.size() && previous_owned_[index] &&
+      previous_versions_[index] == manager_.entity_versions_[index];
+  if (!owned) return *get_ptr(index);
+  return previous_->get(index);
+}
+
+template<typename C> template<typename T, typename Add, typename Remove>
+Aggregate<T> const &ComponentManager<C>::aggregate(T init, Add add, Remove remove) {
+  auto *aggregate = new AggregateOf<C, T, Add, Remove>(init, add, remove);
+  add_aggregate(aggregate);
+  return *aggregate;
+}
+
+template<typename C>
+void ComponentManager<C>::add_aggregate(ComponentAggregate<C> *aggregate) {
+  aggregates_.push_back(std::unique_ptr<ComponentAggregate<C>>(aggregate));
+  index_t size = std::min<index_t>(pool_.size(), index_t(manager_.component_masks_.size()));
+  for (index_t index = 0; index < size; ++index) {
+    if (manager_.component_masks_[index].test(component_index<C>())) aggregate->add(index, *pool_.get_ptr(index));
+  }
+}
+
+template<typename C>
+void ComponentManager<C>::aggregate_added(index_t index) {
+  for (auto &aggregate : aggregates_) aggregate->add(index, *pool_.get_ptr(index));
+}
+
+template<typename C>
+void ComponentManager<C>::aggregate_removed(index_t index) {
+  for (auto &aggregate : aggregates_) aggregate->remove(index, *pool_.get_ptr(index));
+}
+
+template<typename C>
+void ComponentManager<C>::recompute_aggregates() {
+  if (aggregates_.empty()) return;
+  index_t size = std::min<index_t>(pool_.size(), index_t(manager_.component_masks_.size()));
+  for (auto &aggregate : aggregates_) {
+    aggregate->reset();
+    for (index_t index = 0; index < size; ++index) {
+      if (manager_.component_masks_[index].test(component_index<C>())) aggregate->add(index, *pool_.get_ptr(index));
+    }
+  }
+}
+
+template<typename C>
+void ComponentManager<C>::unshare(index_t index) {
+  ECS_ASSERT(index < pool_.capacity(), "Pool has not allocated memory for this index.");
+  size_t chunk_size = pool_.chunk_size();
+  size_t chunk_index = index / chunk_size;
+  if (!pool_.is_shared(chunk_index)) return;
+  char *shared = pool_.detach_chunk(chunk_index);
+  index_t first = index_t(chunk_index * chunk_size);
+  index_t last = std::min<index_t>(index_t(first + chunk_size), index_t(manager_.component_masks_.size()));
+  for (index_t i = first; i < last; ++i) {
+    if (manager_.component_masks_[i].test(component_index<C>())) {
+      copy_component<C>(pool_.get_ptr(i), *reinterpret_cast<C *>(shared + (i - first) * sizeof(C)));
+    }
+  }
+  BasePool::release_chunk(shared);
+}
+
 template<typename C>
 ComponentMask ComponentManager<C>::mask() {
   return component_mask<C>();
@@ -0,0 +1,61 @@
+#ifndef ECS_CURSOR_H
+#define ECS_CURSOR_H
+
+#include "Defines.h"
+
+namespace ecs{
+
+///---------------------------------------------------------------------
+/// A Cursor iterates through a View over several calls
+///---------------------------------------------------------------------
+///
+/// Each call to for_each continues from where the last call stopped,
+/// and stops when its budget is spent, or when the end of the View is
+/// reached. The next call after the end starts from the beginning
+/// again. This way a system can visit every entity eventually, without
+/// doing all the work within one update.
+///
+/// The cursor is an entity index, so entities can be created and
+/// destroyed between calls. Destroyed entities are skipped, and
+/// entities created behind the cursor are visited on the next pass.
+///
+///---------------------------------------------------------------------
+template<typename T>
+class Cursor {
+  ECS_ASSERT_IS_ENTITY(T)
+ public:
+  inline Cursor() : index_(0), passes_(0) { }
+
+  /// Visit at most max_entities entities. Returns how many were visited
+  template<typename Lambda>
+  inline size_t for_each(View<T> view, size_t max_entities, Lambda lambda);
+
+  /// Visit entities until max_time has passed. The time is checked every
+  /// time_check_interval entities. Returns how many were visited
+  template<typename Rep, typename Period, typename Lambda>
+  inline size_t for_each(View<T> view, std::chrono::duration<Rep, Period> max_time, Lambda lambda);
+
+  /// The index where the next call continues
+  inline index_t index() const { return index_; }
+
+  /// How many times the end of a View has been reached
+  inline size_t passes() const { return passes_; }
+
+  /// Start from the beginning with the next call
+  inline void reset() { index_ = 0; }
+
+  static const size_t time_check_interval = 64;
+
+ private:
+  template<typename Lambda, typename Predicate>
+  inline size_t visit(View<T> &view, Lambda &lambda, Predicate has_budget);
+
+  index_t index_;
+  size_t passes_;
+}; //Cursor
+
+} // namespace ecs
+
+#include "Cursor.inl"
+
+#endif //ECS_CURSOR_H
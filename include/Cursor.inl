@@ -0,0 +1,38 @@
+#include "View.h"
+
+namespace ecs{
+
+template<typename T> template<typename Lambda>
+size_t Cursor<T>::for_each(View<T> view, size_t max_entities, Lambda lambda) {
+  return visit(view, lambda, [max_entities](size_t visited) {
+    return visited < max_entities;
+  });
+}
+
+template<typename T> template<typename Rep, typename Period, typename Lambda>
+size_t Cursor<T>::for_each(View<T> view, std::chrono::duration<Rep, Period> max_time, Lambda lambda) {
+  auto deadline = std::chrono::steady_clock::now() + max_time;
+  return visit(view, lambda, [deadline](size_t visited) {
+    return visited % time_check_interval != 0 || std::chrono::steady_clock::now() < deadline;
+  });
+}
+
+template<typename T> template<typename Lambda, typename Predicate>
+size_t Cursor<T>::visit(View<T> &view, Lambda &lambda, Predicate has_budget) {
+  auto it = view.begin();
+  auto end = view.end();
+  it.seek(index_);
+  size_t visited = 0;
+  for (; it != end && has_budget(visited); ++it, ++visited) {
+    lambda(*it);
+  }
+  if (it == end) {
+    index_ = 0;
+    ++passes_;
+  } else {
+    index_ = it.index();
+  }
+  return visited;
+}
+
+} // namespace ecs
@@ -24,6 +24,42 @@
 #define ECS_DEFAULT_CHUNK_SIZE ECS_CACHE_LINE_SIZE
 #endif
 
+/// How many entities ahead the components are prefetched, when iterating
+/// with a lambda. Can be changed with EntityManager::set_prefetch_distance
+#ifndef ECS_PREFETCH_DISTANCE
+#define ECS_PREFETCH_DISTANCE 4
+#endif
+
+/// How many entity indexes each partial result of a reduction covers.
+/// Must be a multiple of ECS_CACHE_LINE_SIZE
+#ifndef ECS_REDUCE_SLICE_SIZE
+#define ECS_REDUCE_SLICE_SIZE 1024
+#endif
+
+/// How many slices each thread should have at least, when a reduction
+/// picks how many threads to use. Fewer slices run on the calling thread
+#ifndef ECS_REDUCE_SLICES_PER_THREAD
+#define ECS_REDUCE_SLICES_PER_THREAD 16
+#endif
+
+/// How many rows import_columns reads at a time. Must be a multiple of
+/// ECS_CACHE_LINE_SIZE
+#ifndef ECS_IMPORT_BATCH_SIZE
+#define ECS_IMPORT_BATCH_SIZE 65536
+#endif
+
+/// How many packets a Replicator keeps track of for each observer, that
+/// are not acknowledged yet. Older packets are merged.
+#ifndef ECS_REPLICATION_HISTORY
+#define ECS_REPLICATION_HISTORY 32
+#endif
+
+/// How many times SharedWorldReader::read copies a snapshot, that is
+/// overwritten while it is copied, before it gives up
+#ifndef ECS_SHARED_WORLD_RETRIES
+#define ECS_SHARED_WORLD_RETRIES 16
+#endif
+
 #define ECS_ASSERT_IS_CALLABLE(T)                                                           \
             static_assert(details::is_callable<T>::value,                                   \
             "Provide a function or lambda expression");                                     \
@@ -2,6 +2,7 @@
 #define ECS_ENTITY_H
 
 #include "Id.h"
+#include "Handle.h"
 
 namespace ecs{
 ///---------------------------------------------------------------------
@@ -22,10 +23,19 @@ class Entity {
   inline Id &id() { return id_; }
   inline Id const &id() const { return id_; }
 
+  /// The Id of this Entity, packed without the EntityManager
+  inline Handle handle() const { return Handle(id_); }
+
   /// Returns the requested component, or error if it doesn't exist
   template<typename C> inline C &get();
   template<typename C> inline C const &get() const;
 
+  /// Returns the value the component had at the last swap_buffers, or
+  /// the current value if the entity did not exist or did not have the
+  /// component then. Component must be double buffered, see
+  /// EntityManager::double_buffer
+  template<typename C> inline C const &previous() const;
+
   /// Set the requested component, if old component exist,
   /// a new one is created. Otherwise, the assignment operator
   /// is used.
@@ -55,6 +65,11 @@ class Entity {
   /// Destroys this entity. Removes all components as well
   void inline destroy();
 
+  /// Destroys this entity after a number of seconds, unless it is destroyed
+  /// before that. Setting it again replaces the earlier time.
+  /// See EntityManager::update_expiry
+  void inline expire_in(float seconds);
+
   /// Return true if entity has all specified components. False otherwise
   template<typename... Components> inline bool has();
   template<typename... Components> inline bool has() const;
@@ -24,6 +24,11 @@ C const &Entity::get() const {
   return manager_->get_component<C>(*this);
 }
 
+template<typename C>
+C const &Entity::previous() const {
+  return manager_->get_previous_component<C>(*this);
+}
+
 template<typename C, typename ... Args>
 C &Entity::set(Args && ... args){
   return manager_->set_component<C>(*this, std::forward<Args>(args) ...);
@@ -75,6 +80,10 @@ void Entity::clear_mask() {
   manager_->clear_mask(*this);
 }
 
+void Entity::expire_in(float seconds) {
+  manager_->expire_in(*this, seconds);
+}
+
 void Entity::destroy() {
   manager_->destroy(*this);
 }
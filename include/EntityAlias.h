@@ -36,12 +36,19 @@ class EntityAlias : public details::BaseEntity {
   inline Id &id();
   inline Id const &id() const;
 
+  /// The Id of the entity, packed without the EntityManager
+  inline Handle handle() const;
+
   /// Returns the requested component, or error if it doesn't exist
   template<typename C> inline auto get()       -> typename std::enable_if< is_component<C>::value, C &>::type;
   template<typename C> inline auto get()       -> typename std::enable_if<!is_component<C>::value, C &>::type;
   template<typename C> inline auto get() const -> typename std::enable_if< is_component<C>::value, C const &>::type;
   template<typename C> inline auto get() const -> typename std::enable_if<!is_component<C>::value, C const &>::type;
 
+  /// Returns the value the component had at the last swap_buffers.
+  /// Component must be double buffered, see EntityManager::double_buffer
+  template<typename C> inline C const &previous() const;
+
   /// Set the requested component, if old component exist,
   /// a new one is created. Otherwise, the assignment operator
   /// is used.
@@ -78,6 +85,9 @@ class EntityAlias : public details::BaseEntity {
 
   /// Destroys this entity. Removes all components as well
   inline void destroy();
+
+  /// Destroys this entity after a number of seconds, unless it is destroyed before that
+  inline void expire_in(float seconds);
   /// Return true if entity has all specified components. False otherwise
   template<typename... Components_> inline bool has();
   template<typename... Components_> inline bool has() const;
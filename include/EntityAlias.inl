@@ -30,6 +30,11 @@ Id const &EntityAlias<Cs...>::id() const {
   return entity().id();
 }
 
+template<typename ...Cs>
+Handle EntityAlias<Cs...>::handle() const {
+  return Handle(entity().id());
+}
+
 template<typename ...Cs> template<typename C>
 inline auto EntityAlias<Cs...>::get() ->
 typename std::enable_if<is_component<C>::value, C &>::type{
@@ -54,6 +59,11 @@ typename std::enable_if<!is_component<C>::value, C const &>::type{
   return entity().template get<C>();
 }
 
+template<typename ...Cs> template<typename C>
+inline C const &EntityAlias<Cs...>::previous() const {
+  return entity().template previous<C>();
+}
+
 template<typename ...Cs> template<typename C, typename ... Args>
 inline auto EntityAlias<Cs...>::set(Args &&... args) ->
 typename std::enable_if<is_component<C>::value, C &>::type{
@@ -119,6 +129,11 @@ void EntityAlias<Cs...>::destroy() {
   entity().destroy();
 }
 
+template<typename ...Cs>
+void EntityAlias<Cs...>::expire_in(float seconds) {
+  entity().expire_in(seconds);
+}
+
 template<typename ...Cs> template<typename... Components>
 bool EntityAlias<Cs...>::has() {
   return entity().template has<Components...>();
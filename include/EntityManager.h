@@ -1,6 +1,13 @@
 #ifndef ECS_ENTITYMANAGER_H
 #define ECS_ENTITYMANAGER_H
 
+#include "Property.h"
+#include "Aggregate.h"
+#include "TimingWheel.h"
+#include "MaskScan.h"
+#include "EventChannel.h"
+#include "GuidIndex.h"
+
 namespace ecs {
 
 /// Forward declareations
@@ -10,7 +17,13 @@ class Entity;
 class UnallocatedEntity;
 template<typename>
 class View;
+template<typename...>
+class EntityShard;
+template<typename, typename...>
+class Replicator;
 class Id;
+template<typename>
+struct MinMax;
 
 namespace details{
 
@@ -20,6 +33,15 @@ namespace details{
 template<size_t N, typename...>
 struct with_t;
 
+/// Used to reduce all entities with specific components into one value,
+/// on several threads. Used by reduce and its variants.
+template<typename...>
+struct reduce_t;
+
+/// Used to write components as columns. Used by export_columns.
+template<typename...>
+struct columns_t;
+
 } // namespace details
 
 ///---------------------------------------------------------------------
@@ -86,6 +108,91 @@ class EntityManager: details::forbid_copies {
   template<typename T>
   inline void with(T lambda);
 
+  /// Reduce the components of every entity with Components into one value.
+  /// map(Components const &...) gives the value of each entity, and
+  /// combine(T, T) combines two values. The entities are reduced in
+  /// slices, on up to threads threads (0 uses up to one thread per core,
+  /// and one per ECS_REDUCE_SLICES_PER_THREAD slices), and the partial
+  /// results are combined in the order of the entities, so the result is
+  /// the same for any number of threads. map and combine are called from
+  /// several threads at the same time, and the EntityManager must not be
+  /// modified until reduce returns. Returns init combined with the
+  /// result, or init if no entity has Components.
+  /// example: entities.reduce<Health>(0.f,
+  ///              [] (Health const &health) { return health.value; },
+  ///              [] (float a, float b) { return a + b; });
+  template<typename ...Components, typename T, typename Map, typename Combine>
+  inline T reduce(T init, Map map, Combine combine, size_t threads = 0) const;
+
+  /// The sum, the smallest and the largest value of component C, over
+  /// every entity that has it. A default constructed value is given if no
+  /// entity has C. Reduced in the same way as reduce.
+  template<typename C>
+  inline typename details::component_value<C>::type sum(size_t threads = 0) const;
+  template<typename C>
+  inline typename details::component_value<C>::type min(size_t threads = 0) const;
+  template<typename C>
+  inline typename details::component_value<C>::type max(size_t threads = 0) const;
+
+  /// Count the entities that have every component in Components
+  template<typename C, typename ...Components>
+  inline size_t count() const;
+
+  /// Find the entities with the smallest and the largest key(Components const &...).
+  /// If several entities have the same key, the one with the lowest index is given.
+  template<typename ...Components, typename Key>
+  inline MinMax<typename details::function_traits<Key>::return_type> minmax_by(Key key, size_t threads = 0) const;
+
+  /// The k entities with the largest value of component C, largest first.
+  /// Entities with equal values are given in the order of their index. The
+  /// k largest values of each slice of entities are selected on several
+  /// threads, like in reduce, before the k largest of those are selected.
+  template<typename C>
+  inline std::vector<Id> top_k(size_t k, size_t threads = 0) const;
+
+  /// The k entities within view with the largest value of component C
+  template<typename C, typename T>
+  inline std::vector<Id> top_k(size_t k, View<T> const &view, size_t threads = 0) const;
+
+  /// The k entities with the largest key(Components const &...)
+  template<typename ...Components, typename Key>
+  inline std::vector<Id> top_k_by(size_t k, Key key, size_t threads = 0) const;
+
+  /// An approximate value of component C, that q of the values are less
+  /// than. q = 0.5 gives the median. The values are summarized by at most 64
+  /// values per slice of entities, so the value is within about 1/64 of a
+  /// slice from the exact quantile. A default constructed value is given if
+  /// no entity has C.
+  template<typename C>
+  inline typename details::component_value<C>::type quantile(double q, size_t threads = 0) const;
+
+  /// Approximate values for several quantiles at once
+  template<typename C>
+  inline std::vector<typename details::component_value<C>::type> quantiles(std::vector<double> const &qs,
+                                                                           size_t threads = 0) const;
+
+  /// Keep an Aggregate of every component of type C up to date.
+  /// add(T &value, C const &component) adds a component to the value, and
+  /// remove(T &value, C const &component) takes it away again. The Aggregate
+  /// is updated when a component is added, set, removed or destroyed, so
+  /// reading it is O(1). Changes made through a reference to a component
+  /// are not seen, so use Entity::set to change the component. The
+  /// Aggregate exists as long as the EntityManager does.
+  /// example: entities.aggregate<Health>(0,
+  ///              [] (int &total, Health const &health) { total += health.value; },
+  ///              [] (int &total, Health const &health) { total -= health.value; });
+  template<typename C, typename T, typename Add, typename Remove>
+  inline Aggregate<T> const &aggregate(T init, Add add, Remove remove);
+
+  /// Keep the sum of every component of type C up to date
+  template<typename C>
+  inline Aggregate<typename details::component_value<C>::type> const &aggregate_sum();
+
+  /// Keep the number of components of type C with each key(C const &) up to date
+  template<typename C, typename Key>
+  inline Aggregate<std::map<typename details::function_traits<Key>::return_type, size_t>> const &
+  aggregate_count_by(Key key);
+
   // Access a View of all entities that has every component as Specified EntityAlias
   template<typename T>
   inline View <T> fetch_every();
@@ -95,12 +202,120 @@ class EntityManager: details::forbid_copies {
   template<typename T>
   inline void fetch_every(T lambda);
 
+  /// Reserve memory for at least num_of_entities entities with Components.
+  /// The entities can then be created from another thread, using the
+  /// returned EntityShard. The shard must be merged or destroyed before
+  /// this EntityManager is destroyed.
+  template<typename ...Components>
+  inline EntityShard<Components...> create_shard(size_t num_of_entities);
+
+  /// Make all entities created by an EntityShard visible. Must be called
+  /// from the thread that owns the EntityManager.
+  template<typename ...Components>
+  inline void merge(EntityShard<Components...> &shard);
+
+  /// Pairs of old and new Id, for entities that are moved between EntityManagers
+  using IdRemap = std::vector<std::pair<Id, Id>>;
+
+  /// Move all entities from another EntityManager into this one. Memory
+  /// for components is handed over, without copying each component.
+  /// Entities that are set to expire expire after the time that remains.
+  /// The other EntityManager is empty afterwards.
+  inline IdRemap merge(EntityManager &&other);
+
+  /// Move all entities in a view to another EntityManager. Blocks where
+  /// every entity is moved are handed over, without copying each component.
+  /// Entities that are set to expire expire after the time that remains.
+  template<typename T>
+  inline IdRemap move_entities(View<T> view, EntityManager &target);
+
+  /// Create a copy of this EntityManager. Component memory is shared
+  /// between the copies, and is copied first when modified. Must not
+  /// be called while any EntityShard is being filled.
+  inline std::unique_ptr<EntityManager> fork();
+
+  /// Write Components of every entity that has any of them to out, as one
+  /// column per component, that can be read with Columns. Each row is an
+  /// entity, and each column has a bitmap of which entities that have the
+  /// component. Components must be trivially copyable. To export while the
+  /// EntityManager is being modified, export a fork on another thread.
+  template<typename ...Components>
+  inline void export_columns(std::ostream &out) const;
+
+  /// Write Components of every entity within view, that has any component
+  template<typename ...Components, typename T>
+  inline void export_columns(std::ostream &out, View<T> const &view) const;
+
+  /// Create an entity for each row of columns that are written by
+  /// export_columns, and read from in. Components must be the exported
+  /// components, in the same order. The rows are read ECS_IMPORT_BATCH_SIZE
+  /// at a time, so memory use does not grow with the number of rows, and
+  /// the entities of each batch are given blocks together. in must be
+  /// seekable. progress(size_t imported, size_t total) is called after each
+  /// batch. The entities get new Ids. Returns how many entities are created.
+  template<typename ...Components, typename Progress>
+  inline size_t import_columns(std::istream &in, Progress progress);
+  template<typename ...Components>
+  inline size_t import_columns(std::istream &in);
+
+  /// Keep the previous value of every component of type C, readable
+  /// with Entity::previous. Systems can then read the previous values
+  /// while other systems modify the current ones. Previous values only
+  /// exist for components that existed at the last swap. C must be
+  /// trivially copyable. Forks, and EntityManagers that entities are
+  /// merged or moved into, double buffer C too.
+  template<typename C>
+  inline void double_buffer();
+
+  /// Make the current values readable as previous values, for every
+  /// double buffered component. Which entities have each component is
+  /// recorded too, which takes time in proportion to the number of
+  /// entities. Called by SystemManager::update.
+  inline void swap_buffers();
+
+  /// Advance the time used for expiring entities, and destroy every entity
+  /// that has expired. Called by SystemManager::update. Returns the number
+  /// of destroyed entities.
+  inline size_t update_expiry(float time);
+
+  /// Set how many seconds each tick of the expiry time is. Expiry times are
+  /// rounded up to whole ticks. Can't be changed while entities are set to expire.
+  inline void set_expiry_resolution(float seconds);
+
+  /// How many entities are set to expire
+  inline size_t expiring_count() const { return expiring_count_; }
+
+  /// Get the EventChannel for events of type E. It is created the
+  /// first time it is used.
+  template<typename E>
+  inline EventChannel<E> &events();
+
+  /// Make the events emitted since the last swap readable, for every
+  /// EventChannel. Called by SystemManager::update.
+  inline void swap_events();
+
+  /// Set how many entities ahead the components are prefetched, when
+  /// iterating with a lambda. 0 turns prefetching off.
+  inline void set_prefetch_distance(size_t distance) { prefetch_distance_ = distance; }
+  inline size_t prefetch_distance() const { return prefetch_distance_; }
+
+  /// Find the entity with a Guid component of value guid. If there is no
+  /// such entity, the returned Entity is not valid. The Guids are indexed
+  /// the first time this is called, and the index is then kept up to date.
+  inline Entity find_guid(uint64_t guid);
+
   // Get an Entity at specified index
   inline Entity operator[](index_t index);
 
   // Get an Entity with a specific Id. Id must be valid
   inline Entity operator[](Id id);
 
+  // Get the Entity of a Handle. The entity must not be destroyed
+  inline Entity operator[](Handle handle);
+
+  /// Returns true if the entity of handle is not destroyed. False for a null Handle
+  inline bool is_valid(Handle handle) const;
+
   // Get the Entity count for this EntityManager
   inline size_t count();
 
@@ -114,12 +329,69 @@ class EntityManager: details::forbid_copies {
   /// with similar components
   inline std::vector <Entity> create_with_mask(details::ComponentMask mask, const size_t num_of_entities);
 
+  /// Find indexes for any number of new entities with components, and append them to indexes
+  inline void allocate_indexes(details::ComponentMask mask, size_t num_of_entities, std::vector<index_t> &indexes);
+
   /// Find a proper index for a new entity with components
   inline index_t find_new_entity_index(details::ComponentMask mask);
 
   /// Create a new block for this entity type.
   inline void create_new_block(IndexAccessor &index_accessor, unsigned long mask_as_ulong, index_t next_free_index);
 
+  /// Give this entity type a block that is no longer used by any entity, or
+  /// create a new block if there is none. Returns the block
+  inline index_t claim_block(IndexAccessor &index_accessor, unsigned long mask_as_ulong, index_t next_free_index);
+
+  /// Take the blocks that are empty from the entity types that own them,
+  /// so that they can be claimed by any entity type
+  inline void recycle_empty_blocks();
+
+  /// Mark the blocks of a shard that have no entities as empty, so that
+  /// they are recycled, when the shard is merged or destroyed
+  inline void release_shard_blocks(index_t first_index, size_t capacity);
+
+  /// Create a new block that is marked as full, so that it is only used by the caller.
+  inline index_t create_full_block(IndexAccessor &index_accessor, unsigned long mask_as_ulong);
+
+  /// Find all indexes that are used by entities
+  inline std::vector<bool> used_slots() const;
+
+  /// Invalidates an entity, without destroying its components, and makes its index free for new entities
+  inline void release_slot(index_t index);
+
+  /// Make the entity at index expire after a number of seconds, or not at all
+  inline void set_expiry(index_t index, double seconds);
+  inline void clear_expiry(index_t index);
+
+  /// Make the entity at index expire when the entity at from_index of from would
+  inline void carry_expiry(EntityManager const &from, index_t from_index, index_t index);
+
+  /// Put an index that is no longer used in the free list of its block
+  inline void free_index(index_t index);
+
+  /// Removes all entities. Components that are not shared with a fork are destroyed
+  inline void clear_entities();
+
+  /// Become a copy of another EntityManager, sharing component memory with it.
+  /// Only chunks that were modified since they were last shared are released,
+  /// but the per entity records are copied, and every aggregate is recomputed,
+  /// so the cost is still proportional to the number of entities
+  inline void share_state(EntityManager &other);
+
+  /// Compute every aggregate from the start, after components are moved in bulk
+  inline void recompute_aggregates();
+
+  /// Add every component of the entity at index to the aggregates, or remove them
+  inline void aggregate_added(index_t index);
+  inline void aggregate_removed(index_t index);
+
+  /// The index of every Guid component, created when first used
+  inline details::GuidIndex &guid_index();
+
+  /// The Ids of the entities given by top_k
+  template<typename K>
+  inline std::vector<Id> top_k_ids(std::vector<std::pair<K, index_t>> const &selected) const;
+
   /// Creates a ComponentManager. Mainly used by get_component_manager the first time its called
   template<typename C, typename ...Args>
   inline details::ComponentManager <C> &create_component_manager(Args &&... args);
@@ -130,6 +402,19 @@ class EntityManager: details::forbid_copies {
   template<typename C>
   inline details::ComponentManager <C> const &get_component_manager_fast() const;
 
+  /// If no ComponentManager exists for C, no entity has it
+  template<typename C>
+  inline bool has_component_manager() const;
+
+  /// The address of component C at index first. The components up to the
+  /// next multiple of block_size are found by their offset from it. nullptr
+  /// if they may be in another chunk of memory, and have to be looked up
+  /// one by one. Assumes that the ComponentManager exists.
+  template<typename C>
+  inline C *get_block_ptr(index_t first, index_t block_size);
+  template<typename C>
+  inline C const *get_block_ptr(index_t first, index_t block_size) const;
+
   /// Get the ComponentManager. Creates a component manager if it
   /// doesn't exists for specified component type.
   template<typename C>
@@ -140,7 +425,13 @@ class EntityManager: details::forbid_copies {
   inline details::BaseManager &get_component_manager(size_t component_index);
   inline details::BaseManager const &get_component_manager(size_t component_index) const;
 
-  /// Get component for a specific entity or index.
+  /// Get the ComponentManager. Creates a component manager, of the same type as
+  /// other_manager, if it doesn't exist.
+  inline details::BaseManager &get_component_manager(size_t component_index,
+                                                     details::BaseManager const &other_manager);
+
+  /// Get component for a specific entity or index. The previous value
+  /// is only available for double buffered components.
   template<typename C>
   inline C &get_component(Entity &entity);
   template<typename C>
@@ -149,6 +440,8 @@ class EntityManager: details::forbid_copies {
   /// Get component for a specific entity or index. Assumes that a
   /// ComponentManager exists for the specific component type.
   template<typename C>
+  inline C const &get_previous_component(Entity const &entity) const;
+  template<typename C>
   inline C &get_component_fast(index_t index);
   template<typename C>
   inline C const &get_component_fast(index_t index) const;
@@ -235,6 +528,9 @@ class EntityManager: details::forbid_copies {
   /// Destroy an entity. Also removed all added components
   inline void destroy(Entity &entity);
 
+  /// Destroy an entity after a number of seconds, if it is still valid
+  inline void expire_in(Entity &entity, float seconds);
+
   /// Get the entity mask from a specific entity or index
   inline details::ComponentMask &mask(Entity &entity);
   inline details::ComponentMask const &mask(Entity const &entity) const;
@@ -254,6 +550,33 @@ class EntityManager: details::forbid_copies {
   std::vector <index_t> next_free_indexes_;
   std::vector <size_t> index_to_component_mask;
   std::map <size_t, IndexAccessor> component_mask_to_index_accessor_;
+  /// How many entities each block has
+  std::vector <index_t> block_entity_counts_;
+  /// Blocks that have become empty since they were last recycled. May contain
+  /// blocks that are used again, or the same block more than once
+  std::vector <index_t> empty_blocks_;
+  /// Blocks that are not owned by any entity type
+  std::vector <index_t> free_blocks_;
+
+  /// Entities that are set to expire, and the tick each entity expires at (0 if not set)
+  details::TimingWheel expiry_wheel_;
+  std::vector<uint64_t> expiry_ticks_;
+  /// How many of expiry_ticks_ are set. The wheel also holds entries that are cancelled
+  size_t expiring_count_ = 0;
+  double expiry_resolution_ = 1.0 / 60;
+  /// Time passed that is not yet a whole expiry tick
+  double expiry_time_ = 0;
+
+  size_t prefetch_distance_ = ECS_PREFETCH_DISTANCE;
+
+  /// Owned by the ComponentManager of Guid
+  details::GuidIndex *guid_index_ = nullptr;
+
+  /// Shards that are neither merged nor destroyed
+  size_t open_shards_ = 0;
+
+  /// Indexed by event type
+  std::vector<std::unique_ptr<details::BaseEventChannel>> event_channels_;
 
   /// How many blocks of entities there exists. Used when tracking where to put entities in momory
   index_t block_count_ = 0;
@@ -263,14 +586,26 @@ class EntityManager: details::forbid_copies {
   /// The EntityManager want some friends :)
   template<size_t N, typename...>
   friend struct details::with_t;
+  template<typename...>
+  friend struct details::reduce_t;
+  template<typename...>
+  friend struct details::columns_t;
   template<typename T>
   friend class details::ComponentManager;
   template<typename ...Cs>
   friend class EntityAlias;
   template<typename T>
   friend class Iterator;
+  template<typename T>
+  friend class View;
+  template<typename ...Cs>
+  friend class EntityShard;
+  template<typename Location, typename ...Cs>
+  friend class Replicator;
   friend class Entity;
   friend class UnallocatedEntity;
+  friend class RollbackBuffer;
+  friend class Metrics;
   friend class BaseComponent;
 };
 
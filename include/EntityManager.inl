@@ -13,30 +13,120 @@ struct with_t<N, Lambda, Args...>:
 
 template<typename Lambda, typename... Args>
 struct with_t<0, Lambda, Args...> {
+  // Entities are visited block_size at a time. The address of each component
+  // of the first entity in a block is looked up once, and the components of
+  // the other entities are found by their offset from it.
+  static const index_t block_size = 64;
+
+  struct Block {
+    index_t first;
+    index_t end;
+    // Matching entities that are not visited yet. Bit i is entity first + i
+    uint64_t matches;
+    // nullptr if the component has to be looked up for each entity
+    std::tuple<Args *...> components;
+  };
+
   static inline void for_each(EntityManager &manager, Lambda lambda) {
     typedef details::function_traits <Lambda> function;
     static_assert(function::arg_count > 0, "Lambda or function must have at least 1 argument.");
-    auto view = manager.with<Args...>();
-    auto it = view.begin();
-    auto end = view.end();
-    for (; it != end; ++it) {
-      lambda(get_arg<Args>(manager, it.index())...);
+    ComponentMask mask = details::component_mask<Args...>();
+    // Entities created while iterating are not visited
+    index_t size = index_t(manager.component_masks_.size());
+    Block current = Block(), ahead = Block();
+    index_t index, ahead_index;
+    // The ahead block runs ahead, and prefetches the components of the entities it passes
+    bool prefetching = manager.prefetch_distance_ > 0;
+    for (size_t i = 0; i < manager.prefetch_distance_ && prefetching; ++i) {
+      prefetching = next(manager, mask, size, ahead, ahead_index);
+    }
+    while (next(manager, mask, size, current, index)) {
+      if (prefetching && (prefetching = next(manager, mask, size, ahead, ahead_index))) {
+        prefetch_args(manager, ahead, ahead_index);
+      }
+      // The mask may have changed since it was scanned
+      if ((manager.component_masks_[index] & mask) != mask) continue;
+      lambda(get_arg<Args>(manager, current, index)...);
+    }
+  }
+
+  // Take the next matching entity, moving on to the next block with matches when needed
+  static inline bool next(EntityManager &manager, ComponentMask const &mask, index_t size, Block &block, index_t &index) {
+    if (!block.matches && !find_block(manager, mask, size, block.end, block)) return false;
+    index = block.first + details::count_trailing_zeros(block.matches);
+    block.matches &= block.matches - 1;
+    return true;
+  }
+
+  static inline bool find_block(EntityManager &manager, ComponentMask const &mask, index_t size, index_t first, Block &block) {
+    for (; first < size; first += block_size) {
+      index_t end = std::min<index_t>(size, first + block_size);
+      uint64_t matches = details::match_masks(&manager.component_masks_[first], end - first, mask);
+      if (matches) {
+        block.first = first;
+        block.end = end;
+        block.matches = matches;
+        block.components = std::make_tuple(get_block_ptr<Args>(manager, first)...);
+        return true;
+      }
     }
+    block.first = block.end = size;
+    return false;
+  }
+
+  //When arg is component, get the address of the component of the first entity in the block
+  template<typename C>
+  static inline auto get_block_ptr(EntityManager &manager, index_t first) ->
+  typename std::enable_if<!details::is_entity_arg<C>::value, C *>::type {
+    return manager.get_block_ptr<C>(first, block_size);
+  }
+
+  //When arg is the Entity or Handle, there is no component
+  template<typename C>
+  static inline auto get_block_ptr(EntityManager &manager, index_t first) ->
+  typename std::enable_if<details::is_entity_arg<C>::value, C *>::type {
+    return nullptr;
+  }
+
+  static inline void prefetch_args(EntityManager &manager, Block const &block, index_t index) {
+    int expand[] = {0, (prefetch_arg<Args>(manager, block, index), 0)...};
+    (void) expand;
   }
 
+  //When arg is component, prefetch component
+  template<typename C>
+  static inline auto prefetch_arg(EntityManager const &manager, Block const &block, index_t index) ->
+  typename std::enable_if<!details::is_entity_arg<C>::value, void>::type {
+    C *ptr = std::get<details::index_of<C, Args...>::value>(block.components);
+    details::prefetch(ptr ? ptr + (index - block.first) : &manager.get_component_fast<C>(index));
+  }
+
+  //When arg is the Entity or Handle, there is nothing to prefetch
+  template<typename C>
+  static inline auto prefetch_arg(EntityManager const &manager, Block const &block, index_t index) ->
+  typename std::enable_if<details::is_entity_arg<C>::value, void>::type { }
+
   //When arg is component, access component
   template<typename C>
-  static inline auto get_arg(EntityManager &manager, index_t index) ->
-  typename std::enable_if<!std::is_same<C, Entity>::value, C &>::type {
-    return manager.get_component_fast<C>(index);
+  static inline auto get_arg(EntityManager &manager, Block const &block, index_t index) ->
+  typename std::enable_if<!details::is_entity_arg<C>::value, C &>::type {
+    C *ptr = std::get<details::index_of<C, Args...>::value>(block.components);
+    return ptr ? ptr[index - block.first] : manager.get_component_fast<C>(index);
   }
 
   //When arg is the Entity, access the Entity
   template<typename C>
-  static inline auto get_arg(EntityManager &manager, index_t index) ->
+  static inline auto get_arg(EntityManager &manager, Block const &block, index_t index) ->
   typename std::enable_if<std::is_same<C, Entity>::value, Entity>::type {
     return manager.get_entity(index);
   }
+
+  //When arg is the Handle, access the Id of the entity, without creating an Entity
+  template<typename C>
+  static inline auto get_arg(EntityManager &manager, Block const &block, index_t index) ->
+  typename std::enable_if<std::is_same<C, Handle>::value, Handle>::type {
+    return Handle(Id(index, manager.entity_versions_[index]));
+  }
 };
 
 template<typename Lambda>
@@ -51,6 +141,9 @@ EntityManager::EntityManager(size_t chunk_size) {
 
 
 EntityManager::~EntityManager()  {
+  // A shard would write to, and give back, memory that is released here.
+  // Not ECS_ASSERT, which may be defined to throw
+  assert(open_shards_ == 0 && "Every EntityShard must be merged or destroyed before its EntityManager");
   for (details::BaseManager *manager : component_managers_) {
     if (manager) delete manager;
   }
@@ -145,15 +238,29 @@ Entity EntityManager::create_with_mask(details::ComponentMask mask)  {
 }
 
 std::vector<Entity> EntityManager::create_with_mask(details::ComponentMask mask, const size_t num_of_entities) {
+  std::vector<index_t> indexes;
+  indexes.reserve(num_of_entities);
+  allocate_indexes(mask, num_of_entities, indexes);
   std::vector<Entity> new_entities;
+  new_entities.reserve(num_of_entities);
+  for (index_t index : indexes) {
+    new_entities.push_back(get_entity(index));
+  }
+  return new_entities;
+}
+
+void EntityManager::allocate_indexes(details::ComponentMask mask, size_t num_of_entities,
+                                     std::vector<index_t> &indexes) {
   size_t entities_left = num_of_entities;
-  new_entities.reserve(entities_left);
   auto mask_as_ulong = mask.to_ulong();
   IndexAccessor &index_accessor = component_mask_to_index_accessor_[mask_as_ulong];
   //See if we can use old indexes for destroyed entities via free list
-  while (!index_accessor.free_list.empty() && entities_left--) {
-    new_entities.push_back(get_entity(index_accessor.free_list.back()));
+  while (entities_left > 0 && !index_accessor.free_list.empty()) {
+    index_t index = index_accessor.free_list.back();
+    indexes.push_back(index);
     index_accessor.free_list.pop_back();
+    ++block_entity_counts_[index / ECS_CACHE_LINE_SIZE];
+    --entities_left;
   }
   index_t block_index = 0;
   index_t current = ECS_CACHE_LINE_SIZE; // <- if empty, create new block instantly
@@ -166,25 +273,300 @@ std::vector<Entity> EntityManager::create_with_mask(details::ComponentMask mask,
   } else {
     slots_required = block_count_ * ECS_CACHE_LINE_SIZE + entities_left;
   }
-  entity_versions_.resize(slots_required);
-  component_masks_.resize(slots_required, details::ComponentMask(0));
+  if (entity_versions_.size() < slots_required) {
+    entity_versions_.resize(slots_required);
+    component_masks_.resize(slots_required, details::ComponentMask(0));
+  }
 
-  // Insert until no entity is left or no block remain
+  // Insert until no entity is left
   while (entities_left) {
+    // Add more blocks if the current one is full
+    if (current == ECS_CACHE_LINE_SIZE) {
+      block_index = claim_block(index_accessor, mask_as_ulong, 0);
+      current = 0;
+    }
+    index_t first = current;
     for (; current < ECS_CACHE_LINE_SIZE && entities_left; ++current) {
-      new_entities.push_back(get_entity(current + ECS_CACHE_LINE_SIZE * block_index));
+      indexes.push_back(current + ECS_CACHE_LINE_SIZE * block_index);
       entities_left--;
     }
-    // Add more blocks if there are entities left
-    if (entities_left) {
-      block_index = block_count_;
-      create_new_block(index_accessor, mask_as_ulong, 0);
-      ++block_count_;
-      current = 0;
+    next_free_indexes_[block_index] = current;
+    block_entity_counts_[block_index] += current - first;
+  }
+  count_ += index_t(num_of_entities);
+}
+
+template<typename ...Components>
+EntityShard<Components...> EntityManager::create_shard(size_t num_of_entities) {
+  auto mask_as_ulong = details::component_mask<Components...>().to_ulong();
+  IndexAccessor &index_accessor = component_mask_to_index_accessor_[mask_as_ulong];
+  index_t num_of_blocks = index_t((num_of_entities + ECS_CACHE_LINE_SIZE - 1) / ECS_CACHE_LINE_SIZE);
+  index_t first_index = block_count_ * ECS_CACHE_LINE_SIZE;
+  for (index_t i = 0; i < num_of_blocks; ++i) {
+    create_full_block(index_accessor, mask_as_ulong);
+  }
+  size_t slots_required = block_count_ * ECS_CACHE_LINE_SIZE;
+  entity_versions_.resize(slots_required);
+  component_masks_.resize(slots_required, details::ComponentMask(0));
+  ++open_shards_;
+  return EntityShard<Components...>(*this, first_index, num_of_blocks * ECS_CACHE_LINE_SIZE);
+}
+
+template<typename ...Components>
+void EntityManager::merge(EntityShard<Components...> &shard) {
+  ECS_ASSERT(shard.manager_ == this, "EntityShard is already merged or belongs to another EntityManager");
+  details::ComponentMask mask = details::component_mask<Components...>();
+  index_t begin = shard.first_index_;
+  index_t end = begin + index_t(shard.size_);
+  for (index_t index = begin; index < end; ++index) {
+    component_masks_[index] = mask;
+    ++block_entity_counts_[index / ECS_CACHE_LINE_SIZE];
+  }
+  // Slots the shard did not use, lowest index is used first
+  IndexAccessor &index_accessor = component_mask_to_index_accessor_[mask.to_ulong()];
+  for (index_t index = begin + index_t(shard.capacity_); index > end; --index) {
+    index_accessor.free_list.push_back(index - 1);
+  }
+  count_ += index_t(shard.size_);
+  shard.manager_ = nullptr;
+  release_shard_blocks(begin, shard.capacity_);
+  for (index_t index = begin; index < end; ++index) {
+    int expand[] = {(get_component_manager_fast<Components>().aggregate_added(index), 0)...};
+    (void) expand;
+  }
+}
+
+EntityManager::IdRemap EntityManager::merge(EntityManager &&other) {
+  ECS_ASSERT(&other != this, "Cannot merge an EntityManager with itself");
+  IdRemap remap;
+  index_t first_block = block_count_;
+  index_t offset = first_block * ECS_CACHE_LINE_SIZE;
+  std::vector<bool> used = other.used_slots();
+  for (index_t index = 0; index < used.size(); ++index) {
+    if (used[index]) {
+      version_t version = other.entity_versions_[index];
+      remap.push_back(std::make_pair(Id(index, version), Id(index + offset, version)));
     }
   }
-  count_ += num_of_entities;
-  return new_entities;
+  // Blocks keep their position relative to each other
+  for (auto &pair : other.component_mask_to_index_accessor_) {
+    IndexAccessor &other_accessor = pair.second;
+    IndexAccessor &index_accessor = component_mask_to_index_accessor_[pair.first];
+    if (!index_accessor.block_index.empty() && !other_accessor.block_index.empty()) {
+      // Only the last block is filled, so hand out what remains of the current one with the free list
+      index_t block_index = index_accessor.block_index.back();
+      index_t &current = next_free_indexes_[block_index];
+      for (index_t i = ECS_CACHE_LINE_SIZE; i > current; --i) {
+        index_accessor.free_list.push_back(block_index * ECS_CACHE_LINE_SIZE + i - 1);
+      }
+      current = ECS_CACHE_LINE_SIZE;
+    }
+    for (index_t block_index : other_accessor.block_index) {
+      index_accessor.block_index.push_back(block_index + first_block);
+    }
+    for (index_t index : other_accessor.free_list) {
+      index_accessor.free_list.push_back(index + offset);
+    }
+  }
+  for (index_t block_index : other.empty_blocks_) {
+    empty_blocks_.push_back(block_index + first_block);
+  }
+  for (index_t block_index : other.free_blocks_) {
+    free_blocks_.push_back(block_index + first_block);
+  }
+  block_entity_counts_.insert(block_entity_counts_.end(),
+                              other.block_entity_counts_.begin(), other.block_entity_counts_.end());
+  next_free_indexes_.insert(next_free_indexes_.end(), other.next_free_indexes_.begin(), other.next_free_indexes_.end());
+  index_to_component_mask.insert(index_to_component_mask.end(),
+                                 other.index_to_component_mask.begin(), other.index_to_component_mask.end());
+  entity_versions_.resize(offset);
+  component_masks_.resize(offset, details::ComponentMask(0));
+  entity_versions_.insert(entity_versions_.end(), other.entity_versions_.begin(), other.entity_versions_.end());
+  component_masks_.insert(component_masks_.end(), other.component_masks_.begin(), other.component_masks_.end());
+  for (size_t i = 0; i < other.component_managers_.size(); ++i) {
+    details::BaseManager *other_manager = other.component_managers_[i];
+    if (other_manager == nullptr) continue;
+    details::BaseManager &manager = get_component_manager(i, *other_manager);
+    details::BasePool &pool = manager.pool();
+    details::BasePool &other_pool = other_manager->pool();
+    if (pool.chunk_size() == other_pool.chunk_size() && offset % pool.chunk_size() == 0) {
+      pool.adopt_chunks(other_pool, offset / pool.chunk_size());
+    } else {
+      for (index_t index = 0; index < other.component_masks_.size(); ++index) {
+        if (other.component_masks_[index].test(i)) {
+          other_manager->move(index, manager, index + offset);
+        }
+      }
+    }
+  }
+  block_count_ += other.block_count_;
+  count_ += other.count_;
+  for (auto const &ids : remap) {
+    carry_expiry(other, ids.first.index(), ids.second.index());
+  }
+  // Every component is moved already, so nothing should be destroyed
+  other.component_masks_.clear();
+  other.clear_entities();
+  for (auto const &ids : remap) {
+    aggregate_added(ids.second.index());
+  }
+  return remap;
+}
+
+template<typename T>
+EntityManager::IdRemap EntityManager::move_entities(View<T> view, EntityManager &target) {
+  ECS_ASSERT(view.manager_ == this, "View does not belong to this EntityManager");
+  ECS_ASSERT(&target != this, "Cannot move entities within the same EntityManager");
+  IdRemap remap;
+  details::ComponentMask view_mask = view.mask_;
+  std::vector<bool> used = used_slots();
+  for (index_t block_index = 0; block_index < block_count_; ++block_index) {
+    index_t begin = block_index * ECS_CACHE_LINE_SIZE;
+    index_t end = std::min<index_t>(begin + ECS_CACHE_LINE_SIZE, index_t(used.size()));
+    bool whole_block = end - begin == ECS_CACHE_LINE_SIZE;
+    details::ComponentMask block_mask(0);
+    for (index_t index = begin; index < end; ++index) {
+      bool move = used[index] && (component_masks_[index] & view_mask) == view_mask;
+      whole_block = whole_block && move;
+      if (move) block_mask |= component_masks_[index];
+    }
+    // Hand over the memory of every component in the block, if possible
+    for (size_t i = 0; whole_block && i < component_managers_.size(); ++i) {
+      if (!block_mask.test(i)) continue;
+      whole_block = component_managers_[i]->pool().chunk_size() == ECS_CACHE_LINE_SIZE &&
+          (target.component_managers_.size() <= i || target.component_managers_[i] == nullptr ||
+              target.component_managers_[i]->pool().chunk_size() == ECS_CACHE_LINE_SIZE);
+    }
+    if (whole_block) {
+      unsigned long mask_as_ulong = index_to_component_mask[block_index];
+      index_t target_block = target.create_full_block(target.component_mask_to_index_accessor_[mask_as_ulong],
+                                                      mask_as_ulong);
+      index_t target_begin = target_block * ECS_CACHE_LINE_SIZE;
+      target.entity_versions_.resize(target_begin + ECS_CACHE_LINE_SIZE);
+      target.component_masks_.resize(target_begin + ECS_CACHE_LINE_SIZE, details::ComponentMask(0));
+      for (index_t index = begin; index < end; ++index) {
+        aggregate_removed(index);
+      }
+      for (size_t i = 0; i < component_managers_.size(); ++i) {
+        if (!block_mask.test(i)) continue;
+        details::BaseManager &target_manager = target.get_component_manager(i, *component_managers_[i]);
+        target_manager.pool().ensure_min_size(target_begin + ECS_CACHE_LINE_SIZE);
+        target_manager.pool().swap_chunk(target_block, component_managers_[i]->pool(), block_index);
+      }
+      for (index_t index = begin; index < end; ++index) {
+        index_t target_index = target_begin + (index - begin);
+        target.entity_versions_[target_index] = entity_versions_[index];
+        target.component_masks_[target_index] = component_masks_[index];
+        remap.push_back(std::make_pair(Id(index, entity_versions_[index]),
+                                       Id(target_index, entity_versions_[index])));
+        target.carry_expiry(*this, index, target_index);
+        release_slot(index);
+      }
+      for (index_t index = begin; index < end; ++index) {
+        target.aggregate_added(target_begin + (index - begin));
+      }
+      target.block_entity_counts_[target_block] = ECS_CACHE_LINE_SIZE;
+      target.count_ += ECS_CACHE_LINE_SIZE;
+      continue;
+    }
+    for (index_t index = begin; index < end; ++index) {
+      if (!used[index] || (component_masks_[index] & view_mask) != view_mask) continue;
+      details::ComponentMask mask = component_masks_[index];
+      Entity entity = target.create_with_mask(mask);
+      index_t target_index = entity.id().index();
+      aggregate_removed(index);
+      for (size_t i = 0; i < component_managers_.size(); ++i) {
+        if (!mask.test(i)) continue;
+        component_managers_[i]->move(index, target.get_component_manager(i, *component_managers_[i]), target_index);
+      }
+      target.component_masks_[target_index] = mask;
+      target.aggregate_added(target_index);
+      remap.push_back(std::make_pair(Id(index, entity_versions_[index]), entity.id()));
+      target.carry_expiry(*this, index, target_index);
+      release_slot(index);
+    }
+  }
+  return remap;
+}
+
+std::unique_ptr<EntityManager> EntityManager::fork() {
+  std::unique_ptr<EntityManager> copy(new EntityManager(0));
+  copy->share_state(*this);
+  return copy;
+}
+
+template<typename ...Components>
+void EntityManager::export_columns(std::ostream &out) const {
+  details::columns_t<Components...>::write(*this, details::ComponentMask(0), details::component_mask<Components...>(),
+                                           0, std::numeric_limits<index_t>::max(), out);
+}
+
+template<typename ...Components, typename T>
+void EntityManager::export_columns(std::ostream &out, View<T> const &view) const {
+  ECS_ASSERT(view.manager_ == this, "View does not belong to this EntityManager");
+  details::columns_t<Components...>::write(*this, view.mask_, ~details::ComponentMask(0),
+                                           view.first_, view.last_, out);
+}
+
+template<typename ...Components, typename Progress>
+size_t EntityManager::import_columns(std::istream &in, Progress progress) {
+  return details::columns_t<Components...>::read(*this, in, progress);
+}
+
+template<typename ...Components>
+size_t EntityManager::import_columns(std::istream &in) {
+  return import_columns<Components...>(in, [](size_t, size_t) { });
+}
+
+template<typename C>
+void EntityManager::double_buffer() {
+  get_component_manager<C>().double_buffer();
+}
+
+void EntityManager::swap_buffers() {
+  for (details::BaseManager *manager : component_managers_) {
+    if (manager) manager->swap_buffers();
+  }
+}
+
+size_t EntityManager::update_expiry(float time) {
+  size_t destroyed = 0;
+  expiry_time_ += time;
+  // Tolerate rounding errors, so that a multiple of the resolution is not rounded down
+  uint64_t ticks = uint64_t(expiry_time_ / expiry_resolution_ + 0.001);
+  expiry_time_ = std::max(0.0, expiry_time_ - double(ticks) * expiry_resolution_);
+  for (uint64_t tick = 0; tick < ticks; ++tick) {
+    uint64_t now = expiry_wheel_.now() + 1;
+    expiry_wheel_.advance([this, now, &destroyed](details::TimingWheel::Entry const &entry) {
+      // Entities that are destroyed, or set to expire at another time, are skipped
+      Entity entity = get_entity(entry.id.index());
+      if (entity.id() == entry.id && expiry_ticks_[entry.id.index()] == now) {
+        destroy(entity);
+        ++destroyed;
+      }
+    });
+  }
+  return destroyed;
+}
+
+void EntityManager::set_expiry_resolution(float seconds) {
+  ECS_ASSERT(seconds > 0, "Expiry resolution must be positive");
+  ECS_ASSERT(expiring_count_ == 0, "Can't change expiry resolution while entities are set to expire");
+  expiry_resolution_ = seconds;
+}
+
+template<typename E>
+EventChannel<E> &EntityManager::events() {
+  size_t index = details::event_index<E>();
+  if (event_channels_.size() <= index) event_channels_.resize(index + 1);
+  if (!event_channels_[index]) event_channels_[index].reset(new EventChannel<E>());
+  return static_cast<EventChannel<E> &>(*event_channels_[index]);
+}
+
+void EntityManager::swap_events() {
+  for (auto &channel : event_channels_) {
+    if (channel) channel->swap();
+  }
 }
 
 template<typename ...Components>
@@ -200,6 +582,161 @@ void EntityManager::with(T lambda)  {
 }
 
 
+template<typename ...Components, typename T, typename Map, typename Combine>
+T EntityManager::reduce(T init, Map map, Combine combine, size_t threads) const {
+  T result = init;
+  using reducer = details::reduce_t<Components...>;
+  bool found = reducer::reduce(*this, reducer::range(), result,
+                               [&map](index_t, Components const &... components) { return map(components...); },
+                               combine, threads);
+  return found ? combine(init, result) : init;
+}
+
+template<typename C>
+typename details::component_value<C>::type EntityManager::sum(size_t threads) const {
+  using V = typename details::component_value<C>::type;
+  V result = V();
+  details::reduce_t<C>::reduce(*this, details::reduce_t<C>::range(), result,
+                               [](index_t, C const &component) -> V { return static_cast<V const &>(component); },
+                               [](V const &a, V const &b) -> V { return a + b; }, threads);
+  return result;
+}
+
+template<typename C>
+typename details::component_value<C>::type EntityManager::min(size_t threads) const {
+  using V = typename details::component_value<C>::type;
+  V result = V();
+  details::reduce_t<C>::reduce(*this, details::reduce_t<C>::range(), result,
+                               [](index_t, C const &component) -> V { return static_cast<V const &>(component); },
+                               [](V const &a, V const &b) -> V { return b < a ? b : a; }, threads);
+  return result;
+}
+
+template<typename C>
+typename details::component_value<C>::type EntityManager::max(size_t threads) const {
+  using V = typename details::component_value<C>::type;
+  V result = V();
+  details::reduce_t<C>::reduce(*this, details::reduce_t<C>::range(), result,
+                               [](index_t, C const &component) -> V { return static_cast<V const &>(component); },
+                               [](V const &a, V const &b) -> V { return a < b ? b : a; }, threads);
+  return result;
+}
+
+template<typename C, typename ...Components>
+size_t EntityManager::count() const {
+  details::ComponentMask mask = details::component_mask<C, Components...>();
+  return details::count_matches(component_masks_.data(), component_masks_.size(), mask);
+}
+
+template<typename ...Components, typename Key>
+MinMax<typename details::function_traits<Key>::return_type> EntityManager::minmax_by(Key key, size_t threads) const {
+  using K = typename details::function_traits<Key>::return_type;
+  MinMax<K> result = MinMax<K>{0, K(), K(), Id(0, 0), Id(0, 0)};
+  auto const &versions = entity_versions_;
+  using reducer = details::reduce_t<Components...>;
+  reducer::reduce(
+      *this, reducer::range(), result,
+      [&key, &versions](index_t index, Components const &... components) {
+        K value = key(components...);
+        Id id(index, versions[index]);
+        return MinMax<K>{1, value, value, id, id};
+      },
+      [](MinMax<K> const &a, MinMax<K> const &b) {
+        // a is always before b, so a is kept when the keys are equal
+        MinMax<K> result = a;
+        result.count += b.count;
+        if (b.min < a.min) {
+          result.min = b.min;
+          result.min_id = b.min_id;
+        }
+        if (a.max < b.max) {
+          result.max = b.max;
+          result.max_id = b.max_id;
+        }
+        return result;
+      }, threads);
+  return result;
+}
+
+template<typename C>
+std::vector<Id> EntityManager::top_k(size_t k, size_t threads) const {
+  using V = typename details::component_value<C>::type;
+  using reducer = details::reduce_t<C>;
+  return top_k_ids(reducer::template top_k<V>(
+      *this, reducer::range(), k, [](C const &component) -> V { return static_cast<V const &>(component); },
+      threads));
+}
+
+template<typename C, typename T>
+std::vector<Id> EntityManager::top_k(size_t k, View<T> const &view, size_t threads) const {
+  ECS_ASSERT(view.manager_ == this, "View does not belong to this EntityManager");
+  using V = typename details::component_value<C>::type;
+  using reducer = details::reduce_t<C>;
+  return top_k_ids(reducer::template top_k<V>(
+      *this, reducer::range(view.mask_, view.first_, view.last_), k,
+      [](C const &component) -> V { return static_cast<V const &>(component); }, threads));
+}
+
+template<typename ...Components, typename Key>
+std::vector<Id> EntityManager::top_k_by(size_t k, Key key, size_t threads) const {
+  using K = typename details::function_traits<Key>::return_type;
+  using reducer = details::reduce_t<Components...>;
+  return top_k_ids(reducer::template top_k<K>(*this, reducer::range(), k, key, threads));
+}
+
+template<typename K>
+std::vector<Id> EntityManager::top_k_ids(std::vector<std::pair<K, index_t>> const &selected) const {
+  std::vector<Id> ids;
+  ids.reserve(selected.size());
+  for (auto const &candidate : selected) {
+    ids.push_back(Id(candidate.second, entity_versions_[candidate.second]));
+  }
+  return ids;
+}
+
+template<typename C>
+typename details::component_value<C>::type EntityManager::quantile(double q, size_t threads) const {
+  return quantiles<C>(std::vector<double>(1, q), threads)[0];
+}
+
+template<typename C>
+std::vector<typename details::component_value<C>::type> EntityManager::quantiles(std::vector<double> const &qs,
+                                                                                 size_t threads) const {
+  using V = typename details::component_value<C>::type;
+  using reducer = details::reduce_t<C>;
+  std::vector<V> values = reducer::template quantiles<V>(
+      *this, reducer::range(), qs, [](C const &component) -> V { return static_cast<V const &>(component); },
+      threads);
+  if (values.empty()) values.resize(qs.size(), V());
+  return values;
+}
+
+template<typename C, typename T, typename Add, typename Remove>
+Aggregate<T> const &EntityManager::aggregate(T init, Add add, Remove remove) {
+  return get_component_manager<C>().aggregate(init, add, remove);
+}
+
+template<typename C>
+Aggregate<typename details::component_value<C>::type> const &EntityManager::aggregate_sum() {
+  using V = typename details::component_value<C>::type;
+  return aggregate<C>(V(),
+                      [](V &sum, C const &component) { sum = sum + static_cast<V const &>(component); },
+                      [](V &sum, C const &component) { sum = sum - static_cast<V const &>(component); });
+}
+
+template<typename C, typename Key>
+Aggregate<std::map<typename details::function_traits<Key>::return_type, size_t>> const &EntityManager::aggregate_count_by(Key key) {
+  using Counts = std::map<typename details::function_traits<Key>::return_type, size_t>;
+  return aggregate<C>(Counts(),
+                      [key](Counts &counts, C const &component) { ++counts[key(component)]; },
+                      [key](Counts &counts, C const &component) {
+                        auto it = counts.find(key(component));
+                        // The key is missing if the component was changed through a reference
+                        ECS_ASSERT(it != counts.end(), "Removed component has a key that is not counted");
+                        if (it != counts.end() && --it->second == 0) counts.erase(it);
+                      });
+}
+
 template<typename T>
 View<T> EntityManager::fetch_every()  {
   ECS_ASSERT_IS_ENTITY(T);
@@ -219,6 +756,26 @@ void EntityManager::fetch_every(T lambda)  {
 }
 
 
+Entity EntityManager::find_guid(uint64_t guid) {
+  index_t index;
+  // The entry is stale if the Guid was changed through a reference
+  if (guid_index().find(guid, index) && index < component_masks_.size() &&
+      component_masks_[index].test(details::component_index<Guid>()) &&
+      get_component_fast<Guid>(index).value == guid) {
+    return get_entity(index);
+  }
+  // No entity has this index
+  return Entity(this, Id(std::numeric_limits<index_t>::max(), 0));
+}
+
+details::GuidIndex &EntityManager::guid_index() {
+  if (guid_index_ == nullptr) {
+    guid_index_ = new details::GuidIndex();
+    get_component_manager<Guid>().add_aggregate(guid_index_);
+  }
+  return *guid_index_;
+}
+
 Entity EntityManager::operator[](index_t index) {
   return get_entity(index);
 }
@@ -230,6 +787,15 @@ Entity EntityManager::operator[](Id id)  {
   return entity;
 }
 
+Entity EntityManager::operator[](Handle handle) {
+  ECS_ASSERT(is_valid(handle), "Handle is no longer valid (Entity was destroyed)");
+  return get_entity(handle.id());
+}
+
+bool EntityManager::is_valid(Handle handle) const {
+  return handle.index() < entity_versions_.size() && handle.version() == entity_versions_[handle.index()];
+}
+
 size_t EntityManager::count(){
   return count_;
 }
@@ -237,25 +803,22 @@ size_t EntityManager::count(){
 index_t EntityManager::find_new_entity_index(details::ComponentMask mask) {
   auto mask_as_ulong = mask.to_ulong();
   IndexAccessor &index_accessor = component_mask_to_index_accessor_[mask_as_ulong];
+  index_t index;
   //See if we can use old indexes for destroyed entities via free list
   if (!index_accessor.free_list.empty()) {
-    auto index = index_accessor.free_list.back();
+    index = index_accessor.free_list.back();
     index_accessor.free_list.pop_back();
-    return index;
-  }
-  // EntityManager has created similar entities already
-  if (!index_accessor.block_index.empty()) {
-    //No free_indexes in free list (removed entities), find a new index
-    //at last block, if that block has free slots
-    auto &block_index = index_accessor.block_index[index_accessor.block_index.size() - 1];
-    auto &current = next_free_indexes_[block_index];
-    // If block has empty slot, use it
-    if (ECS_CACHE_LINE_SIZE > current) {
-      return (current++) + ECS_CACHE_LINE_SIZE * block_index;
-    }
+  } else if (!index_accessor.block_index.empty() &&
+      ECS_CACHE_LINE_SIZE > next_free_indexes_[index_accessor.block_index.back()]) {
+    // EntityManager has created similar entities already. No free_indexes in
+    // free list (removed entities), so use an empty slot at the last block
+    index_t block_index = index_accessor.block_index.back();
+    index = (next_free_indexes_[block_index]++) + ECS_CACHE_LINE_SIZE * block_index;
+  } else {
+    index = claim_block(index_accessor, mask_as_ulong, 1) * ECS_CACHE_LINE_SIZE;
   }
-  create_new_block(index_accessor, mask_as_ulong, 1);
-  return (block_count_++) * ECS_CACHE_LINE_SIZE;
+  ++block_entity_counts_[index / ECS_CACHE_LINE_SIZE];
+  return index;
 }
 
 void EntityManager::create_new_block(EntityManager::IndexAccessor &index_accessor,
@@ -264,10 +827,207 @@ void EntityManager::create_new_block(EntityManager::IndexAccessor &index_accesso
   index_accessor.block_index.push_back(block_count_);
   next_free_indexes_.resize(block_count_ + 1);
   index_to_component_mask.resize(block_count_ + 1);
+  block_entity_counts_.resize(block_count_ + 1, 0);
   next_free_indexes_[block_count_] = next_free_index;
   index_to_component_mask[block_count_] = mask_as_ulong;
 }
 
+index_t EntityManager::claim_block(IndexAccessor &index_accessor,
+                                   unsigned long mask_as_ulong,
+                                   index_t next_free_index) {
+  if (free_blocks_.empty()) recycle_empty_blocks();
+  if (free_blocks_.empty()) {
+    create_new_block(index_accessor, mask_as_ulong, next_free_index);
+    return block_count_++;
+  }
+  index_t block_index = free_blocks_.back();
+  free_blocks_.pop_back();
+  index_accessor.block_index.push_back(block_index);
+  next_free_indexes_[block_index] = next_free_index;
+  index_to_component_mask[block_index] = mask_as_ulong;
+  return block_index;
+}
+
+void EntityManager::recycle_empty_blocks() {
+  if (empty_blocks_.empty()) return;
+  std::vector<bool> recycled(block_count_, false);
+  std::vector<size_t> masks;
+  for (index_t block_index : empty_blocks_) {
+    // The block may have been used again since it became empty
+    if (block_entity_counts_[block_index] != 0 || recycled[block_index]) continue;
+    recycled[block_index] = true;
+    masks.push_back(index_to_component_mask[block_index]);
+    next_free_indexes_[block_index] = 0;
+    free_blocks_.push_back(block_index);
+  }
+  empty_blocks_.clear();
+  std::sort(masks.begin(), masks.end());
+  masks.erase(std::unique(masks.begin(), masks.end()), masks.end());
+  // Every slot of a recycled block is in the free list of its previous owner
+  for (size_t mask_as_ulong : masks) {
+    IndexAccessor &index_accessor = component_mask_to_index_accessor_[mask_as_ulong];
+    auto &free_list = index_accessor.free_list;
+    free_list.erase(std::remove_if(free_list.begin(), free_list.end(), [&recycled](index_t index) {
+      return recycled[index / ECS_CACHE_LINE_SIZE];
+    }), free_list.end());
+    auto &blocks = index_accessor.block_index;
+    blocks.erase(std::remove_if(blocks.begin(), blocks.end(), [&recycled](index_t block_index) {
+      return recycled[block_index];
+    }), blocks.end());
+  }
+}
+
+void EntityManager::release_shard_blocks(index_t first_index, size_t capacity) {
+  index_t first_block = first_index / ECS_CACHE_LINE_SIZE;
+  index_t end_block = index_t((first_index + capacity) / ECS_CACHE_LINE_SIZE);
+  for (index_t block_index = first_block; block_index < end_block; ++block_index) {
+    if (block_entity_counts_[block_index] == 0) empty_blocks_.push_back(block_index);
+  }
+  if (empty_blocks_.size() > block_count_) recycle_empty_blocks();
+  --open_shards_;
+}
+
+index_t EntityManager::create_full_block(IndexAccessor &index_accessor, unsigned long mask_as_ulong) {
+  index_t block_index = block_count_;
+  create_new_block(index_accessor, mask_as_ulong, ECS_CACHE_LINE_SIZE);
+  ++block_count_;
+  // Keep the block that is currently being filled as the last block
+  auto &blocks = index_accessor.block_index;
+  if (blocks.size() > 1) {
+    std::iter_swap(blocks.end() - 2, blocks.end() - 1);
+  }
+  return block_index;
+}
+
+std::vector<bool> EntityManager::used_slots() const {
+  std::vector<bool> used(entity_versions_.size(), false);
+  for (index_t block_index = 0; block_index < block_count_; ++block_index) {
+    index_t begin = block_index * ECS_CACHE_LINE_SIZE;
+    index_t end = std::min<index_t>(begin + next_free_indexes_[block_index], index_t(used.size()));
+    for (index_t index = begin; index < end; ++index) {
+      used[index] = true;
+    }
+  }
+  for (auto &pair : component_mask_to_index_accessor_) {
+    for (index_t index : pair.second.free_list) {
+      used[index] = false;
+    }
+  }
+  return used;
+}
+
+void EntityManager::set_expiry(index_t index, double seconds) {
+  // Tolerate rounding errors, so that a multiple of the resolution is not rounded up to the next tick
+  double ticks = std::ceil(seconds / expiry_resolution_ - 0.001);
+  uint64_t due_in = ticks > 1 ? uint64_t(ticks) : 1;
+  if (expiry_ticks_.size() <= index) expiry_ticks_.resize(entity_versions_.size(), 0);
+  if (expiry_ticks_[index] == 0) ++expiring_count_;
+  expiry_wheel_.insert(Id(index, entity_versions_[index]), due_in);
+  expiry_ticks_[index] = expiry_wheel_.now() + due_in;
+}
+
+void EntityManager::clear_expiry(index_t index) {
+  // The entry in the wheel is skipped when it is due
+  if (index < expiry_ticks_.size() && expiry_ticks_[index] != 0) {
+    expiry_ticks_[index] = 0;
+    --expiring_count_;
+  }
+}
+
+void EntityManager::carry_expiry(EntityManager const &from, index_t from_index, index_t index) {
+  if (from_index >= from.expiry_ticks_.size() || from.expiry_ticks_[from_index] == 0) return;
+  // Converted to seconds, since the resolutions may differ
+  double ticks = double(from.expiry_ticks_[from_index] - from.expiry_wheel_.now());
+  set_expiry(index, ticks * from.expiry_resolution_ - from.expiry_time_);
+}
+
+void EntityManager::release_slot(index_t index) {
+  clear_expiry(index);
+  ++entity_versions_[index];
+  component_masks_[index].reset();
+  free_index(index);
+  --count_;
+}
+
+void EntityManager::free_index(index_t index) {
+  index_t block_index = index / ECS_CACHE_LINE_SIZE;
+  component_mask_to_index_accessor_[index_to_component_mask[block_index]].free_list.push_back(index);
+  if (--block_entity_counts_[block_index] == 0) {
+    empty_blocks_.push_back(block_index);
+    // A block may be emptied many times before a new block is needed, so don't let the list grow unbounded
+    if (empty_blocks_.size() > block_count_) recycle_empty_blocks();
+  }
+}
+
+void EntityManager::clear_entities() {
+  for (details::BaseManager *manager : component_managers_) {
+    if (manager) manager->clear();
+  }
+  component_masks_.clear();
+  entity_versions_.clear();
+  next_free_indexes_.clear();
+  index_to_component_mask.clear();
+  component_mask_to_index_accessor_.clear();
+  block_entity_counts_.clear();
+  empty_blocks_.clear();
+  free_blocks_.clear();
+  expiry_wheel_.clear();
+  expiry_ticks_.clear();
+  expiring_count_ = 0;
+  block_count_ = 0;
+  count_ = 0;
+}
+
+void EntityManager::share_state(EntityManager &other) {
+  if (&other == this) return;
+  // Components that only this EntityManager has are destroyed
+  for (size_t i = 0; i < component_managers_.size(); ++i) {
+    bool shared = i < other.component_managers_.size() && other.component_managers_[i];
+    if (component_managers_[i] && !shared) component_managers_[i]->clear();
+  }
+  for (size_t i = 0; i < other.component_managers_.size(); ++i) {
+    if (other.component_managers_[i]) {
+      get_component_manager(i, *other.component_managers_[i]).share(*other.component_managers_[i]);
+    }
+  }
+  component_masks_ = other.component_masks_;
+  entity_versions_ = other.entity_versions_;
+  next_free_indexes_ = other.next_free_indexes_;
+  index_to_component_mask = other.index_to_component_mask;
+  component_mask_to_index_accessor_ = other.component_mask_to_index_accessor_;
+  block_entity_counts_ = other.block_entity_counts_;
+  empty_blocks_ = other.empty_blocks_;
+  free_blocks_ = other.free_blocks_;
+  expiry_wheel_ = other.expiry_wheel_;
+  expiry_ticks_ = other.expiry_ticks_;
+  expiring_count_ = other.expiring_count_;
+  expiry_resolution_ = other.expiry_resolution_;
+  expiry_time_ = other.expiry_time_;
+  block_count_ = other.block_count_;
+  count_ = other.count_;
+  recompute_aggregates();
+}
+
+void EntityManager::aggregate_added(index_t index) {
+  details::ComponentMask const &mask = component_masks_[index];
+  for (size_t i = 0; i < component_managers_.size(); ++i) {
+    if (mask.test(i)) component_managers_[i]->aggregate_added(index);
+  }
+}
+
+void EntityManager::aggregate_removed(index_t index) {
+  details::ComponentMask const &mask = component_masks_[index];
+  for (size_t i = 0; i < component_managers_.size(); ++i) {
+    if (mask.test(i)) component_managers_[i]->aggregate_removed(index);
+  }
+}
+
+void EntityManager::recompute_aggregates() {
+  for (details::BaseManager *manager : component_managers_) {
+    if (manager) manager->recompute_aggregates();
+  }
+}
+
 template<typename C, typename ...Args>
 details::ComponentManager<C> &EntityManager::create_component_manager(Args && ... args)  {
   details::ComponentManager<C> *ptr = new details::ComponentManager<C>(std::forward<EntityManager &>(*this),
@@ -286,6 +1046,27 @@ details::ComponentManager<C> const &EntityManager::get_component_manager_fast()
   return *reinterpret_cast<details::ComponentManager<C> *>(component_managers_[details::component_index<C>()]);
 }
 
+template<typename C>
+bool EntityManager::has_component_manager() const {
+  size_t index = details::component_index<C>();
+  return index < component_managers_.size() && component_managers_[index] != nullptr;
+}
+
+template<typename C>
+C *EntityManager::get_block_ptr(index_t first, index_t block_size) {
+  auto &component_manager = get_component_manager_fast<C>();
+  // Each block must be within a single chunk of memory
+  if (component_manager.pool().chunk_size() % block_size != 0) return nullptr;
+  return component_manager.get_ptr(first);
+}
+
+template<typename C>
+C const *EntityManager::get_block_ptr(index_t first, index_t block_size) const {
+  auto const &component_manager = get_component_manager_fast<C>();
+  if (component_manager.pool().chunk_size() % block_size != 0) return nullptr;
+  return component_manager.get_ptr(first);
+}
+
 
 template<typename C>
 details::ComponentManager<C> &EntityManager::get_component_manager()  {
@@ -303,8 +1084,8 @@ details::ComponentManager<C> &EntityManager::get_component_manager()  {
 template<typename C>
 details::ComponentManager<C> const &EntityManager::get_component_manager() const  {
   auto index = details::component_index<C>();
-  ECS_ASSERT(component_managers_.size() > index, component_managers_[index] == nullptr &&
-      "Component manager not created");
+  ECS_ASSERT(component_managers_.size() > index && component_managers_[index] != nullptr,
+             "Component manager not created");
   return *reinterpret_cast<details::ComponentManager<C> *>(component_managers_[index]);
 }
 
@@ -317,6 +1098,17 @@ details::BaseManager const &EntityManager::get_component_manager(size_t componen
   return *component_managers_[component_index];
 }
 
+details::BaseManager &EntityManager::get_component_manager(size_t component_index,
+                                                           details::BaseManager const &other_manager) {
+  if (component_managers_.size() <= component_index) {
+    component_managers_.resize(component_index + 1, nullptr);
+  }
+  if (component_managers_[component_index] == nullptr) {
+    component_managers_[component_index] = other_manager.create_manager(*this);
+  }
+  return *component_managers_[component_index];
+}
+
 template<typename C>
 C &EntityManager::get_component(Entity &entity) {
   ECS_ASSERT(has_component<C>(entity), "Entity doesn't have this component attached");
@@ -329,6 +1121,11 @@ C const &EntityManager::get_component(Entity const &entity) const {
   return get_component_manager<C>().get(entity.id_.index_);
 }
 
+template<typename C>
+C const &EntityManager::get_previous_component(Entity const &entity) const {
+  return get_component_manager<C>().previous(entity.id_.index_);
+}
+
 template<typename C>
 C &EntityManager::get_component_fast(index_t index)  {
   return get_component_manager_fast<C>().get(index);
@@ -391,7 +1188,7 @@ template<typename C, typename ...Args>
 C &EntityManager::set_component(Entity &entity, Args && ... args) {
   ECS_ASSERT_VALID_ENTITY(entity);
   if (entity.has<C>()) {
-    return get_component_fast<C>(entity) = create_tmp_component<C>(std::forward<Args>(args)...);
+    return get_component_manager_fast<C>().set(entity.id_.index_, create_tmp_component<C>(std::forward<Args>(args)...));
   }
   else return create_component<C>(entity, std::forward<Args>(args)...);
 }
@@ -400,7 +1197,7 @@ template<typename C, typename ...Args>
 C &EntityManager::set_component_fast(Entity &entity, Args && ... args) {
   ECS_ASSERT_VALID_ENTITY(entity);
   ECS_ASSERT(entity.has<C>(), "Entity does not have component attached");
-  return get_component_fast<C>(entity) = create_tmp_component<C>(std::forward<Args>(args)...);
+  return get_component_manager_fast<C>().set(entity.id_.index_, create_tmp_component<C>(std::forward<Args>(args)...));
 }
 
 bool EntityManager::has_component(Entity &entity, details::ComponentMask component_mask) {
@@ -437,12 +1234,17 @@ bool EntityManager::is_valid(Entity const &entity) const  {
 void EntityManager::destroy(Entity &entity) {
   index_t index = entity.id().index_;
   remove_all_components(entity);
+  clear_expiry(index);
   ++entity_versions_[index];
-  auto &mask_as_ulong = index_to_component_mask[index / ECS_CACHE_LINE_SIZE];
-  component_mask_to_index_accessor_[mask_as_ulong].free_list.push_back(index);
+  free_index(index);
   --count_;
 }
 
+void EntityManager::expire_in(Entity &entity, float seconds) {
+  ECS_ASSERT(is_valid(entity), "Entity is not valid");
+  set_expiry(entity.id().index_, seconds);
+}
+
 details::ComponentMask &EntityManager::mask(Entity &entity)  {
   return mask(entity.id_.index_);
 }
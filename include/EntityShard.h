@@ -0,0 +1,92 @@
+#ifndef ECS_ENTITYSHARD_H
+#define ECS_ENTITYSHARD_H
+
+#include "Defines.h"
+
+namespace ecs{
+
+///---------------------------------------------------------------------
+/// EntityShard is used to create entities from another thread
+///---------------------------------------------------------------------
+///
+/// An EntityShard owns a range of blocks that the EntityManager has
+/// set aside for entities with the specified Components. Creating an
+/// entity through the shard only writes to memory within those blocks,
+/// so any number of shards can create entities on different threads
+/// without locking, while the EntityManager is used as normal.
+///
+/// Entities created by a shard become visible in the EntityManager once
+/// the shard is merged, which must be done from the thread that owns
+/// the EntityManager. Slots that the shard did not use are handed back
+/// to the EntityManager at that point.
+///
+/// A shard that is destroyed without being merged destroys the
+/// components it created, and gives its blocks back to the
+/// EntityManager. That must also be done from the thread that owns the
+/// EntityManager. Every shard must be merged or destroyed before the
+/// EntityManager is, which is asserted.
+///
+///---------------------------------------------------------------------
+template<typename ...Components>
+class EntityShard {
+  static_assert(sizeof...(Components) > 0, "An EntityShard must create entities with at least one component.");
+ public:
+  inline EntityShard(EntityShard &&other);
+  inline EntityShard &operator=(EntityShard &&other);
+  inline ~EntityShard() { release(); }
+  EntityShard(const EntityShard &) = delete;
+  EntityShard &operator=(const EntityShard &) = delete;
+
+  /// Create an entity with default constructed components. Returns
+  /// the Id that the entity has when the shard is merged.
+  inline Id create();
+
+  /// Create an entity with one argument for each component. Returns
+  /// the Id that the entity has when the shard is merged.
+  template<typename ...Args>
+  inline Id create(Args &&... args);
+
+  /// How many entities that are created with this shard
+  inline size_t size() const { return size_; }
+
+  /// How many entities this shard can create before it is full
+  inline size_t capacity() const { return capacity_; }
+
+  inline bool full() const { return size_ == capacity_; }
+
+ private:
+  // Chunks of a component pool that covers the blocks of this shard
+  struct ComponentChunks {
+    size_t first_chunk;
+    size_t chunk_size;
+    std::vector<char *> chunks;
+  };
+
+  inline EntityShard(EntityManager &manager, index_t first_index, size_t capacity);
+
+  template<typename C>
+  inline void add_component_chunks();
+
+  template<typename C>
+  inline C *get_ptr(index_t index);
+
+  inline index_t next_index();
+
+  /// Destroy the created components and give the blocks back, if the shard is not merged
+  inline void release();
+
+  EntityManager               *manager_;
+  index_t                      first_index_;
+  size_t                       size_;
+  size_t                       capacity_;
+  std::vector<version_t>       versions_;
+  std::vector<ComponentChunks> components_;
+
+  friend class EntityManager;
+}; //EntityShard
+
+} // namespace ecs
+
+#include "EntityShard.inl"
+
+#endif //ECS_ENTITYSHARD_H
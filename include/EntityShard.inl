@@ -0,0 +1,107 @@
+#include "EntityShard.h"
+#include "EntityManager.h"
+
+namespace ecs{
+
+template<typename ...Cs>
+EntityShard<Cs...>::EntityShard(EntityManager &manager, index_t first_index, size_t capacity) :
+    manager_(&manager),
+    first_index_(first_index),
+    size_(0),
+    capacity_(capacity),
+    versions_(manager.entity_versions_.begin() + first_index,
+              manager.entity_versions_.begin() + first_index + capacity) {
+  // Order of components_ is the same as Cs...
+  components_.reserve(sizeof...(Cs));
+  int expand[] = {(add_component_chunks<Cs>(), 0)...};
+  (void) expand;
+}
+
+template<typename ...Cs>
+EntityShard<Cs...>::EntityShard(EntityShard &&other) :
+    manager_(other.manager_),
+    first_index_(other.first_index_),
+    size_(other.size_),
+    capacity_(other.capacity_),
+    versions_(std::move(other.versions_)),
+    components_(std::move(other.components_)) {
+  other.manager_ = nullptr;
+}
+
+template<typename ...Cs>
+EntityShard<Cs...> &EntityShard<Cs...>::operator=(EntityShard &&other) {
+  if (&other != this) {
+    release();
+    manager_ = other.manager_;
+    first_index_ = other.first_index_;
+    size_ = other.size_;
+    capacity_ = other.capacity_;
+    versions_ = std::move(other.versions_);
+    components_ = std::move(other.components_);
+    other.manager_ = nullptr;
+  }
+  return *this;
+}
+
+template<typename ...Cs>
+Id EntityShard<Cs...>::create() {
+  index_t index = next_index();
+  int expand[] = {(details::create_component<Cs>(get_ptr<Cs>(index)), 0)...};
+  (void) expand;
+  return Id(index, versions_[index - first_index_]);
+}
+
+template<typename ...Cs> template<typename ...Args>
+Id EntityShard<Cs...>::create(Args &&... args) {
+  static_assert(sizeof...(Args) == sizeof...(Cs), "Provide one argument for each component.");
+  index_t index = next_index();
+  int expand[] = {(details::create_component<Cs>(get_ptr<Cs>(index), std::forward<Args>(args)), 0)...};
+  (void) expand;
+  return Id(index, versions_[index - first_index_]);
+}
+
+template<typename ...Cs> template<typename C>
+void EntityShard<Cs...>::add_component_chunks() {
+  details::ComponentManager<C> &component_manager = manager_->get_component_manager<C>();
+  details::BasePool &pool = component_manager.pool();
+  pool.ensure_min_size(first_index_ + capacity_);
+  ComponentChunks component;
+  component.chunk_size = pool.chunk_size();
+  component.first_chunk = first_index_ / component.chunk_size;
+  if (capacity_ > 0) {
+    size_t last_chunk = (first_index_ + capacity_ - 1) / component.chunk_size;
+    for (size_t i = component.first_chunk; i <= last_chunk; ++i) {
+      // Make sure that the chunk is not shared with a fork
+      component_manager.get_ptr(index_t(std::max(i * component.chunk_size, size_t(first_index_))));
+      component.chunks.push_back(pool.chunk(i));
+    }
+  }
+  components_.push_back(component);
+}
+
+template<typename ...Cs> template<typename C>
+C *EntityShard<Cs...>::get_ptr(index_t index) {
+  ComponentChunks &component = components_[details::index_of<C, Cs...>::value];
+  return reinterpret_cast<C *>(component.chunks[index / component.chunk_size - component.first_chunk] +
+      (index % component.chunk_size) * sizeof(C));
+}
+
+template<typename ...Cs>
+index_t EntityShard<Cs...>::next_index() {
+  ECS_ASSERT(manager_ != nullptr, "EntityShard is already merged");
+  ECS_ASSERT(!full(), "EntityShard is full");
+  return first_index_ + index_t(size_++);
+}
+
+template<typename ...Cs>
+void EntityShard<Cs...>::release() {
+  if (manager_ == nullptr) return;
+  for (index_t index = first_index_; index < first_index_ + size_; ++index) {
+    int expand[] = {(get_ptr<Cs>(index)->~Cs(), 0)...};
+    (void) expand;
+  }
+  manager_->release_shard_blocks(first_index_, capacity_);
+  manager_ = nullptr;
+}
+
+} // namespace ecs
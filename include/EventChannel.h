@@ -0,0 +1,146 @@
+#ifndef ECS_EVENTCHANNEL_H
+#define ECS_EVENTCHANNEL_H
+
+#include "Defines.h"
+
+namespace ecs{
+
+namespace details{
+
+///---------------------------------------------------------------------
+/// Helper class, all EventChannels are a BaseEventChannel
+///---------------------------------------------------------------------
+class BaseEventChannel {
+ public:
+  virtual ~BaseEventChannel() { }
+  /// Make the events emitted since the last swap readable
+  virtual void swap() = 0;
+  /// How many events are readable
+  virtual size_t size() const = 0;
+};
+
+} // namespace details
+
+///---------------------------------------------------------------------
+/// An EventChannel is used to send events of type E between systems
+///---------------------------------------------------------------------
+///
+/// Events are double buffered per update. Events emitted during one
+/// update can be read during the next, as one contiguous array, after
+/// the channel is swapped. SystemManager::update swaps every channel
+/// of its EntityManager.
+///
+/// Events can be emitted from any number of threads at the same time,
+/// through a Writer each. A Writer appends to its own buffer, so no
+/// locking is done. The buffers are gathered when the channel is
+/// swapped, which must not be done while any Writer is emitting.
+///
+/// Any number of Readers can read the same events. A Reader remembers
+/// which events it has read, so that a system that is not updated every
+/// update reads the events it has not seen yet, as long as they are
+/// still readable.
+///
+///---------------------------------------------------------------------
+template<typename E>
+class EventChannel: public details::BaseEventChannel, details::forbid_copies {
+ private:
+  // Buffer for one Writer. Buffers are kept until the channel is destroyed,
+  // and reused by new Writers.
+  struct Buffer {
+    std::vector<E> events;
+    std::atomic<bool> used;
+    Buffer *next;
+  };
+
+ public:
+  ///---------------------------------------------------------------------
+  /// A Writer emits events from a single thread. It must not outlive
+  /// the channel.
+  ///---------------------------------------------------------------------
+  class Writer {
+   public:
+    Writer(Writer &&other) : buffer_(other.buffer_) { other.buffer_ = nullptr; }
+    inline Writer &operator=(Writer &&other);
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+    inline ~Writer();
+
+    inline void emit(E const &event) { buffer_->events.push_back(event); }
+    inline void emit(E &&event) { buffer_->events.push_back(std::move(event)); }
+
+    template<typename ...Args>
+    inline void emplace(Args &&... args) { buffer_->events.emplace_back(std::forward<Args>(args)...); }
+
+   private:
+    Writer(Buffer *buffer) : buffer_(buffer) { }
+    Buffer *buffer_;
+    friend class EventChannel;
+  };
+
+  ///---------------------------------------------------------------------
+  /// A Reader reads every readable event once
+  ///---------------------------------------------------------------------
+  class Reader {
+   public:
+    /// Call lambda for every readable event that this Reader has not read.
+    /// Returns the number of events read.
+    template<typename Lambda>
+    inline size_t read(Lambda lambda);
+
+    /// How many readable events this Reader has not read
+    inline size_t unread() const;
+
+    /// How many events this Reader missed, because they were no longer
+    /// readable when it read
+    inline size_t missed() const { return missed_; }
+
+   private:
+    Reader(EventChannel const &channel, uint64_t next) : channel_(&channel), next_(next), missed_(0) { }
+    EventChannel const *channel_;
+    /// Sequence number of the next event to read
+    uint64_t next_;
+    size_t missed_;
+    friend class EventChannel;
+  };
+
+  inline EventChannel() : first_(0), buffers_(nullptr) { }
+  inline ~EventChannel();
+
+  /// Emit an event from the thread that owns the EntityManager
+  inline void emit(E const &event) { pending_.push_back(event); }
+  inline void emit(E &&event) { pending_.push_back(std::move(event)); }
+
+  template<typename ...Args>
+  inline void emplace(Args &&... args) { pending_.emplace_back(std::forward<Args>(args)...); }
+
+  /// Get a Writer, for emitting events from another thread. Can be
+  /// called from any thread.
+  inline Writer writer();
+
+  /// Get a Reader, that reads events that become readable after this call
+  inline Reader reader() const { return Reader(*this, first_ + events_.size()); }
+
+  /// The events that are readable, emitted before the last swap
+  inline std::vector<E> const &events() const { return events_; }
+  inline size_t size() const override { return events_.size(); }
+  inline bool empty() const { return events_.empty(); }
+
+  /// Make the events emitted since the last swap readable. Events that
+  /// were readable are dropped.
+  inline void swap() override;
+
+ private:
+  /// Readable events, and the sequence number of the first of them
+  std::vector<E> events_;
+  uint64_t first_;
+  /// Events emitted through the channel itself
+  std::vector<E> pending_;
+  /// Lock free list of Writer buffers
+  std::atomic<Buffer *> buffers_;
+};
+
+} // namespace ecs
+
+#include "EventChannel.inl"
+
+#endif //ECS_EVENTCHANNEL_H
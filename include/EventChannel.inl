@@ -0,0 +1,81 @@
+namespace ecs{
+
+template<typename E>
+typename EventChannel<E>::Writer &EventChannel<E>::Writer::operator=(Writer &&other) {
+  if (this != &other) {
+    if (buffer_) buffer_->used.store(false, std::memory_order_release);
+    buffer_ = other.buffer_;
+    other.buffer_ = nullptr;
+  }
+  return *this;
+}
+
+template<typename E>
+EventChannel<E>::Writer::~Writer() {
+  // Emitted events are kept in the buffer until the channel is swapped
+  if (buffer_) buffer_->used.store(false, std::memory_order_release);
+}
+
+template<typename E> template<typename Lambda>
+size_t EventChannel<E>::Reader::read(Lambda lambda) {
+  std::vector<E> const &events = channel_->events_;
+  uint64_t first = channel_->first_;
+  if (next_ < first) {
+    missed_ += size_t(first - next_);
+    next_ = first;
+  }
+  size_t count = size_t(first + events.size() - next_);
+  for (size_t i = size_t(next_ - first); i < events.size(); ++i) {
+    lambda(events[i]);
+  }
+  next_ = first + events.size();
+  return count;
+}
+
+template<typename E>
+size_t EventChannel<E>::Reader::unread() const {
+  uint64_t end = channel_->first_ + channel_->events_.size();
+  return size_t(end - std::max(next_, channel_->first_));
+}
+
+template<typename E>
+EventChannel<E>::~EventChannel() {
+  Buffer *buffer = buffers_.load(std::memory_order_acquire);
+  while (buffer) {
+    Buffer *next = buffer->next;
+    delete buffer;
+    buffer = next;
+  }
+}
+
+template<typename E>
+typename EventChannel<E>::Writer EventChannel<E>::writer() {
+  // Reuse the buffer of a Writer that is destroyed
+  for (Buffer *buffer = buffers_.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+    bool used = false;
+    if (buffer->used.compare_exchange_strong(used, true, std::memory_order_acquire)) {
+      return Writer(buffer);
+    }
+  }
+  Buffer *buffer = new Buffer();
+  buffer->used.store(true, std::memory_order_relaxed);
+  buffer->next = buffers_.load(std::memory_order_relaxed);
+  while (!buffers_.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed)) { }
+  return Writer(buffer);
+}
+
+template<typename E>
+void EventChannel<E>::swap() {
+  first_ += events_.size();
+  // The old events are cleared, but their memory is reused for the next update
+  events_.clear();
+  events_.swap(pending_);
+  for (Buffer *buffer = buffers_.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+    events_.insert(events_.end(),
+                   std::make_move_iterator(buffer->events.begin()),
+                   std::make_move_iterator(buffer->events.end()));
+    buffer->events.clear();
+  }
+}
+
+} // namespace ecs
@@ -0,0 +1,103 @@
+#ifndef ECS_GUIDINDEX_H
+#define ECS_GUIDINDEX_H
+
+#include "Defines.h"
+#include "Property.h"
+#include "Aggregate.h"
+#include "MaskScan.h"
+
+namespace ecs{
+
+///---------------------------------------------------------------------
+/// Guid is a component for identifying an entity by a stable 64 bit
+/// value, that is chosen by the user
+///---------------------------------------------------------------------
+///
+/// An entity with a Guid can be found with EntityManager::find_guid.
+/// Two entities must not have the same Guid.
+///
+/// @usage entities.create_with<Guid, Position>(1234, Position{0, 0});
+///        Entity entity = entities.find_guid(1234);
+///---------------------------------------------------------------------
+struct Guid: Property<uint64_t> {
+  Guid() { }
+  Guid(uint64_t value) : Property<uint64_t>(value) { }
+};
+
+namespace details{
+
+///---------------------------------------------------------------------
+/// GuidIndex is a hash table from Guid to entity index
+///---------------------------------------------------------------------
+///
+/// The table uses open addressing, so no memory is allocated for each
+/// entry. Each slot has a control byte, that tells if the slot is empty,
+/// deleted, or holds an entry with 7 specific bits of the hash. Slots
+/// are probed in groups of 16 control bytes, which are compared at once
+/// with SSE2 if available.
+///
+/// The index is kept up to date by the ComponentManager of Guid. A Guid
+/// that is changed through a reference is not seen, so its entry keeps
+/// the old value until the component is removed. EntityManager::find_guid
+/// checks the component of the entity it finds for that reason.
+///---------------------------------------------------------------------
+class GuidIndex: public ComponentAggregate<Guid>, forbid_copies {
+ public:
+  static const size_t group_size = 16;
+
+  inline GuidIndex() : size_(0), deleted_(0) { reset(); }
+
+  /// The index of the entity with guid, or false if there is none
+  inline bool find(uint64_t guid, index_t &index) const;
+
+  inline size_t size() const { return size_; }
+
+  void add(index_t index, Guid const &guid) override { insert(guid.value, index); }
+  void remove(index_t index, Guid const &guid) override { erase(guid.value, index); }
+  inline void reset() override;
+
+ private:
+  struct Slot {
+    uint64_t guid;
+    index_t index;
+  };
+
+  /// Control bytes of slots without an entry. Slots with an entry have
+  /// 7 bits of the hash as control byte
+  enum : int8_t {
+    empty = -128,
+    deleted = -2
+  };
+
+  static inline uint64_t hash(uint64_t guid);
+  static inline int8_t control_of(uint64_t hash) { return int8_t(hash & 0x7F); }
+
+  /// Bit i is set if control byte pos + i is value
+  inline uint32_t match(size_t pos, int8_t value) const;
+  /// Bit i is set if control byte pos + i is empty or deleted
+  inline uint32_t match_free(size_t pos) const;
+
+  inline void insert(uint64_t guid, index_t index);
+  /// Remove the entry of guid at index. If there is none, because the
+  /// Guid was changed through a reference, the entry at index is found
+  /// by looking at every slot
+  inline void erase(uint64_t guid, index_t index);
+  inline void set_control(size_t slot, int8_t value);
+  inline void rehash(size_t capacity);
+
+  /// The capacity is a power of 2, of at least group_size. The first
+  /// group_size control bytes are repeated after the last one, so that a
+  /// group can be read from any slot.
+  std::vector<int8_t> control_;
+  std::vector<Slot> slots_;
+  size_t size_;
+  size_t deleted_;
+};
+
+} // namespace details
+
+} // namespace ecs
+
+#include "GuidIndex.inl"
+
+#endif //ECS_GUIDINDEX_H
@@ -0,0 +1,143 @@
+namespace ecs{
+
+namespace details{
+
+bool GuidIndex::find(uint64_t guid, index_t &index) const {
+  uint64_t h = hash(guid);
+  int8_t control = control_of(h);
+  size_t mask = slots_.size() - 1;
+  size_t pos = size_t(h >> 7) & mask;
+  for (size_t probed = 0; probed < slots_.size(); probed += group_size) {
+    for (uint32_t matches = match(pos, control); matches; matches &= matches - 1) {
+      Slot const &slot = slots_[(pos + count_trailing_zeros(matches)) & mask];
+      if (slot.guid == guid) {
+        index = slot.index;
+        return true;
+      }
+    }
+    // The guid would have been put in the first empty slot
+    if (match(pos, empty)) return false;
+    pos = (pos + group_size) & mask;
+  }
+  return false;
+}
+
+void GuidIndex::reset() {
+  control_.assign(2 * group_size, empty);
+  slots_.assign(group_size, Slot());
+  size_ = 0;
+  deleted_ = 0;
+}
+
+uint64_t GuidIndex::hash(uint64_t guid) {
+  // Guids may be sequential, so every bit is mixed into every other
+  guid ^= guid >> 30;
+  guid *= 0xbf58476d1ce4e5b9ULL;
+  guid ^= guid >> 27;
+  guid *= 0x94d049bb133111ebULL;
+  guid ^= guid >> 31;
+  return guid;
+}
+
+uint32_t GuidIndex::match(size_t pos, int8_t value) const {
+#ifdef ECS_SSE2
+  __m128i group = _mm_loadu_si128(reinterpret_cast<__m128i const *>(&control_[pos]));
+  return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(value))));
+#else
+  uint32_t matches = 0;
+  for (size_t i = 0; i < group_size; ++i) {
+    if (control_[pos + i] == value) matches |= uint32_t(1) << i;
+  }
+  return matches;
+#endif
+}
+
+uint32_t GuidIndex::match_free(size_t pos) const {
+  // Empty and deleted are the only negative control bytes
+#ifdef ECS_SSE2
+  return uint32_t(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const *>(&control_[pos]))));
+#else
+  uint32_t matches = 0;
+  for (size_t i = 0; i < group_size; ++i) {
+    if (control_[pos + i] < 0) matches |= uint32_t(1) << i;
+  }
+  return matches;
+#endif
+}
+
+void GuidIndex::insert(uint64_t guid, index_t index) {
+  index_t existing;
+  ECS_ASSERT(!find(guid, existing), "Guid is already used by another entity");
+  (void) existing;
+  // At most 7/8 of the slots are used or deleted
+  if ((size_ + deleted_ + 1) * 8 > slots_.size() * 7) {
+    size_t capacity = slots_.size();
+    while ((size_ + 1) * 2 > capacity) capacity *= 2;
+    rehash(capacity);
+  }
+  uint64_t h = hash(guid);
+  size_t mask = slots_.size() - 1;
+  size_t pos = size_t(h >> 7) & mask;
+  uint32_t free = match_free(pos);
+  while (!free) {
+    pos = (pos + group_size) & mask;
+    free = match_free(pos);
+  }
+  size_t slot = (pos + count_trailing_zeros(free)) & mask;
+  if (control_[slot] == deleted) --deleted_;
+  set_control(slot, control_of(h));
+  slots_[slot].guid = guid;
+  slots_[slot].index = index;
+  ++size_;
+}
+
+void GuidIndex::erase(uint64_t guid, index_t index) {
+  uint64_t h = hash(guid);
+  int8_t control = control_of(h);
+  size_t mask = slots_.size() - 1;
+  size_t pos = size_t(h >> 7) & mask;
+  size_t found = slots_.size();
+  for (size_t probed = 0; probed < slots_.size() && found == slots_.size(); probed += group_size) {
+    for (uint32_t matches = match(pos, control); matches; matches &= matches - 1) {
+      size_t slot = (pos + count_trailing_zeros(matches)) & mask;
+      if (slots_[slot].guid == guid && slots_[slot].index == index) {
+        found = slot;
+        break;
+      }
+    }
+    if (match(pos, empty)) break;
+    pos = (pos + group_size) & mask;
+  }
+  for (size_t slot = 0; found == slots_.size() && slot < slots_.size(); ++slot) {
+    if (control_[slot] >= 0 && slots_[slot].index == index) found = slot;
+  }
+  ECS_ASSERT(found < slots_.size(), "Guid is not in the index");
+  if (found == slots_.size()) return;
+  // Later guids may have been probed past this slot, so it can't be made empty
+  set_control(found, deleted);
+  --size_;
+  ++deleted_;
+}
+
+void GuidIndex::set_control(size_t slot, int8_t value) {
+  control_[slot] = value;
+  if (slot < group_size) control_[slots_.size() + slot] = value;
+}
+
+void GuidIndex::rehash(size_t capacity) {
+  std::vector<int8_t> control;
+  std::vector<Slot> slots;
+  control.swap(control_);
+  slots.swap(slots_);
+  control_.assign(capacity + group_size, empty);
+  slots_.resize(capacity);
+  size_ = 0;
+  deleted_ = 0;
+  for (size_t slot = 0; slot < slots.size(); ++slot) {
+    if (control[slot] >= 0) insert(slots[slot].guid, slots[slot].index);
+  }
+}
+
+} // namespace details
+
+} // namespace ecs
@@ -0,0 +1,62 @@
+#ifndef ECS_HANDLE_H
+#define ECS_HANDLE_H
+
+#include "Id.h"
+
+namespace ecs{
+
+///---------------------------------------------------------------------
+/// Handle is the Id of an entity packed into 64 bits, without the
+/// EntityManager
+///---------------------------------------------------------------------
+///
+/// An Entity is 16 bytes, since it keeps a pointer to its
+/// EntityManager. A Handle is 8 bytes and can be copied with memcpy, so
+/// it is better suited to keep references to other entities in
+/// components and containers. Use EntityManager::operator[] to get the
+/// Entity of a Handle. A default constructed Handle refers to no entity.
+///
+/// @usage struct Target { Handle entity; };
+///        shooter.add<Target>(Target{enemy.handle()});
+///        Entity enemy = entities[shooter.get<Target>().entity];
+///---------------------------------------------------------------------
+class Handle {
+ public:
+  inline Handle() : value_(null_value) { }
+  inline Handle(Id id);
+
+  inline index_t index() const { return index_t(value_); }
+  inline version_t version() const { return version_t(value_ >> 32); }
+  inline Id id() const { return Id(index(), version()); }
+
+  /// The index in the lowest 32 bits, and the version above it
+  inline uint64_t value() const { return value_; }
+  static inline Handle from_value(uint64_t value);
+
+  /// Returns true if the Handle does not refer to any entity
+  inline bool is_null() const { return value_ == null_value; }
+
+ private:
+  static const uint64_t null_value = ~uint64_t(0);
+
+  uint64_t value_;
+};
+
+inline bool operator==(Handle const &lhs, Handle const &rhs) { return lhs.value() == rhs.value(); }
+inline bool operator!=(Handle const &lhs, Handle const &rhs) { return lhs.value() != rhs.value(); }
+inline bool operator<(Handle const &lhs, Handle const &rhs) { return lhs.value() < rhs.value(); }
+
+} // namespace ecs
+
+namespace std {
+
+template<>
+struct hash<ecs::Handle> {
+  size_t operator()(ecs::Handle const &handle) const { return hash<uint64_t>()(handle.value()); }
+};
+
+} // namespace std
+
+#include "Handle.inl"
+
+#endif //ECS_HANDLE_H
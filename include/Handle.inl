@@ -0,0 +1,15 @@
+namespace ecs{
+
+Handle::Handle(Id id) :
+    value_(uint64_t(id.version()) << 32 | id.index())
+{
+  static_assert(sizeof(index_t) <= 4 && sizeof(version_t) <= 4, "Id does not fit in a Handle");
+}
+
+Handle Handle::from_value(uint64_t value) {
+  Handle handle;
+  handle.value_ = value;
+  return handle;
+}
+
+} // namespace ecs
@@ -6,13 +6,24 @@ namespace ecs{
 ///---------------------------------------------------------------------
 /// Iterator is an iterator for iterating through the entity manager.
 /// The iterator should fulfill the c++ standards for an input iterator,
+///
+/// The component masks are scanned up to 64 at a time, and the matching
+/// entities are then taken from the resulting bitmap. A mask is tested
+/// again before its entity is visited, so entities that lose a
+/// component during iteration are skipped. Entities that gain a
+/// component during iteration are only visited if their group of 64 is
+/// not scanned yet, so an entity after the current one in the same
+/// group is not visited. Entities created during iteration, at indexes
+/// beyond those that existed when it began, are never visited.
 ///---------------------------------------------------------------------
 template<typename T>
 class Iterator: public std::iterator<std::input_iterator_tag, typename std::remove_reference<T>::type> {
   using T_no_ref = typename std::remove_reference<typename std::remove_const<T>::type>::type;
 
  public:
-  Iterator(EntityManager *manager, details::ComponentMask mask, bool begin = true);
+  /// Iterates through entities with an index within [first, last)
+  Iterator(EntityManager *manager, details::ComponentMask mask, bool begin = true,
+           index_t first = 0, index_t last = std::numeric_limits<index_t>::max());
   Iterator(const Iterator &it);
   Iterator &operator=(const Iterator &rhs) = default;
 
@@ -20,6 +31,9 @@ class Iterator: public std::iterator<std::input_iterator_tag, typename std::remo
   index_t index() const;
   Iterator &operator++();
 
+  // Move the cursor to the first entity at or after index
+  Iterator &seek(index_t index);
+
   // The the current entity
   T       entity();
   T const entity() const;
@@ -28,10 +42,21 @@ class Iterator: public std::iterator<std::input_iterator_tag, typename std::remo
   // find next entity withing the EntityManager which has the correct components
   void find_next();
 
+  // find the first entity at or after index which has the correct components
+  void scan(index_t index);
+
+  static const index_t scan_size = 64;
+
   EntityManager         *manager_;
   details::ComponentMask mask_;
+  index_t                first_;
   index_t                cursor_;
   size_t                 size_;
+  // Matching entities after the cursor, among the last scanned masks.
+  // Bit i is entity group_ + i. next_ is the index after the last scanned mask
+  uint64_t               matches_;
+  index_t                group_;
+  index_t                next_;
 }; //Iterator
 
 template<typename T> bool operator==(Iterator<T> const &lhs, Iterator<T> const &rhs);
@@ -2,18 +2,31 @@ namespace ecs{
 
 
 template<typename T>
-Iterator<T>::Iterator(EntityManager *manager, details::ComponentMask mask, bool begin) :
+Iterator<T>::Iterator(EntityManager *manager, details::ComponentMask mask, bool begin, index_t first, index_t last) :
     manager_(manager),
     mask_(mask),
-    cursor_(0){
+    matches_(0),
+    group_(0){
   // Must be pool size because of potential holes
-  size_ = manager_->entity_versions_.size();
-  if (!begin) cursor_ = size_;
-  find_next();
+  size_ = std::min<size_t>(manager_->entity_versions_.size(), last);
+  first_ = index_t(std::min<size_t>(first, size_));
+  if (begin) {
+    scan(first_);
+  } else {
+    cursor_ = next_ = index_t(size_);
+  }
 }
 
 template<typename T>
-Iterator<T>::Iterator(const Iterator &it) : Iterator(it.manager_, it.cursor_) { }
+Iterator<T>::Iterator(const Iterator &it) :
+    manager_(it.manager_),
+    mask_(it.mask_),
+    first_(it.first_),
+    cursor_(it.cursor_),
+    size_(it.size_),
+    matches_(it.matches_),
+    group_(it.group_),
+    next_(it.next_) { }
 
 template<typename T>
 index_t Iterator<T>::index() const {
@@ -22,9 +35,35 @@ index_t Iterator<T>::index() const {
 
 template<typename T>
 inline void Iterator<T>::find_next() {
-  while (cursor_ < size_ && (manager_->component_masks_[cursor_] & mask_) != mask_) {
-    ++cursor_;
+  while (matches_) {
+    index_t index = group_ + details::count_trailing_zeros(matches_);
+    matches_ &= matches_ - 1;
+    // The mask may have changed since it was scanned
+    if ((manager_->component_masks_[index] & mask_) == mask_) {
+      cursor_ = index;
+      return;
+    }
+  }
+  scan(next_);
+}
+
+template<typename T>
+inline void Iterator<T>::scan(index_t index) {
+  matches_ = 0;
+  while (index < size_) {
+    // Scan until the next multiple of scan_size, so that scans are aligned with blocks
+    index_t end = index_t(std::min<size_t>(size_, (index / scan_size + 1) * scan_size));
+    uint64_t matches = details::match_masks(&manager_->component_masks_[index], end - index, mask_);
+    if (matches) {
+      group_ = index;
+      next_ = end;
+      cursor_ = index + details::count_trailing_zeros(matches);
+      matches_ = matches & (matches - 1);
+      return;
+    }
+    index = end;
   }
+  cursor_ = next_ = index_t(size_);
 }
 
 template<typename T>
@@ -39,11 +78,16 @@ const T Iterator<T>::entity() const  {
 
 template<typename T>
 Iterator<T> &Iterator<T>::operator++() {
-  ++cursor_;
   find_next();
   return *this;
 }
 
+template<typename T>
+Iterator<T> &Iterator<T>::seek(index_t index) {
+  scan(index_t(std::min<size_t>(std::max(index, first_), size_)));
+  return *this;
+}
+
 template<typename T>
 bool operator==(Iterator<T> const &lhs, Iterator<T> const &rhs) {
   return lhs.index() == rhs.index();
@@ -0,0 +1,156 @@
+#ifndef ECS_MASKSCAN_H
+#define ECS_MASKSCAN_H
+
+#include "Defines.h"
+
+#if !defined(ECS_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define ECS_SSE2
+#include <emmintrin.h>
+#endif
+
+#if !defined(ECS_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define ECS_AVX2_DISPATCH
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+///--------------------------------------------------------------------
+/// This file contains functions for finding which entities have a set
+/// of components, by scanning their component masks
+///--------------------------------------------------------------------
+///
+/// Up to 64 masks are tested at a time, giving a bitmap with one bit
+/// for each mask that has every component. When the ComponentMask is
+/// 64 bits, AVX2 tests 4 masks per instruction, if the CPU supports it,
+/// and SSE2 tests 2. Otherwise the masks are tested one by one.
+/// Define ECS_NO_SIMD to always test them one by one.
+///--------------------------------------------------------------------
+
+namespace ecs{
+
+namespace details{
+
+/// The index of the lowest set bit. Bits must not be 0
+inline unsigned count_trailing_zeros(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+  return unsigned(__builtin_ctzll(bits));
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+  _BitScanForward64(&index, bits);
+  return unsigned(index);
+#else
+  unsigned index = 0;
+  while (!(bits & 1)) {
+    bits >>= 1;
+    ++index;
+  }
+  return index;
+#endif
+}
+
+inline size_t count_bits(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+  return size_t(__builtin_popcountll(bits));
+#else
+  size_t count = 0;
+  for (; bits; bits &= bits - 1) ++count;
+  return count;
+#endif
+}
+
+/// Test the masks one by one
+inline uint64_t match_masks_scalar(ComponentMask const *masks, size_t count, ComponentMask const &mask) {
+  uint64_t matches = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if ((masks[i] & mask) == mask) matches |= uint64_t(1) << i;
+  }
+  return matches;
+}
+
+/// The memory of a 64 bit ComponentMask, as it is laid out in an array of masks
+inline uint64_t mask_as_word(ComponentMask const &mask) {
+  uint64_t word;
+  std::memcpy(&word, &mask, sizeof(word));
+  return word;
+}
+
+#ifdef ECS_SSE2
+/// Test 2 masks per instruction. A mask has every component when no bit
+/// of the requested mask is missing in it
+inline uint64_t match_masks_sse2(ComponentMask const *masks, size_t count, ComponentMask const &mask) {
+  __m128i requested = _mm_set1_epi64x((long long) mask_as_word(mask));
+  __m128i zero = _mm_setzero_si128();
+  uint64_t matches = 0;
+  size_t i = 0;
+  for (; i + 2 <= count; i += 2) {
+    __m128i missing = _mm_andnot_si128(_mm_loadu_si128(reinterpret_cast<__m128i const *>(masks + i)), requested);
+    // One bit per 32 bit half, and both halves of a mask must be 0
+    unsigned zero_halves = unsigned(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(missing, zero))));
+    unsigned both = zero_halves & (zero_halves >> 1);
+    matches |= uint64_t((both & 1) | ((both >> 1) & 2)) << i;
+  }
+  if (i < count) matches |= match_masks_scalar(masks + i, count - i, mask) << i;
+  return matches;
+}
+#endif
+
+#ifdef ECS_AVX2_DISPATCH
+/// Test 4 masks per instruction
+__attribute__((target("avx2")))
+inline uint64_t match_masks_avx2(ComponentMask const *masks, size_t count, ComponentMask const &mask) {
+  __m256i requested = _mm256_set1_epi64x((long long) mask_as_word(mask));
+  __m256i zero = _mm256_setzero_si256();
+  uint64_t matches = 0;
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m256i missing = _mm256_andnot_si256(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(masks + i)), requested);
+    unsigned found = unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(missing, zero))));
+    matches |= uint64_t(found) << i;
+  }
+  if (i < count) matches |= match_masks_scalar(masks + i, count - i, mask) << i;
+  return matches;
+}
+
+inline bool has_avx2() {
+  static const bool avx2 = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+  }();
+  return avx2;
+}
+#endif
+
+/// Test at most 64 masks. Bit i of the result is set if masks[i] has
+/// every component in mask
+inline uint64_t match_masks(ComponentMask const *masks, size_t count, ComponentMask const &mask) {
+  ECS_ASSERT(count <= 64, "At most 64 masks can be tested at a time");
+#if defined(ECS_SSE2) || defined(ECS_AVX2_DISPATCH)
+  if (sizeof(ComponentMask) == sizeof(uint64_t)) {
+#ifdef ECS_AVX2_DISPATCH
+    if (has_avx2()) return match_masks_avx2(masks, count, mask);
+#endif
+#ifdef ECS_SSE2
+    return match_masks_sse2(masks, count, mask);
+#endif
+  }
+#endif
+  return match_masks_scalar(masks, count, mask);
+}
+
+/// Count how many masks have every component in mask
+inline size_t count_matches(ComponentMask const *masks, size_t count, ComponentMask const &mask) {
+  size_t matches = 0;
+  for (size_t i = 0; i < count; i += 64) {
+    matches += count_bits(match_masks(masks + i, std::min<size_t>(64, count - i), mask));
+  }
+  return matches;
+}
+
+} // namespace details
+
+} // namespace ecs
+
+#endif //ECS_MASKSCAN_H
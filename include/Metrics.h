@@ -0,0 +1,117 @@
+#ifndef ECS_METRICS_H
+#define ECS_METRICS_H
+
+#include "EntityManager.h"
+
+namespace ecs{
+
+namespace details{
+
+/// Write value as a Prometheus label value, with \, " and newlines escaped
+inline void write_label_value(std::ostream &out, std::string const &value);
+
+} // namespace details
+
+///---------------------------------------------------------------------
+/// Metrics keeps track of the health of an EntityManager, and of the
+/// systems of a SystemManager, and writes it in the Prometheus text
+/// exposition format
+///---------------------------------------------------------------------
+///
+/// Nothing is counted when entities or components are used. The
+/// SystemManager that owns the Metrics counts updates, how long each
+/// system takes, how many events each EventChannel has when it is
+/// swapped, and how many entities expire, once per update. Everything
+/// else, like how many entities have each component mask and how much
+/// memory each component pool uses, is read from the EntityManager
+/// when the metrics are written. Writing must be done from the thread
+/// that owns the EntityManager.
+///
+/// Components, systems and event types are labelled by their index,
+/// unless they are given a name.
+///
+/// @usage SystemManager systems(entities);
+///        systems.metrics().name_component<Position>("position");
+///        ...
+///        systems.metrics().write_file("/var/run/game/metrics.prom");
+///---------------------------------------------------------------------
+class Metrics: details::forbid_copies {
+ public:
+  inline Metrics(EntityManager &entities) :
+      entities_(&entities), updates_(0), update_seconds_(0), last_update_seconds_(0), expired_(0) { }
+
+  /// Set the label value used for component C, system S or events E
+  template<typename C>
+  inline void name_component(std::string const &name);
+  template<typename S>
+  inline void name_system(std::string const &name);
+  template<typename E>
+  inline void name_events(std::string const &name);
+
+  /// Write every metric
+  inline void write(std::ostream &out) const;
+  inline std::string str() const;
+
+  /// Write every metric to a file at path. A temporary file is written
+  /// first, and then renamed, so that the file is never read half
+  /// written. Returns false if the file could not be written.
+  inline bool write_file(std::string const &path) const;
+
+  inline uint64_t updates() const { return updates_; }
+
+ private:
+  struct SystemStats {
+    uint64_t updates = 0;
+    double seconds = 0;
+    double last_seconds = 0;
+  };
+
+  struct EventStats {
+    uint64_t total = 0;
+    /// How many events were emitted since the swap before
+    size_t backlog = 0;
+  };
+
+  /// Called by SystemManager::update
+  inline void record_system(size_t system, double seconds);
+  inline void record_events();
+  inline void record_update(double seconds, size_t expired);
+
+  /// The label value of index, using names if it has one
+  static inline std::string name_of(std::vector<std::string> const &names, char const *kind, size_t index);
+  static inline void set_name(std::vector<std::string> &names, size_t index, std::string const &name);
+
+  /// Write the # HELP and # TYPE lines of a metric
+  static inline void describe(std::ostream &out, char const *name, char const *type, char const *help);
+
+  using MaskCounts = std::unordered_map<details::ComponentMask, size_t>;
+
+  /// How many entities have each mask, other than the empty one
+  inline MaskCounts count_masks() const;
+
+  inline void write_entities(std::ostream &out, MaskCounts const &counts) const;
+  inline void write_components(std::ostream &out, MaskCounts const &counts) const;
+  inline void write_events(std::ostream &out) const;
+  inline void write_systems(std::ostream &out) const;
+
+  EntityManager *entities_;
+  std::vector<std::string> component_names_;
+  std::vector<std::string> system_names_;
+  std::vector<std::string> event_names_;
+
+  /// Indexed by system and event type
+  std::vector<SystemStats> systems_;
+  std::vector<EventStats> events_;
+  uint64_t updates_;
+  double update_seconds_;
+  double last_update_seconds_;
+  uint64_t expired_;
+
+  friend class SystemManager;
+};
+
+} // namespace ecs
+
+#include "Metrics.inl"
+
+#endif //ECS_METRICS_H
@@ -0,0 +1,234 @@
+namespace ecs{
+
+namespace details{
+
+void write_label_value(std::ostream &out, std::string const &value) {
+  out << '"';
+  for (char c : value) {
+    if (c == '\\') out << "\\\\";
+    else if (c == '"') out << "\\\"";
+    else if (c == '\n') out << "\\n";
+    else out << c;
+  }
+  out << '"';
+}
+
+} // namespace details
+
+template<typename C>
+void Metrics::name_component(std::string const &name) {
+  set_name(component_names_, details::component_index<C>(), name);
+}
+
+template<typename S>
+void Metrics::name_system(std::string const &name) {
+  set_name(system_names_, details::system_index<S>(), name);
+}
+
+template<typename E>
+void Metrics::name_events(std::string const &name) {
+  set_name(event_names_, details::event_index<E>(), name);
+}
+
+void Metrics::write(std::ostream &out) const {
+  std::streamsize precision = out.precision(9);
+  MaskCounts counts = count_masks();
+  write_entities(out, counts);
+  write_components(out, counts);
+  write_events(out);
+  write_systems(out);
+  out.precision(precision);
+}
+
+std::string Metrics::str() const {
+  std::ostringstream out;
+  write(out);
+  return out.str();
+}
+
+bool Metrics::write_file(std::string const &path) const {
+  std::string temporary = path + ".tmp";
+  {
+    std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+    write(out);
+    out.close();
+    if (!out) {
+      std::remove(temporary.c_str());
+      return false;
+    }
+  }
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    // Renaming does not replace an existing file on every platform
+    std::remove(path.c_str());
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+      std::remove(temporary.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+void Metrics::record_system(size_t system, double seconds) {
+  if (systems_.size() <= system) systems_.resize(system + 1);
+  SystemStats &stats = systems_[system];
+  ++stats.updates;
+  stats.seconds += seconds;
+  stats.last_seconds = seconds;
+}
+
+void Metrics::record_events() {
+  auto const &channels = entities_->event_channels_;
+  if (events_.size() < channels.size()) events_.resize(channels.size());
+  for (size_t index = 0; index < channels.size(); ++index) {
+    // Just after a swap, the readable events are those emitted since the swap before
+    size_t backlog = channels[index] ? channels[index]->size() : 0;
+    events_[index].total += backlog;
+    events_[index].backlog = backlog;
+  }
+}
+
+void Metrics::record_update(double seconds, size_t expired) {
+  ++updates_;
+  update_seconds_ += seconds;
+  last_update_seconds_ = seconds;
+  expired_ += expired;
+}
+
+std::string Metrics::name_of(std::vector<std::string> const &names, char const *kind, size_t index) {
+  if (index < names.size() && !names[index].empty()) return names[index];
+  return std::string(kind) + "_" + std::to_string(index);
+}
+
+void Metrics::set_name(std::vector<std::string> &names, size_t index, std::string const &name) {
+  if (names.size() <= index) names.resize(index + 1);
+  names[index] = name;
+}
+
+void Metrics::describe(std::ostream &out, char const *name, char const *type, char const *help) {
+  out << "# HELP " << name << ' ' << help << '\n';
+  out << "# TYPE " << name << ' ' << type << '\n';
+}
+
+Metrics::MaskCounts Metrics::count_masks() const {
+  // Entities next to each other mostly have the same mask, so the last count is kept at hand
+  MaskCounts counts;
+  details::ComponentMask last;
+  size_t *count = nullptr;
+  for (details::ComponentMask const &mask : entities_->component_masks_) {
+    if (mask.none()) continue;
+    if (count == nullptr || mask != last) {
+      last = mask;
+      count = &counts[mask];
+    }
+    ++*count;
+  }
+  return counts;
+}
+
+void Metrics::write_entities(std::ostream &out, MaskCounts const &counts) const {
+  EntityManager const &entities = *entities_;
+  describe(out, "ecs_entities", "gauge", "Entities that exist.");
+  out << "ecs_entities " << entities.count_ << '\n';
+  describe(out, "ecs_entity_capacity", "gauge", "Entities there is memory for.");
+  out << "ecs_entity_capacity " << entities.capacity() << '\n';
+
+  // Sorted by label, so that the output does not change between writes
+  std::map<std::string, size_t> by_label;
+  size_t with_components = 0;
+  for (auto const &mask_count : counts) {
+    with_components += mask_count.second;
+    std::string label;
+    for (size_t component = 0; component < mask_count.first.size(); ++component) {
+      if (!mask_count.first.test(component)) continue;
+      if (!label.empty()) label += ',';
+      label += name_of(component_names_, "component", component);
+    }
+    by_label[label] += mask_count.second;
+  }
+  if (entities.count_ > with_components) by_label[""] += entities.count_ - with_components;
+  describe(out, "ecs_entities_by_mask", "gauge", "Entities with each set of components.");
+  for (auto const &label_count : by_label) {
+    out << "ecs_entities_by_mask{components=";
+    details::write_label_value(out, label_count.first);
+    out << "} " << label_count.second << '\n';
+  }
+
+  describe(out, "ecs_expiring_entities", "gauge", "Expiry times that are set and not yet passed.");
+  out << "ecs_expiring_entities " << entities.expiring_count_ << '\n';
+  describe(out, "ecs_expired_entities_total", "counter", "Entities destroyed because they expired.");
+  out << "ecs_expired_entities_total " << expired_ << '\n';
+}
+
+void Metrics::write_components(std::ostream &out, MaskCounts const &counts) const {
+  EntityManager const &entities = *entities_;
+  size_t component_count = entities.component_managers_.size();
+  std::vector<size_t> with_component(component_count, 0);
+  for (auto const &mask_count : counts) {
+    for (size_t component = 0; component < component_count; ++component) {
+      if (mask_count.first.test(component)) with_component[component] += mask_count.second;
+    }
+  }
+  describe(out, "ecs_component_entities", "gauge", "Entities with each component.");
+  for (size_t component = 0; component < component_count; ++component) {
+    if (entities.component_managers_[component] == nullptr) continue;
+    out << "ecs_component_entities{component=";
+    details::write_label_value(out, name_of(component_names_, "component", component));
+    out << "} " << with_component[component] << '\n';
+  }
+  describe(out, "ecs_component_pool_bytes", "gauge", "Memory allocated by the pool of each component.");
+  for (size_t component = 0; component < component_count; ++component) {
+    details::BaseManager *manager = entities.component_managers_[component];
+    if (manager == nullptr) continue;
+    out << "ecs_component_pool_bytes{component=";
+    details::write_label_value(out, name_of(component_names_, "component", component));
+    out << "} " << manager->pool().memory() << '\n';
+  }
+}
+
+void Metrics::write_events(std::ostream &out) const {
+  describe(out, "ecs_events_total", "counter", "Events made readable by swapping each EventChannel.");
+  for (size_t index = 0; index < events_.size(); ++index) {
+    out << "ecs_events_total{events=";
+    details::write_label_value(out, name_of(event_names_, "events", index));
+    out << "} " << events_[index].total << '\n';
+  }
+  describe(out, "ecs_event_backlog", "gauge", "Events emitted between the last two swaps of each EventChannel.");
+  for (size_t index = 0; index < events_.size(); ++index) {
+    out << "ecs_event_backlog{events=";
+    details::write_label_value(out, name_of(event_names_, "events", index));
+    out << "} " << events_[index].backlog << '\n';
+  }
+}
+
+void Metrics::write_systems(std::ostream &out) const {
+  describe(out, "ecs_updates_total", "counter", "Updates of the SystemManager.");
+  out << "ecs_updates_total " << updates_ << '\n';
+  describe(out, "ecs_update_seconds_total", "counter", "Time spent in updates of the SystemManager.");
+  out << "ecs_update_seconds_total " << update_seconds_ << '\n';
+  describe(out, "ecs_update_last_seconds", "gauge", "Time spent in the last update of the SystemManager.");
+  out << "ecs_update_last_seconds " << last_update_seconds_ << '\n';
+
+  describe(out, "ecs_system_updates_total", "counter", "Updates of each system.");
+  for (size_t index = 0; index < systems_.size(); ++index) {
+    if (systems_[index].updates == 0) continue;
+    out << "ecs_system_updates_total{system=";
+    details::write_label_value(out, name_of(system_names_, "system", index));
+    out << "} " << systems_[index].updates << '\n';
+  }
+  describe(out, "ecs_system_seconds_total", "counter", "Time spent in updates of each system.");
+  for (size_t index = 0; index < systems_.size(); ++index) {
+    if (systems_[index].updates == 0) continue;
+    out << "ecs_system_seconds_total{system=";
+    details::write_label_value(out, name_of(system_names_, "system", index));
+    out << "} " << systems_[index].seconds << '\n';
+  }
+  describe(out, "ecs_system_last_seconds", "gauge", "Time spent in the last update of each system.");
+  for (size_t index = 0; index < systems_.size(); ++index) {
+    if (systems_[index].updates == 0) continue;
+    out << "ecs_system_last_seconds{system=";
+    details::write_label_value(out, name_of(system_names_, "system", index));
+    out << "} " << systems_[index].last_seconds << '\n';
+  }
+}
+
+} // namespace ecs
@@ -16,6 +16,10 @@ namespace details {
 /// Pool allocation class. The standard is to store one cache-line
 /// (64 bytes) per chunk.
 ///
+/// Chunks are reference counted, so that several pools can share the
+/// same memory (see EntityManager::fork). A shared chunk must be made
+/// unique with detach_chunk before it is modified.
+///
 ///---------------------------------------------------------------------
 class BasePool: forbid_copies {
  public:
@@ -25,17 +29,62 @@ class BasePool: forbid_copies {
   inline index_t size() const { return size_; }
   inline index_t capacity() const { return capacity_; }
   inline size_t chunks() const { return chunks_.size(); }
+  inline size_t chunk_size() const { return chunk_size_; }
+  /// Bytes allocated for the chunks, including their headers
+  inline size_t memory() const { return chunks_.size() * (chunk_header_size + element_size_ * chunk_size_); }
+  inline char *chunk(size_t index) { return chunks_[index]; }
   inline void ensure_min_size(std::size_t size);
   inline void ensure_min_capacity(size_t min_capacity);
 
+  /// Exchange a chunk with a chunk from another pool. Objects stay
+  /// where they are in memory, only the ownership changes.
+  inline void swap_chunk(size_t chunk_index, BasePool &other, size_t other_chunk_index);
+
+  /// Take ownership of every chunk in another pool, and place them
+  /// starting at first_chunk. The other pool is empty afterwards.
+  inline void adopt_chunks(BasePool &other, size_t first_chunk);
+
+  /// Release all memory, without calling any destructors
+  inline void clear();
+
+  /// Share every chunk with another pool. Memory owned by this pool
+  /// is released, without calling any destructors. Only chunks that
+  /// are not already shared with the other pool are updated.
+  inline void share_chunks(BasePool &other);
+
+  /// Check if a chunk is shared with another pool
+  inline bool is_shared(size_t chunk_index) const;
+
+  /// Check if any chunk has been shared with another pool
+  inline bool has_shared() const { return has_shared_; }
+
+  /// Replace a shared chunk with new uninitialized memory. Returns the
+  /// shared chunk, which must be released with release_chunk once its
+  /// objects are copied.
+  inline char *detach_chunk(size_t chunk_index);
+
+  inline static void release_chunk(char *chunk);
+
   virtual void destroy(index_t index) = 0;
 
  protected:
+  // Placed in front of each chunk
+  struct ChunkHeader {
+    std::atomic<size_t> references;
+  };
+  static const size_t chunk_header_size = alignof(std::max_align_t) > sizeof(ChunkHeader) ?
+                                          alignof(std::max_align_t) : sizeof(ChunkHeader);
+
+  inline char *allocate_chunk();
+  inline static ChunkHeader &header(char *chunk);
+
   index_t size_;
   index_t capacity_;
   size_t element_size_;
   size_t chunk_size_;
   std::vector<char *> chunks_;
+  /// Set when chunks are shared, so that pools that never share memory can skip checking each chunk
+  bool has_shared_;
 };
 
 ///---------------------------------------------------------------------
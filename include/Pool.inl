@@ -6,12 +6,13 @@ BasePool::BasePool(size_t element_size, size_t chunk_size) :
     size_(0),
     capacity_(0),
     element_size_(element_size),
-    chunk_size_(chunk_size) {
+    chunk_size_(chunk_size),
+    has_shared_(false) {
 }
 
 BasePool::~BasePool() {
   for (char *ptr : chunks_) {
-    delete[] ptr;
+    release_chunk(ptr);
   }
 }
 void BasePool::ensure_min_size(std::size_t size) {
@@ -22,12 +23,100 @@ void BasePool::ensure_min_size(std::size_t size) {
 }
 void BasePool::ensure_min_capacity(size_t min_capacity) {
   while (min_capacity >= capacity_) {
-    char *chunk = new char[element_size_ * chunk_size_];
-    chunks_.push_back(chunk);
+    chunks_.push_back(allocate_chunk());
     capacity_ += chunk_size_;
   }
 }
 
+void BasePool::swap_chunk(size_t chunk_index, BasePool &other, size_t other_chunk_index) {
+  ECS_ASSERT(element_size_ == other.element_size_ && chunk_size_ == other.chunk_size_, "Pools are not compatible");
+  ECS_ASSERT(chunk_index < chunks_.size() && other_chunk_index < other.chunks_.size(), "Chunk is not allocated");
+  std::swap(chunks_[chunk_index], other.chunks_[other_chunk_index]);
+  if (other.has_shared()) has_shared_ = true;
+  if (has_shared()) other.has_shared_ = true;
+}
+
+void BasePool::adopt_chunks(BasePool &other, size_t first_chunk) {
+  ECS_ASSERT(element_size_ == other.element_size_ && chunk_size_ == other.chunk_size_, "Pools are not compatible");
+  if (first_chunk > 0) ensure_min_capacity(first_chunk * chunk_size_ - 1);
+  for (size_t i = 0; i < other.chunks_.size(); ++i) {
+    if (first_chunk + i < chunks_.size()) {
+      std::swap(chunks_[first_chunk + i], other.chunks_[i]);
+    } else {
+      chunks_.push_back(other.chunks_[i]);
+      capacity_ += index_t(chunk_size_);
+      other.chunks_[i] = nullptr;
+    }
+  }
+  if (other.size_ > 0) {
+    size_ = std::max<index_t>(size_, index_t(first_chunk * chunk_size_) + other.size_);
+  }
+  if (other.has_shared()) has_shared_ = true;
+  other.clear();
+}
+
+void BasePool::clear() {
+  for (char *ptr : chunks_) {
+    release_chunk(ptr);
+  }
+  chunks_.clear();
+  size_ = 0;
+  capacity_ = 0;
+  has_shared_ = false;
+}
+
+void BasePool::share_chunks(BasePool &other) {
+  ECS_ASSERT(element_size_ == other.element_size_ && chunk_size_ == other.chunk_size_, "Pools are not compatible");
+  if (this == &other) return;
+  for (size_t i = other.chunks_.size(); i < chunks_.size(); ++i) {
+    release_chunk(chunks_[i]);
+  }
+  chunks_.resize(other.chunks_.size(), nullptr);
+  // Chunks that are already shared with other are kept, so that only
+  // chunks that have been modified since last time are touched
+  for (size_t i = 0; i < chunks_.size(); ++i) {
+    if (chunks_[i] != other.chunks_[i]) {
+      header(other.chunks_[i]).references.fetch_add(1, std::memory_order_relaxed);
+      release_chunk(chunks_[i]);
+      chunks_[i] = other.chunks_[i];
+    }
+  }
+  size_ = other.size_;
+  capacity_ = other.capacity_;
+  has_shared_ = true;
+  other.has_shared_ = true;
+}
+
+bool BasePool::is_shared(size_t chunk_index) const {
+  return header(chunks_[chunk_index]).references.load(std::memory_order_acquire) > 1;
+}
+
+char *BasePool::detach_chunk(size_t chunk_index) {
+  char *shared = chunks_[chunk_index];
+  chunks_[chunk_index] = allocate_chunk();
+  return shared;
+}
+
+char *BasePool::allocate_chunk() {
+  char *memory = new char[chunk_header_size + element_size_ * chunk_size_];
+  new(memory) ChunkHeader();
+  char *chunk = memory + chunk_header_size;
+  header(chunk).references.store(1, std::memory_order_relaxed);
+  return chunk;
+}
+
+void BasePool::release_chunk(char *chunk) {
+  if (chunk == nullptr) return;
+  if (header(chunk).references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    header(chunk).~ChunkHeader();
+    delete[] (chunk - chunk_header_size);
+  }
+}
+
+BasePool::ChunkHeader &BasePool::header(char *chunk) {
+  return *reinterpret_cast<ChunkHeader *>(chunk - chunk_header_size);
+}
+
 template<typename T>
 Pool<T>::Pool(size_t chunk_size) : BasePool(sizeof(T), chunk_size) { }
 
@@ -10,6 +10,20 @@ namespace details{
 ///---------------------------------------------------------------------
 class BaseProperty{};
 
+///---------------------------------------------------------------------
+/// The type of the value of a component. The value of a Property is
+/// its ValueType, other components are their own value.
+///---------------------------------------------------------------------
+template<typename C, bool = std::is_base_of<BaseProperty, C>::value>
+struct component_value {
+  using type = C;
+};
+
+template<typename C>
+struct component_value<C, true> {
+  using type = typename C::ValueType;
+};
+
 } // namespace details
 
 ///---------------------------------------------------------------------
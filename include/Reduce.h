@@ -0,0 +1,319 @@
+#ifndef ECS_REDUCE_H
+#define ECS_REDUCE_H
+
+#include "EntityManager.h"
+
+namespace ecs{
+
+///---------------------------------------------------------------------
+/// The smallest and largest key of a number of entities, and the
+/// entities that have them. Given by EntityManager::minmax_by.
+///---------------------------------------------------------------------
+template<typename K>
+struct MinMax {
+  /// How many entities that were compared. The other members are only
+  /// set if count > 0
+  size_t count;
+  K min;
+  K max;
+  Id min_id;
+  Id max_id;
+};
+
+namespace details{
+
+///---------------------------------------------------------------------
+/// Used to reduce the components of every entity with Components into
+/// a single value, on several threads
+///---------------------------------------------------------------------
+///
+/// The entities are divided into slices of ECS_REDUCE_SLICE_SIZE entity
+/// indexes. Each thread takes one slice at a time and reduces it into a
+/// partial result. The partial results are then combined in the order
+/// of the slices, so the result is the same no matter how many threads
+/// are used, or which thread reduced which slice.
+///
+///---------------------------------------------------------------------
+template<typename ...Components>
+struct reduce_t {
+  static_assert(sizeof...(Components) > 0, "At least 1 component must be reduced.");
+  static_assert(ECS_REDUCE_SLICE_SIZE % ECS_CACHE_LINE_SIZE == 0,
+                "ECS_REDUCE_SLICE_SIZE must be a multiple of ECS_CACHE_LINE_SIZE");
+
+  static const index_t block_size = 64;
+  static const index_t slice_size = ECS_REDUCE_SLICE_SIZE;
+
+  /// The entities to reduce, with every component in mask and an index within [first, last)
+  struct Range {
+    ComponentMask mask;
+    index_t first;
+    index_t last;
+  };
+
+  /// Every entity with Components, and every component in mask
+  static inline Range range(ComponentMask mask = ComponentMask(0), index_t first = 0,
+                           index_t last = std::numeric_limits<index_t>::max()) {
+    return Range{mask | details::component_mask<Components...>(), first, last};
+  }
+
+  template<typename T>
+  struct Partial {
+    T value;
+    bool found;
+  };
+
+  /// Reduce every entity in range, calling map(index, Components const &...)
+  /// for each. Returns false, and leaves result as it is, if there are no
+  /// such entities.
+  template<typename T, typename Map, typename Combine>
+  static inline bool reduce(EntityManager const &manager, Range const &range, T &result,
+                            Map map, Combine combine, size_t threads) {
+    std::vector<Partial<T>> partials = fold(
+        manager, range, Partial<T>{result, false},
+        [&map, &combine](Partial<T> &partial, index_t index, Components const &... components) {
+          if (partial.found) {
+            partial.value = combine(partial.value, map(index, components...));
+          } else {
+            partial.value = map(index, components...);
+            partial.found = true;
+          }
+        }, threads);
+    bool found = false;
+    for (Partial<T> &partial : partials) {
+      if (!partial.found) continue;
+      result = found ? combine(result, partial.value) : partial.value;
+      found = true;
+    }
+    return found;
+  }
+
+  /// The slices of entity indexes within a Range
+  struct Slices {
+    index_t first;
+    index_t end;
+    index_t first_slice;
+    size_t count;
+
+    index_t slice_first(size_t slice) const {
+      return std::max<index_t>(first, index_t((first_slice + slice) * slice_size));
+    }
+    index_t slice_end(size_t slice) const {
+      return index_t(std::min<size_t>(end, (first_slice + slice + 1) * size_t(slice_size)));
+    }
+  };
+
+  static inline Slices slices(EntityManager const &manager, Range const &range) {
+    Slices slices;
+    slices.first = range.first;
+    slices.end = index_t(std::min<size_t>(range.last, manager.component_masks_.size()));
+    slices.first_slice = range.first / slice_size;
+    slices.count = 0;
+    // No entity is in range if a component has no ComponentManager
+    if (range.first < slices.end && has_managers(manager)) {
+      slices.count = (slices.end - 1) / slice_size - slices.first_slice + 1;
+    }
+    return slices;
+  }
+
+  /// How many threads are used for a number of slices. 0 threads means one
+  /// per core, but at most one per slices_per_thread slices, since starting a
+  /// thread costs about as much as reducing a few slices
+  static inline size_t thread_count(size_t slices, size_t threads,
+                                    size_t slices_per_thread = ECS_REDUCE_SLICES_PER_THREAD) {
+    if (threads == 0) {
+      threads = std::min<size_t>(std::thread::hardware_concurrency(), slices / slices_per_thread);
+    }
+    return std::max<size_t>(1, std::min(threads, slices));
+  }
+
+  /// Call work(thread, slice) for every slice, on thread_count(slices, threads,
+  /// slices_per_thread) threads. Each thread takes one slice at a time, and is
+  /// numbered from 0.
+  template<typename Work>
+  static inline void run(size_t slices, size_t threads, Work work,
+                         size_t slices_per_thread = ECS_REDUCE_SLICES_PER_THREAD) {
+    threads = thread_count(slices, threads, slices_per_thread);
+    std::atomic<size_t> next_slice(0);
+    auto take_slices = [&](size_t thread) {
+      for (size_t slice = next_slice.fetch_add(1); slice < slices; slice = next_slice.fetch_add(1)) {
+        work(thread, slice);
+      }
+    };
+    std::vector<std::thread> workers;
+    for (size_t thread = 1; thread < threads; ++thread) {
+      workers.emplace_back(take_slices, thread);
+    }
+    // The calling thread does its share of the work
+    take_slices(0);
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+  }
+
+  /// Fold the entities of each slice in range into a copy of init, calling
+  /// fold(T &, index, Components const &...) for each entity. Gives the
+  /// result of every slice, in order.
+  template<typename T, typename Fold>
+  static inline std::vector<T> fold(EntityManager const &manager, Range const &range, T const &init,
+                                    Fold fold_entity, size_t threads) {
+    Slices slices = reduce_t::slices(manager, range);
+    std::vector<T> partials(slices.count, init);
+    run(slices.count, threads, [&](size_t, size_t slice) {
+      T &partial = partials[slice];
+      for_each(manager, range.mask, slices.slice_first(slice), slices.slice_end(slice),
+               [&fold_entity, &partial](index_t index, Components const &... components) {
+                 fold_entity(partial, index, components...);
+               });
+    });
+    return partials;
+  }
+
+  /// Find the k entities in range with the largest key(Components const &...),
+  /// largest first. Each thread keeps the k best entities it has seen in a
+  /// heap, and then the best of those are selected. Larger keys are better,
+  /// and lower indexes are better for equal keys, so the same entities are
+  /// selected no matter which thread saw them.
+  template<typename K, typename Key>
+  static inline std::vector<std::pair<K, index_t>> top_k(EntityManager const &manager, Range const &range,
+                                                         size_t k, Key key, size_t threads) {
+    using Candidate = std::pair<K, index_t>;
+    auto better = [](Candidate const &a, Candidate const &b) {
+      return b.first < a.first || (!(a.first < b.first) && a.second < b.second);
+    };
+    std::vector<Candidate> result;
+    if (k == 0) return result;
+    Slices slices = reduce_t::slices(manager, range);
+    std::vector<std::vector<Candidate>> heaps(thread_count(slices.count, threads));
+    run(slices.count, threads, [&](size_t thread, size_t slice) {
+      // The worst candidate is at the front of the heap
+      std::vector<Candidate> &heap = heaps[thread];
+      for_each(manager, range.mask, slices.slice_first(slice), slices.slice_end(slice),
+               [k, &key, &better, &heap](index_t index, Components const &... components) {
+                 Candidate candidate(key(components...), index);
+                 if (heap.size() < k) {
+                   heap.push_back(candidate);
+                   std::push_heap(heap.begin(), heap.end(), better);
+                 } else if (better(candidate, heap.front())) {
+                   std::pop_heap(heap.begin(), heap.end(), better);
+                   heap.back() = candidate;
+                   std::push_heap(heap.begin(), heap.end(), better);
+                 }
+               });
+    });
+    for (std::vector<Candidate> &heap : heaps) {
+      result.insert(result.end(), heap.begin(), heap.end());
+    }
+    size_t count = std::min(k, result.size());
+    std::partial_sort(result.begin(), result.begin() + count, result.end(), better);
+    result.resize(count);
+    return result;
+  }
+
+  /// At most this many keys of each slice are kept, when finding quantiles
+  static const size_t quantile_resolution = 64;
+
+  /// Find a key(Components const &...) for each quantile q in [0, 1], that
+  /// about q of the keys are less than. The keys of each slice are
+  /// summarized by quantile_resolution evenly spaced keys, which are then
+  /// merged in the order of the slices. Gives an empty vector if there are
+  /// no entities in range.
+  template<typename K, typename Key>
+  static inline std::vector<K> quantiles(EntityManager const &manager, Range const &range,
+                                         std::vector<double> const &qs, Key key, size_t threads) {
+    // Each key of a summary stands for a number of keys
+    using Summary = std::vector<std::pair<K, double>>;
+    Slices slices = reduce_t::slices(manager, range);
+    std::vector<Summary> summaries(slices.count);
+    // The keys of the current slice of each thread. Reused between slices
+    std::vector<std::vector<K>> keys(thread_count(slices.count, threads));
+    run(slices.count, threads, [&](size_t thread, size_t slice) {
+      std::vector<K> &slice_keys = keys[thread];
+      slice_keys.clear();
+      for_each(manager, range.mask, slices.slice_first(slice), slices.slice_end(slice),
+               [&key, &slice_keys](index_t, Components const &... components) {
+                 slice_keys.push_back(key(components...));
+               });
+      Summary &summary = summaries[slice];
+      size_t size = slice_keys.size();
+      if (size <= quantile_resolution) {
+        for (K const &slice_key : slice_keys) summary.push_back(std::make_pair(slice_key, 1.0));
+        return;
+      }
+      double weight = double(size) / quantile_resolution;
+      select(slice_keys, 0, quantile_resolution, 0, size, weight);
+      for (size_t i = 0; i < quantile_resolution; ++i) {
+        summary.push_back(std::make_pair(slice_keys[size_t((i + 0.5) * weight)], weight));
+      }
+    });
+    Summary merged;
+    for (Summary &summary : summaries) {
+      merged.insert(merged.end(), summary.begin(), summary.end());
+    }
+    std::vector<K> result;
+    if (merged.empty()) return result;
+    std::sort(merged.begin(), merged.end());
+    double total = 0;
+    for (auto &weighted : merged) total += weighted.second;
+    for (double q : qs) {
+      ECS_ASSERT(q >= 0 && q <= 1, "A quantile must be within [0, 1]");
+      // The first key where at least q of the keys are counted
+      double counted = 0;
+      size_t i = 0;
+      while (i + 1 < merged.size() && counted + merged[i].second < q * total) {
+        counted += merged[i++].second;
+      }
+      result.push_back(merged[i].first);
+    }
+    return result;
+  }
+
+  /// Move the evenly spaced keys [first, last) into their sorted position, by
+  /// selecting the middle one, and then the ones before and after it. keys
+  /// [begin, end) are the ones that can be in their positions.
+  template<typename K>
+  static inline void select(std::vector<K> &keys, size_t first, size_t last, size_t begin, size_t end, double weight) {
+    if (first >= last) return;
+    size_t middle = first + (last - first) / 2;
+    size_t position = size_t((middle + 0.5) * weight);
+    std::nth_element(keys.begin() + begin, keys.begin() + position, keys.begin() + end);
+    select(keys, first, middle, begin, position, weight);
+    select(keys, middle + 1, last, position + 1, end, weight);
+  }
+
+  /// Call visit(index, Components const &...) for every entity in [first, end) with mask
+  template<typename Visit>
+  static inline void for_each(EntityManager const &manager, ComponentMask const &mask, index_t first, index_t end,
+                              Visit visit) {
+    for (index_t block = first; block < end;) {
+      index_t block_end = std::min<index_t>(end, (block / block_size + 1) * block_size);
+      uint64_t matches = details::match_masks(&manager.component_masks_[block], block_end - block, mask);
+      if (matches) {
+        std::tuple<Components const *...> components(manager.get_block_ptr<Components>(block, block_size)...);
+        for (; matches; matches &= matches - 1) {
+          index_t index = block + details::count_trailing_zeros(matches);
+          visit(index, get_arg<Components>(manager, components, block, index)...);
+        }
+      }
+      block = block_end;
+    }
+  }
+
+  /// If no ComponentManager exists for a component, no entity has it
+  static inline bool has_managers(EntityManager const &manager) {
+    bool has[] = {manager.has_component_manager<Components>()...};
+    return std::find(std::begin(has), std::end(has), false) == std::end(has);
+  }
+
+  template<typename C>
+  static inline C const &get_arg(EntityManager const &manager, std::tuple<Components const *...> const &components,
+                                 index_t first, index_t index) {
+    C const *ptr = std::get<details::index_of<C, Components...>::value>(components);
+    return ptr ? ptr[index - first] : manager.get_component_fast<C>(index);
+  }
+};
+
+} // namespace details
+
+} // namespace ecs
+
+#endif //ECS_REDUCE_H
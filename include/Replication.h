@@ -0,0 +1,301 @@
+#ifndef ECS_REPLICATION_H
+#define ECS_REPLICATION_H
+
+#include "EntityManager.h"
+#include "Reduce.h"
+
+namespace ecs{
+
+///---------------------------------------------------------------------
+/// BitWriter appends values to a buffer, using as few bits as asked for
+///---------------------------------------------------------------------
+///
+/// Bits are written lowest bit first, and bytes are filled from their
+/// lowest bit, so the result does not depend on the byte order of the
+/// machine. The last byte is completed with zeros by flush, which is
+/// also done when the BitWriter is destroyed.
+///---------------------------------------------------------------------
+class BitWriter: details::forbid_copies {
+ public:
+  inline BitWriter(std::vector<uint8_t> &out) : out_(&out), pending_(0), pending_bits_(0), written_(0) { }
+  inline ~BitWriter() { flush(); }
+
+  /// Write the lowest bits of value. bits must be at most 64
+  inline void write(uint64_t value, unsigned bits);
+  inline void write_bool(bool value) { write(value ? 1 : 0, 1); }
+
+  /// Write value 7 bits at a time, so that small values take few bits
+  inline void write_varint(uint64_t value);
+
+  /// Write value, clamped to [min, max], as the closest of 2^bits evenly
+  /// spaced values. bits must be at most 32
+  inline void write_float(float value, float min, float max, unsigned bits);
+
+  /// Write the first bits of data, that is written by another BitWriter
+  inline void write_bits(uint8_t const *data, size_t bits);
+
+  /// Fill the last byte with zeros, so that everything is in the buffer
+  inline void flush();
+
+  /// How many bits that are written
+  inline size_t bit_count() const { return written_; }
+
+ private:
+  std::vector<uint8_t> *out_;
+  /// Bits that do not fill a whole 64 bit word yet
+  uint64_t pending_;
+  unsigned pending_bits_;
+  size_t written_;
+};
+
+///---------------------------------------------------------------------
+/// BitReader reads values that are written with a BitWriter
+///---------------------------------------------------------------------
+///
+/// Reading past the end gives zeros, and makes overflow() true.
+///---------------------------------------------------------------------
+class BitReader {
+ public:
+  inline BitReader(void const *data, size_t size) :
+      data_(static_cast<uint8_t const *>(data)), size_(size), position_(0), overflow_(false) { }
+
+  inline uint64_t read(unsigned bits);
+  inline bool read_bool() { return read(1) != 0; }
+  inline uint64_t read_varint();
+  inline float read_float(float min, float max, unsigned bits);
+
+  /// True if more bits were read than there are
+  inline bool overflow() const { return overflow_; }
+
+ private:
+  uint8_t const *data_;
+  size_t size_;
+  /// In bits
+  size_t position_;
+  bool overflow_;
+};
+
+///---------------------------------------------------------------------
+/// Replicate<C> tells how component C is sent to clients. It must be
+/// specialized for every replicated component.
+///---------------------------------------------------------------------
+///
+/// write must always write the same number of bits for C. Fields are
+/// best quantized, with BitWriter::write_float for example, since
+/// changes that do not change the written bits are not sent. read must
+/// read what write wrote. The component that locates entities also
+/// needs position, that gives the point used to decide which observers
+/// see the entity.
+///
+/// @usage template<> struct Replicate<Position> {
+///          static void write(BitWriter &out, Position const &position) {
+///            out.write_float(position.x, -1024, 1024, 16);
+///            out.write_float(position.y, -1024, 1024, 16);
+///          }
+///          static void read(BitReader &in, Position &position) {
+///            position.x = in.read_float(-1024, 1024, 16);
+///            position.y = in.read_float(-1024, 1024, 16);
+///          }
+///          static Point position(Position const &position) {
+///            return Point{position.x, position.y, 0};
+///          }
+///        };
+///---------------------------------------------------------------------
+template<typename C>
+struct Replicate;
+
+namespace details{
+
+/// Entities are written as the distance to the index of the entity before, and the version
+inline void write_handle(BitWriter &writer, Handle handle, index_t &previous);
+inline Handle read_handle(BitReader &reader, index_t &previous);
+
+} // namespace details
+
+struct Point {
+  float x, y, z;
+};
+
+/// A client that sees every entity within radius of position
+struct Observer {
+  Point position;
+  float radius;
+};
+
+///---------------------------------------------------------------------
+/// A Replicator writes, for each observer, what has happened to the
+/// entities it sees since the last tick its client acknowledged
+///---------------------------------------------------------------------
+///
+/// Entities with a Location component are replicated, together with
+/// any of Components they have. update finds the components that have
+/// changed, by comparing what Replicate<C>::write writes for each of
+/// them with what it wrote before, and puts every entity in a grid by
+/// its position. write then finds the entities within the radius of an
+/// observer, and writes a packet with the entities that the client may
+/// have but no longer sees, the entities that are new to it, and the
+/// changed components of the others.
+///
+/// Packets are written relative to the last acknowledged tick, so a
+/// lost packet is covered by the next one. Every value in a packet is
+/// absolute, so a packet can be applied by a client that has applied
+/// any of the packets written since that tick. A Replica applies the
+/// packets on the client side.
+///
+/// @usage Replicator<Position, Position, Health> replicator(entities, 64);
+///        size_t observer = replicator.add_observer(Observer{Point{0, 0, 0}, 100});
+///        ...
+///        replicator.update(tick);
+///        replicator.write(observer, packet);
+///        send(packet);
+///        ...
+///        replicator.acknowledge(observer, acknowledged_tick);
+///---------------------------------------------------------------------
+template<typename Location, typename ...Components>
+class Replicator: details::forbid_copies {
+  static_assert(sizeof...(Components) > 0, "At least 1 component must be replicated.");
+  static_assert(sizeof...(Components) <= 32, "At most 32 components can be replicated.");
+
+ public:
+  static const size_t component_count = sizeof...(Components);
+
+  /// Entities are put in a grid of squares with sides of cell_size, in
+  /// x and y. About the radius of the observers works well.
+  inline Replicator(EntityManager &entities, float cell_size);
+
+  /// Add an observer, that has not seen any entity. Returns its number
+  inline size_t add_observer(Observer const &observer);
+  inline void set_observer(size_t observer, Observer const &value) { observers_[observer].observer = value; }
+  inline Observer const &observer(size_t observer) const { return observers_[observer].observer; }
+  inline size_t observer_count() const { return observers_.size(); }
+
+  /// Find what has changed since the last update, and where each entity
+  /// is. Must be called with increasing ticks, greater than 0, before
+  /// packets of the tick are written.
+  inline void update(uint64_t tick);
+
+  /// Append the packet of the current tick for observer to out
+  inline void write(size_t observer, std::vector<uint8_t> &out);
+
+  /// Append the packet of every observer to its buffer in out, on
+  /// threads threads (0 uses one thread per core)
+  inline void write_all(std::vector<std::vector<uint8_t>> &out, size_t threads = 0);
+
+  /// The client of observer has applied the packet of tick. Later packets
+  /// are written relative to it. Unknown and old ticks are ignored.
+  inline void acknowledge(size_t observer, uint64_t tick);
+
+  /// The last tick observer acknowledged, 0 if none
+  inline uint64_t acknowledged(size_t observer) const { return observers_[observer].baseline; }
+
+ private:
+  /// A packet that is not acknowledged yet, and the entities it told the client about
+  struct Sent {
+    uint64_t tick;
+    std::vector<Handle> visible;
+  };
+
+  struct ObserverState {
+    Observer observer;
+    uint64_t baseline;
+    /// Entities the client has whichever packet since baseline it applied
+    /// last, and entities it may have
+    std::vector<Handle> known;
+    std::vector<Handle> maybe;
+    std::vector<Sent> sent;
+  };
+
+  /// What Replicate<C>::write wrote for every entity, and when it changed
+  struct Encoded {
+    size_t bits;
+    size_t bytes;
+    std::vector<uint8_t> data;
+    std::vector<uint64_t> changed;
+  };
+
+  /// Entities are compared by index first, so that lists are in the order of the entities
+  static inline bool by_index(Handle const &a, Handle const &b) {
+    return a.index() < b.index() || (a.index() == b.index() && a.version() < b.version());
+  }
+
+  inline uint64_t cell(float x, float y) const;
+
+  /// Encode component C of the entity at index, and see if it has changed
+  template<typename C>
+  inline void update_component(index_t index, uint32_t presence, uint32_t old_presence, bool is_new);
+
+  /// The entities within the radius of observer, in the order of their index
+  inline void find_visible(Observer const &observer, std::vector<Handle> &visible) const;
+
+  /// Write the components in mask of the entity at index
+  inline void write_components(BitWriter &writer, index_t index, uint32_t mask) const;
+
+  EntityManager *entities_;
+  float cell_size_;
+  uint64_t tick_;
+  std::vector<ObserverState> observers_;
+
+  /// Of each entity index, at the last update. Presence is a bit for each
+  /// of Components the entity has, and is 0 if it has no Location
+  std::vector<version_t> versions_;
+  std::vector<uint32_t> presence_;
+  /// The last tick anything was changed
+  std::vector<uint64_t> changed_;
+  std::vector<Point> positions_;
+  Encoded encoded_[component_count];
+  /// The cell and index of each located entity, sorted
+  std::vector<std::pair<uint64_t, index_t>> cells_;
+  std::vector<uint8_t> scratch_;
+};
+
+///---------------------------------------------------------------------
+/// A Replica applies the packets of a Replicator to an EntityManager,
+/// on the client side
+///---------------------------------------------------------------------
+///
+/// Each replicated entity gets a local entity, that is found with the
+/// Handle it has on the server. Components must be the same as those of
+/// the Replicator, and be default constructible.
+///
+/// @usage Replica<Position, Health> replica(entities);
+///        if (replica.read(packet)) send_ack(replica.tick());
+///---------------------------------------------------------------------
+template<typename ...Components>
+class Replica: details::forbid_copies {
+ public:
+  static const size_t component_count = sizeof...(Components);
+
+  inline Replica(EntityManager &entities) : entities_(&entities), tick_(0) { }
+
+  /// Apply a packet. Returns false, without changing anything, if a packet
+  /// of the same or a later tick is applied already.
+  inline bool read(void const *data, size_t size);
+  inline bool read(std::vector<uint8_t> const &packet) { return read(packet.data(), packet.size()); }
+
+  /// The tick of the last applied packet, which is the one to acknowledge
+  inline uint64_t tick() const { return tick_; }
+
+  /// The local entity of an entity on the server. Not valid if it is not replicated
+  inline Entity operator[](Handle remote);
+
+  /// How many entities that are replicated
+  inline size_t size() const { return local_.size(); }
+
+ private:
+  /// Read the components in mask into the local entity of remote, and
+  /// remove those it does not have, according to presence
+  inline void read_components(BitReader &reader, Handle remote, uint32_t presence, uint32_t mask);
+
+  template<typename C>
+  inline void read_component(BitReader &reader, Entity &entity, uint32_t presence, uint32_t mask);
+
+  EntityManager *entities_;
+  uint64_t tick_;
+  std::unordered_map<Handle, Handle> local_;
+};
+
+} // namespace ecs
+
+#include "Replication.inl"
+
+#endif //ECS_REPLICATION_H
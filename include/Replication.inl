@@ -0,0 +1,413 @@
+namespace ecs{
+
+void BitWriter::write(uint64_t value, unsigned bits) {
+  if (bits == 0) return;
+  if (bits < 64) value &= (uint64_t(1) << bits) - 1;
+  written_ += bits;
+  pending_ |= value << pending_bits_;
+  unsigned total = pending_bits_ + bits;
+  if (total >= 64) {
+    for (unsigned i = 0; i < 8; ++i) {
+      out_->push_back(uint8_t(pending_ >> (8 * i)));
+    }
+    // The bits of value that did not fit
+    pending_ = pending_bits_ ? value >> (64 - pending_bits_) : 0;
+    total -= 64;
+  }
+  pending_bits_ = total;
+}
+
+void BitWriter::write_varint(uint64_t value) {
+  while (value >= 0x80) {
+    write((value & 0x7F) | 0x80, 8);
+    value >>= 7;
+  }
+  write(value, 8);
+}
+
+void BitWriter::write_float(float value, float min, float max, unsigned bits) {
+  double steps = double((uint64_t(1) << bits) - 1);
+  double t = (double(value) - min) / (double(max) - min);
+  t = std::max(0.0, std::min(1.0, t));
+  write(uint64_t(t * steps + 0.5), bits);
+}
+
+void BitWriter::write_bits(uint8_t const *data, size_t bits) {
+  for (; bits >= 64; bits -= 64, data += 8) {
+    uint64_t word = 0;
+    for (unsigned i = 0; i < 8; ++i) {
+      word |= uint64_t(data[i]) << (8 * i);
+    }
+    write(word, 64);
+  }
+  for (; bits > 0; bits -= std::min<size_t>(bits, 8), ++data) {
+    write(*data, unsigned(std::min<size_t>(bits, 8)));
+  }
+}
+
+void BitWriter::flush() {
+  for (unsigned i = 0; i * 8 < pending_bits_; ++i) {
+    out_->push_back(uint8_t(pending_ >> (8 * i)));
+  }
+  written_ = (written_ + 7) / 8 * 8;
+  pending_ = 0;
+  pending_bits_ = 0;
+}
+
+uint64_t BitReader::read(unsigned bits) {
+  uint64_t value = 0;
+  unsigned done = 0;
+  while (done < bits) {
+    size_t byte = position_ / 8;
+    unsigned offset = unsigned(position_ % 8);
+    if (byte >= size_) {
+      overflow_ = true;
+      return value;
+    }
+    unsigned take = std::min(8 - offset, bits - done);
+    uint64_t chunk = (data_[byte] >> offset) & ((1u << take) - 1);
+    value |= chunk << done;
+    done += take;
+    position_ += take;
+  }
+  return value;
+}
+
+uint64_t BitReader::read_varint() {
+  uint64_t value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    uint64_t byte = read(8);
+    value |= (byte & 0x7F) << shift;
+    if (!(byte & 0x80)) break;
+  }
+  return value;
+}
+
+float BitReader::read_float(float min, float max, unsigned bits) {
+  double steps = double((uint64_t(1) << bits) - 1);
+  return float(min + (double(max) - min) * (double(read(bits)) / steps));
+}
+
+namespace details{
+
+void write_handle(BitWriter &writer, Handle handle, index_t &previous) {
+  writer.write_varint(handle.index() - previous);
+  writer.write(handle.version(), 8 * sizeof(version_t));
+  previous = handle.index();
+}
+
+Handle read_handle(BitReader &reader, index_t &previous) {
+  index_t index = previous + index_t(reader.read_varint());
+  version_t version = version_t(reader.read(8 * sizeof(version_t)));
+  previous = index;
+  return Handle(Id(index, version));
+}
+
+} // namespace details
+
+template<typename Location, typename ...Components>
+Replicator<Location, Components...>::Replicator(EntityManager &entities, float cell_size) :
+    entities_(&entities),
+    cell_size_(cell_size),
+    tick_(0)
+{
+  ECS_ASSERT(cell_size > 0, "Cell size must be positive");
+  for (Encoded &encoded : encoded_) {
+    encoded.bits = 0;
+    encoded.bytes = 0;
+  }
+}
+
+template<typename Location, typename ...Components>
+size_t Replicator<Location, Components...>::add_observer(Observer const &observer) {
+  ObserverState state;
+  state.observer = observer;
+  state.baseline = 0;
+  observers_.push_back(state);
+  return observers_.size() - 1;
+}
+
+template<typename Location, typename ...Components>
+uint64_t Replicator<Location, Components...>::cell(float x, float y) const {
+  int32_t cx = int32_t(std::floor(x / cell_size_));
+  int32_t cy = int32_t(std::floor(y / cell_size_));
+  return uint64_t(uint32_t(cx)) << 32 | uint32_t(cy);
+}
+
+template<typename Location, typename ...Components>
+void Replicator<Location, Components...>::update(uint64_t tick) {
+  ECS_ASSERT(tick > tick_, "Ticks must be updated in increasing order, starting above 0");
+  tick_ = tick;
+  EntityManager &manager = *entities_;
+  size_t size = manager.component_masks_.size();
+  if (versions_.size() < size) {
+    versions_.resize(size, 0);
+    presence_.resize(size, 0);
+    changed_.resize(size, 0);
+    positions_.resize(size);
+  }
+  details::ComponentMask location_mask = details::component_mask<Location>();
+  details::ComponentMask masks[] = {details::component_mask<Components>()...};
+  cells_.clear();
+  for (index_t index = 0; index < versions_.size(); ++index) {
+    uint32_t presence = 0;
+    bool located = index < size && (manager.component_masks_[index] & location_mask) == location_mask;
+    if (located) {
+      for (size_t c = 0; c < component_count; ++c) {
+        if ((manager.component_masks_[index] & masks[c]).any()) presence |= uint32_t(1) << c;
+      }
+    }
+    // A new entity may have been given the index
+    bool is_new = index < size && manager.entity_versions_[index] != versions_[index];
+    if (is_new) versions_[index] = manager.entity_versions_[index];
+    uint32_t old_presence = presence_[index];
+    if (presence != old_presence || (is_new && presence)) changed_[index] = tick;
+    presence_[index] = presence;
+    if (!located) continue;
+    int expand[] = {(update_component<Components>(index, presence, old_presence, is_new), 0)...};
+    (void) expand;
+    Point point = Replicate<Location>::position(manager.get_component_fast<Location>(index));
+    positions_[index] = point;
+    cells_.push_back(std::make_pair(cell(point.x, point.y), index));
+  }
+  std::sort(cells_.begin(), cells_.end());
+}
+
+template<typename Location, typename ...Components>
+template<typename C>
+void Replicator<Location, Components...>::update_component(index_t index, uint32_t presence,
+                                                           uint32_t old_presence, bool is_new) {
+  const size_t c = details::index_of<C, Components...>::value;
+  const uint32_t bit = uint32_t(1) << c;
+  if (!(presence & bit)) return;
+  Encoded &encoded = encoded_[c];
+  scratch_.clear();
+  size_t bits;
+  {
+    BitWriter writer(scratch_);
+    Replicate<C>::write(writer, entities_->get_component_fast<C>(index));
+    bits = writer.bit_count();
+  }
+  if (encoded.bytes == 0) {
+    encoded.bits = bits;
+    encoded.bytes = std::max<size_t>(1, scratch_.size());
+  }
+  ECS_ASSERT(bits == encoded.bits, "Replicate<C>::write must always write the same number of bits");
+  scratch_.resize(encoded.bytes, 0);
+  if (encoded.changed.size() < versions_.size()) {
+    encoded.changed.resize(versions_.size(), 0);
+    encoded.data.resize(versions_.size() * encoded.bytes, 0);
+  }
+  uint8_t *data = &encoded.data[index * encoded.bytes];
+  // Components that are added get a change, even if they have the same value as before
+  bool added = is_new || !(old_presence & bit);
+  if (added || std::memcmp(data, scratch_.data(), encoded.bytes) != 0) {
+    std::memcpy(data, scratch_.data(), encoded.bytes);
+    encoded.changed[index] = tick_;
+    changed_[index] = tick_;
+  }
+}
+
+template<typename Location, typename ...Components>
+void Replicator<Location, Components...>::find_visible(Observer const &observer, std::vector<Handle> &visible) const {
+  std::vector<index_t> indexes;
+  Point const &center = observer.position;
+  float radius = observer.radius;
+  int32_t first_x = int32_t(std::floor((center.x - radius) / cell_size_));
+  int32_t last_x = int32_t(std::floor((center.x + radius) / cell_size_));
+  int32_t first_y = int32_t(std::floor((center.y - radius) / cell_size_));
+  int32_t last_y = int32_t(std::floor((center.y + radius) / cell_size_));
+  for (int32_t cx = first_x; cx <= last_x; ++cx) {
+    for (int32_t cy = first_y; cy <= last_y; ++cy) {
+      uint64_t key = uint64_t(uint32_t(cx)) << 32 | uint32_t(cy);
+      auto it = std::lower_bound(cells_.begin(), cells_.end(), std::make_pair(key, index_t(0)));
+      for (; it != cells_.end() && it->first == key; ++it) {
+        Point const &point = positions_[it->second];
+        float dx = point.x - center.x, dy = point.y - center.y, dz = point.z - center.z;
+        if (dx * dx + dy * dy + dz * dz <= radius * radius) indexes.push_back(it->second);
+      }
+    }
+  }
+  std::sort(indexes.begin(), indexes.end());
+  visible.clear();
+  visible.reserve(indexes.size());
+  for (index_t index : indexes) {
+    visible.push_back(Handle(Id(index, versions_[index])));
+  }
+}
+
+template<typename Location, typename ...Components>
+void Replicator<Location, Components...>::write(size_t observer, std::vector<uint8_t> &out) {
+  ECS_ASSERT(tick_ > 0, "update must be called before packets are written");
+  ObserverState &state = observers_[observer];
+  std::vector<Handle> visible;
+  find_visible(state.observer, visible);
+  // The client has applied the packet of the baseline, or any packet sent after it
+  std::vector<Handle> known = state.known, maybe = state.maybe, merged;
+  for (Sent const &sent : state.sent) {
+    merged.clear();
+    std::set_intersection(known.begin(), known.end(), sent.visible.begin(), sent.visible.end(),
+                          std::back_inserter(merged), by_index);
+    known.swap(merged);
+    merged.clear();
+    std::set_union(maybe.begin(), maybe.end(), sent.visible.begin(), sent.visible.end(),
+                   std::back_inserter(merged), by_index);
+    maybe.swap(merged);
+  }
+  std::vector<Handle> left, entered, kept;
+  std::set_difference(maybe.begin(), maybe.end(), visible.begin(), visible.end(), std::back_inserter(left), by_index);
+  std::set_difference(visible.begin(), visible.end(), known.begin(), known.end(),
+                      std::back_inserter(entered), by_index);
+  std::set_intersection(visible.begin(), visible.end(), known.begin(), known.end(),
+                        std::back_inserter(kept), by_index);
+  std::vector<Handle> changed;
+  for (Handle handle : kept) {
+    if (changed_[handle.index()] > state.baseline) changed.push_back(handle);
+  }
+
+  BitWriter writer(out);
+  writer.write_varint(tick_);
+  index_t previous = 0;
+  writer.write_varint(left.size());
+  for (Handle handle : left) {
+    details::write_handle(writer, handle, previous);
+  }
+  previous = 0;
+  writer.write_varint(entered.size());
+  for (Handle handle : entered) {
+    details::write_handle(writer, handle, previous);
+    uint32_t presence = presence_[handle.index()];
+    writer.write(presence, component_count);
+    write_components(writer, handle.index(), presence);
+  }
+  previous = 0;
+  writer.write_varint(changed.size());
+  for (Handle handle : changed) {
+    details::write_handle(writer, handle, previous);
+    uint32_t presence = presence_[handle.index()];
+    uint32_t mask = 0;
+    for (size_t c = 0; c < component_count; ++c) {
+      if ((presence & (uint32_t(1) << c)) && encoded_[c].changed[handle.index()] > state.baseline) {
+        mask |= uint32_t(1) << c;
+      }
+    }
+    writer.write(presence, component_count);
+    writer.write(mask, component_count);
+    write_components(writer, handle.index(), mask);
+  }
+  writer.flush();
+
+  Sent sent;
+  sent.tick = tick_;
+  sent.visible.swap(visible);
+  state.sent.push_back(std::move(sent));
+  // A client that does not acknowledge is treated as if it could have applied any of the oldest packets
+  if (state.sent.size() > ECS_REPLICATION_HISTORY) {
+    Sent const &oldest = state.sent.front();
+    merged.clear();
+    std::set_intersection(state.known.begin(), state.known.end(), oldest.visible.begin(), oldest.visible.end(),
+                          std::back_inserter(merged), by_index);
+    state.known.swap(merged);
+    merged.clear();
+    std::set_union(state.maybe.begin(), state.maybe.end(), oldest.visible.begin(), oldest.visible.end(),
+                   std::back_inserter(merged), by_index);
+    state.maybe.swap(merged);
+    state.sent.erase(state.sent.begin());
+  }
+}
+
+template<typename Location, typename ...Components>
+void Replicator<Location, Components...>::write_components(BitWriter &writer, index_t index, uint32_t mask) const {
+  for (size_t c = 0; c < component_count; ++c) {
+    if (mask & (uint32_t(1) << c)) {
+      Encoded const &encoded = encoded_[c];
+      writer.write_bits(&encoded.data[index * encoded.bytes], encoded.bits);
+    }
+  }
+}
+
+template<typename Location, typename ...Components>
+void Replicator<Location, Components...>::write_all(std::vector<std::vector<uint8_t>> &out, size_t threads) {
+  out.resize(std::max(out.size(), observers_.size()));
+  // Each observer only changes its own state, and is worth a thread of its own
+  details::reduce_t<Location>::run(observers_.size(), threads, [this, &out](size_t, size_t observer) {
+    write(observer, out[observer]);
+  }, 1);
+}
+
+template<typename Location, typename ...Components>
+void Replicator<Location, Components...>::acknowledge(size_t observer, uint64_t tick) {
+  ObserverState &state = observers_[observer];
+  auto acknowledged = std::find_if(state.sent.begin(), state.sent.end(), [tick](Sent const &sent) {
+    return sent.tick == tick;
+  });
+  if (acknowledged == state.sent.end()) return;
+  state.baseline = tick;
+  state.known = acknowledged->visible;
+  state.maybe = acknowledged->visible;
+  state.sent.erase(state.sent.begin(), acknowledged + 1);
+}
+
+template<typename ...Components>
+bool Replica<Components...>::read(void const *data, size_t size) {
+  BitReader reader(data, size);
+  uint64_t tick = reader.read_varint();
+  if (tick <= tick_ || reader.overflow()) return false;
+  tick_ = tick;
+  index_t previous = 0;
+  for (uint64_t left = reader.read_varint(); left > 0 && !reader.overflow(); --left) {
+    Handle remote = details::read_handle(reader, previous);
+    auto it = local_.find(remote);
+    if (it == local_.end()) continue;
+    if (entities_->is_valid(it->second)) (*entities_)[it->second].destroy();
+    local_.erase(it);
+  }
+  previous = 0;
+  for (uint64_t entered = reader.read_varint(); entered > 0 && !reader.overflow(); --entered) {
+    Handle remote = details::read_handle(reader, previous);
+    uint32_t presence = uint32_t(reader.read(component_count));
+    read_components(reader, remote, presence, presence);
+  }
+  previous = 0;
+  for (uint64_t changed = reader.read_varint(); changed > 0 && !reader.overflow(); --changed) {
+    Handle remote = details::read_handle(reader, previous);
+    uint32_t presence = uint32_t(reader.read(component_count));
+    uint32_t mask = uint32_t(reader.read(component_count));
+    read_components(reader, remote, presence, mask);
+  }
+  ECS_ASSERT(!reader.overflow(), "Packet is truncated");
+  return true;
+}
+
+template<typename ...Components>
+void Replica<Components...>::read_components(BitReader &reader, Handle remote, uint32_t presence, uint32_t mask) {
+  Handle &local = local_[remote];
+  if (local.is_null() || !entities_->is_valid(local)) {
+    Entity created = entities_->create();
+    local = created.handle();
+  }
+  Entity entity = (*entities_)[local];
+  int expand[] = {(read_component<Components>(reader, entity, presence, mask), 0)...};
+  (void) expand;
+}
+
+template<typename ...Components>
+template<typename C>
+void Replica<Components...>::read_component(BitReader &reader, Entity &entity, uint32_t presence, uint32_t mask) {
+  const uint32_t bit = uint32_t(1) << details::index_of<C, Components...>::value;
+  if (mask & bit) {
+    C component;
+    Replicate<C>::read(reader, component);
+    entity.set<C>(component);
+  } else if (!(presence & bit) && entity.has<C>()) {
+    entity.remove<C>();
+  }
+}
+
+template<typename ...Components>
+Entity Replica<Components...>::operator[](Handle remote) {
+  auto it = local_.find(remote);
+  return Entity(entities_, it == local_.end() ? Handle().id() : it->second.id());
+}
+
+} // namespace ecs
@@ -0,0 +1,77 @@
+#ifndef ECS_ROLLBACKBUFFER_H
+#define ECS_ROLLBACKBUFFER_H
+
+#include "Defines.h"
+
+namespace ecs{
+
+class EntityManager;
+
+///---------------------------------------------------------------------
+/// A RollbackBuffer keeps the state of an EntityManager for the last
+/// number of ticks, so that it can be rewound to any of them.
+///---------------------------------------------------------------------
+///
+/// Each recorded tick is a fork of the EntityManager (see
+/// EntityManager::fork). Component memory is shared between ticks, so
+/// a tick only holds its own copy of the chunks that were modified
+/// after it was recorded. Recording a tick when the buffer is full
+/// reuses the memory of the oldest tick.
+///
+/// @usage Record every tick, and when a correction arrives for an old
+///        tick, restore that tick and simulate forward again:
+///
+///        history.restore(tick);
+///        for (size_t t = tick + 1; t <= current_tick; ++t) {
+///          systems.update(dt);
+///          history.record(t);
+///        }
+///
+///---------------------------------------------------------------------
+class RollbackBuffer: details::forbid_copies {
+ public:
+  inline RollbackBuffer(EntityManager &entities, size_t capacity);
+  inline ~RollbackBuffer();
+
+  /// Store the current state of the EntityManager as tick. Ticks must
+  /// be recorded in increasing order.
+  inline void record(size_t tick);
+
+  /// Rewind the EntityManager to the state recorded at tick. Every
+  /// tick recorded after that is discarded.
+  inline void restore(size_t tick);
+
+  /// Check if the state of a tick is stored
+  inline bool contains(size_t tick) const;
+
+  /// Remove every recorded tick
+  inline void clear();
+
+  /// How many ticks that are stored / can be stored
+  inline size_t size() const { return size_; }
+  inline size_t capacity() const { return snapshots_.size(); }
+  inline bool empty() const { return size_ == 0; }
+
+  /// The oldest and newest tick that are stored. Buffer must not be empty
+  inline size_t oldest() const;
+  inline size_t newest() const;
+
+ private:
+  /// Position in the ring buffer of the i:th oldest tick
+  inline size_t position(size_t i) const { return (first_ + i) % snapshots_.size(); }
+
+  /// Position in the ring buffer where tick is stored, or size() if not stored
+  inline size_t find(size_t tick) const;
+
+  EntityManager                              *entities_;
+  std::vector<std::unique_ptr<EntityManager>> snapshots_;
+  std::vector<size_t>                         ticks_;
+  size_t                                      first_;
+  size_t                                      size_;
+};
+
+} // namespace ecs
+
+#include "RollbackBuffer.inl"
+
+#endif //ECS_ROLLBACKBUFFER_H
@@ -0,0 +1,81 @@
+#include "RollbackBuffer.h"
+#include "EntityManager.h"
+
+namespace ecs{
+
+RollbackBuffer::RollbackBuffer(EntityManager &entities, size_t capacity) :
+    entities_(&entities),
+    snapshots_(capacity),
+    ticks_(capacity, 0),
+    first_(0),
+    size_(0) {
+  ECS_ASSERT(capacity > 0, "RollbackBuffer must be able to store at least one tick");
+}
+
+RollbackBuffer::~RollbackBuffer() {
+  clear();
+}
+
+void RollbackBuffer::record(size_t tick) {
+  ECS_ASSERT((empty() || tick > newest()), "Ticks must be recorded in increasing order");
+  size_t pos;
+  if (size_ < capacity()) {
+    pos = position(size_++);
+  } else {
+    // Reuse the oldest tick
+    pos = first_;
+    first_ = position(1);
+  }
+  if (snapshots_[pos]) {
+    snapshots_[pos]->share_state(*entities_);
+  } else {
+    snapshots_[pos] = entities_->fork();
+  }
+  ticks_[pos] = tick;
+}
+
+void RollbackBuffer::restore(size_t tick) {
+  size_t i = find(tick);
+  ECS_ASSERT(i < size_, "Tick is not stored in RollbackBuffer");
+  entities_->share_state(*snapshots_[position(i)]);
+  // Newer ticks are discarded. Their memory is released first when
+  // reused by record, to keep restore fast.
+  size_ = i + 1;
+}
+
+bool RollbackBuffer::contains(size_t tick) const {
+  return find(tick) < size_;
+}
+
+void RollbackBuffer::clear() {
+  for (auto &snapshot : snapshots_) {
+    if (snapshot) snapshot->clear_entities();
+  }
+  first_ = 0;
+  size_ = 0;
+}
+
+size_t RollbackBuffer::oldest() const {
+  ECS_ASSERT(!empty(), "RollbackBuffer is empty");
+  return ticks_[position(0)];
+}
+
+size_t RollbackBuffer::newest() const {
+  ECS_ASSERT(!empty(), "RollbackBuffer is empty");
+  return ticks_[position(size_ - 1)];
+}
+
+size_t RollbackBuffer::find(size_t tick) const {
+  // Ticks are increasing, so a binary search is possible
+  size_t low = 0, high = size_;
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    size_t mid_tick = ticks_[position(mid)];
+    if (mid_tick == tick) return mid;
+    if (mid_tick < tick) low = mid + 1;
+    else high = mid;
+  }
+  return size_;
+}
+
+} // namespace ecs
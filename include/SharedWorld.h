@@ -0,0 +1,184 @@
+#ifndef ECS_SHAREDWORLD_H
+#define ECS_SHAREDWORLD_H
+
+#include "EntityManager.h"
+#include "Columns.h"
+
+/// Shared memory needs POSIX shm_open and mmap. Define
+/// ECS_NO_SHARED_MEMORY to leave SharedWorld out.
+#if !defined(ECS_NO_SHARED_MEMORY) && (defined(__unix__) || defined(__APPLE__))
+#define ECS_SHARED_MEMORY
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef ECS_SHARED_MEMORY
+
+namespace ecs{
+
+namespace details{
+
+///---------------------------------------------------------------------
+/// The layout of a shared memory segment of a SharedWorld
+///---------------------------------------------------------------------
+///
+/// A SharedHeader is followed by two slots of slot_size bytes, that
+/// each start at a multiple of columns_alignment. A slot holds exported
+/// columns. The sequence of a slot is odd while the slot is written, and
+/// latest is 1 + the slot that was published last, or 0 before the
+/// first snapshot is published.
+///---------------------------------------------------------------------
+struct SharedSlot {
+  std::atomic<uint64_t> sequence;
+  std::atomic<uint64_t> epoch;
+  std::atomic<uint64_t> size;
+};
+
+struct SharedHeader {
+  char magic[8];
+  uint64_t slot_size;
+  std::atomic<uint64_t> latest;
+  SharedSlot slots[2];
+};
+
+static const char shared_magic[8] = {'E', 'C', 'S', 'S', 'H', 'M', '0', '1'};
+
+/// Where slot starts, from the start of the segment
+inline uint64_t shared_slot_offset(uint64_t slot_size, size_t slot) {
+  return align_column(sizeof(SharedHeader)) + slot * slot_size;
+}
+
+/// A stream buffer that writes to memory of a fixed size, and fails
+/// when it is full
+class FixedBuffer: public std::streambuf {
+ public:
+  inline FixedBuffer(char *data, size_t size) { setp(data, data + size); }
+  inline size_t size() const { return size_t(pptr() - pbase()); }
+};
+
+} // namespace details
+
+///---------------------------------------------------------------------
+/// SharedWorld publishes snapshots of components to a POSIX shared
+/// memory segment, that other processes can read with a
+/// SharedWorldReader
+///---------------------------------------------------------------------
+///
+/// Each snapshot is written as columns by EntityManager::export_columns,
+/// so the component pools and which components each entity has can be
+/// read without knowing anything about the EntityManager.
+///
+/// The segment has two slots, that snapshots are written to in turn. A
+/// snapshot is written to the slot that was not published last, and the
+/// sequence of the slot is odd while it is written, like a seqlock.
+/// Readers check the sequence before and after they copy a slot, and
+/// try again if it changed, so the writer never waits for a reader.
+/// Components must be trivially copyable.
+///
+/// The segment is removed when the SharedWorld is destroyed. Readers
+/// that have attached keep their mapping.
+///
+/// @usage SharedWorld shared("/world", 64 * 1024 * 1024);
+///        ...
+///        shared.publish<Position, Health>(entities, tick);
+///---------------------------------------------------------------------
+class SharedWorld: details::forbid_copies {
+ public:
+  /// Create the segment called name, or replace it if it exists, with
+  /// room for snapshots of slot_size bytes. Check is_open to see if it
+  /// could be created
+  inline SharedWorld(std::string const &name, size_t slot_size);
+  inline ~SharedWorld();
+
+  /// False if the segment could not be created. Nothing is published then
+  inline bool is_open() const { return data_ != nullptr; }
+
+  /// Write Components of every entity that has any of them as the next
+  /// snapshot, tagged with epoch. Returns false, and keeps the snapshot
+  /// published before, if it does not fit in a slot, or if the segment
+  /// is not open.
+  template<typename ...Components>
+  inline bool publish(EntityManager const &entities, uint64_t epoch);
+
+  /// Write Components of every entity within view that has any of them
+  template<typename ...Components, typename T>
+  inline bool publish(EntityManager const &entities, View<T> const &view, uint64_t epoch);
+
+  inline std::string const &name() const { return name_; }
+  inline size_t slot_size() const { return slot_size_; }
+
+ private:
+  /// Write a snapshot to the slot that is not published, with write(out)
+  template<typename Write>
+  inline bool publish_with(uint64_t epoch, Write write);
+
+  inline details::SharedHeader &header() { return *static_cast<details::SharedHeader *>(data_); }
+
+  std::string name_;
+  size_t slot_size_;
+  size_t size_;
+  void *data_;
+};
+
+///---------------------------------------------------------------------
+/// SharedWorldReader attaches to the segment of a SharedWorld, read
+/// only, and copies consistent snapshots from it
+///---------------------------------------------------------------------
+///
+/// read copies the latest snapshot into memory of the reader, which
+/// columns() then reads. The writer may publish while a snapshot is
+/// copied, in which case the copy is made again, up to
+/// ECS_SHARED_WORLD_RETRIES times.
+///
+/// @usage SharedWorldReader reader("/world");
+///        if (reader.is_open() && reader.read()) {
+///          ecs::Columns const &columns = reader.columns();
+///          Health const *health = columns.values<Health>(1);
+///          ...
+///        }
+///---------------------------------------------------------------------
+class SharedWorldReader: details::forbid_copies {
+ public:
+  /// Attach to the segment called name. is_open() is false if there is no
+  /// such segment, or if it is not made by a SharedWorld
+  inline SharedWorldReader(std::string const &name);
+  inline ~SharedWorldReader();
+
+  inline bool is_open() const { return data_ != nullptr; }
+
+  /// Copy the latest snapshot. Returns false, and keeps the snapshot read
+  /// before, if nothing is published yet, or if the writer overwrote the
+  /// snapshot every time it was copied.
+  inline bool read();
+
+  /// True once a snapshot is read
+  inline bool has_snapshot() const { return columns_.get() != nullptr; }
+
+  /// The epoch of the snapshot that was read last
+  inline uint64_t epoch() const { return epoch_; }
+
+  /// The snapshot that was read last. Only valid if has_snapshot()
+  inline Columns const &columns() const { return *columns_; }
+
+ private:
+  inline details::SharedHeader const &header() const {
+    return *static_cast<details::SharedHeader const *>(data_);
+  }
+
+  size_t size_;
+  void *data_;
+  uint64_t epoch_;
+  /// Of uint64_t, so that the copy is aligned like Columns wants it
+  std::vector<uint64_t> buffer_;
+  std::unique_ptr<Columns> columns_;
+};
+
+} // namespace ecs
+
+#include "SharedWorld.inl"
+
+#endif // ECS_SHARED_MEMORY
+
+#endif //ECS_SHAREDWORLD_H
@@ -0,0 +1,134 @@
+namespace ecs{
+
+SharedWorld::SharedWorld(std::string const &name, size_t slot_size) :
+    name_(name),
+    slot_size_(size_t(details::align_column(slot_size))),
+    size_(size_t(details::shared_slot_offset(slot_size_, 2))),
+    data_(nullptr) {
+  // A segment left by a writer that did not exit cleanly is replaced
+  shm_unlink(name_.c_str());
+  // Failing to create the segment is reported by is_open
+  int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) return;
+  bool sized = ftruncate(fd, off_t(size_)) == 0;
+  if (sized) {
+    data_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (!sized || data_ == MAP_FAILED) {
+    data_ = nullptr;
+    shm_unlink(name_.c_str());
+  }
+  if (!is_open()) return;
+  details::SharedHeader &shared = header();
+  std::memcpy(shared.magic, details::shared_magic, sizeof(shared.magic));
+  shared.slot_size = slot_size_;
+  shared.latest.store(0, std::memory_order_relaxed);
+  for (details::SharedSlot &slot : shared.slots) {
+    slot.sequence.store(0, std::memory_order_relaxed);
+    slot.epoch.store(0, std::memory_order_relaxed);
+    slot.size.store(0, std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+SharedWorld::~SharedWorld() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+    shm_unlink(name_.c_str());
+  }
+}
+
+template<typename ...Components>
+bool SharedWorld::publish(EntityManager const &entities, uint64_t epoch) {
+  return publish_with(epoch, [&entities](std::ostream &out) {
+    entities.export_columns<Components...>(out);
+  });
+}
+
+template<typename ...Components, typename T>
+bool SharedWorld::publish(EntityManager const &entities, View<T> const &view, uint64_t epoch) {
+  return publish_with(epoch, [&entities, &view](std::ostream &out) {
+    entities.export_columns<Components...>(out, view);
+  });
+}
+
+template<typename Write>
+bool SharedWorld::publish_with(uint64_t epoch, Write write) {
+  if (!is_open()) return false;
+  details::SharedHeader &shared = header();
+  // There is only one writer, so latest is what this SharedWorld stored last
+  uint64_t latest = shared.latest.load(std::memory_order_relaxed);
+  size_t target = latest == 1 ? 1 : 0;
+  details::SharedSlot &slot = shared.slots[target];
+  uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+  slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  char *data = static_cast<char *>(data_) + details::shared_slot_offset(slot_size_, target);
+  details::FixedBuffer buffer(data, slot_size_);
+  std::ostream out(&buffer);
+  write(out);
+  bool fits = bool(out);
+  slot.size.store(fits ? buffer.size() : 0, std::memory_order_relaxed);
+  slot.epoch.store(epoch, std::memory_order_relaxed);
+  slot.sequence.store(sequence + 2, std::memory_order_release);
+  if (fits) {
+    shared.latest.store(target + 1, std::memory_order_release);
+  }
+  return fits;
+}
+
+SharedWorldReader::SharedWorldReader(std::string const &name) : size_(0), data_(nullptr), epoch_(0) {
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) return;
+  struct stat status;
+  if (fstat(fd, &status) == 0 && size_t(status.st_size) >= sizeof(details::SharedHeader)) {
+    size_ = size_t(status.st_size);
+    data_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (data_ == MAP_FAILED) data_ = nullptr;
+  }
+  close(fd);
+  if (data_ == nullptr) return;
+  details::SharedHeader const &shared = header();
+  if (std::memcmp(shared.magic, details::shared_magic, sizeof(shared.magic)) != 0 ||
+      details::shared_slot_offset(shared.slot_size, 2) > size_) {
+    munmap(data_, size_);
+    data_ = nullptr;
+  }
+}
+
+SharedWorldReader::~SharedWorldReader() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+  }
+}
+
+bool SharedWorldReader::read() {
+  if (data_ == nullptr) return false;
+  details::SharedHeader const &shared = header();
+  std::vector<uint64_t> copy;
+  for (size_t attempt = 0; attempt < ECS_SHARED_WORLD_RETRIES; ++attempt) {
+    uint64_t latest = shared.latest.load(std::memory_order_acquire);
+    if (latest == 0) return false;
+    size_t target = size_t(latest - 1) & 1;
+    details::SharedSlot const &slot = shared.slots[target];
+    uint64_t before = slot.sequence.load(std::memory_order_acquire);
+    if (before & 1) continue;
+    uint64_t size = slot.size.load(std::memory_order_relaxed);
+    uint64_t epoch = slot.epoch.load(std::memory_order_relaxed);
+    if (size < sizeof(details::ColumnsHeader) || size > shared.slot_size) continue;
+    copy.resize(size_t((size + sizeof(uint64_t) - 1) / sizeof(uint64_t)));
+    char const *data = static_cast<char const *>(data_) + details::shared_slot_offset(shared.slot_size, target);
+    std::memcpy(copy.data(), data, size_t(size));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != before) continue;
+    buffer_.swap(copy);
+    epoch_ = epoch;
+    columns_.reset(new Columns(buffer_.data(), size_t(size)));
+    return true;
+  }
+  return false;
+}
+
+} // namespace ecs
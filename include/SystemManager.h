@@ -5,11 +5,22 @@
 #ifndef OPENECS_SYSTEM_MANAGER_H
 #define OPENECS_SYSTEM_MANAGER_H
 
+#include "Metrics.h"
+
 namespace ecs {
 
 class EntityManager;
 class System;
 
+/// The phases of SystemManager::update. Every system in a phase is
+/// updated before any system in the next phase.
+enum class Phase {
+  PreUpdate,
+  FixedUpdate,
+  Update,
+  PostUpdate
+};
+
 ///---------------------------------------------------------------------
 /// A SystemManager is responsible for managing Systems.
 ///---------------------------------------------------------------------
@@ -19,15 +30,23 @@ class System;
 /// Each system can access the EntityManager and perform operations
 /// on the entities.
 ///
+/// Systems are updated in phases. Systems in Phase::FixedUpdate can
+/// be updated with a fixed time step. A system can also be updated
+/// only every nth update, to spread out the work of systems that
+/// don't need to run every update.
+///
+/// Each update is counted and timed, together with each system, in
+/// metrics(), which can be written for Prometheus.
+///
 ///---------------------------------------------------------------------
 class SystemManager: details::forbid_copies {
  public:
 
-  inline SystemManager(EntityManager &entities) : entities_(&entities) { }
+  inline SystemManager(EntityManager &entities) : entities_(&entities), metrics_(entities) { }
 
   inline ~SystemManager();
 
-  /// Adds a System to this SystemManager.
+  /// Adds a System to this SystemManager. It is updated in Phase::Update
   template<typename S, typename ...Args>
   inline S &add(Args &&... args);
 
@@ -35,17 +54,73 @@ class SystemManager: details::forbid_copies {
   template<typename S>
   inline void remove();
 
-  /// Update all attached systems. They are updated in the order they are added
+  /// Update all attached systems. They are updated phase by phase, in the
+  /// order they are added. Expired entities are destroyed first. Then double
+  /// buffered components and event channels are swapped, so that every system
+  /// reads the previous values, and the events emitted, from the last update.
   inline void update(float time);
 
   /// Check if a system is attached.
   template<typename S>
   inline bool exists();
 
+  /// Set in which phase a system is updated
+  template<typename S>
+  inline void set_phase(Phase phase);
+
+  /// Update a system only every nth update of its phase. The system gets
+  /// the time passed since it was last updated. Systems in the same phase
+  /// are staggered, so that as few as possible are updated at the same
+  /// time. The system is staggered again when its phase is set.
+  template<typename S>
+  inline void set_rate_divisor(size_t divisor);
+
+  /// Update systems in Phase::FixedUpdate with a fixed time step. They are
+  /// updated as many times as the passed time allows, but at most max_steps
+  /// times per update. Time left after max_steps is dropped. A time step of
+  /// 0 updates them once per update, with the passed time.
+  inline void set_fixed_time_step(float time_step, size_t max_steps = 8);
+
+  /// How far into the next fixed time step the simulation is, between 0 and 1.
+  /// Can be used to interpolate between fixed updates.
+  inline float fixed_time_alpha() const;
+
+  /// The metrics of the systems, and of the EntityManager
+  inline Metrics &metrics() { return metrics_; }
+  inline Metrics const &metrics() const { return metrics_; }
+
  private:
+  struct Schedule {
+    Phase phase = Phase::Update;
+    size_t divisor = 1;
+    size_t offset = 0;
+    /// Time passed since the system was last updated
+    float time = 0;
+  };
+
+  /// Update every system in a phase, that should be updated this time
+  inline void update_phase(Phase phase, float time);
+
+  template<typename S>
+  inline Schedule &schedule();
+
+  /// Choose the offset of a system, among the systems in its phase
+  inline void stagger(size_t index);
+
+  static inline double seconds_since(std::chrono::steady_clock::time_point start);
+
   std::vector<System *> systems_;
+  std::vector<Schedule> schedules_;
   std::vector<size_t> order_;
   EntityManager *entities_;
+  Metrics metrics_;
+
+  /// How many times each phase has been updated
+  size_t phase_updates_[4] = {0, 0, 0, 0};
+  float fixed_time_step_ = 0;
+  size_t max_fixed_steps_ = 8;
+  /// Time passed that is not yet used by a fixed time step
+  float fixed_time_ = 0;
 
   friend class System;
 };
@@ -15,9 +15,11 @@ S& SystemManager::add(Args &&... args) {
   ECS_ASSERT_IS_SYSTEM(S);
   ECS_ASSERT(!exists<S>(), "System already exists");
   systems_.resize(details::system_index<S>() + 1);
+  schedules_.resize(systems_.size());
   S *system = new S(std::forward<Args>(args) ...);
   system->manager_ = this;
   systems_[details::system_index<S>()] = system;
+  schedules_[details::system_index<S>()] = Schedule();
   order_.push_back(details::system_index<S>());
   return *system;
 }
@@ -37,8 +39,44 @@ void SystemManager::remove() {
 }
 
 void SystemManager::update(float time) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  size_t expired = entities_->update_expiry(time);
+  entities_->swap_buffers();
+  entities_->swap_events();
+  metrics_.record_events();
+  update_phase(Phase::PreUpdate, time);
+  if (fixed_time_step_ > 0) {
+    fixed_time_ += time;
+    size_t steps = 0;
+    for (; fixed_time_ >= fixed_time_step_ && steps < max_fixed_steps_; ++steps) {
+      update_phase(Phase::FixedUpdate, fixed_time_step_);
+      fixed_time_ -= fixed_time_step_;
+    }
+    // Catching up is capped, to not fall further behind when steps are too slow
+    if (fixed_time_ >= fixed_time_step_) {
+      fixed_time_ = std::fmod(fixed_time_, fixed_time_step_);
+    }
+  } else {
+    update_phase(Phase::FixedUpdate, time);
+  }
+  update_phase(Phase::Update, time);
+  update_phase(Phase::PostUpdate, time);
+  metrics_.record_update(seconds_since(start), expired);
+}
+
+void SystemManager::update_phase(Phase phase, float time) {
+  size_t updates = phase_updates_[static_cast<size_t>(phase)]++;
   for (auto index : order_) {
-    systems_[index]->update(time);
+    Schedule &schedule = schedules_[index];
+    if (schedule.phase != phase) continue;
+    schedule.time += time;
+    if ((updates + schedule.offset) % schedule.divisor == 0) {
+      float passed = schedule.time;
+      schedule.time = 0;
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      systems_[index]->update(passed);
+      metrics_.record_system(index, seconds_since(start));
+    }
   }
 }
 
@@ -48,4 +86,64 @@ inline bool SystemManager::exists() {
   return systems_.size() > details::system_index<S>() && systems_[details::system_index<S>()] != nullptr;
 }
 
+template<typename S>
+void SystemManager::set_phase(Phase phase) {
+  schedule<S>().phase = phase;
+  stagger(details::system_index<S>());
+}
+
+template<typename S>
+void SystemManager::set_rate_divisor(size_t divisor) {
+  ECS_ASSERT(divisor > 0, "Rate divisor must be at least 1");
+  schedule<S>().divisor = divisor;
+  stagger(details::system_index<S>());
+}
+
+void SystemManager::stagger(size_t index) {
+  Schedule &schedule = schedules_[index];
+  // Use the first offset where the system is updated together with the fewest other systems in its phase
+  size_t best_offset = 0;
+  size_t best_shared = std::numeric_limits<size_t>::max();
+  for (size_t offset = 0; offset < schedule.divisor; ++offset) {
+    size_t shared = 0;
+    for (auto other_index : order_) {
+      Schedule const &other = schedules_[other_index];
+      // Systems that are updated every time are shared by every offset
+      if (other_index == index || other.phase != schedule.phase || other.divisor == 1) continue;
+      // The updates of the system repeat with respect to the other system after other.divisor of them
+      for (size_t n = 1; n <= other.divisor; ++n) {
+        size_t update = n * schedule.divisor - offset;
+        if ((update + other.offset) % other.divisor == 0) ++shared;
+      }
+    }
+    if (shared < best_shared) {
+      best_offset = offset;
+      best_shared = shared;
+    }
+  }
+  schedule.offset = best_offset;
+}
+
+void SystemManager::set_fixed_time_step(float time_step, size_t max_steps) {
+  ECS_ASSERT(time_step >= 0, "Fixed time step can't be negative");
+  ECS_ASSERT(max_steps > 0, "At least one fixed step must be allowed per update");
+  fixed_time_step_ = time_step;
+  max_fixed_steps_ = max_steps;
+  fixed_time_ = 0;
+}
+
+float SystemManager::fixed_time_alpha() const {
+  return fixed_time_step_ > 0 ? fixed_time_ / fixed_time_step_ : 0;
+}
+
+double SystemManager::seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template<typename S>
+SystemManager::Schedule &SystemManager::schedule() {
+  ECS_ASSERT(exists<S>(), "System does not exist");
+  return schedules_[details::system_index<S>()];
+}
+
 } // namespace ecs
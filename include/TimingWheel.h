@@ -0,0 +1,72 @@
+#ifndef ECS_TIMINGWHEEL_H
+#define ECS_TIMINGWHEEL_H
+
+#include "Id.h"
+
+namespace ecs{
+
+namespace details{
+
+///---------------------------------------------------------------------
+/// A TimingWheel keeps track of when entities are due
+///---------------------------------------------------------------------
+///
+/// Time is counted in ticks. The wheel has several levels of slots,
+/// where each level covers a range of ticks that is slot_count times
+/// larger than the level below. An entity is placed in the level that
+/// covers when it is due, and is moved down to a lower level as time
+/// passes. This way advancing one tick only touches the entities that
+/// are due, and every slot_count:th tick the entities of one slot in
+/// the level above.
+///
+///---------------------------------------------------------------------
+class TimingWheel {
+ public:
+  struct Entry {
+    Id id;
+    uint64_t due;
+  };
+
+  inline TimingWheel() : now_(0), size_(0) { }
+
+  /// The current tick
+  inline uint64_t now() const { return now_; }
+
+  /// Number of entries that are not due yet
+  inline size_t size() const { return size_; }
+
+  /// Add an entry that is due a number of ticks from now, at least 1
+  inline void insert(Id id, uint64_t ticks);
+
+  /// Advance one tick, and call lambda for every entry that is due
+  template<typename Lambda>
+  inline void advance(Lambda lambda);
+
+  /// Remove all entries
+  inline void clear();
+
+  static const size_t slot_bits = 8;
+  static const size_t slot_count = size_t(1) << slot_bits;
+  static const size_t levels = 4;
+
+ private:
+  inline void insert(Entry const &entry);
+
+  /// Move the entries in the current slot of a level to lower levels
+  inline void cascade(size_t level);
+
+  inline std::vector<Entry> &slot(size_t level, uint64_t tick);
+
+  uint64_t now_;
+  size_t size_;
+  /// Allocated first when needed
+  std::vector<std::vector<Entry>> slots_;
+};
+
+} // namespace details
+
+} // namespace ecs
+
+#include "TimingWheel.inl"
+
+#endif //ECS_TIMINGWHEEL_H
@@ -0,0 +1,62 @@
+namespace ecs{
+
+namespace details{
+
+void TimingWheel::insert(Id id, uint64_t ticks) {
+  ECS_ASSERT(ticks > 0, "Entry must be due in the future");
+  ECS_ASSERT(ticks < (uint64_t(1) << (slot_bits * levels)), "Entry is due too far in the future");
+  Entry entry = {id, now_ + ticks};
+  insert(entry);
+  ++size_;
+}
+
+template<typename Lambda>
+void TimingWheel::advance(Lambda lambda) {
+  ++now_;
+  if (size_ == 0) return;
+  // Each level is cascaded when the level below has gone through all its slots
+  size_t level = 1;
+  while (level < levels && (now_ & ((uint64_t(1) << (slot_bits * level)) - 1)) == 0) {
+    ++level;
+  }
+  for (size_t i = level - 1; i > 0; --i) {
+    cascade(i);
+  }
+  std::vector<Entry> due;
+  due.swap(slot(0, now_));
+  size_ -= due.size();
+  for (Entry const &entry : due) {
+    lambda(entry);
+  }
+}
+
+void TimingWheel::clear() {
+  slots_.clear();
+  size_ = 0;
+}
+
+void TimingWheel::insert(Entry const &entry) {
+  uint64_t ticks = entry.due - now_;
+  size_t level = 0;
+  while (level + 1 < levels && ticks >= (uint64_t(1) << (slot_bits * (level + 1)))) {
+    ++level;
+  }
+  slot(level, entry.due).push_back(entry);
+}
+
+void TimingWheel::cascade(size_t level) {
+  std::vector<Entry> entries;
+  entries.swap(slot(level, now_));
+  for (Entry const &entry : entries) {
+    insert(entry);
+  }
+}
+
+std::vector<TimingWheel::Entry> &TimingWheel::slot(size_t level, uint64_t tick) {
+  if (slots_.empty()) slots_.resize(levels * slot_count);
+  return slots_[level * slot_count + ((tick >> (slot_bits * level)) & (slot_count - 1))];
+}
+
+} // namespace details
+
+} // namespace ecs
@@ -221,6 +221,7 @@ void UnallocatedEntity::allocate() {
         componentManager.ensure_min_size(index);
         //Copy data from tmp location to acctuial location in component manager
         std::memcpy(componentManager.get_void_ptr(index), &component_data[offset], componentHeader.size);
+        componentManager.aggregate_added(index);
         offset+=componentHeader.size;
       }
     }
@@ -6,10 +6,15 @@
 /// nice helper functions
 ///--------------------------------------------------------------------
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
 namespace ecs{
 
 /// Forward declarations
 class Entity;
+class Handle;
 
 namespace details{
 
@@ -68,6 +73,19 @@ template<typename T, typename Tail, typename... Ts>
 struct is_type<T, Tail, Ts...>: is_type<T, Ts...>::type { };
 
 
+///---------------------------------------------------------------------
+/// Determine the position of a type within a list of types
+///---------------------------------------------------------------------
+template<typename T, typename... Ts>
+struct index_of;
+
+template<typename T, typename... Ts>
+struct index_of<T, T, Ts...>: std::integral_constant<size_t, 0> { };
+
+template<typename T, typename Head, typename... Ts>
+struct index_of<T, Head, Ts...>: std::integral_constant<size_t, 1 + index_of<T, Ts...>::value> { };
+
+
 ///---------------------------------------------------------------------
 /// Check if a class has implemented operator()
 ///
@@ -101,54 +119,90 @@ class forbid_copies {
 ///--------------------------------------------------------------------
 /// Helper functions
 ///--------------------------------------------------------------------
+///
+/// Component, system and event indexes are shared by every EntityManager and
+/// SystemManager in the process. Each index is assigned the first time
+/// a type is used. Function local statics are initialized thread-safe,
+/// and the counters are atomic, so different threads can register types
+/// at the same time.
+///--------------------------------------------------------------------
 
-inline size_t &component_counter() {
-  static size_t counter = 0;
+inline std::atomic<size_t> &component_counter() {
+  static std::atomic<size_t> counter(0);
   return counter;
 }
 
 inline size_t inc_component_counter()  {
-  size_t index = component_counter()++;
+  size_t index = component_counter().fetch_add(1);
   ECS_ASSERT(index < ECS_MAX_NUM_OF_COMPONENTS, "maximum number of components exceeded.");
   return index;
 }
 
 template<typename C>
 size_t component_index() {
-  static size_t index = inc_component_counter();
+  static const size_t index = inc_component_counter();
   return index;
 }
 
-inline size_t &system_counter() {
-  static size_t counter = 0;
+inline std::atomic<size_t> &system_counter() {
+  static std::atomic<size_t> counter(0);
   return counter;
 }
 
 template<typename C>
 size_t system_index() {
-  static size_t index = system_counter()++;
+  static const size_t index = system_counter().fetch_add(1);
+  return index;
+}
+
+inline std::atomic<size_t> &event_counter() {
+  static std::atomic<size_t> counter(0);
+  return counter;
+}
+
+template<typename E>
+size_t event_index() {
+  static const size_t index = event_counter().fetch_add(1);
   return index;
 }
 
+/// Hint that memory will soon be read, so that it can be loaded into the cache
+inline void prefetch(void const *ptr) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(ptr);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  _mm_prefetch(static_cast<char const *>(ptr), _MM_HINT_T0);
+#else
+  (void) ptr;
+#endif
+}
+
+///---------------------------------------------------------------------
+/// Determine if a lambda argument identifies the entity, instead of
+/// being one of its components
+///---------------------------------------------------------------------
+template<typename T>
+struct is_entity_arg: std::integral_constant<bool, std::is_same<T, Entity>::value ||
+                                                   std::is_same<T, Handle>::value> { };
+
 //C1 should not be Entity
 template<typename C>
 inline auto component_mask() -> typename
-std::enable_if<!std::is_same<C, Entity>::value, ComponentMask>::type {
+std::enable_if<!is_entity_arg<C>::value, ComponentMask>::type {
   ComponentMask mask = ComponentMask((1UL << component_index<C>()));
   return mask;
 }
 
-//When C1 is Entity, ignore
+//When C1 is Entity or Handle, ignore
 template<typename C>
 inline auto component_mask() -> typename
-std::enable_if<std::is_same<C, Entity>::value, ComponentMask>::type {
+std::enable_if<is_entity_arg<C>::value, ComponentMask>::type {
   return ComponentMask(0);
 }
 
 //recursive function for component_mask creation
 template<typename C1, typename C2, typename ...Cs>
-inline auto component_mask() -> typename
-std::enable_if<!std::is_same<C1, Entity>::value, ComponentMask>::type {
+inline ComponentMask component_mask() {
   ComponentMask mask = component_mask<C1>() | component_mask<C2, Cs...>();
   return mask;
 }
@@ -10,6 +10,10 @@ namespace ecs{
 ///        that can be used to access the iterator with begin() and
 ///        end() that iterates through all entities with specified
 ///        Components
+///
+///        A View can be limited to a range of entity indexes, and be
+///        split into several Views, or iterated block by block, to
+///        divide the work between threads.
 ///---------------------------------------------------------------------
 template<typename T>
 class View {
@@ -18,7 +22,9 @@ class View {
   using iterator        = Iterator<T>;
   using const_iterator = Iterator<T const &>;
 
-  View(EntityManager *manager, details::ComponentMask mask);
+  /// A View of the entities with an index within [first, last)
+  View(EntityManager *manager, details::ComponentMask mask,
+       index_t first = 0, index_t last = std::numeric_limits<index_t>::max());
 
   iterator begin();
   iterator end();
@@ -28,9 +34,27 @@ class View {
   template<typename ...Components>
   View<T>&& with();
 
+  /// The blocks of entities within this View. The iterators can be
+  /// moved by any number of blocks at once
+  BlockRange<T> blocks() const;
+
+  /// Split this View into n Views that together cover it. Each View has
+  /// about the same number of entities, and starts and ends at the border
+  /// of a block. Some Views may be empty, if there are few entities.
+  std::vector<View<T>> split(size_t n) const;
+
+  /// The range of entity indexes this View covers
+  index_t first() const { return first_; }
+  index_t last() const { return last_; }
+
  private:
+  /// The end of the range, limited to the entities that exists
+  index_t end_index() const;
+
   EntityManager         *manager_;
   details::ComponentMask mask_;
+  index_t                first_;
+  index_t                last_;
 
   friend class EntityManager;
 }; //View
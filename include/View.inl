@@ -3,29 +3,31 @@
 namespace ecs{
 
 template<typename T>
-View<T>::View(EntityManager *manager, details::ComponentMask mask)  :
+View<T>::View(EntityManager *manager, details::ComponentMask mask, index_t first, index_t last)  :
     manager_(manager),
-    mask_(mask) { }
+    mask_(mask),
+    first_(first),
+    last_(last) { }
 
 
 template<typename T>
 typename View<T>::iterator View<T>::begin() {
-  return iterator(manager_, mask_, true);
+  return iterator(manager_, mask_, true, first_, last_);
 }
 
 template<typename T>
 typename View<T>::iterator View<T>::end() {
-  return iterator(manager_, mask_, false);
+  return iterator(manager_, mask_, false, first_, last_);
 }
 
 template<typename T>
 typename View<T>::const_iterator View<T>::begin() const {
-  return const_iterator(manager_, mask_, true);
+  return const_iterator(manager_, mask_, true, first_, last_);
 }
 
 template<typename T>
 typename View<T>::const_iterator View<T>::end() const {
-  return const_iterator(manager_, mask_, false);
+  return const_iterator(manager_, mask_, false, first_, last_);
 }
 
 template<typename T>
@@ -43,4 +45,52 @@ View<T>&& View<T>::with() {
   return *this;
 }
 
+template<typename T>
+BlockRange<T> View<T>::blocks() const {
+  index_t end = end_index();
+  index_t begin = std::min(first_, end);
+  index_t first_block = begin / ECS_CACHE_LINE_SIZE;
+  index_t end_block = begin == end ? first_block : (end + ECS_CACHE_LINE_SIZE - 1) / ECS_CACHE_LINE_SIZE;
+  return BlockRange<T>(BlockIterator<T>(manager_, mask_, begin, end, first_block),
+                       BlockIterator<T>(manager_, mask_, begin, end, end_block));
+}
+
+template<typename T>
+std::vector<View<T>> View<T>::split(size_t n) const {
+  ECS_ASSERT(n > 0, "A View must be split into at least 1 View");
+  index_t end = end_index();
+  index_t begin = std::min(first_, end);
+  // Count the entities within each block
+  std::vector<size_t> block_counts;
+  size_t total = 0;
+  for (index_t block_begin = begin; block_begin < end;) {
+    index_t block_end = std::min<index_t>(end, (block_begin / ECS_CACHE_LINE_SIZE + 1) * ECS_CACHE_LINE_SIZE);
+    size_t count = details::count_matches(&manager_->component_masks_[block_begin], block_end - block_begin, mask_);
+    block_counts.push_back(count);
+    total += count;
+    block_begin = block_end;
+  }
+  std::vector<View<T>> views;
+  views.reserve(n);
+  index_t cut = first_;
+  size_t block = 0;
+  size_t counted = 0;
+  for (size_t i = 1; i < n; ++i) {
+    index_t view_first = cut;
+    while (block < block_counts.size() && counted < total * i / n) {
+      counted += block_counts[block++];
+      cut = std::min<index_t>(end, (cut / ECS_CACHE_LINE_SIZE + 1) * ECS_CACHE_LINE_SIZE);
+    }
+    views.push_back(View<T>(manager_, mask_, view_first, cut));
+  }
+  // The last View covers the rest, including entities created after the split
+  views.push_back(View<T>(manager_, mask_, cut, last_));
+  return views;
+}
+
+template<typename T>
+index_t View<T>::end_index() const {
+  return index_t(std::min<size_t>(last_, manager_->entity_versions_.size()));
+}
+
 } // namespace ecs
\ No newline at end of file
@@ -22,10 +22,26 @@
 #include <bitset>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <string>
 #include <functional>
 #include <cassert>
 #include <iostream>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <cstddef>
+#include <cmath>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <tuple>
+#include <iterator>
+#include <thread>
 
 
 #include "Defines.h"
@@ -33,12 +49,22 @@
 #include "ComponentManager.h"
 #include "Property.h"
 #include "Id.h"
+#include "Handle.h"
 #include "Entity.h"
 #include "EntityAlias.h"
 #include "UnallocatedEntity.h"
 #include "Iterator.h"
+#include "BlockIterator.h"
 #include "View.h"
+#include "Cursor.h"
+#include "EntityShard.h"
 #include "EntityManager.h"
+#include "Reduce.h"
+#include "Columns.h"
+#include "Replication.h"
+#include "SharedWorld.h"
+#include "Metrics.h"
+#include "RollbackBuffer.h"
 #include "SystemManager.h"
 #include "System.h"
 
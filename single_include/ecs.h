@@ -1,6 +1,6 @@
 ///
 /// OpenEcs v0.1.101
-/// Generated: 2016-02-04 13:54:34.305076
+/// Generated: 2026-10-17 21:41:12.357298
 /// ----------------------------------------------------------
 /// This file has been generated from multiple files. Do not modify
 /// ----------------------------------------------------------
@@ -31,15 +31,33 @@
 #include <bitset>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <string>
 #include <functional>
 #include <cassert>
 #include <iostream>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <cstddef>
+#include <cmath>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <tuple>
+#include <iterator>
+#include <thread>
 
 // #included from: Defines.h
 #ifndef ECS_DEFINES_H
 #define ECS_DEFINES_H
 
+#include <bitset>
+
 /// The cache line size for the processor. Usually 64 bytes
 #ifndef ECS_CACHE_LINE_SIZE
 #define ECS_CACHE_LINE_SIZE 64
@@ -61,6 +79,42 @@
 #define ECS_DEFAULT_CHUNK_SIZE ECS_CACHE_LINE_SIZE
 #endif
 
+/// How many entities ahead the components are prefetched, when iterating
+/// with a lambda. Can be changed with EntityManager::set_prefetch_distance
+#ifndef ECS_PREFETCH_DISTANCE
+#define ECS_PREFETCH_DISTANCE 4
+#endif
+
+/// How many entity indexes each partial result of a reduction covers.
+/// Must be a multiple of ECS_CACHE_LINE_SIZE
+#ifndef ECS_REDUCE_SLICE_SIZE
+#define ECS_REDUCE_SLICE_SIZE 1024
+#endif
+
+/// How many slices each thread should have at least, when a reduction
+/// picks how many threads to use. Fewer slices run on the calling thread
+#ifndef ECS_REDUCE_SLICES_PER_THREAD
+#define ECS_REDUCE_SLICES_PER_THREAD 16
+#endif
+
+/// How many rows import_columns reads at a time. Must be a multiple of
+/// ECS_CACHE_LINE_SIZE
+#ifndef ECS_IMPORT_BATCH_SIZE
+#define ECS_IMPORT_BATCH_SIZE 65536
+#endif
+
+/// How many packets a Replicator keeps track of for each observer, that
+/// are not acknowledged yet. Older packets are merged.
+#ifndef ECS_REPLICATION_HISTORY
+#define ECS_REPLICATION_HISTORY 32
+#endif
+
+/// How many times SharedWorldReader::read copies a snapshot, that is
+/// overwritten while it is copied, before it gives up
+#ifndef ECS_SHARED_WORLD_RETRIES
+#define ECS_SHARED_WORLD_RETRIES 16
+#endif
+
 #define ECS_ASSERT_IS_CALLABLE(T)                                                           \
             static_assert(details::is_callable<T>::value,                                   \
             "Provide a function or lambda expression");                                     \
@@ -114,10 +168,15 @@ using ComponentMask = std::bitset<ECS_MAX_NUM_OF_COMPONENTS>;
 /// nice helper functions
 ///--------------------------------------------------------------------
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
 namespace ecs{
 
 /// Forward declarations
 class Entity;
+class Handle;
 
 namespace details{
 
@@ -174,6 +233,18 @@ struct is_type<T, Tail>: std::false_type { };
 template<typename T, typename Tail, typename... Ts>
 struct is_type<T, Tail, Ts...>: is_type<T, Ts...>::type { };
 
+///---------------------------------------------------------------------
+/// Determine the position of a type within a list of types
+///---------------------------------------------------------------------
+template<typename T, typename... Ts>
+struct index_of;
+
+template<typename T, typename... Ts>
+struct index_of<T, T, Ts...>: std::integral_constant<size_t, 0> { };
+
+template<typename T, typename Head, typename... Ts>
+struct index_of<T, Head, Ts...>: std::integral_constant<size_t, 1 + index_of<T, Ts...>::value> { };
+
 ///---------------------------------------------------------------------
 /// Check if a class has implemented operator()
 ///
@@ -206,54 +277,90 @@ class forbid_copies {
 ///--------------------------------------------------------------------
 /// Helper functions
 ///--------------------------------------------------------------------
+///
+/// Component, system and event indexes are shared by every EntityManager and
+/// SystemManager in the process. Each index is assigned the first time
+/// a type is used. Function local statics are initialized thread-safe,
+/// and the counters are atomic, so different threads can register types
+/// at the same time.
+///--------------------------------------------------------------------
 
-inline size_t &component_counter() {
-  static size_t counter = 0;
+inline std::atomic<size_t> &component_counter() {
+  static std::atomic<size_t> counter(0);
   return counter;
 }
 
 inline size_t inc_component_counter()  {
-  size_t index = component_counter()++;
+  size_t index = component_counter().fetch_add(1);
   ECS_ASSERT(index < ECS_MAX_NUM_OF_COMPONENTS, "maximum number of components exceeded.");
   return index;
 }
 
 template<typename C>
 size_t component_index() {
-  static size_t index = inc_component_counter();
+  static const size_t index = inc_component_counter();
   return index;
 }
 
-inline size_t &system_counter() {
-  static size_t counter = 0;
+inline std::atomic<size_t> &system_counter() {
+  static std::atomic<size_t> counter(0);
   return counter;
 }
 
 template<typename C>
 size_t system_index() {
-  static size_t index = system_counter()++;
+  static const size_t index = system_counter().fetch_add(1);
+  return index;
+}
+
+inline std::atomic<size_t> &event_counter() {
+  static std::atomic<size_t> counter(0);
+  return counter;
+}
+
+template<typename E>
+size_t event_index() {
+  static const size_t index = event_counter().fetch_add(1);
   return index;
 }
 
+/// Hint that memory will soon be read, so that it can be loaded into the cache
+inline void prefetch(void const *ptr) {
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(ptr);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  _mm_prefetch(static_cast<char const *>(ptr), _MM_HINT_T0);
+#else
+  (void) ptr;
+#endif
+}
+
+///---------------------------------------------------------------------
+/// Determine if a lambda argument identifies the entity, instead of
+/// being one of its components
+///---------------------------------------------------------------------
+template<typename T>
+struct is_entity_arg: std::integral_constant<bool, std::is_same<T, Entity>::value ||
+                                                   std::is_same<T, Handle>::value> { };
+
 //C1 should not be Entity
 template<typename C>
 inline auto component_mask() -> typename
-std::enable_if<!std::is_same<C, Entity>::value, ComponentMask>::type {
+std::enable_if<!is_entity_arg<C>::value, ComponentMask>::type {
   ComponentMask mask = ComponentMask((1UL << component_index<C>()));
   return mask;
 }
 
-//When C1 is Entity, ignore
+//When C1 is Entity or Handle, ignore
 template<typename C>
 inline auto component_mask() -> typename
-std::enable_if<std::is_same<C, Entity>::value, ComponentMask>::type {
+std::enable_if<is_entity_arg<C>::value, ComponentMask>::type {
   return ComponentMask(0);
 }
 
 //recursive function for component_mask creation
 template<typename C1, typename C2, typename ...Cs>
-inline auto component_mask() -> typename
-std::enable_if<!std::is_same<C1, Entity>::value, ComponentMask>::type {
+inline ComponentMask component_mask() {
   ComponentMask mask = component_mask<C1>() | component_mask<C2, Cs...>();
   return mask;
 }
@@ -276,6 +383,10 @@ namespace details {
 /// Pool allocation class. The standard is to store one cache-line
 /// (64 bytes) per chunk.
 ///
+/// Chunks are reference counted, so that several pools can share the
+/// same memory (see EntityManager::fork). A shared chunk must be made
+/// unique with detach_chunk before it is modified.
+///
 ///---------------------------------------------------------------------
 class BasePool: forbid_copies {
  public:
@@ -285,17 +396,62 @@ class BasePool: forbid_copies {
   inline index_t size() const { return size_; }
   inline index_t capacity() const { return capacity_; }
   inline size_t chunks() const { return chunks_.size(); }
+  inline size_t chunk_size() const { return chunk_size_; }
+  /// Bytes allocated for the chunks, including their headers
+  inline size_t memory() const { return chunks_.size() * (chunk_header_size + element_size_ * chunk_size_); }
+  inline char *chunk(size_t index) { return chunks_[index]; }
   inline void ensure_min_size(std::size_t size);
   inline void ensure_min_capacity(size_t min_capacity);
 
+  /// Exchange a chunk with a chunk from another pool. Objects stay
+  /// where they are in memory, only the ownership changes.
+  inline void swap_chunk(size_t chunk_index, BasePool &other, size_t other_chunk_index);
+
+  /// Take ownership of every chunk in another pool, and place them
+  /// starting at first_chunk. The other pool is empty afterwards.
+  inline void adopt_chunks(BasePool &other, size_t first_chunk);
+
+  /// Release all memory, without calling any destructors
+  inline void clear();
+
+  /// Share every chunk with another pool. Memory owned by this pool
+  /// is released, without calling any destructors. Only chunks that
+  /// are not already shared with the other pool are updated.
+  inline void share_chunks(BasePool &other);
+
+  /// Check if a chunk is shared with another pool
+  inline bool is_shared(size_t chunk_index) const;
+
+  /// Check if any chunk has been shared with another pool
+  inline bool has_shared() const { return has_shared_; }
+
+  /// Replace a shared chunk with new uninitialized memory. Returns the
+  /// shared chunk, which must be released with release_chunk once its
+  /// objects are copied.
+  inline char *detach_chunk(size_t chunk_index);
+
+  inline static void release_chunk(char *chunk);
+
   virtual void destroy(index_t index) = 0;
 
  protected:
+  // Placed in front of each chunk
+  struct ChunkHeader {
+    std::atomic<size_t> references;
+  };
+  static const size_t chunk_header_size = alignof(std::max_align_t) > sizeof(ChunkHeader) ?
+                                          alignof(std::max_align_t) : sizeof(ChunkHeader);
+
+  inline char *allocate_chunk();
+  inline static ChunkHeader &header(char *chunk);
+
   index_t size_;
   index_t capacity_;
   size_t element_size_;
   size_t chunk_size_;
   std::vector<char *> chunks_;
+  /// Set when chunks are shared, so that pools that never share memory can skip checking each chunk
+  bool has_shared_;
 };
 
 ///---------------------------------------------------------------------
@@ -339,12 +495,13 @@ BasePool::BasePool(size_t element_size, size_t chunk_size) :
     size_(0),
     capacity_(0),
     element_size_(element_size),
-    chunk_size_(chunk_size) {
+    chunk_size_(chunk_size),
+    has_shared_(false) {
 }
 
 BasePool::~BasePool() {
   for (char *ptr : chunks_) {
-    delete[] ptr;
+    release_chunk(ptr);
   }
 }
 void BasePool::ensure_min_size(std::size_t size) {
@@ -355,12 +512,100 @@ void BasePool::ensure_min_size(std::size_t size) {
 }
 void BasePool::ensure_min_capacity(size_t min_capacity) {
   while (min_capacity >= capacity_) {
-    char *chunk = new char[element_size_ * chunk_size_];
-    chunks_.push_back(chunk);
+    chunks_.push_back(allocate_chunk());
     capacity_ += chunk_size_;
   }
 }
 
+void BasePool::swap_chunk(size_t chunk_index, BasePool &other, size_t other_chunk_index) {
+  ECS_ASSERT(element_size_ == other.element_size_ && chunk_size_ == other.chunk_size_, "Pools are not compatible");
+  ECS_ASSERT(chunk_index < chunks_.size() && other_chunk_index < other.chunks_.size(), "Chunk is not allocated");
+  std::swap(chunks_[chunk_index], other.chunks_[other_chunk_index]);
+  if (other.has_shared()) has_shared_ = true;
+  if (has_shared()) other.has_shared_ = true;
+}
+
+void BasePool::adopt_chunks(BasePool &other, size_t first_chunk) {
+  ECS_ASSERT(element_size_ == other.element_size_ && chunk_size_ == other.chunk_size_, "Pools are not compatible");
+  if (first_chunk > 0) ensure_min_capacity(first_chunk * chunk_size_ - 1);
+  for (size_t i = 0; i < other.chunks_.size(); ++i) {
+    if (first_chunk + i < chunks_.size()) {
+      std::swap(chunks_[first_chunk + i], other.chunks_[i]);
+    } else {
+      chunks_.push_back(other.chunks_[i]);
+      capacity_ += index_t(chunk_size_);
+      other.chunks_[i] = nullptr;
+    }
+  }
+  if (other.size_ > 0) {
+    size_ = std::max<index_t>(size_, index_t(first_chunk * chunk_size_) + other.size_);
+  }
+  if (other.has_shared()) has_shared_ = true;
+  other.clear();
+}
+
+void BasePool::clear() {
+  for (char *ptr : chunks_) {
+    release_chunk(ptr);
+  }
+  chunks_.clear();
+  size_ = 0;
+  capacity_ = 0;
+  has_shared_ = false;
+}
+
+void BasePool::share_chunks(BasePool &other) {
+  ECS_ASSERT(element_size_ == other.element_size_ && chunk_size_ == other.chunk_size_, "Pools are not compatible");
+  if (this == &other) return;
+  for (size_t i = other.chunks_.size(); i < chunks_.size(); ++i) {
+    release_chunk(chunks_[i]);
+  }
+  chunks_.resize(other.chunks_.size(), nullptr);
+  // Chunks that are already shared with other are kept, so that only
+  // chunks that have been modified since last time are touched
+  for (size_t i = 0; i < chunks_.size(); ++i) {
+    if (chunks_[i] != other.chunks_[i]) {
+      header(other.chunks_[i]).references.fetch_add(1, std::memory_order_relaxed);
+      release_chunk(chunks_[i]);
+      chunks_[i] = other.chunks_[i];
+    }
+  }
+  size_ = other.size_;
+  capacity_ = other.capacity_;
+  has_shared_ = true;
+  other.has_shared_ = true;
+}
+
+bool BasePool::is_shared(size_t chunk_index) const {
+  return header(chunks_[chunk_index]).references.load(std::memory_order_acquire) > 1;
+}
+
+char *BasePool::detach_chunk(size_t chunk_index) {
+  char *shared = chunks_[chunk_index];
+  chunks_[chunk_index] = allocate_chunk();
+  return shared;
+}
+
+char *BasePool::allocate_chunk() {
+  char *memory = new char[chunk_header_size + element_size_ * chunk_size_];
+  new(memory) ChunkHeader();
+  char *chunk = memory + chunk_header_size;
+  header(chunk).references.store(1, std::memory_order_relaxed);
+  return chunk;
+}
+
+void BasePool::release_chunk(char *chunk) {
+  if (chunk == nullptr) return;
+  if (header(chunk).references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    header(chunk).~ChunkHeader();
+    delete[] (chunk - chunk_header_size);
+  }
+}
+
+BasePool::ChunkHeader &BasePool::header(char *chunk) {
+  return *reinterpret_cast<ChunkHeader *>(chunk - chunk_header_size);
+}
+
 template<typename T>
 Pool<T>::Pool(size_t chunk_size) : BasePool(sizeof(T), chunk_size) { }
 
@@ -411,6 +656,78 @@ inline const T & Pool<T>::operator[](size_t index) const {
 #ifndef ECS_COMPONENTMANAGER_H
 #define ECS_COMPONENTMANAGER_H
 
+// #included from: Aggregate.h
+#ifndef ECS_AGGREGATE_H
+#define ECS_AGGREGATE_H
+
+namespace ecs{
+
+///---------------------------------------------------------------------
+/// An Aggregate is a value computed from every component of a type,
+/// that is kept up to date as components change
+///---------------------------------------------------------------------
+///
+/// Aggregates are created with EntityManager::aggregate. The value is
+/// updated when a component is added, set, removed or destroyed, so it
+/// can be read at any time without iterating through the entities.
+///
+/// @usage auto &strength = entities.aggregate_sum<Strength>();
+///        strength.value();
+///---------------------------------------------------------------------
+template<typename T>
+class Aggregate: details::forbid_copies {
+ public:
+  /// The current value
+  inline T const &value() const { return value_; }
+
+ protected:
+  Aggregate(T init) : init_(init), value_(init) { }
+
+  /// The value when no entity has the component
+  T init_;
+  T value_;
+};
+
+namespace details{
+
+///---------------------------------------------------------------------
+/// Helper class, all aggregates of a component of type C are a
+/// ComponentAggregate<C>, so that its ComponentManager can update them
+///---------------------------------------------------------------------
+template<typename C>
+class ComponentAggregate {
+ public:
+  virtual ~ComponentAggregate() { }
+  /// The component of the entity at index is added or removed
+  virtual void add(index_t index, C const &component) = 0;
+  virtual void remove(index_t index, C const &component) = 0;
+  /// Go back to the value when no entity has the component
+  virtual void reset() = 0;
+};
+
+///---------------------------------------------------------------------
+/// An Aggregate that uses add(T &, C const &) and remove(T &, C const &)
+/// to update its value
+///---------------------------------------------------------------------
+template<typename C, typename T, typename Add, typename Remove>
+class AggregateOf: public Aggregate<T>, public ComponentAggregate<C> {
+ public:
+  AggregateOf(T init, Add add, Remove remove) : Aggregate<T>(init), add_(add), remove_(remove) { }
+
+  void add(index_t, C const &component) override { add_(this->value_, component); }
+  void remove(index_t, C const &component) override { remove_(this->value_, component); }
+  void reset() override { this->value_ = this->init_; }
+
+ private:
+  Add add_;
+  Remove remove_;
+};
+
+} // namespace details
+
+} // namespace ecs
+
+#endif //ECS_AGGREGATE_H
 namespace ecs{
 
 // Forward declarations
@@ -441,6 +758,18 @@ typename std::enable_if<
     !std::is_constructible<C, Args...>::value &&
         std::is_base_of<details::BaseProperty, C>::value, C&>::type;
 
+///-----------------------------------------------------------------------
+/// global function for copying a component to a specific location
+///-----------------------------------------------------------------------
+template<typename C>
+auto copy_component(void* ptr, C const &component) ->
+typename std::enable_if<std::is_copy_constructible<C>::value, void>::type;
+
+// Component can't be copied -> error when trying to
+template<typename C>
+auto copy_component(void* ptr, C const &component) ->
+typename std::enable_if<!std::is_copy_constructible<C>::value, void>::type;
+
 ///---------------------------------------------------------------------
 /// Helper class, all ComponentManager are a BaseManager
 ///---------------------------------------------------------------------
@@ -452,11 +781,40 @@ class BaseManager {
   virtual void* get_void_ptr(index_t index) = 0;
   virtual void const* get_void_ptr(index_t index) const = 0;
   virtual void ensure_min_size(index_t size) = 0;
+  virtual BasePool &pool() = 0;
+  /// Create an empty ComponentManager for the same component type, owned by another EntityManager
+  virtual BaseManager *create_manager(EntityManager &manager) const = 0;
+  /// Move a component to another ComponentManager of the same type. Does not change any component mask
+  virtual void move(index_t index, BaseManager &target, index_t target_index) = 0;
+  /// Destroy every component that is not shared with a fork, and release all memory
+  virtual void clear() = 0;
+  /// Share the memory of another ComponentManager of the same type. Only chunks that differ are
+  /// released, and only their components that are not shared with a fork are destroyed
+  virtual void share(BaseManager &other) = 0;
+  /// Make the current components readable as previous values, if double buffered
+  virtual void swap_buffers() = 0;
+  /// Add the component at index to every aggregate, after it is written to directly
+  virtual void aggregate_added(index_t index) = 0;
+  /// Remove the component at index from every aggregate, before it is moved away
+  virtual void aggregate_removed(index_t index) = 0;
+  /// Compute every aggregate from the start, after components are moved in bulk
+  virtual void recompute_aggregates() = 0;
 };
 
 ///---------------------------------------------------------------------
 /// Helper class, This is the main class for holding many Component of
 /// a specified type. It uses a memory pool to store the components
+///
+/// Memory may be shared with a fork of the EntityManager. Any non-const
+/// access to a component copies the shared chunk it is located in.
+///
+/// A double buffered ComponentManager also keeps the value every
+/// component had at the last swap_buffers. The previous values share
+/// memory with the current ones, so only chunks that are modified after
+/// a swap are copied.
+///
+/// Aggregates of the components are updated when a component is created,
+/// set or removed.
 ///---------------------------------------------------------------------
 template<typename C>
 class ComponentManager: public BaseManager, details::forbid_copies {
@@ -470,6 +828,10 @@ class ComponentManager: public BaseManager, details::forbid_copies {
   /// Remove component at specific index and call destructor
   void remove(index_t index);
 
+  /// Assign a new value to the component at specific index
+  template<typename T>
+  C& set(index_t index, T &&value);
+
   /// Access a component given a specific index
   C& operator[](index_t index);
   C& get(index_t index);
@@ -489,9 +851,64 @@ class ComponentManager: public BaseManager, details::forbid_copies {
   /// Get the bitmask for the component this ComponentManger handles
   ComponentMask mask();
 
+  /// Access the memory pool where components are stored
+  details::Pool<C> &pool() { return pool_; }
+  details::Pool<C> const &pool() const { return pool_; }
+
+  /// Create an empty ComponentManager for the same component type, owned by another EntityManager
+  BaseManager *create_manager(EntityManager &manager) const;
+
+  /// Move a component to another ComponentManager of the same type. Does not change any component
+  /// mask, or any aggregate
+  void move(index_t index, BaseManager &target, index_t target_index);
+
+  /// Destroy every component that is not shared with a fork, and release all memory
+  void clear();
+
+  /// Share the memory of another ComponentManager of the same type. Only chunks that differ are
+  /// released, and only their components that are not shared with a fork are destroyed
+  void share(BaseManager &other);
+
+  /// Start keeping the previous value of each component. Component must be trivially copyable
+  void double_buffer();
+  bool is_double_buffered() const { return previous_ != nullptr; }
+
+  /// Make the current components readable as previous values. Does nothing if not double buffered
+  void swap_buffers();
+
+  /// Access the value a component had at the last swap_buffers. The
+  /// current value is returned if the entity at index did not have the
+  /// component at the last swap
+  C const &previous(index_t index) const;
+
+  /// Start keeping an aggregate up to date. Every existing component is added to it
+  template<typename T, typename Add, typename Remove>
+  Aggregate<T> const &aggregate(T init, Add add, Remove remove);
+
+  /// Start keeping any ComponentAggregate up to date, and take ownership of it
+  void add_aggregate(ComponentAggregate<C> *aggregate);
+
+  void aggregate_added(index_t index);
+  void aggregate_removed(index_t index);
+  void recompute_aggregates();
+
  private:
+  /// If the chunk where index is located is shared with another EntityManager,
+  /// make it unique by copying every component in it
+  void unshare(index_t index);
+
+  /// Remember which entities have the component, when previous values are taken
+  void record_previous_owners();
+
   EntityManager &manager_;
   details::Pool<C> pool_;
+  /// Shares chunks with pool_, that are not modified since last swap_buffers
+  std::unique_ptr<details::Pool<C>> previous_;
+  /// The version of the entity at each index at the last swap_buffers, and
+  /// whether it had the component then
+  std::vector<version_t> previous_versions_;
+  std::vector<bool> previous_owned_;
+  std::vector<std::unique_ptr<ComponentAggregate<C>>> aggregates_;
 }; //ComponentManager
 
 } // namespace details
@@ -503,285 +920,300 @@ class ComponentManager: public BaseManager, details::forbid_copies {
 #ifndef ECS_ENTITYMANAGER_H
 #define ECS_ENTITYMANAGER_H
 
-namespace ecs {
+// #included from: Property.h
+#ifndef ECS_PROPERTY_H
+#define ECS_PROPERTY_H
 
-/// Forward declareations
-template <typename...>
-class EntityAlias;
-class Entity;
-class UnallocatedEntity;
-template<typename>
-class View;
-class Id;
+namespace ecs{
 
 namespace details{
+///---------------------------------------------------------------------
+/// Helper class used for compile-time checks to determine if a
+/// component is a propery.
+///---------------------------------------------------------------------
+class BaseProperty{};
 
-/// Used to iterate through the EntityManager with a lambda-expression,
-/// with each argument as a specific component type. Used by with
-/// function.
-template<size_t N, typename...>
-struct with_t;
+///---------------------------------------------------------------------
+/// The type of the value of a component. The value of a Property is
+/// its ValueType, other components are their own value.
+///---------------------------------------------------------------------
+template<typename C, bool = std::is_base_of<BaseProperty, C>::value>
+struct component_value {
+  using type = C;
+};
+
+template<typename C>
+struct component_value<C, true> {
+  using type = typename C::ValueType;
+};
 
 } // namespace details
 
 ///---------------------------------------------------------------------
-/// This is the main class for holding all Entities and Components
+/// A Property is a helper class for Component with only one
+/// property of any type
 ///---------------------------------------------------------------------
 ///
-/// It uses a vector for holding entity versions and another for component
-/// masks. It also uses 1 memory pool for each type of component.
+/// A Property is a helper class for Component with only one
+/// property of any type.
 ///
-/// The index of each data structure is used to identify each entity.
-/// The version is used for checking if entity is valid.
-/// The component mask is used to check what components an entity has
+/// it implements standard constructors, type conversations and
+/// operators:
 ///
-/// The Entity id = {index + version}. When an Entity is removed,
-/// the index is added to the free list. A free list knows where spaces are
-/// left open for new entities (to ensure no holes).
+///     ==, !=
+///     >=, <=, <, >
+///     +=, -=, *=, /=, %=
+///     &=, |=, ^=
+///     +, -, *; /, %
+///     &, |, ^, ~
+///     >>, <<
+///     ++, --
 ///
+/// TODO: Add more operators?
 ///---------------------------------------------------------------------
-class EntityManager: details::forbid_copies {
- private:
-  // Class for accessing where to put entities with specific components.
-  struct IndexAccessor {
-    // Used to store next available index there is within each block
-    std::vector <index_t> block_index;
-    // Used to store all indexes that are free
-    std::vector <index_t> free_list;
-  };
-
- public:
-  inline EntityManager(size_t chunk_size = 8192);
-  inline ~EntityManager();
+template<typename T>
+struct Property : details::BaseProperty{
+  Property() { }
+  Property(const T &value) : value(value) { }
 
-  /// Create a new Entity
-  inline UnallocatedEntity create();
+  operator const T &() const { return value; }
+  operator T &() { return value; }
 
-  /// Create a specified number of new entities.
-  inline std::vector <Entity> create(const size_t num_of_entities);
+  T value;
+  using ValueType = T;
+};
 
-  /// Create a specified number of new entities, and do something with each entity
-  template<typename T>
-  inline void create(const size_t num_of_entities, T lambda);
+/// Comparision operators
+template<typename T, typename E> bool operator==(Property<T> const &lhs, const E &rhs);
+template<typename T, typename E> bool operator!=(Property<T> const &lhs, const E &rhs);
+template<typename T, typename E> bool operator>=(Property<T> const &lhs, const E &rhs);
+template<typename T, typename E> bool operator> (Property<T> const &lhs, const E &rhs);
+template<typename T, typename E> bool operator<=(Property<T> const &lhs, const E &rhs);
+template<typename T, typename E> bool operator< (Property<T> const &lhs, const E &rhs);
 
-  /// Create, using EntityAlias
-  template<typename T, typename ...Args>
-  inline auto create(Args &&... args) -> typename std::enable_if<!std::is_constructible<T, Args...>::value, T>::type;
-  template<typename T, typename ...Args>
-  inline auto create(Args &&... args) -> typename std::enable_if<std::is_constructible<T, Args...>::value, T>::type;
+/// Compound assignment operators
+template<typename T, typename E> T& operator+=(Property<T> &lhs, const E &rhs);
+template<typename T, typename E> T& operator-=(Property<T> &lhs, const E &rhs);
+template<typename T, typename E> T& operator*=(Property<T> &lhs, const E &rhs);
+template<typename T, typename E> T& operator/=(Property<T> &lhs, const E &rhs);
+template<typename T, typename E> T& operator%=(Property<T> &lhs, const E &rhs);
+template<typename T, typename E> T& operator&=(Property<T> &lhs, const E &rhs);
+template<typename T, typename E> T& operator|=(Property<T> &lhs, const E &rhs);
+template<typename T, typename E> T& operator^=(Property<T> &lhs, const E &rhs);
 
-  /// Create an entity with components assigned
-  template<typename ...Components, typename ...Args>
-  inline auto create_with(Args && ... args ) ->
-      typename std::conditional<(sizeof...(Components) > 0), EntityAlias<Components...>, EntityAlias<Args...>>::type;
+/// Arithmetic operators
+template<typename T, typename E> T  operator+ (Property<T> &lhs, const E &rhs);
+template<typename T, typename E> T  operator- (Property<T> &lhs, const E &rhs);
+template<typename T, typename E> T  operator* (Property<T> &lhs, const E &rhs);
+template<typename T, typename E> T  operator/ (Property<T> &lhs, const E &rhs);
+template<typename T, typename E> T  operator% (Property<T> &lhs, const E &rhs);
+template<typename T>             T& operator++(Property<T> &lhs);
+template<typename T>             T  operator++(Property<T> &lhs, int);
+template<typename T>             T& operator--(Property<T> &lhs);
+template<typename T>             T  operator--(Property<T> &lhs, int);
 
-  /// Create an entity with components assigned, using default values
-  template<typename ...Components>
-  inline EntityAlias<Components...> create_with();
-
-  // Access a View of all entities with specified components
-  template<typename ...Components>
-  inline View <EntityAlias<Components...>> with();
+/// Bitwise operators
+template<typename T, typename E> T operator&(Property<T> &lhs, const E &rhs);
+template<typename T, typename E> T operator|(Property<T> &lhs, const E &rhs);
+template<typename T, typename E> T operator^(Property<T> &lhs, const E &rhs);
+template<typename T, typename E> T operator~(Property<T> &lhs);
+template<typename T, typename E> T operator>>(Property<T> &lhs, const E &rhs);
+template<typename T, typename E> T operator<<(Property<T> &lhs, const E &rhs);
 
-  // Iterate through all entities with all components, specified as lambda parameters
-  // example: entities.with([] (Position& pos) {  });
-  template<typename T>
-  inline void with(T lambda);
+} // namespace ecs
 
-  // Access a View of all entities that has every component as Specified EntityAlias
-  template<typename T>
-  inline View <T> fetch_every();
+// #included from: Property.inl
+namespace ecs{
 
-  // Access a View of all entities that has every component as Specified EntityAlias specified as lambda parameters
-  // example: entities.fetch_every([] (EntityAlias<Position>& entity) {  });
-  template<typename T>
-  inline void fetch_every(T lambda);
+template<typename T, typename E>
+inline bool operator==(Property<T> const &lhs, const E &rhs) {
+  return lhs.value == rhs;
+}
 
-  // Get an Entity at specified index
-  inline Entity operator[](index_t index);
+template<typename T, typename E>
+inline bool operator!=(Property<T> const &lhs, const E &rhs) {
+  return lhs.value != rhs;
+}
 
-  // Get an Entity with a specific Id. Id must be valid
-  inline Entity operator[](Id id);
+template<typename T, typename E>
+inline bool operator>=(Property<T> const &lhs, const E &rhs) {
+  return lhs.value >= rhs;
+}
 
-  // Get the Entity count for this EntityManager
-  inline size_t count();
+template<typename T, typename E>
+inline bool operator>(Property<T> const &lhs, const E &rhs) {
+  return lhs.value > rhs;
+}
 
- private:
+template<typename T, typename E>
+inline bool operator<=(Property<T> const &lhs, const E &rhs) {
+  return lhs.value <= rhs;
+}
 
-  /// Creates an entity and put it close to entities
-  /// with similar components
-  inline Entity create_with_mask(details::ComponentMask mask);
+template<typename T, typename E>
+inline bool operator<(Property<T> const &lhs, const E &rhs) {
+  return lhs.value < rhs;
+}
 
-  /// Creates any number of entities > 0 and put them close to entities
-  /// with similar components
-  inline std::vector <Entity> create_with_mask(details::ComponentMask mask, const size_t num_of_entities);
+template<typename T, typename E>
+inline T &operator+=(Property<T> &lhs, const E &rhs) {
+  return lhs.value += rhs;
+}
 
-  /// Find a proper index for a new entity with components
-  inline index_t find_new_entity_index(details::ComponentMask mask);
+template<typename T, typename E>
+inline T &operator-=(Property<T> &lhs, const E &rhs) {
+  return lhs.value -= rhs;
+}
 
-  /// Create a new block for this entity type.
-  inline void create_new_block(IndexAccessor &index_accessor, unsigned long mask_as_ulong, index_t next_free_index);
+template<typename T, typename E>
+inline T &operator*=(Property<T> &lhs, const E &rhs) {
+  return lhs.value *= rhs;
+}
 
-  /// Creates a ComponentManager. Mainly used by get_component_manager the first time its called
-  template<typename C, typename ...Args>
-  inline details::ComponentManager <C> &create_component_manager(Args &&... args);
+template<typename T, typename E>
+inline T &operator/=(Property<T> &lhs, const E &rhs) {
+  return lhs.value /= rhs;
+}
 
-  /// Get the ComponentManager. Assumes that the component manager already exists.
-  template<typename C>
-  inline details::ComponentManager <C> &get_component_manager_fast();
-  template<typename C>
-  inline details::ComponentManager <C> const &get_component_manager_fast() const;
+template<typename T, typename E>
+inline T &operator%=(Property<T> &lhs, const E &rhs) {
+  return lhs.value %= rhs;
+}
 
-  /// Get the ComponentManager. Creates a component manager if it
-  /// doesn't exists for specified component type.
-  template<typename C>
-  inline details::ComponentManager <C> &get_component_manager();
-  template<typename C>
-  inline details::ComponentManager <C> const &get_component_manager() const;
+template<typename T, typename E>
+inline T &operator&=(Property<T> &lhs, const E &rhs) {
+  return lhs.value &= rhs;
+}
 
-  inline details::BaseManager &get_component_manager(size_t component_index);
-  inline details::BaseManager const &get_component_manager(size_t component_index) const;
+template<typename T, typename E>
+inline T &operator|=(Property<T> &lhs, const E &rhs) {
+  return lhs.value |= rhs;
+}
 
-  /// Get component for a specific entity or index.
-  template<typename C>
-  inline C &get_component(Entity &entity);
-  template<typename C>
-  inline C const &get_component(Entity const &entity) const;
+template<typename T, typename E>
+inline T &operator^=(Property<T> &lhs, const E &rhs) {
+  return lhs.value ^= rhs;
+}
 
-  /// Get component for a specific entity or index. Assumes that a
-  /// ComponentManager exists for the specific component type.
-  template<typename C>
-  inline C &get_component_fast(index_t index);
-  template<typename C>
-  inline C const &get_component_fast(index_t index) const;
-  template<typename C>
-  inline C &get_component_fast(Entity &entity);
-  template<typename C>
-  inline C const &get_component_fast(Entity const &entity) const;
+template<typename T, typename E>
+inline T operator+(Property<T> &lhs, const E &rhs) {
+  return lhs.value + rhs;
+}
 
-  /// Use to create a component tmp that is assignable. Calls the constructor.
-  template<typename C, typename ...Args>
-  inline static auto create_tmp_component(Args &&... args) ->
-  typename std::enable_if<std::is_constructible<C, Args...>::value, C>::type {
-    return C(std::forward<Args>(args) ...);
-  }
+template<typename T, typename E>
+inline T operator-(Property<T> &lhs, const E &rhs) {
+  return lhs.value - rhs;
+}
 
-  /// Use to create a component tmp that is assignable. Uses uniform initialization.
-  template<typename C, typename ...Args>
-  inline static auto create_tmp_component(Args &&... args) ->
-  typename std::enable_if<
-      !std::is_constructible<C, Args...>::value &&
-          !std::is_base_of<details::BaseProperty, C>::value,
-      C>::type {
-    return C{std::forward<Args>(args) ...};
-  }
+template<typename T, typename E>
+inline T operator*(Property<T> &lhs, const E &rhs) {
+  return lhs.value * rhs;
+}
 
-  /// Use to create a component tmp that is assignable. Call the right constructor
-  /// Called when component is a property, and no constructor inaccessible.
-  template<typename C, typename ...Args>
-  inline static auto create_tmp_component(Args &&... args) ->
-  typename std::enable_if<
-      !std::is_constructible<C, Args...>::value &&
-          std::is_base_of<details::BaseProperty, C>::value,
-      C>::type {
-    static_assert(sizeof...(Args) == 1, ECS_ASSERT_MSG_ONLY_ONE_ARGS_PROPERTY_CONSTRUCTOR);
-    //static_assert(sizeof(C) == sizeof(std::tuple < Args... > ),
-    //"Cannot initilize component property. Please provide a constructor");
-    auto tmp = typename C::ValueType(std::forward<Args>(args)...);
-    return *reinterpret_cast<C *>(&tmp);
-  }
+template<typename T, typename E>
+inline T operator/(Property<T> &lhs, const E &rhs) {
+  return lhs.value / rhs;
+}
 
-  /// Creates a component for a specific entity with Args
-  template<typename C, typename ...Args>
-  inline C &create_component(Entity &entity, Args &&... args);
+template<typename T, typename E>
+inline T operator%(Property<T> &lhs, const E &rhs) {
+  return lhs.value % rhs;
+}
 
-  /// Removes a specific component from an entity.
-  template<typename C>
-  inline void remove_component(Entity &entity);
+template<typename T>
+inline T &operator++(Property<T> &lhs) {
+  ++lhs.value;
+  return lhs.value;
+}
 
-  /// Removes a specific component from an entity. Assumes that
-  /// a ComponentManager exists for component type
-  template<typename C>
-  inline void remove_component_fast(Entity &entity);
+template<typename T>
+inline T operator++(Property<T> &lhs, int) {
+  T copy = lhs;
+  ++lhs;
+  return copy;
+}
 
-  /// Removes all components from a single entity
-  inline void remove_all_components(Entity &entity);
+template<typename T>
+inline T& operator--(Property<T> &lhs) {
+  --lhs.value;
+  return lhs.value;
+}
 
-  /// Clears the component mask without removing any components
-  inline void clear_mask(Entity &entity);
+template<typename T>
+inline T operator--(Property<T> &lhs, int) {
+  T copy = lhs;
+  --lhs;
+  return copy;
+}
 
-  /// Set a component for a specific entity. It uses contructor if
-  /// entity does not have component. It uses assignment operator
-  /// if component already added
-  template<typename C, typename ...Args>
-  inline C &set_component(Entity &entity, Args &&... args);
+template<typename T, typename E>
+inline T operator&(Property<T> &lhs, const E &rhs) {
+  return lhs.value & rhs;
+}
 
-  /// Set a component for a specific entity. It assumes that the
-  /// entity already has the component and uses the assignment
-  /// operator.
-  template<typename C, typename ...Args>
-  inline C &set_component_fast(Entity &entity, Args &&... args);
+template<typename T, typename E>
+inline T operator|(Property<T> &lhs, const E &rhs) {
+  return lhs.value | rhs;
+}
 
-  /// Check if component has specified component types attached
-  inline bool has_component(Entity &entity, details::ComponentMask component_mask);
-  inline bool has_component(Entity const &entity, details::ComponentMask const &component_mask) const;
-  template<typename ...Components>
-  inline bool has_component(Entity &entity);
-  template<typename ...Components>
-  inline bool has_component(Entity const &entity) const;
+template<typename T, typename E>
+inline T operator^(Property<T> &lhs, const E &rhs) {
+  return lhs.value ^ rhs;
+}
 
-  /// Check if an entity is valid
-  inline bool is_valid(Entity &entity);
-  inline bool is_valid(Entity const &entity) const;
+template<typename T, typename E>
+inline T operator~(Property<T> &lhs) {
+  return ~lhs.value;
+}
 
-  /// Destroy an entity. Also removed all added components
-  inline void destroy(Entity &entity);
+template<typename T, typename E>
+inline T operator>>(Property<T> &lhs, const E &rhs) {
+  return lhs.value >> rhs;
+}
 
-  /// Get the entity mask from a specific entity or index
-  inline details::ComponentMask &mask(Entity &entity);
-  inline details::ComponentMask const &mask(Entity const &entity) const;
-  inline details::ComponentMask &mask(index_t index);
-  inline details::ComponentMask const &mask(index_t index) const;
+template<typename T, typename E>
+inline T operator<<(Property<T> &lhs, const E &rhs) {
+  return lhs.value << rhs;
+}
 
-  /// Get an entity given its id or index. When using Id, it must always be valid
-  inline Entity get_entity(Id id);
-  inline Entity get_entity(index_t index);
+} // namespace ecs
 
-  /// Gey how many entities the EntityManager can handle atm
-  inline size_t capacity() const;
+///---------------------------------------------------------------------
+/// This will allow a property to be streamed into a input and output
+/// stream.
+///---------------------------------------------------------------------
+namespace std {
 
-  std::vector<details::BaseManager *> component_managers_;
-  std::vector <details::ComponentMask> component_masks_;
-  std::vector <version_t> entity_versions_;
-  std::vector <index_t> next_free_indexes_;
-  std::vector <size_t> index_to_component_mask;
-  std::map <size_t, IndexAccessor> component_mask_to_index_accessor_;
+template<typename T>
+ostream &operator<<(ostream &os, const ecs::Property<T> &obj) {
+  return os << obj.value;
+}
 
-  /// How many blocks of entities there exists. Used when tracking where to put entities in momory
-  index_t block_count_ = 0;
-  /// How many entities there are atm
-  index_t count_ = 0;
+template<typename T>
+istream &operator>>(istream &is, ecs::Property<T> &obj) {
+  return is >> obj.value;
+}
 
-  /// The EntityManager want some friends :)
-  template<size_t N, typename...>
-  friend struct details::with_t;
-  template<typename T>
-  friend class details::ComponentManager;
-  template<typename ...Cs>
-  friend class EntityAlias;
-  template<typename T>
-  friend class Iterator;
-  friend class Entity;
-  friend class UnallocatedEntity;
-  friend class BaseComponent;
-};
+} //namespace std
 
-} // namespace ecs
+///---------------------------------------------------------------------
+/// This will enable properties to be added to a string
+///---------------------------------------------------------------------
+template<typename T>
+std::string operator+(const std::string &lhs, const ecs::Property<T> &rhs) { return lhs + rhs.value; }
 
-// #included from: EntityManager.inl
-// #included from: Entity.h
-#ifndef ECS_ENTITY_H
-#define ECS_ENTITY_H
+template<typename T>
+std::string operator+(std::string &&lhs, ecs::Property<T> &&rhs) { return lhs + rhs.value; }
+
+template<typename T>
+std::string operator+(std::string &&lhs, const ecs::Property<T> &rhs) { return lhs + rhs.value; }
+
+template<typename T>
+std::string operator+(const std::string &lhs, ecs::Property<T> &&rhs) { return lhs + rhs.value; }
+#endif //ECS_PROPERTY_H
+// #included from: TimingWheel.h
+#ifndef ECS_TIMINGWHEEL_H
+#define ECS_TIMINGWHEEL_H
 
 // #included from: Id.h
 #ifndef ECS_ID_H
@@ -839,1954 +1271,7058 @@ bool operator!=(const Id& lhs, const Id &rhs) {
 } // namespace ecs
 #endif //ECS_ID_H
 namespace ecs{
+
+namespace details{
+
 ///---------------------------------------------------------------------
-/// Entity is the identifier of an identity
+/// A TimingWheel keeps track of when entities are due
 ///---------------------------------------------------------------------
 ///
-/// An entity consists of an id and version. The version is used to
-/// ensure that new entities allocated with the same id are separable.
-///
-/// An entity becomes invalid when destroyed.
+/// Time is counted in ticks. The wheel has several levels of slots,
+/// where each level covers a range of ticks that is slot_count times
+/// larger than the level below. An entity is placed in the level that
+/// covers when it is due, and is moved down to a lower level as time
+/// passes. This way advancing one tick only touches the entities that
+/// are due, and every slot_count:th tick the entities of one slot in
+/// the level above.
 ///
 ///---------------------------------------------------------------------
-class Entity {
+class TimingWheel {
  public:
-  inline Entity(EntityManager *manager, Id id);
-  inline Entity &operator=(const Entity &rhs);
+  struct Entry {
+    Id id;
+    uint64_t due;
+  };
 
-  inline Id &id() { return id_; }
-  inline Id const &id() const { return id_; }
+  inline TimingWheel() : now_(0), size_(0) { }
 
-  /// Returns the requested component, or error if it doesn't exist
-  template<typename C> inline C &get();
-  template<typename C> inline C const &get() const;
+  /// The current tick
+  inline uint64_t now() const { return now_; }
 
-  /// Set the requested component, if old component exist,
-  /// a new one is created. Otherwise, the assignment operator
-  /// is used.
-  template<typename C, typename ... Args> inline C &set(Args &&... args);
+  /// Number of entries that are not due yet
+  inline size_t size() const { return size_; }
 
-  /// Add the requested component, error if component of the same type exist already
-  template<typename C, typename ... Args> inline C &add(Args &&... args);
+  /// Add an entry that is due a number of ticks from now, at least 1
+  inline void insert(Id id, uint64_t ticks);
 
-  /// Access this Entity as an EntityAlias.
-  template<typename T> inline T &as();
-  template<typename T> inline T const &as() const;
+  /// Advance one tick, and call lambda for every entry that is due
+  template<typename Lambda>
+  inline void advance(Lambda lambda);
 
-  /// Assume that this entity has provided Components
-  /// Use for faster component access calls
-  template<typename ...Components> inline EntityAlias<Components...> &assume();
-  template<typename ...Components> inline EntityAlias<Components...> const &assume() const;
+  /// Remove all entries
+  inline void clear();
 
-  /// Removes a component. Error of it doesn't exist
-  template<typename C> inline void remove();
+  static const size_t slot_bits = 8;
+  static const size_t slot_count = size_t(1) << slot_bits;
+  static const size_t levels = 4;
 
-  /// Removes all components and call destructors
-  void inline remove_everything();
+ private:
+  inline void insert(Entry const &entry);
 
-  /// Clears the component mask without destroying components (faster than remove_everything)
-  void inline clear_mask();
+  /// Move the entries in the current slot of a level to lower levels
+  inline void cascade(size_t level);
 
-  /// Destroys this entity. Removes all components as well
-  void inline destroy();
+  inline std::vector<Entry> &slot(size_t level, uint64_t tick);
 
-  /// Return true if entity has all specified components. False otherwise
-  template<typename... Components> inline bool has();
-  template<typename... Components> inline bool has() const;
+  uint64_t now_;
+  size_t size_;
+  /// Allocated first when needed
+  std::vector<std::vector<Entry>> slots_;
+};
 
-  /// Returns whether an entity is an entity alias or not
-  template<typename T> inline bool is();
-  template<typename T> inline bool is() const;
+} // namespace details
 
-  /// Returns true if entity has not been destroyed. False otherwise
-  bool inline is_valid();
-  bool inline is_valid() const;
+} // namespace ecs
 
- private:
-  /// Return true if entity has all specified compoents. False otherwise
-  inline bool has(details::ComponentMask &check_mask);
-  inline bool has(details::ComponentMask const &check_mask) const;
+// #included from: TimingWheel.inl
+namespace ecs{
 
-  inline details::ComponentMask &mask();
-  inline details::ComponentMask const &mask() const;
+namespace details{
 
-  inline static details::ComponentMask static_mask();
+void TimingWheel::insert(Id id, uint64_t ticks) {
+  ECS_ASSERT(ticks > 0, "Entry must be due in the future");
+  ECS_ASSERT(ticks < (uint64_t(1) << (slot_bits * levels)), "Entry is due too far in the future");
+  Entry entry = {id, now_ + ticks};
+  insert(entry);
+  ++size_;
+}
 
-  EntityManager *manager_;
-  Id             id_;
+template<typename Lambda>
+void TimingWheel::advance(Lambda lambda) {
+  ++now_;
+  if (size_ == 0) return;
+  // Each level is cascaded when the level below has gone through all its slots
+  size_t level = 1;
+  while (level < levels && (now_ & ((uint64_t(1) << (slot_bits * level)) - 1)) == 0) {
+    ++level;
+  }
+  for (size_t i = level - 1; i > 0; --i) {
+    cascade(i);
+  }
+  std::vector<Entry> due;
+  due.swap(slot(0, now_));
+  size_ -= due.size();
+  for (Entry const &entry : due) {
+    lambda(entry);
+  }
+}
 
-  friend class EntityManager;
-}; //Entity
+void TimingWheel::clear() {
+  slots_.clear();
+  size_ = 0;
+}
 
-inline bool operator==(const Entity &lhs, const Entity &rhs);
-inline bool operator!=(const Entity &lhs, const Entity &rhs);
+void TimingWheel::insert(Entry const &entry) {
+  uint64_t ticks = entry.due - now_;
+  size_t level = 0;
+  while (level + 1 < levels && ticks >= (uint64_t(1) << (slot_bits * (level + 1)))) {
+    ++level;
+  }
+  slot(level, entry.due).push_back(entry);
+}
+
+void TimingWheel::cascade(size_t level) {
+  std::vector<Entry> entries;
+  entries.swap(slot(level, now_));
+  for (Entry const &entry : entries) {
+    insert(entry);
+  }
+}
+
+std::vector<TimingWheel::Entry> &TimingWheel::slot(size_t level, uint64_t tick) {
+  if (slots_.empty()) slots_.resize(levels * slot_count);
+  return slots_[level * slot_count + ((tick >> (slot_bits * level)) & (slot_count - 1))];
+}
+
+} // namespace details
 
 } // namespace ecs
+#endif //ECS_TIMINGWHEEL_H
+// #included from: MaskScan.h
+#ifndef ECS_MASKSCAN_H
+#define ECS_MASKSCAN_H
+
+#if !defined(ECS_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#define ECS_SSE2
+#include <emmintrin.h>
+#endif
 
-// #included from: Entity.inl
-// #included from: EntityAlias.h
-#ifndef ECS_ENTITYALIAS_H
-#define ECS_ENTITYALIAS_H
+#if !defined(ECS_NO_SIMD) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define ECS_AVX2_DISPATCH
+#include <immintrin.h>
+#endif
 
-// #included from: BaseEntity.h
-//
-// Created by Robin Grönberg on 05/12/15.
-//
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
-#ifndef OPENECS_BASEENTITY_H
-#define OPENECS_BASEENTITY_H
+///--------------------------------------------------------------------
+/// This file contains functions for finding which entities have a set
+/// of components, by scanning their component masks
+///--------------------------------------------------------------------
+///
+/// Up to 64 masks are tested at a time, giving a bitmap with one bit
+/// for each mask that has every component. When the ComponentMask is
+/// 64 bits, AVX2 tests 4 masks per instruction, if the CPU supports it,
+/// and SSE2 tests 2. Otherwise the masks are tested one by one.
+/// Define ECS_NO_SIMD to always test them one by one.
+///--------------------------------------------------------------------
 
-namespace ecs {
+namespace ecs{
 
-namespace details {
+namespace details{
 
-class BaseEntity {
+/// The index of the lowest set bit. Bits must not be 0
+inline unsigned count_trailing_zeros(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+  return unsigned(__builtin_ctzll(bits));
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+  _BitScanForward64(&index, bits);
+  return unsigned(index);
+#else
+  unsigned index = 0;
+  while (!(bits & 1)) {
+    bits >>= 1;
+    ++index;
+  }
+  return index;
+#endif
+}
+
+inline size_t count_bits(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+  return size_t(__builtin_popcountll(bits));
+#else
+  size_t count = 0;
+  for (; bits; bits &= bits - 1) ++count;
+  return count;
+#endif
+}
+
+/// Test the masks one by one
+inline uint64_t match_masks_scalar(ComponentMask const *masks, size_t count, ComponentMask const &mask) {
+  uint64_t matches = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if ((masks[i] & mask) == mask) matches |= uint64_t(1) << i;
+  }
+  return matches;
+}
+
+/// The memory of a 64 bit ComponentMask, as it is laid out in an array of masks
+inline uint64_t mask_as_word(ComponentMask const &mask) {
+  uint64_t word;
+  std::memcpy(&word, &mask, sizeof(word));
+  return word;
+}
+
+#ifdef ECS_SSE2
+/// Test 2 masks per instruction. A mask has every component when no bit
+/// of the requested mask is missing in it
+inline uint64_t match_masks_sse2(ComponentMask const *masks, size_t count, ComponentMask const &mask) {
+  __m128i requested = _mm_set1_epi64x((long long) mask_as_word(mask));
+  __m128i zero = _mm_setzero_si128();
+  uint64_t matches = 0;
+  size_t i = 0;
+  for (; i + 2 <= count; i += 2) {
+    __m128i missing = _mm_andnot_si128(_mm_loadu_si128(reinterpret_cast<__m128i const *>(masks + i)), requested);
+    // One bit per 32 bit half, and both halves of a mask must be 0
+    unsigned zero_halves = unsigned(_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(missing, zero))));
+    unsigned both = zero_halves & (zero_halves >> 1);
+    matches |= uint64_t((both & 1) | ((both >> 1) & 2)) << i;
+  }
+  if (i < count) matches |= match_masks_scalar(masks + i, count - i, mask) << i;
+  return matches;
+}
+#endif
+
+#ifdef ECS_AVX2_DISPATCH
+/// Test 4 masks per instruction
+__attribute__((target("avx2")))
+inline uint64_t match_masks_avx2(ComponentMask const *masks, size_t count, ComponentMask const &mask) {
+  __m256i requested = _mm256_set1_epi64x((long long) mask_as_word(mask));
+  __m256i zero = _mm256_setzero_si256();
+  uint64_t matches = 0;
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m256i missing = _mm256_andnot_si256(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(masks + i)), requested);
+    unsigned found = unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(missing, zero))));
+    matches |= uint64_t(found) << i;
+  }
+  if (i < count) matches |= match_masks_scalar(masks + i, count - i, mask) << i;
+  return matches;
+}
+
+inline bool has_avx2() {
+  static const bool avx2 = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+  }();
+  return avx2;
+}
+#endif
+
+/// Test at most 64 masks. Bit i of the result is set if masks[i] has
+/// every component in mask
+inline uint64_t match_masks(ComponentMask const *masks, size_t count, ComponentMask const &mask) {
+  ECS_ASSERT(count <= 64, "At most 64 masks can be tested at a time");
+#if defined(ECS_SSE2) || defined(ECS_AVX2_DISPATCH)
+  if (sizeof(ComponentMask) == sizeof(uint64_t)) {
+#ifdef ECS_AVX2_DISPATCH
+    if (has_avx2()) return match_masks_avx2(masks, count, mask);
+#endif
+#ifdef ECS_SSE2
+    return match_masks_sse2(masks, count, mask);
+#endif
+  }
+#endif
+  return match_masks_scalar(masks, count, mask);
+}
+
+/// Count how many masks have every component in mask
+inline size_t count_matches(ComponentMask const *masks, size_t count, ComponentMask const &mask) {
+  size_t matches = 0;
+  for (size_t i = 0; i < count; i += 64) {
+    matches += count_bits(match_masks(masks + i, std::min<size_t>(64, count - i), mask));
+  }
+  return matches;
+}
+
+} // namespace details
+
+} // namespace ecs
+
+#endif //ECS_MASKSCAN_H
+// #included from: EventChannel.h
+#ifndef ECS_EVENTCHANNEL_H
+#define ECS_EVENTCHANNEL_H
+
+namespace ecs{
+
+namespace details{
+
+///---------------------------------------------------------------------
+/// Helper class, all EventChannels are a BaseEventChannel
+///---------------------------------------------------------------------
+class BaseEventChannel {
  public:
-  inline BaseEntity(const Entity &entity);
- protected:
-  inline BaseEntity();
-  inline BaseEntity(EntityManager* manager);
-  inline BaseEntity(const BaseEntity &other);
-  inline BaseEntity& operator=(const BaseEntity& other) { entity_ = other.entity_; return *this; }
+  virtual ~BaseEventChannel() { }
+  /// Make the events emitted since the last swap readable
+  virtual void swap() = 0;
+  /// How many events are readable
+  virtual size_t size() const = 0;
+};
 
-  inline EntityManager &entities() { return *manager_; }
-  inline Entity &entity() { return entity_; }
-  inline EntityManager const& entities() const { return *manager_; }
-  inline Entity const& entity() const { return entity_; }
+} // namespace details
+
+///---------------------------------------------------------------------
+/// An EventChannel is used to send events of type E between systems
+///---------------------------------------------------------------------
+///
+/// Events are double buffered per update. Events emitted during one
+/// update can be read during the next, as one contiguous array, after
+/// the channel is swapped. SystemManager::update swaps every channel
+/// of its EntityManager.
+///
+/// Events can be emitted from any number of threads at the same time,
+/// through a Writer each. A Writer appends to its own buffer, so no
+/// locking is done. The buffers are gathered when the channel is
+/// swapped, which must not be done while any Writer is emitting.
+///
+/// Any number of Readers can read the same events. A Reader remembers
+/// which events it has read, so that a system that is not updated every
+/// update reads the events it has not seen yet, as long as they are
+/// still readable.
+///
+///---------------------------------------------------------------------
+template<typename E>
+class EventChannel: public details::BaseEventChannel, details::forbid_copies {
  private:
-  union {
-    EntityManager *manager_;
-    Entity entity_;
+  // Buffer for one Writer. Buffers are kept until the channel is destroyed,
+  // and reused by new Writers.
+  struct Buffer {
+    std::vector<E> events;
+    std::atomic<bool> used;
+    Buffer *next;
   };
-}; //BaseEntity
 
-} // namespace details
+ public:
+  ///---------------------------------------------------------------------
+  /// A Writer emits events from a single thread. It must not outlive
+  /// the channel.
+  ///---------------------------------------------------------------------
+  class Writer {
+   public:
+    Writer(Writer &&other) : buffer_(other.buffer_) { other.buffer_ = nullptr; }
+    inline Writer &operator=(Writer &&other);
+    Writer(const Writer &) = delete;
+    Writer &operator=(const Writer &) = delete;
+    inline ~Writer();
+
+    inline void emit(E const &event) { buffer_->events.push_back(event); }
+    inline void emit(E &&event) { buffer_->events.push_back(std::move(event)); }
+
+    template<typename ...Args>
+    inline void emplace(Args &&... args) { buffer_->events.emplace_back(std::forward<Args>(args)...); }
+
+   private:
+    Writer(Buffer *buffer) : buffer_(buffer) { }
+    Buffer *buffer_;
+    friend class EventChannel;
+  };
+
+  ///---------------------------------------------------------------------
+  /// A Reader reads every readable event once
+  ///---------------------------------------------------------------------
+  class Reader {
+   public:
+    /// Call lambda for every readable event that this Reader has not read.
+    /// Returns the number of events read.
+    template<typename Lambda>
+    inline size_t read(Lambda lambda);
+
+    /// How many readable events this Reader has not read
+    inline size_t unread() const;
+
+    /// How many events this Reader missed, because they were no longer
+    /// readable when it read
+    inline size_t missed() const { return missed_; }
+
+   private:
+    Reader(EventChannel const &channel, uint64_t next) : channel_(&channel), next_(next), missed_(0) { }
+    EventChannel const *channel_;
+    /// Sequence number of the next event to read
+    uint64_t next_;
+    size_t missed_;
+    friend class EventChannel;
+  };
+
+  inline EventChannel() : first_(0), buffers_(nullptr) { }
+  inline ~EventChannel();
+
+  /// Emit an event from the thread that owns the EntityManager
+  inline void emit(E const &event) { pending_.push_back(event); }
+  inline void emit(E &&event) { pending_.push_back(std::move(event)); }
+
+  template<typename ...Args>
+  inline void emplace(Args &&... args) { pending_.emplace_back(std::forward<Args>(args)...); }
+
+  /// Get a Writer, for emitting events from another thread. Can be
+  /// called from any thread.
+  inline Writer writer();
+
+  /// Get a Reader, that reads events that become readable after this call
+  inline Reader reader() const { return Reader(*this, first_ + events_.size()); }
+
+  /// The events that are readable, emitted before the last swap
+  inline std::vector<E> const &events() const { return events_; }
+  inline size_t size() const override { return events_.size(); }
+  inline bool empty() const { return events_.empty(); }
+
+  /// Make the events emitted since the last swap readable. Events that
+  /// were readable are dropped.
+  inline void swap() override;
+
+ private:
+  /// Readable events, and the sequence number of the first of them
+  std::vector<E> events_;
+  uint64_t first_;
+  /// Events emitted through the channel itself
+  std::vector<E> pending_;
+  /// Lock free list of Writer buffers
+  std::atomic<Buffer *> buffers_;
+};
 
 } // namespace ecs
 
-// #included from: BaseEntity.inl
+// #included from: EventChannel.inl
+namespace ecs{
 
+template<typename E>
+typename EventChannel<E>::Writer &EventChannel<E>::Writer::operator=(Writer &&other) {
+  if (this != &other) {
+    if (buffer_) buffer_->used.store(false, std::memory_order_release);
+    buffer_ = other.buffer_;
+    other.buffer_ = nullptr;
+  }
+  return *this;
+}
+
+template<typename E>
+EventChannel<E>::Writer::~Writer() {
+  // Emitted events are kept in the buffer until the channel is swapped
+  if (buffer_) buffer_->used.store(false, std::memory_order_release);
+}
+
+template<typename E> template<typename Lambda>
+size_t EventChannel<E>::Reader::read(Lambda lambda) {
+  std::vector<E> const &events = channel_->events_;
+  uint64_t first = channel_->first_;
+  if (next_ < first) {
+    missed_ += size_t(first - next_);
+    next_ = first;
+  }
+  size_t count = size_t(first + events.size() - next_);
+  for (size_t i = size_t(next_ - first); i < events.size(); ++i) {
+    lambda(events[i]);
+  }
+  next_ = first + events.size();
+  return count;
+}
+
+template<typename E>
+size_t EventChannel<E>::Reader::unread() const {
+  uint64_t end = channel_->first_ + channel_->events_.size();
+  return size_t(end - std::max(next_, channel_->first_));
+}
+
+template<typename E>
+EventChannel<E>::~EventChannel() {
+  Buffer *buffer = buffers_.load(std::memory_order_acquire);
+  while (buffer) {
+    Buffer *next = buffer->next;
+    delete buffer;
+    buffer = next;
+  }
+}
+
+template<typename E>
+typename EventChannel<E>::Writer EventChannel<E>::writer() {
+  // Reuse the buffer of a Writer that is destroyed
+  for (Buffer *buffer = buffers_.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+    bool used = false;
+    if (buffer->used.compare_exchange_strong(used, true, std::memory_order_acquire)) {
+      return Writer(buffer);
+    }
+  }
+  Buffer *buffer = new Buffer();
+  buffer->used.store(true, std::memory_order_relaxed);
+  buffer->next = buffers_.load(std::memory_order_relaxed);
+  while (!buffers_.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed)) { }
+  return Writer(buffer);
+}
+
+template<typename E>
+void EventChannel<E>::swap() {
+  first_ += events_.size();
+  // The old events are cleared, but their memory is reused for the next update
+  events_.clear();
+  events_.swap(pending_);
+  for (Buffer *buffer = buffers_.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+    events_.insert(events_.end(),
+                   std::make_move_iterator(buffer->events.begin()),
+                   std::make_move_iterator(buffer->events.end()));
+    buffer->events.clear();
+  }
+}
+
+} // namespace ecs
+#endif //ECS_EVENTCHANNEL_H
+// #included from: GuidIndex.h
+#ifndef ECS_GUIDINDEX_H
+#define ECS_GUIDINDEX_H
+
+namespace ecs{
+
+///---------------------------------------------------------------------
+/// Guid is a component for identifying an entity by a stable 64 bit
+/// value, that is chosen by the user
+///---------------------------------------------------------------------
+///
+/// An entity with a Guid can be found with EntityManager::find_guid.
+/// Two entities must not have the same Guid.
+///
+/// @usage entities.create_with<Guid, Position>(1234, Position{0, 0});
+///        Entity entity = entities.find_guid(1234);
+///---------------------------------------------------------------------
+struct Guid: Property<uint64_t> {
+  Guid() { }
+  Guid(uint64_t value) : Property<uint64_t>(value) { }
+};
+
+namespace details{
+
+///---------------------------------------------------------------------
+/// GuidIndex is a hash table from Guid to entity index
+///---------------------------------------------------------------------
+///
+/// The table uses open addressing, so no memory is allocated for each
+/// entry. Each slot has a control byte, that tells if the slot is empty,
+/// deleted, or holds an entry with 7 specific bits of the hash. Slots
+/// are probed in groups of 16 control bytes, which are compared at once
+/// with SSE2 if available.
+///
+/// The index is kept up to date by the ComponentManager of Guid. A Guid
+/// that is changed through a reference is not seen, so its entry keeps
+/// the old value until the component is removed. EntityManager::find_guid
+/// checks the component of the entity it finds for that reason.
+///---------------------------------------------------------------------
+class GuidIndex: public ComponentAggregate<Guid>, forbid_copies {
+ public:
+  static const size_t group_size = 16;
+
+  inline GuidIndex() : size_(0), deleted_(0) { reset(); }
+
+  /// The index of the entity with guid, or false if there is none
+  inline bool find(uint64_t guid, index_t &index) const;
+
+  inline size_t size() const { return size_; }
+
+  void add(index_t index, Guid const &guid) override { insert(guid.value, index); }
+  void remove(index_t index, Guid const &guid) override { erase(guid.value, index); }
+  inline void reset() override;
+
+ private:
+  struct Slot {
+    uint64_t guid;
+    index_t index;
+  };
+
+  /// Control bytes of slots without an entry. Slots with an entry have
+  /// 7 bits of the hash as control byte
+  enum : int8_t {
+    empty = -128,
+    deleted = -2
+  };
+
+  static inline uint64_t hash(uint64_t guid);
+  static inline int8_t control_of(uint64_t hash) { return int8_t(hash & 0x7F); }
+
+  /// Bit i is set if control byte pos + i is value
+  inline uint32_t match(size_t pos, int8_t value) const;
+  /// Bit i is set if control byte pos + i is empty or deleted
+  inline uint32_t match_free(size_t pos) const;
+
+  inline void insert(uint64_t guid, index_t index);
+  /// Remove the entry of guid at index. If there is none, because the
+  /// Guid was changed through a reference, the entry at index is found
+  /// by looking at every slot
+  inline void erase(uint64_t guid, index_t index);
+  inline void set_control(size_t slot, int8_t value);
+  inline void rehash(size_t capacity);
+
+  /// The capacity is a power of 2, of at least group_size. The first
+  /// group_size control bytes are repeated after the last one, so that a
+  /// group can be read from any slot.
+  std::vector<int8_t> control_;
+  std::vector<Slot> slots_;
+  size_t size_;
+  size_t deleted_;
+};
+
+} // namespace details
+
+} // namespace ecs
+
+// #included from: GuidIndex.inl
+namespace ecs{
+
+namespace details{
+
+bool GuidIndex::find(uint64_t guid, index_t &index) const {
+  uint64_t h = hash(guid);
+  int8_t control = control_of(h);
+  size_t mask = slots_.size() - 1;
+  size_t pos = size_t(h >> 7) & mask;
+  for (size_t probed = 0; probed < slots_.size(); probed += group_size) {
+    for (uint32_t matches = match(pos, control); matches; matches &= matches - 1) {
+      Slot const &slot = slots_[(pos + count_trailing_zeros(matches)) & mask];
+      if (slot.guid == guid) {
+        index = slot.index;
+        return true;
+      }
+    }
+    // The guid would have been put in the first empty slot
+    if (match(pos, empty)) return false;
+    pos = (pos + group_size) & mask;
+  }
+  return false;
+}
+
+void GuidIndex::reset() {
+  control_.assign(2 * group_size, empty);
+  slots_.assign(group_size, Slot());
+  size_ = 0;
+  deleted_ = 0;
+}
+
+uint64_t GuidIndex::hash(uint64_t guid) {
+  // Guids may be sequential, so every bit is mixed into every other
+  guid ^= guid >> 30;
+  guid *= 0xbf58476d1ce4e5b9ULL;
+  guid ^= guid >> 27;
+  guid *= 0x94d049bb133111ebULL;
+  guid ^= guid >> 31;
+  return guid;
+}
+
+uint32_t GuidIndex::match(size_t pos, int8_t value) const {
+#ifdef ECS_SSE2
+  __m128i group = _mm_loadu_si128(reinterpret_cast<__m128i const *>(&control_[pos]));
+  return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(value))));
+#else
+  uint32_t matches = 0;
+  for (size_t i = 0; i < group_size; ++i) {
+    if (control_[pos + i] == value) matches |= uint32_t(1) << i;
+  }
+  return matches;
+#endif
+}
+
+uint32_t GuidIndex::match_free(size_t pos) const {
+  // Empty and deleted are the only negative control bytes
+#ifdef ECS_SSE2
+  return uint32_t(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const *>(&control_[pos]))));
+#else
+  uint32_t matches = 0;
+  for (size_t i = 0; i < group_size; ++i) {
+    if (control_[pos + i] < 0) matches |= uint32_t(1) << i;
+  }
+  return matches;
+#endif
+}
+
+void GuidIndex::insert(uint64_t guid, index_t index) {
+  index_t existing;
+  ECS_ASSERT(!find(guid, existing), "Guid is already used by another entity");
+  (void) existing;
+  // At most 7/8 of the slots are used or deleted
+  if ((size_ + deleted_ + 1) * 8 > slots_.size() * 7) {
+    size_t capacity = slots_.size();
+    while ((size_ + 1) * 2 > capacity) capacity *= 2;
+    rehash(capacity);
+  }
+  uint64_t h = hash(guid);
+  size_t mask = slots_.size() - 1;
+  size_t pos = size_t(h >> 7) & mask;
+  uint32_t free = match_free(pos);
+  while (!free) {
+    pos = (pos + group_size) & mask;
+    free = match_free(pos);
+  }
+  size_t slot = (pos + count_trailing_zeros(free)) & mask;
+  if (control_[slot] == deleted) --deleted_;
+  set_control(slot, control_of(h));
+  slots_[slot].guid = guid;
+  slots_[slot].index = index;
+  ++size_;
+}
+
+void GuidIndex::erase(uint64_t guid, index_t index) {
+  uint64_t h = hash(guid);
+  int8_t control = control_of(h);
+  size_t mask = slots_.size() - 1;
+  size_t pos = size_t(h >> 7) & mask;
+  size_t found = slots_.size();
+  for (size_t probed = 0; probed < slots_.size() && found == slots_.size(); probed += group_size) {
+    for (uint32_t matches = match(pos, control); matches; matches &= matches - 1) {
+      size_t slot = (pos + count_trailing_zeros(matches)) & mask;
+      if (slots_[slot].guid == guid && slots_[slot].index == index) {
+        found = slot;
+        break;
+      }
+    }
+    if (match(pos, empty)) break;
+    pos = (pos + group_size) & mask;
+  }
+  for (size_t slot = 0; found == slots_.size() && slot < slots_.size(); ++slot) {
+    if (control_[slot] >= 0 && slots_[slot].index == index) found = slot;
+  }
+  ECS_ASSERT(found < slots_.size(), "Guid is not in the index");
+  if (found == slots_.size()) return;
+  // Later guids may have been probed past this slot, so it can't be made empty
+  set_control(found, deleted);
+  --size_;
+  ++deleted_;
+}
+
+void GuidIndex::set_control(size_t slot, int8_t value) {
+  control_[slot] = value;
+  if (slot < group_size) control_[slots_.size() + slot] = value;
+}
+
+void GuidIndex::rehash(size_t capacity) {
+  std::vector<int8_t> control;
+  std::vector<Slot> slots;
+  control.swap(control_);
+  slots.swap(slots_);
+  control_.assign(capacity + group_size, empty);
+  slots_.resize(capacity);
+  size_ = 0;
+  deleted_ = 0;
+  for (size_t slot = 0; slot < slots.size(); ++slot) {
+    if (control[slot] >= 0) insert(slots[slot].guid, slots[slot].index);
+  }
+}
+
+} // namespace details
+
+} // namespace ecs
+#endif //ECS_GUIDINDEX_H
 namespace ecs {
 
-namespace details {
+/// Forward declareations
+template <typename...>
+class EntityAlias;
+class Entity;
+class UnallocatedEntity;
+template<typename>
+class View;
+template<typename...>
+class EntityShard;
+template<typename, typename...>
+class Replicator;
+class Id;
+template<typename>
+struct MinMax;
+
+namespace details{
+
+/// Used to iterate through the EntityManager with a lambda-expression,
+/// with each argument as a specific component type. Used by with
+/// function.
+template<size_t N, typename...>
+struct with_t;
+
+/// Used to reduce all entities with specific components into one value,
+/// on several threads. Used by reduce and its variants.
+template<typename...>
+struct reduce_t;
+
+/// Used to write components as columns. Used by export_columns.
+template<typename...>
+struct columns_t;
+
+} // namespace details
+
+///---------------------------------------------------------------------
+/// This is the main class for holding all Entities and Components
+///---------------------------------------------------------------------
+///
+/// It uses a vector for holding entity versions and another for component
+/// masks. It also uses 1 memory pool for each type of component.
+///
+/// The index of each data structure is used to identify each entity.
+/// The version is used for checking if entity is valid.
+/// The component mask is used to check what components an entity has
+///
+/// The Entity id = {index + version}. When an Entity is removed,
+/// the index is added to the free list. A free list knows where spaces are
+/// left open for new entities (to ensure no holes).
+///
+///---------------------------------------------------------------------
+class EntityManager: details::forbid_copies {
+ private:
+  // Class for accessing where to put entities with specific components.
+  struct IndexAccessor {
+    // Used to store next available index there is within each block
+    std::vector <index_t> block_index;
+    // Used to store all indexes that are free
+    std::vector <index_t> free_list;
+  };
+
+ public:
+  inline EntityManager(size_t chunk_size = 8192);
+  inline ~EntityManager();
+
+  /// Create a new Entity
+  inline UnallocatedEntity create();
+
+  /// Create a specified number of new entities.
+  inline std::vector <Entity> create(const size_t num_of_entities);
+
+  /// Create a specified number of new entities, and do something with each entity
+  template<typename T>
+  inline void create(const size_t num_of_entities, T lambda);
+
+  /// Create, using EntityAlias
+  template<typename T, typename ...Args>
+  inline auto create(Args &&... args) -> typename std::enable_if<!std::is_constructible<T, Args...>::value, T>::type;
+  template<typename T, typename ...Args>
+  inline auto create(Args &&... args) -> typename std::enable_if<std::is_constructible<T, Args...>::value, T>::type;
+
+  /// Create an entity with components assigned
+  template<typename ...Components, typename ...Args>
+  inline auto create_with(Args && ... args ) ->
+      typename std::conditional<(sizeof...(Components) > 0), EntityAlias<Components...>, EntityAlias<Args...>>::type;
+
+  /// Create an entity with components assigned, using default values
+  template<typename ...Components>
+  inline EntityAlias<Components...> create_with();
+
+  // Access a View of all entities with specified components
+  template<typename ...Components>
+  inline View <EntityAlias<Components...>> with();
+
+  // Iterate through all entities with all components, specified as lambda parameters
+  // example: entities.with([] (Position& pos) {  });
+  template<typename T>
+  inline void with(T lambda);
+
+  /// Reduce the components of every entity with Components into one value.
+  /// map(Components const &...) gives the value of each entity, and
+  /// combine(T, T) combines two values. The entities are reduced in
+  /// slices, on up to threads threads (0 uses up to one thread per core,
+  /// and one per ECS_REDUCE_SLICES_PER_THREAD slices), and the partial
+  /// results are combined in the order of the entities, so the result is
+  /// the same for any number of threads. map and combine are called from
+  /// several threads at the same time, and the EntityManager must not be
+  /// modified until reduce returns. Returns init combined with the
+  /// result, or init if no entity has Components.
+  /// example: entities.reduce<Health>(0.f,
+  ///              [] (Health const &health) { return health.value; },
+  ///              [] (float a, float b) { return a + b; });
+  template<typename ...Components, typename T, typename Map, typename Combine>
+  inline T reduce(T init, Map map, Combine combine, size_t threads = 0) const;
+
+  /// The sum, the smallest and the largest value of component C, over
+  /// every entity that has it. A default constructed value is given if no
+  /// entity has C. Reduced in the same way as reduce.
+  template<typename C>
+  inline typename details::component_value<C>::type sum(size_t threads = 0) const;
+  template<typename C>
+  inline typename details::component_value<C>::type min(size_t threads = 0) const;
+  template<typename C>
+  inline typename details::component_value<C>::type max(size_t threads = 0) const;
+
+  /// Count the entities that have every component in Components
+  template<typename C, typename ...Components>
+  inline size_t count() const;
+
+  /// Find the entities with the smallest and the largest key(Components const &...).
+  /// If several entities have the same key, the one with the lowest index is given.
+  template<typename ...Components, typename Key>
+  inline MinMax<typename details::function_traits<Key>::return_type> minmax_by(Key key, size_t threads = 0) const;
+
+  /// The k entities with the largest value of component C, largest first.
+  /// Entities with equal values are given in the order of their index. The
+  /// k largest values of each slice of entities are selected on several
+  /// threads, like in reduce, before the k largest of those are selected.
+  template<typename C>
+  inline std::vector<Id> top_k(size_t k, size_t threads = 0) const;
+
+  /// The k entities within view with the largest value of component C
+  template<typename C, typename T>
+  inline std::vector<Id> top_k(size_t k, View<T> const &view, size_t threads = 0) const;
+
+  /// The k entities with the largest key(Components const &...)
+  template<typename ...Components, typename Key>
+  inline std::vector<Id> top_k_by(size_t k, Key key, size_t threads = 0) const;
+
+  /// An approximate value of component C, that q of the values are less
+  /// than. q = 0.5 gives the median. The values are summarized by at most 64
+  /// values per slice of entities, so the value is within about 1/64 of a
+  /// slice from the exact quantile. A default constructed value is given if
+  /// no entity has C.
+  template<typename C>
+  inline typename details::component_value<C>::type quantile(double q, size_t threads = 0) const;
+
+  /// Approximate values for several quantiles at once
+  template<typename C>
+  inline std::vector<typename details::component_value<C>::type> quantiles(std::vector<double> const &qs,
+                                                                           size_t threads = 0) const;
+
+  /// Keep an Aggregate of every component of type C up to date.
+  /// add(T &value, C const &component) adds a component to the value, and
+  /// remove(T &value, C const &component) takes it away again. The Aggregate
+  /// is updated when a component is added, set, removed or destroyed, so
+  /// reading it is O(1). Changes made through a reference to a component
+  /// are not seen, so use Entity::set to change the component. The
+  /// Aggregate exists as long as the EntityManager does.
+  /// example: entities.aggregate<Health>(0,
+  ///              [] (int &total, Health const &health) { total += health.value; },
+  ///              [] (int &total, Health const &health) { total -= health.value; });
+  template<typename C, typename T, typename Add, typename Remove>
+  inline Aggregate<T> const &aggregate(T init, Add add, Remove remove);
+
+  /// Keep the sum of every component of type C up to date
+  template<typename C>
+  inline Aggregate<typename details::component_value<C>::type> const &aggregate_sum();
+
+  /// Keep the number of components of type C with each key(C const &) up to date
+  template<typename C, typename Key>
+  inline Aggregate<std::map<typename details::function_traits<Key>::return_type, size_t>> const &
+  aggregate_count_by(Key key);
+
+  // Access a View of all entities that has every component as Specified EntityAlias
+  template<typename T>
+  inline View <T> fetch_every();
+
+  // Access a View of all entities that has every component as Specified EntityAlias specified as lambda parameters
+  // example: entities.fetch_every([] (EntityAlias<Position>& entity) {  });
+  template<typename T>
+  inline void fetch_every(T lambda);
+
+  /// Reserve memory for at least num_of_entities entities with Components.
+  /// The entities can then be created from another thread, using the
+  /// returned EntityShard. The shard must be merged or destroyed before
+  /// this EntityManager is destroyed.
+  template<typename ...Components>
+  inline EntityShard<Components...> create_shard(size_t num_of_entities);
+
+  /// Make all entities created by an EntityShard visible. Must be called
+  /// from the thread that owns the EntityManager.
+  template<typename ...Components>
+  inline void merge(EntityShard<Components...> &shard);
+
+  /// Pairs of old and new Id, for entities that are moved between EntityManagers
+  using IdRemap = std::vector<std::pair<Id, Id>>;
+
+  /// Move all entities from another EntityManager into this one. Memory
+  /// for components is handed over, without copying each component.
+  /// Entities that are set to expire expire after the time that remains.
+  /// The other EntityManager is empty afterwards.
+  inline IdRemap merge(EntityManager &&other);
+
+  /// Move all entities in a view to another EntityManager. Blocks where
+  /// every entity is moved are handed over, without copying each component.
+  /// Entities that are set to expire expire after the time that remains.
+  template<typename T>
+  inline IdRemap move_entities(View<T> view, EntityManager &target);
+
+  /// Create a copy of this EntityManager. Component memory is shared
+  /// between the copies, and is copied first when modified. Must not
+  /// be called while any EntityShard is being filled.
+  inline std::unique_ptr<EntityManager> fork();
+
+  /// Write Components of every entity that has any of them to out, as one
+  /// column per component, that can be read with Columns. Each row is an
+  /// entity, and each column has a bitmap of which entities that have the
+  /// component. Components must be trivially copyable. To export while the
+  /// EntityManager is being modified, export a fork on another thread.
+  template<typename ...Components>
+  inline void export_columns(std::ostream &out) const;
+
+  /// Write Components of every entity within view, that has any component
+  template<typename ...Components, typename T>
+  inline void export_columns(std::ostream &out, View<T> const &view) const;
+
+  /// Create an entity for each row of columns that are written by
+  /// export_columns, and read from in. Components must be the exported
+  /// components, in the same order. The rows are read ECS_IMPORT_BATCH_SIZE
+  /// at a time, so memory use does not grow with the number of rows, and
+  /// the entities of each batch are given blocks together. in must be
+  /// seekable. progress(size_t imported, size_t total) is called after each
+  /// batch. The entities get new Ids. Returns how many entities are created.
+  template<typename ...Components, typename Progress>
+  inline size_t import_columns(std::istream &in, Progress progress);
+  template<typename ...Components>
+  inline size_t import_columns(std::istream &in);
+
+  /// Keep the previous value of every component of type C, readable
+  /// with Entity::previous. Systems can then read the previous values
+  /// while other systems modify the current ones. Previous values only
+  /// exist for components that existed at the last swap. C must be
+  /// trivially copyable. Forks, and EntityManagers that entities are
+  /// merged or moved into, double buffer C too.
+  template<typename C>
+  inline void double_buffer();
+
+  /// Make the current values readable as previous values, for every
+  /// double buffered component. Which entities have each component is
+  /// recorded too, which takes time in proportion to the number of
+  /// entities. Called by SystemManager::update.
+  inline void swap_buffers();
+
+  /// Advance the time used for expiring entities, and destroy every entity
+  /// that has expired. Called by SystemManager::update. Returns the number
+  /// of destroyed entities.
+  inline size_t update_expiry(float time);
+
+  /// Set how many seconds each tick of the expiry time is. Expiry times are
+  /// rounded up to whole ticks. Can't be changed while entities are set to expire.
+  inline void set_expiry_resolution(float seconds);
+
+  /// How many entities are set to expire
+  inline size_t expiring_count() const { return expiring_count_; }
+
+  /// Get the EventChannel for events of type E. It is created the
+  /// first time it is used.
+  template<typename E>
+  inline EventChannel<E> &events();
+
+  /// Make the events emitted since the last swap readable, for every
+  /// EventChannel. Called by SystemManager::update.
+  inline void swap_events();
+
+  /// Set how many entities ahead the components are prefetched, when
+  /// iterating with a lambda. 0 turns prefetching off.
+  inline void set_prefetch_distance(size_t distance) { prefetch_distance_ = distance; }
+  inline size_t prefetch_distance() const { return prefetch_distance_; }
+
+  /// Find the entity with a Guid component of value guid. If there is no
+  /// such entity, the returned Entity is not valid. The Guids are indexed
+  /// the first time this is called, and the index is then kept up to date.
+  inline Entity find_guid(uint64_t guid);
+
+  // Get an Entity at specified index
+  inline Entity operator[](index_t index);
+
+  // Get an Entity with a specific Id. Id must be valid
+  inline Entity operator[](Id id);
+
+  // Get the Entity of a Handle. The entity must not be destroyed
+  inline Entity operator[](Handle handle);
+
+  /// Returns true if the entity of handle is not destroyed. False for a null Handle
+  inline bool is_valid(Handle handle) const;
+
+  // Get the Entity count for this EntityManager
+  inline size_t count();
+
+ private:
+
+  /// Creates an entity and put it close to entities
+  /// with similar components
+  inline Entity create_with_mask(details::ComponentMask mask);
+
+  /// Creates any number of entities > 0 and put them close to entities
+  /// with similar components
+  inline std::vector <Entity> create_with_mask(details::ComponentMask mask, const size_t num_of_entities);
+
+  /// Find indexes for any number of new entities with components, and append them to indexes
+  inline void allocate_indexes(details::ComponentMask mask, size_t num_of_entities, std::vector<index_t> &indexes);
+
+  /// Find a proper index for a new entity with components
+  inline index_t find_new_entity_index(details::ComponentMask mask);
+
+  /// Create a new block for this entity type.
+  inline void create_new_block(IndexAccessor &index_accessor, unsigned long mask_as_ulong, index_t next_free_index);
+
+  /// Give this entity type a block that is no longer used by any entity, or
+  /// create a new block if there is none. Returns the block
+  inline index_t claim_block(IndexAccessor &index_accessor, unsigned long mask_as_ulong, index_t next_free_index);
+
+  /// Take the blocks that are empty from the entity types that own them,
+  /// so that they can be claimed by any entity type
+  inline void recycle_empty_blocks();
+
+  /// Mark the blocks of a shard that have no entities as empty, so that
+  /// they are recycled, when the shard is merged or destroyed
+  inline void release_shard_blocks(index_t first_index, size_t capacity);
+
+  /// Create a new block that is marked as full, so that it is only used by the caller.
+  inline index_t create_full_block(IndexAccessor &index_accessor, unsigned long mask_as_ulong);
+
+  /// Find all indexes that are used by entities
+  inline std::vector<bool> used_slots() const;
+
+  /// Invalidates an entity, without destroying its components, and makes its index free for new entities
+  inline void release_slot(index_t index);
+
+  /// Make the entity at index expire after a number of seconds, or not at all
+  inline void set_expiry(index_t index, double seconds);
+  inline void clear_expiry(index_t index);
+
+  /// Make the entity at index expire when the entity at from_index of from would
+  inline void carry_expiry(EntityManager const &from, index_t from_index, index_t index);
+
+  /// Put an index that is no longer used in the free list of its block
+  inline void free_index(index_t index);
+
+  /// Removes all entities. Components that are not shared with a fork are destroyed
+  inline void clear_entities();
+
+  /// Become a copy of another EntityManager, sharing component memory with it.
+  /// Only chunks that were modified since they were last shared are released,
+  /// but the per entity records are copied, and every aggregate is recomputed,
+  /// so the cost is still proportional to the number of entities
+  inline void share_state(EntityManager &other);
+
+  /// Compute every aggregate from the start, after components are moved in bulk
+  inline void recompute_aggregates();
+
+  /// Add every component of the entity at index to the aggregates, or remove them
+  inline void aggregate_added(index_t index);
+  inline void aggregate_removed(index_t index);
+
+  /// The index of every Guid component, created when first used
+  inline details::GuidIndex &guid_index();
+
+  /// The Ids of the entities given by top_k
+  template<typename K>
+  inline std::vector<Id> top_k_ids(std::vector<std::pair<K, index_t>> const &selected) const;
+
+  /// Creates a ComponentManager. Mainly used by get_component_manager the first time its called
+  template<typename C, typename ...Args>
+  inline details::ComponentManager <C> &create_component_manager(Args &&... args);
+
+  /// Get the ComponentManager. Assumes that the component manager already exists.
+  template<typename C>
+  inline details::ComponentManager <C> &get_component_manager_fast();
+  template<typename C>
+  inline details::ComponentManager <C> const &get_component_manager_fast() const;
+
+  /// If no ComponentManager exists for C, no entity has it
+  template<typename C>
+  inline bool has_component_manager() const;
+
+  /// The address of component C at index first. The components up to the
+  /// next multiple of block_size are found by their offset from it. nullptr
+  /// if they may be in another chunk of memory, and have to be looked up
+  /// one by one. Assumes that the ComponentManager exists.
+  template<typename C>
+  inline C *get_block_ptr(index_t first, index_t block_size);
+  template<typename C>
+  inline C const *get_block_ptr(index_t first, index_t block_size) const;
+
+  /// Get the ComponentManager. Creates a component manager if it
+  /// doesn't exists for specified component type.
+  template<typename C>
+  inline details::ComponentManager <C> &get_component_manager();
+  template<typename C>
+  inline details::ComponentManager <C> const &get_component_manager() const;
+
+  inline details::BaseManager &get_component_manager(size_t component_index);
+  inline details::BaseManager const &get_component_manager(size_t component_index) const;
+
+  /// Get the ComponentManager. Creates a component manager, of the same type as
+  /// other_manager, if it doesn't exist.
+  inline details::BaseManager &get_component_manager(size_t component_index,
+                                                     details::BaseManager const &other_manager);
+
+  /// Get component for a specific entity or index. The previous value
+  /// is only available for double buffered components.
+  template<typename C>
+  inline C &get_component(Entity &entity);
+  template<typename C>
+  inline C const &get_component(Entity const &entity) const;
+
+  /// Get component for a specific entity or index. Assumes that a
+  /// ComponentManager exists for the specific component type.
+  template<typename C>
+  inline C const &get_previous_component(Entity const &entity) const;
+  template<typename C>
+  inline C &get_component_fast(index_t index);
+  template<typename C>
+  inline C const &get_component_fast(index_t index) const;
+  template<typename C>
+  inline C &get_component_fast(Entity &entity);
+  template<typename C>
+  inline C const &get_component_fast(Entity const &entity) const;
+
+  /// Use to create a component tmp that is assignable. Calls the constructor.
+  template<typename C, typename ...Args>
+  inline static auto create_tmp_component(Args &&... args) ->
+  typename std::enable_if<std::is_constructible<C, Args...>::value, C>::type {
+    return C(std::forward<Args>(args) ...);
+  }
+
+  /// Use to create a component tmp that is assignable. Uses uniform initialization.
+  template<typename C, typename ...Args>
+  inline static auto create_tmp_component(Args &&... args) ->
+  typename std::enable_if<
+      !std::is_constructible<C, Args...>::value &&
+          !std::is_base_of<details::BaseProperty, C>::value,
+      C>::type {
+    return C{std::forward<Args>(args) ...};
+  }
+
+  /// Use to create a component tmp that is assignable. Call the right constructor
+  /// Called when component is a property, and no constructor inaccessible.
+  template<typename C, typename ...Args>
+  inline static auto create_tmp_component(Args &&... args) ->
+  typename std::enable_if<
+      !std::is_constructible<C, Args...>::value &&
+          std::is_base_of<details::BaseProperty, C>::value,
+      C>::type {
+    static_assert(sizeof...(Args) == 1, ECS_ASSERT_MSG_ONLY_ONE_ARGS_PROPERTY_CONSTRUCTOR);
+    //static_assert(sizeof(C) == sizeof(std::tuple < Args... > ),
+    //"Cannot initilize component property. Please provide a constructor");
+    auto tmp = typename C::ValueType(std::forward<Args>(args)...);
+    return *reinterpret_cast<C *>(&tmp);
+  }
+
+  /// Creates a component for a specific entity with Args
+  template<typename C, typename ...Args>
+  inline C &create_component(Entity &entity, Args &&... args);
+
+  /// Removes a specific component from an entity.
+  template<typename C>
+  inline void remove_component(Entity &entity);
+
+  /// Removes a specific component from an entity. Assumes that
+  /// a ComponentManager exists for component type
+  template<typename C>
+  inline void remove_component_fast(Entity &entity);
+
+  /// Removes all components from a single entity
+  inline void remove_all_components(Entity &entity);
+
+  /// Clears the component mask without removing any components
+  inline void clear_mask(Entity &entity);
+
+  /// Set a component for a specific entity. It uses contructor if
+  /// entity does not have component. It uses assignment operator
+  /// if component already added
+  template<typename C, typename ...Args>
+  inline C &set_component(Entity &entity, Args &&... args);
+
+  /// Set a component for a specific entity. It assumes that the
+  /// entity already has the component and uses the assignment
+  /// operator.
+  template<typename C, typename ...Args>
+  inline C &set_component_fast(Entity &entity, Args &&... args);
+
+  /// Check if component has specified component types attached
+  inline bool has_component(Entity &entity, details::ComponentMask component_mask);
+  inline bool has_component(Entity const &entity, details::ComponentMask const &component_mask) const;
+  template<typename ...Components>
+  inline bool has_component(Entity &entity);
+  template<typename ...Components>
+  inline bool has_component(Entity const &entity) const;
+
+  /// Check if an entity is valid
+  inline bool is_valid(Entity &entity);
+  inline bool is_valid(Entity const &entity) const;
+
+  /// Destroy an entity. Also removed all added components
+  inline void destroy(Entity &entity);
+
+  /// Destroy an entity after a number of seconds, if it is still valid
+  inline void expire_in(Entity &entity, float seconds);
+
+  /// Get the entity mask from a specific entity or index
+  inline details::ComponentMask &mask(Entity &entity);
+  inline details::ComponentMask const &mask(Entity const &entity) const;
+  inline details::ComponentMask &mask(index_t index);
+  inline details::ComponentMask const &mask(index_t index) const;
+
+  /// Get an entity given its id or index. When using Id, it must always be valid
+  inline Entity get_entity(Id id);
+  inline Entity get_entity(index_t index);
+
+  /// Gey how many entities the EntityManager can handle atm
+  inline size_t capacity() const;
+
+  std::vector<details::BaseManager *> component_managers_;
+  std::vector <details::ComponentMask> component_masks_;
+  std::vector <version_t> entity_versions_;
+  std::vector <index_t> next_free_indexes_;
+  std::vector <size_t> index_to_component_mask;
+  std::map <size_t, IndexAccessor> component_mask_to_index_accessor_;
+  /// How many entities each block has
+  std::vector <index_t> block_entity_counts_;
+  /// Blocks that have become empty since they were last recycled. May contain
+  /// blocks that are used again, or the same block more than once
+  std::vector <index_t> empty_blocks_;
+  /// Blocks that are not owned by any entity type
+  std::vector <index_t> free_blocks_;
+
+  /// Entities that are set to expire, and the tick each entity expires at (0 if not set)
+  details::TimingWheel expiry_wheel_;
+  std::vector<uint64_t> expiry_ticks_;
+  /// How many of expiry_ticks_ are set. The wheel also holds entries that are cancelled
+  size_t expiring_count_ = 0;
+  double expiry_resolution_ = 1.0 / 60;
+  /// Time passed that is not yet a whole expiry tick
+  double expiry_time_ = 0;
+
+  size_t prefetch_distance_ = ECS_PREFETCH_DISTANCE;
+
+  /// Owned by the ComponentManager of Guid
+  details::GuidIndex *guid_index_ = nullptr;
+
+  /// Shards that are neither merged nor destroyed
+  size_t open_shards_ = 0;
+
+  /// Indexed by event type
+  std::vector<std::unique_ptr<details::BaseEventChannel>> event_channels_;
+
+  /// How many blocks of entities there exists. Used when tracking where to put entities in momory
+  index_t block_count_ = 0;
+  /// How many entities there are atm
+  index_t count_ = 0;
+
+  /// The EntityManager want some friends :)
+  template<size_t N, typename...>
+  friend struct details::with_t;
+  template<typename...>
+  friend struct details::reduce_t;
+  template<typename...>
+  friend struct details::columns_t;
+  template<typename T>
+  friend class details::ComponentManager;
+  template<typename ...Cs>
+  friend class EntityAlias;
+  template<typename T>
+  friend class Iterator;
+  template<typename T>
+  friend class View;
+  template<typename ...Cs>
+  friend class EntityShard;
+  template<typename Location, typename ...Cs>
+  friend class Replicator;
+  friend class Entity;
+  friend class UnallocatedEntity;
+  friend class RollbackBuffer;
+  friend class Metrics;
+  friend class BaseComponent;
+};
+
+} // namespace ecs
+
+// #included from: EntityManager.inl
+// #included from: Entity.h
+#ifndef ECS_ENTITY_H
+#define ECS_ENTITY_H
+
+// #included from: Handle.h
+#ifndef ECS_HANDLE_H
+#define ECS_HANDLE_H
+
+namespace ecs{
+
+///---------------------------------------------------------------------
+/// Handle is the Id of an entity packed into 64 bits, without the
+/// EntityManager
+///---------------------------------------------------------------------
+///
+/// An Entity is 16 bytes, since it keeps a pointer to its
+/// EntityManager. A Handle is 8 bytes and can be copied with memcpy, so
+/// it is better suited to keep references to other entities in
+/// components and containers. Use EntityManager::operator[] to get the
+/// Entity of a Handle. A default constructed Handle refers to no entity.
+///
+/// @usage struct Target { Handle entity; };
+///        shooter.add<Target>(Target{enemy.handle()});
+///        Entity enemy = entities[shooter.get<Target>().entity];
+///---------------------------------------------------------------------
+class Handle {
+ public:
+  inline Handle() : value_(null_value) { }
+  inline Handle(Id id);
+
+  inline index_t index() const { return index_t(value_); }
+  inline version_t version() const { return version_t(value_ >> 32); }
+  inline Id id() const { return Id(index(), version()); }
+
+  /// The index in the lowest 32 bits, and the version above it
+  inline uint64_t value() const { return value_; }
+  static inline Handle from_value(uint64_t value);
+
+  /// Returns true if the Handle does not refer to any entity
+  inline bool is_null() const { return value_ == null_value; }
+
+ private:
+  static const uint64_t null_value = ~uint64_t(0);
+
+  uint64_t value_;
+};
+
+inline bool operator==(Handle const &lhs, Handle const &rhs) { return lhs.value() == rhs.value(); }
+inline bool operator!=(Handle const &lhs, Handle const &rhs) { return lhs.value() != rhs.value(); }
+inline bool operator<(Handle const &lhs, Handle const &rhs) { return lhs.value() < rhs.value(); }
+
+} // namespace ecs
+
+namespace std {
+
+template<>
+struct hash<ecs::Handle> {
+  size_t operator()(ecs::Handle const &handle) const { return hash<uint64_t>()(handle.value()); }
+};
+
+} // namespace std
+
+// #included from: Handle.inl
+namespace ecs{
+
+Handle::Handle(Id id) :
+    value_(uint64_t(id.version()) << 32 | id.index())
+{
+  static_assert(sizeof(index_t) <= 4 && sizeof(version_t) <= 4, "Id does not fit in a Handle");
+}
+
+Handle Handle::from_value(uint64_t value) {
+  Handle handle;
+  handle.value_ = value;
+  return handle;
+}
+
+} // namespace ecs
+#endif //ECS_HANDLE_H
+namespace ecs{
+///---------------------------------------------------------------------
+/// Entity is the identifier of an identity
+///---------------------------------------------------------------------
+///
+/// An entity consists of an id and version. The version is used to
+/// ensure that new entities allocated with the same id are separable.
+///
+/// An entity becomes invalid when destroyed.
+///
+///---------------------------------------------------------------------
+class Entity {
+ public:
+  inline Entity(EntityManager *manager, Id id);
+  inline Entity &operator=(const Entity &rhs);
+
+  inline Id &id() { return id_; }
+  inline Id const &id() const { return id_; }
+
+  /// The Id of this Entity, packed without the EntityManager
+  inline Handle handle() const { return Handle(id_); }
+
+  /// Returns the requested component, or error if it doesn't exist
+  template<typename C> inline C &get();
+  template<typename C> inline C const &get() const;
+
+  /// Returns the value the component had at the last swap_buffers, or
+  /// the current value if the entity did not exist or did not have the
+  /// component then. Component must be double buffered, see
+  /// EntityManager::double_buffer
+  template<typename C> inline C const &previous() const;
+
+  /// Set the requested component, if old component exist,
+  /// a new one is created. Otherwise, the assignment operator
+  /// is used.
+  template<typename C, typename ... Args> inline C &set(Args &&... args);
+
+  /// Add the requested component, error if component of the same type exist already
+  template<typename C, typename ... Args> inline C &add(Args &&... args);
+
+  /// Access this Entity as an EntityAlias.
+  template<typename T> inline T &as();
+  template<typename T> inline T const &as() const;
+
+  /// Assume that this entity has provided Components
+  /// Use for faster component access calls
+  template<typename ...Components> inline EntityAlias<Components...> &assume();
+  template<typename ...Components> inline EntityAlias<Components...> const &assume() const;
+
+  /// Removes a component. Error of it doesn't exist
+  template<typename C> inline void remove();
+
+  /// Removes all components and call destructors
+  void inline remove_everything();
+
+  /// Clears the component mask without destroying components (faster than remove_everything)
+  void inline clear_mask();
+
+  /// Destroys this entity. Removes all components as well
+  void inline destroy();
+
+  /// Destroys this entity after a number of seconds, unless it is destroyed
+  /// before that. Setting it again replaces the earlier time.
+  /// See EntityManager::update_expiry
+  void inline expire_in(float seconds);
+
+  /// Return true if entity has all specified components. False otherwise
+  template<typename... Components> inline bool has();
+  template<typename... Components> inline bool has() const;
+
+  /// Returns whether an entity is an entity alias or not
+  template<typename T> inline bool is();
+  template<typename T> inline bool is() const;
+
+  /// Returns true if entity has not been destroyed. False otherwise
+  bool inline is_valid();
+  bool inline is_valid() const;
+
+ private:
+  /// Return true if entity has all specified compoents. False otherwise
+  inline bool has(details::ComponentMask &check_mask);
+  inline bool has(details::ComponentMask const &check_mask) const;
+
+  inline details::ComponentMask &mask();
+  inline details::ComponentMask const &mask() const;
+
+  inline static details::ComponentMask static_mask();
+
+  EntityManager *manager_;
+  Id             id_;
+
+  friend class EntityManager;
+}; //Entity
+
+inline bool operator==(const Entity &lhs, const Entity &rhs);
+inline bool operator!=(const Entity &lhs, const Entity &rhs);
+
+} // namespace ecs
+
+// #included from: Entity.inl
+// #included from: EntityAlias.h
+#ifndef ECS_ENTITYALIAS_H
+#define ECS_ENTITYALIAS_H
+
+// #included from: BaseEntity.h
+//
+// Created by Robin Grönberg on 05/12/15.
+//
+
+#ifndef OPENECS_BASEENTITY_H
+#define OPENECS_BASEENTITY_H
+
+namespace ecs {
+
+namespace details {
+
+class BaseEntity {
+ public:
+  inline BaseEntity(const Entity &entity);
+ protected:
+  inline BaseEntity();
+  inline BaseEntity(EntityManager* manager);
+  inline BaseEntity(const BaseEntity &other);
+  inline BaseEntity& operator=(const BaseEntity& other) { entity_ = other.entity_; return *this; }
+
+  inline EntityManager &entities() { return *manager_; }
+  inline Entity &entity() { return entity_; }
+  inline EntityManager const& entities() const { return *manager_; }
+  inline Entity const& entity() const { return entity_; }
+ private:
+  union {
+    EntityManager *manager_;
+    Entity entity_;
+  };
+}; //BaseEntity
+
+} // namespace details
+
+} // namespace ecs
+
+// #included from: BaseEntity.inl
+
+namespace ecs {
+
+namespace details {
+
+BaseEntity::BaseEntity(const Entity &entity) : entity_(entity) { }
+BaseEntity::BaseEntity() { }
+BaseEntity::BaseEntity(EntityManager * manager) : manager_(manager){ }
+BaseEntity::BaseEntity(const BaseEntity &other) : entity_(other.entity_) { }
+
+} // namespace details
+
+} // namespace ecs
+#endif //OPENECS_BASEENTITY_H
+namespace ecs{
+
+///---------------------------------------------------------------------
+/// EntityAlias is a wrapper around an Entity
+///---------------------------------------------------------------------
+///
+/// An EntityAlias makes modification of the entity and other
+/// entities much easier when performing actions. It acts solely as an
+/// abstraction layer between the entity and different actions.
+///
+///---------------------------------------------------------------------
+template<typename ...Components>
+class EntityAlias : public details::BaseEntity {
+ private:
+  /// Underlying EntityAlias. Used for creating Entity alias without
+  /// a provided constructor
+  using Type = EntityAlias<Components...>;
+  template<typename C>
+  using is_component = details::is_type<C, Components...>;
+
+ public:
+  inline EntityAlias(const Entity &entity);
+
+  /// Cast to Entity or EntityAlias
+  inline operator Entity &();
+  inline operator Entity const &() const;
+
+  inline bool operator==(const Entity &rhs) const;
+  inline bool operator!=(const Entity &rhs) const;
+
+  inline Id &id();
+  inline Id const &id() const;
+
+  /// The Id of the entity, packed without the EntityManager
+  inline Handle handle() const;
+
+  /// Returns the requested component, or error if it doesn't exist
+  template<typename C> inline auto get()       -> typename std::enable_if< is_component<C>::value, C &>::type;
+  template<typename C> inline auto get()       -> typename std::enable_if<!is_component<C>::value, C &>::type;
+  template<typename C> inline auto get() const -> typename std::enable_if< is_component<C>::value, C const &>::type;
+  template<typename C> inline auto get() const -> typename std::enable_if<!is_component<C>::value, C const &>::type;
+
+  /// Returns the value the component had at the last swap_buffers.
+  /// Component must be double buffered, see EntityManager::double_buffer
+  template<typename C> inline C const &previous() const;
+
+  /// Set the requested component, if old component exist,
+  /// a new one is created. Otherwise, the assignment operator
+  /// is used.
+  template<typename C, typename ... Args> inline auto set(Args &&... args) ->
+      typename std::enable_if< is_component<C>::value, C &>::type;
+  template<typename C, typename ... Args> inline auto set(Args &&... args) ->
+      typename std::enable_if<!is_component<C>::value, C &>::type;
+
+  /// Add the requested component, error if component of the same type exist already
+  template<typename C, typename ... Args>
+  inline C &add(Args &&... args);
+
+  /// Access this Entity as an EntityAlias.
+  template<typename T> inline T &as();
+  template<typename T> inline T const &as() const;
+
+  /// Assume that this entity has provided Components
+  /// Use for faster component access calls
+  template<typename ...Components_>
+  inline EntityAlias<Components_...> &assume();
+
+  template<typename ...Components_>
+  inline EntityAlias<Components_...> const &assume() const;
+
+  /// Removes a component. Error of it doesn't exist. Cannot remove dependent components
+  template<typename C> inline auto remove() -> typename std::enable_if< is_component<C>::value, void>::type;
+  template<typename C> inline auto remove() -> typename std::enable_if<!is_component<C>::value, void>::type;
+
+  /// Removes all components and call destructors
+  inline void remove_everything();
+
+  /// Clears the component mask without destroying components (faster than remove_everything)
+  inline void clear_mask();
+
+  /// Destroys this entity. Removes all components as well
+  inline void destroy();
+
+  /// Destroys this entity after a number of seconds, unless it is destroyed before that
+  inline void expire_in(float seconds);
+  /// Return true if entity has all specified components. False otherwise
+  template<typename... Components_> inline bool has();
+  template<typename... Components_> inline bool has() const;
+
+  /// Returns whether an entity is an entity alias or not
+  template<typename T> inline bool is();
+  template<typename T> inline bool is() const;
+
+  /// Returns true if entity has not been destroyed. False otherwise
+  inline bool is_valid();
+  inline bool is_valid() const;
+
+ protected:
+  inline EntityAlias();
+
+ private:
+  // Recursion init components with argument
+  template<typename C0, typename Arg>
+  inline void init_components(Arg arg) {
+    add<C0>(arg);
+  }
+
+  template<typename C0, typename C1, typename ... Cs, typename Arg0, typename Arg1, typename ... Args>
+  inline void init_components(Arg0 arg0, Arg1 arg1, Args... args) {
+    init_components<C0>(arg0);
+    init_components<C1, Cs...>(arg1, args...);
+  }
+  // Recursion init components without argument
+  template<typename C>
+  inline void init_components() {
+    add<C>();
+  }
+
+  template<typename C0, typename C1, typename ... Cs>
+  inline void init_components() {
+    init_components<C0>();
+    init_components<C1, Cs...>();
+  }
+
+  template<typename ... Args>
+  inline void init(Args... args) {
+    init_components<Components...>(args...);
+  }
+
+  inline static details::ComponentMask static_mask();
+
+  friend class EntityManager;
+  friend class Entity;
+}; //EntityAlias
+
+} // namespace ecs
+
+// #included from: EntityAlias.inl
+
+namespace ecs{
+
+template<typename ...Cs>
+EntityAlias<Cs...>::EntityAlias() { }
+
+template<typename ...Cs>
+EntityAlias<Cs...>::EntityAlias(const Entity &entity) : details::BaseEntity(entity) {}
+
+template<typename ...Cs>
+EntityAlias<Cs...>::operator Entity &() {
+  return entity();
+}
+
+template<typename ...Cs>
+EntityAlias<Cs...>::operator Entity const &() const {
+  return entity();
+}
+
+template<typename ...Cs>
+Id &EntityAlias<Cs...>::id() {
+  return entity().id();
+}
+
+template<typename ...Cs>
+Id const &EntityAlias<Cs...>::id() const {
+  return entity().id();
+}
+
+template<typename ...Cs>
+Handle EntityAlias<Cs...>::handle() const {
+  return Handle(entity().id());
+}
+
+template<typename ...Cs> template<typename C>
+inline auto EntityAlias<Cs...>::get() ->
+typename std::enable_if<is_component<C>::value, C &>::type{
+  return entities().template get_component_fast<C>(entity());
+}
+
+template<typename ...Cs> template<typename C>
+inline auto EntityAlias<Cs...>::get() const ->
+typename std::enable_if<is_component<C>::value, C const &>::type{
+  return entities().template get_component_fast<C>(entity());
+}
+
+template<typename ...Cs> template<typename C>
+inline auto EntityAlias<Cs...>::get() ->
+typename std::enable_if<!is_component<C>::value, C &>::type{
+  return entity().template get<C>();
+}
+
+template<typename ...Cs> template<typename C>
+inline auto EntityAlias<Cs...>::get() const ->
+typename std::enable_if<!is_component<C>::value, C const &>::type{
+  return entity().template get<C>();
+}
+
+template<typename ...Cs> template<typename C>
+inline C const &EntityAlias<Cs...>::previous() const {
+  return entity().template previous<C>();
+}
+
+template<typename ...Cs> template<typename C, typename ... Args>
+inline auto EntityAlias<Cs...>::set(Args &&... args) ->
+typename std::enable_if<is_component<C>::value, C &>::type{
+  return entities().template set_component_fast<C>(entity(), std::forward<Args>(args)...);
+}
+
+template<typename ...Cs> template<typename C, typename ... Args>
+inline auto EntityAlias<Cs...>::set(Args &&... args) ->
+typename std::enable_if<!is_component<C>::value, C &>::type{
+  return entities().template set_component<C>(entity(), std::forward<Args>(args)...);
+}
+
+template<typename ...Cs> template<typename C, typename ... Args>
+inline C& EntityAlias<Cs...>::add(Args &&... args) {
+  return entity().template add<C>(std::forward<Args>(args)...);
+}
+
+template<typename ...Cs> template<typename C>
+C & EntityAlias<Cs...>::as() {
+  return entity().template as<C>();
+}
+
+template<typename ...Cs> template<typename C>
+C const & EntityAlias<Cs...>::as() const {
+  return entity().template as<C>();
+}
+
+template<typename ...Cs> template<typename ...Components_>
+EntityAlias<Components_...> &EntityAlias<Cs...>::assume() {
+  return entity().template assume<Components_...>();
+}
+
+template<typename ...Cs> template<typename ...Components>
+EntityAlias<Components...> const &EntityAlias<Cs...>::assume() const {
+  return entity().template assume<Components...>();
+}
+
+template<typename ...Cs> template<typename C>
+inline auto EntityAlias<Cs...>::remove() ->
+typename std::enable_if<!is_component<C>::value, void>::type {
+  entity().template remove<C>();
+}
+
+template<typename ...Cs> template<typename C>
+inline auto EntityAlias<Cs...>::remove() ->
+typename std::enable_if<is_component<C>::value, void>::type {
+  entities().template remove_component_fast<C>(entity());
+}
+
+template<typename ...Cs>
+void EntityAlias<Cs...>::remove_everything() {
+  entity().remove_everything();
+}
+
+template<typename ...Cs>
+void EntityAlias<Cs...>::clear_mask() {
+  entity().clear_mask();
+}
+
+template<typename ...Cs>
+void EntityAlias<Cs...>::destroy() {
+  entity().destroy();
+}
+
+template<typename ...Cs>
+void EntityAlias<Cs...>::expire_in(float seconds) {
+  entity().expire_in(seconds);
+}
+
+template<typename ...Cs> template<typename... Components>
+bool EntityAlias<Cs...>::has() {
+  return entity().template has<Components...>();
+}
+
+template<typename ...Cs> template<typename... Components>
+bool EntityAlias<Cs...>::has() const {
+  return entity().template has<Components...>();
+}
+
+template<typename ...Cs> template<typename T>
+bool EntityAlias<Cs...>::is() {
+  return entity().template is<T>();
+}
+template<typename ...Cs> template<typename T>
+bool EntityAlias<Cs...>::is() const {
+  return entity().template is<T>();
+}
+
+template<typename ...Cs>
+bool EntityAlias<Cs...>::is_valid() {
+  return entity().is_valid();
+}
+
+template<typename ...Cs>
+bool EntityAlias<Cs...>::is_valid() const {
+  return entity().is_valid();
+}
+
+template<typename ...Cs>
+details::ComponentMask EntityAlias<Cs...>::static_mask(){
+  return details::component_mask<Cs...>();
+}
+
+template<typename ... Cs>
+inline bool EntityAlias<Cs...>::operator==(const Entity &rhs) const {
+  return entity() == rhs;
+}
+
+template<typename ... Cs>
+inline bool EntityAlias<Cs...>::operator!=(const Entity &rhs) const {
+  return entity() != rhs;
+}
+
+} // namespace ecs
+#endif //ECS_ENTITYALIAS_H
+
+namespace ecs{
+
+Entity::Entity(EntityManager *manager, Id id) :
+    manager_(manager),
+    id_(id)
+{ }
+
+Entity &Entity::operator=(const Entity &rhs) {
+  manager_ = rhs.manager_;
+  id_ = rhs.id_;
+  return *this;
+}
+
+template<typename C>
+C &Entity::get() {
+  return manager_->get_component<C>(*this);
+}
+
+template<typename C>
+C const &Entity::get() const {
+  return manager_->get_component<C>(*this);
+}
+
+template<typename C>
+C const &Entity::previous() const {
+  return manager_->get_previous_component<C>(*this);
+}
+
+template<typename C, typename ... Args>
+C &Entity::set(Args && ... args){
+  return manager_->set_component<C>(*this, std::forward<Args>(args) ...);
+}
+
+template<typename C, typename ... Args>
+C &Entity::add(Args && ... args){
+  return manager_->create_component<C>(*this, std::forward<Args>(args) ...);
+}
+
+template<typename T>
+inline T & Entity::as(){
+  ECS_ASSERT_IS_ENTITY(T);
+  ECS_ASSERT_ENTITY_CORRECT_SIZE(T);
+  ECS_ASSERT(has(T::static_mask()), "Entity doesn't have required components for this EntityAlias");
+  return reinterpret_cast<T &>(*this);
+}
+
+template<typename T>
+inline T const & Entity::as() const{
+  ECS_ASSERT_IS_ENTITY(T);
+  ECS_ASSERT_ENTITY_CORRECT_SIZE(T);
+  ECS_ASSERT(has(T::static_mask()), "Entity doesn't have required components for this EntityAlias");
+  return reinterpret_cast<T const &>(*this);
+}
+
+/// Assume that this entity has provided Components
+/// Use for faster component access calls
+template<typename ...Components>
+inline EntityAlias<Components...> & Entity::assume() {
+  return as<EntityAlias<Components...>>();
+}
+
+template<typename ...Components>
+inline EntityAlias<Components...> const & Entity::assume() const {
+  return as<EntityAlias<Components...>>();
+}
+
+template<typename C>
+void Entity::remove()  {
+  manager_->remove_component<C>(*this);
+}
+
+void Entity::remove_everything() {
+  manager_->remove_all_components(*this);
+}
+
+void Entity::clear_mask() {
+  manager_->clear_mask(*this);
+}
+
+void Entity::expire_in(float seconds) {
+  manager_->expire_in(*this, seconds);
+}
+
+void Entity::destroy() {
+  manager_->destroy(*this);
+}
+
+template<typename... Components>
+bool Entity::has() {
+  return manager_->has_component<Components ...>(*this);
+}
+
+template<typename... Components>
+bool Entity::has() const {
+  return manager_->has_component<Components ...>(*this);
+}
+
+template<typename T>
+bool Entity::is() {
+  ECS_ASSERT_IS_ENTITY(T);
+  ECS_ASSERT_ENTITY_CORRECT_SIZE(T);
+  return has(T::static_mask());
+}
+
+template<typename T>
+bool Entity::is() const {
+  ECS_ASSERT_IS_ENTITY(T);
+  ECS_ASSERT_ENTITY_CORRECT_SIZE(T);
+  return has(T::static_mask());
+}
+
+bool Entity::is_valid() {
+  return manager_->is_valid(*this);
+}
+
+bool Entity::is_valid() const {
+  return manager_->is_valid(*this);
+}
+
+bool Entity::has(details::ComponentMask &check_mask)  {
+  return manager_->has_component(*this, check_mask);
+}
+
+bool Entity::has(details::ComponentMask const &check_mask) const  {
+  return manager_->has_component(*this, check_mask);
+}
+
+details::ComponentMask &Entity::mask()  {
+  return manager_->mask(*this);
+}
+details::ComponentMask const &Entity::mask() const {
+  return manager_->mask(*this);
+}
+
+inline bool operator==(const Entity &lhs, const Entity &rhs) {
+  return lhs.id() == rhs.id();
+}
+
+inline bool operator!=(const Entity &lhs, const Entity &rhs) {
+  return lhs.id() != rhs.id();
+}
+
+details::ComponentMask Entity::static_mask(){
+  return details::ComponentMask(0);
+}
+
+} // namespace ecs
+#endif //ECS_ENTITY_H
+// #included from: UnallocatedEntity.h
+//
+// Created by Robin Grönberg on 05/12/15.
+//
+
+#ifndef OPENECS_UNALLOCATEDENTITY_H
+#define OPENECS_UNALLOCATEDENTITY_H
+
+#include <vector>
+
+namespace ecs{
+
+///---------------------------------------------------------------------
+/// UnallocatedEntity is used when creating an Entity but postponing
+/// allocation for memory in the EntityManager
+///---------------------------------------------------------------------
+///
+/// UnallocatedEntity is used when creating an Entity from the
+/// EntityManager but does not allocate memory inside the EntityManager
+/// until the UnallocatedEntity is assigned, or goes out of scope.
+///
+/// The purpose of doing this is to postpone the placement of the Entity
+/// until components have been attached. Then, the EntityManager knows
+/// what components that the entity has, and can place the entity close
+/// to similar entities in memory. This leads to better usage of the
+/// CPU cache
+///
+/// An UnallocatedEntity can always be implicitly casted to an Entity.
+///
+/// Au UnallocatedEntity is assumed unallocated as long as entity_ is
+/// a nullptr
+///---------------------------------------------------------------------
+class UnallocatedEntity {
+ private:
+  struct ComponentHeader{
+    unsigned int index, size;
+  };
+ public:
+  inline UnallocatedEntity(EntityManager &manager);
+  inline UnallocatedEntity &operator=(const UnallocatedEntity &rhs);
+  inline ~UnallocatedEntity();
+
+  /// Cast to Entity or EntityAlias
+  inline operator Entity &();
+
+  inline bool operator==(const UnallocatedEntity &rhs) const;
+  inline bool operator!=(const UnallocatedEntity &rhs) const;
+  inline bool operator==(const Entity &rhs) const;
+  inline bool operator!=(const Entity &rhs) const;
+
+  inline Id &id();
+
+  /// Returns the requested component, or error if it doesn't exist
+  template<typename C> inline C &get();
+  template<typename C> inline C const &get() const;
+
+  /// Set the requested component, if old component exist,
+  /// a new one is created. Otherwise, the assignment operator
+  /// is used.
+  template<typename C, typename ... Args> inline C &set(Args &&... args);
+
+  /// Add the requested component, error if component of the same type exist already
+  template<typename C, typename ... Args> inline C &add(Args &&... args);
+
+  /// Access this Entity as an EntityAlias.
+  template<typename T> inline T &as();
+
+  /// Assume that this entity has provided Components
+  /// Use for faster component access calls
+  template<typename ...Components> inline EntityAlias<Components...> &assume();
+
+  /// Removes a component. Error of it doesn't exist
+  template<typename C> inline void remove();
+
+  /// Removes all components and call destructors
+  void inline remove_everything();
+
+  /// Clears the component mask without destroying components (faster than remove_everything)
+  void inline clear_mask();
+
+  /// Destroys this entity. Removes all components as well
+  void inline destroy();
+
+  /// Return true if entity has all specified components. False otherwise
+  template<typename... Components> inline bool has() const;
+
+  /// Returns whether an entity is an entity alias or not
+  template<typename T> inline bool is() const;
+
+  /// Returns true if entity has not been destroyed. False otherwise
+  bool inline is_valid() const;
+
+  /// Allocates memory for this Entity. Once allocated, the Unallocated Entity function like a
+  /// normal Entity
+  void inline allocate();
+
+ private:
+
+  bool inline is_allocated() const;
+
+  EntityManager * manager_ = nullptr;
+  Entity entity_;
+  std::vector<char> component_data;
+  std::vector<ComponentHeader> component_headers_;
+  details::ComponentMask mask_ = details::ComponentMask(0);
+
+}; //UnallocatedEntity
+
+} // namespace ecs
+
+// #included from: UnallocatedEntity.inl
+#include <cstring>
+
+namespace ecs{
+
+UnallocatedEntity::UnallocatedEntity(EntityManager& manager) : manager_(&manager), entity_(&manager, Id(index_t(-1),0)){ }
+
+UnallocatedEntity::~UnallocatedEntity(){
+  allocate();
+}
+
+UnallocatedEntity& UnallocatedEntity::operator=(const UnallocatedEntity &rhs){
+  allocate();
+  manager_ = rhs.manager_;
+  entity_ = rhs.entity_;
+  component_data = rhs.component_data;
+  component_headers_ = rhs.component_headers_;
+  return *this;
+}
+
+UnallocatedEntity::operator Entity &() {
+  allocate();
+  return entity_;
+}
+
+Id& UnallocatedEntity::id() {
+  allocate();
+  return entity_.id();
+}
+
+template<typename C>
+C& UnallocatedEntity::get() {
+  ECS_ASSERT(is_valid(), "Unallocated Entity invalid");
+  ECS_ASSERT(has<C>(), "UnallocatedEntity does not have Component Attached");
+  if(is_allocated()){
+    return entity_.get<C>();
+  }
+  int index = 0;
+  for (auto& componentHeader : component_headers_) {
+    if(componentHeader.index == details::component_index<C>()){
+      return *reinterpret_cast<C*>(&component_data[index]);
+    }
+    index += componentHeader.size;
+  }
+  //should not happen
+  return *static_cast<C*>(nullptr);
+}
+
+template<typename C>
+C const & UnallocatedEntity::get() const {
+  ECS_ASSERT(is_valid(), "Unallocated Entity invalid");
+  ECS_ASSERT(has<C>(), "UnallocatedEntity does not have Component Attached");
+  if(is_allocated()){
+    return entity_.get<C>();
+  }else{
+    int index = 0;
+    for (auto& componentHeader : component_headers_) {
+      if(componentHeader.index == details::component_index<C>()){
+        return *reinterpret_cast<C*>(&component_data[index]);
+      }
+      index += componentHeader.size;
+    }
+  }
+  //should not happen
+  return *static_cast<C*>(nullptr);
+}
+
+template<typename C, typename ... Args>
+C& UnallocatedEntity::set(Args &&... args){
+  if(is_allocated()){
+    return entity_.set<C>(std::forward<Args>(args)...);
+  }
+  if(has<C>()){
+    return get<C>() = manager_->create_tmp_component<C>(std::forward<Args>(args)...);
+  }else{
+    return add<C>(std::forward<Args>(args)...);
+  }
+}
+
+template<typename C, typename ... Args>
+C& UnallocatedEntity::add(Args &&... args){
+  if(is_allocated()){
+    return entity_.add<C>(std::forward<Args>(args)...);
+  }
+  ECS_ASSERT(!has<C>(), "Unallocated Entity cannot assign already assigned component with add. Use set instead");
+  ECS_ASSERT(is_valid(), "Unallocated Entity invalid");
+  int index = 0;
+  //Find component location in memory
+  for (auto componentHeader : component_headers_) {
+    index += componentHeader.size;
+  }
+  //Ensure that a component manager exists for C
+  manager_->get_component_manager<C>();
+  //Set component data
+  auto component_index = details::component_index<C>();
+  mask_.set(component_index);
+  component_headers_.push_back(ComponentHeader{static_cast<unsigned int>(component_index), sizeof(C)});
+  component_data.resize(index + sizeof(C));
+  return details::create_component<C>(&component_data[index], std::forward<Args>(args)...);
+}
+
+template<typename C>
+C & UnallocatedEntity::as() {
+  allocate();
+  return entity_.as<C>();
+}
+
+template<typename ...Components_>
+EntityAlias<Components_...> & UnallocatedEntity::assume() {
+  allocate();
+  return entity_.assume<Components_...>();
+}
+
+template<typename C>
+void UnallocatedEntity::remove() {
+  if(is_allocated()){
+    entity_.remove<C>();
+  }else{
+    int index = 0;
+    auto component_index = details::component_index<C>();
+    for (auto& componentHeader : component_headers_) {
+      if(componentHeader.index == component_index){
+        C& component = *reinterpret_cast<C*>(&component_data[index]);
+        component.~C();
+        break;
+      }
+      index += componentHeader.size;
+    }
+    mask_.reset(component_index);
+  }
+}
+
+void UnallocatedEntity::remove_everything() {
+  if(is_allocated()){
+    entity_.remove_everything();
+  }else{
+    //TODO: call dtors on components
+    component_headers_.clear();
+    mask_.reset();
+  }
+}
+
+void UnallocatedEntity::clear_mask() {
+  if(is_allocated()){
+    entity_.clear_mask();
+  } else{
+    component_headers_.clear();
+    mask_.reset();
+  }
+}
+
+void UnallocatedEntity::destroy() {
+  if(is_allocated()){
+    entity_.destroy();
+  }else{
+    manager_ = nullptr;
+  }
+}
+
+template<typename... Components>
+bool UnallocatedEntity::has() const {
+  if(is_allocated()){
+    return entity_.has<Components...>();
+  }else{
+    auto component_mask = details::component_mask<Components...>();
+    return (component_mask & mask_) == component_mask;
+  }
+}
+
+template<typename T>
+bool UnallocatedEntity::is() const {
+  if(is_allocated()){
+    return entity_.is<T>();
+  }else{
+    ECS_ASSERT_IS_ENTITY(T);
+    ECS_ASSERT_ENTITY_CORRECT_SIZE(T);
+    auto component_mask = T::static_mask();
+    return (component_mask & mask_) == component_mask;
+  }
+}
+
+bool UnallocatedEntity::is_valid() const {
+  if(is_allocated()){
+    return entity_.is_valid();
+  }else{
+    return manager_ != nullptr;
+  }
+}
+
+inline bool operator==(const UnallocatedEntity &lhs, const UnallocatedEntity &rhs) {
+  return &lhs == &rhs;
+}
+
+inline bool operator!=(const UnallocatedEntity &lhs, const UnallocatedEntity &rhs) {
+  return &lhs != &rhs;
+}
+
+inline bool UnallocatedEntity::operator==(const Entity &rhs) const {
+  return &entity_ == &rhs;
+}
+
+inline bool UnallocatedEntity::operator!=(const Entity &rhs) const {
+  return &entity_ != &rhs;
+}
+
+bool UnallocatedEntity::is_allocated() const {
+  return manager_ == nullptr;
+}
+
+void UnallocatedEntity::allocate() {
+  if(!is_allocated()){
+    entity_ = manager_->create_with_mask(mask_);
+    if(component_headers_.size() > 0){
+      auto index = entity_.id().index();
+      manager_->mask(index) |= mask_;
+      unsigned int offset = 0;
+      //TODO: set mask
+      for (auto componentHeader : component_headers_) {
+        details::BaseManager& componentManager = manager_->get_component_manager(componentHeader.index);
+        componentManager.ensure_min_size(index);
+        //Copy data from tmp location to acctuial location in component manager
+        std::memcpy(componentManager.get_void_ptr(index), &component_data[offset], componentHeader.size);
+        componentManager.aggregate_added(index);
+        offset+=componentHeader.size;
+      }
+    }
+    manager_ = nullptr;
+  }
+}
+
+} // namespace ecs
+#endif //OPENECS_UNALLOCATEDENTITY_H
+
+namespace ecs{
+
+namespace details{
+
+template<size_t N, typename Lambda, typename... Args>
+struct with_t<N, Lambda, Args...>:
+    with_t<N - 1, Lambda,
+           typename details::function_traits<Lambda>::template arg_remove_ref<N - 1>, Args...> {
+};
+
+template<typename Lambda, typename... Args>
+struct with_t<0, Lambda, Args...> {
+  // Entities are visited block_size at a time. The address of each component
+  // of the first entity in a block is looked up once, and the components of
+  // the other entities are found by their offset from it.
+  static const index_t block_size = 64;
+
+  struct Block {
+    index_t first;
+    index_t end;
+    // Matching entities that are not visited yet. Bit i is entity first + i
+    uint64_t matches;
+    // nullptr if the component has to be looked up for each entity
+    std::tuple<Args *...> components;
+  };
+
+  static inline void for_each(EntityManager &manager, Lambda lambda) {
+    typedef details::function_traits <Lambda> function;
+    static_assert(function::arg_count > 0, "Lambda or function must have at least 1 argument.");
+    ComponentMask mask = details::component_mask<Args...>();
+    // Entities created while iterating are not visited
+    index_t size = index_t(manager.component_masks_.size());
+    Block current = Block(), ahead = Block();
+    index_t index, ahead_index;
+    // The ahead block runs ahead, and prefetches the components of the entities it passes
+    bool prefetching = manager.prefetch_distance_ > 0;
+    for (size_t i = 0; i < manager.prefetch_distance_ && prefetching; ++i) {
+      prefetching = next(manager, mask, size, ahead, ahead_index);
+    }
+    while (next(manager, mask, size, current, index)) {
+      if (prefetching && (prefetching = next(manager, mask, size, ahead, ahead_index))) {
+        prefetch_args(manager, ahead, ahead_index);
+      }
+      // The mask may have changed since it was scanned
+      if ((manager.component_masks_[index] & mask) != mask) continue;
+      lambda(get_arg<Args>(manager, current, index)...);
+    }
+  }
+
+  // Take the next matching entity, moving on to the next block with matches when needed
+  static inline bool next(EntityManager &manager, ComponentMask const &mask, index_t size, Block &block, index_t &index) {
+    if (!block.matches && !find_block(manager, mask, size, block.end, block)) return false;
+    index = block.first + details::count_trailing_zeros(block.matches);
+    block.matches &= block.matches - 1;
+    return true;
+  }
+
+  static inline bool find_block(EntityManager &manager, ComponentMask const &mask, index_t size, index_t first, Block &block) {
+    for (; first < size; first += block_size) {
+      index_t end = std::min<index_t>(size, first + block_size);
+      uint64_t matches = details::match_masks(&manager.component_masks_[first], end - first, mask);
+      if (matches) {
+        block.first = first;
+        block.end = end;
+        block.matches = matches;
+        block.components = std::make_tuple(get_block_ptr<Args>(manager, first)...);
+        return true;
+      }
+    }
+    block.first = block.end = size;
+    return false;
+  }
+
+  //When arg is component, get the address of the component of the first entity in the block
+  template<typename C>
+  static inline auto get_block_ptr(EntityManager &manager, index_t first) ->
+  typename std::enable_if<!details::is_entity_arg<C>::value, C *>::type {
+    return manager.get_block_ptr<C>(first, block_size);
+  }
+
+  //When arg is the Entity or Handle, there is no component
+  template<typename C>
+  static inline auto get_block_ptr(EntityManager &manager, index_t first) ->
+  typename std::enable_if<details::is_entity_arg<C>::value, C *>::type {
+    return nullptr;
+  }
+
+  static inline void prefetch_args(EntityManager &manager, Block const &block, index_t index) {
+    int expand[] = {0, (prefetch_arg<Args>(manager, block, index), 0)...};
+    (void) expand;
+  }
+
+  //When arg is component, prefetch component
+  template<typename C>
+  static inline auto prefetch_arg(EntityManager const &manager, Block const &block, index_t index) ->
+  typename std::enable_if<!details::is_entity_arg<C>::value, void>::type {
+    C *ptr = std::get<details::index_of<C, Args...>::value>(block.components);
+    details::prefetch(ptr ? ptr + (index - block.first) : &manager.get_component_fast<C>(index));
+  }
+
+  //When arg is the Entity or Handle, there is nothing to prefetch
+  template<typename C>
+  static inline auto prefetch_arg(EntityManager const &manager, Block const &block, index_t index) ->
+  typename std::enable_if<details::is_entity_arg<C>::value, void>::type { }
+
+  //When arg is component, access component
+  template<typename C>
+  static inline auto get_arg(EntityManager &manager, Block const &block, index_t index) ->
+  typename std::enable_if<!details::is_entity_arg<C>::value, C &>::type {
+    C *ptr = std::get<details::index_of<C, Args...>::value>(block.components);
+    return ptr ? ptr[index - block.first] : manager.get_component_fast<C>(index);
+  }
+
+  //When arg is the Entity, access the Entity
+  template<typename C>
+  static inline auto get_arg(EntityManager &manager, Block const &block, index_t index) ->
+  typename std::enable_if<std::is_same<C, Entity>::value, Entity>::type {
+    return manager.get_entity(index);
+  }
+
+  //When arg is the Handle, access the Id of the entity, without creating an Entity
+  template<typename C>
+  static inline auto get_arg(EntityManager &manager, Block const &block, index_t index) ->
+  typename std::enable_if<std::is_same<C, Handle>::value, Handle>::type {
+    return Handle(Id(index, manager.entity_versions_[index]));
+  }
+};
+
+template<typename Lambda>
+using with_ = with_t<details::function_traits<Lambda>::arg_count, Lambda>;
+
+} // namespace details
+
+EntityManager::EntityManager(size_t chunk_size) {
+  entity_versions_.reserve(chunk_size);
+  component_masks_.reserve(chunk_size);
+}
+
+EntityManager::~EntityManager()  {
+  // A shard would write to, and give back, memory that is released here.
+  // Not ECS_ASSERT, which may be defined to throw
+  assert(open_shards_ == 0 && "Every EntityShard must be merged or destroyed before its EntityManager");
+  for (details::BaseManager *manager : component_managers_) {
+    if (manager) delete manager;
+  }
+  component_managers_.clear();
+  component_masks_.clear();
+  entity_versions_.clear();
+  next_free_indexes_.clear();
+  component_mask_to_index_accessor_.clear();
+  index_to_component_mask.clear();
+}
+
+UnallocatedEntity EntityManager::create() {
+  return UnallocatedEntity(*this);
+}
+
+std::vector<Entity> EntityManager::create(const size_t num_of_entities)  {
+  return create_with_mask(details::ComponentMask(0), num_of_entities);
+}
+
+template<typename T>
+inline void EntityManager::create(const size_t num_of_entities, T lambda){
+  ECS_ASSERT_IS_CALLABLE(T);
+  using EntityAlias_ = typename details::function_traits<T>::template arg_remove_ref<0>;
+  ECS_ASSERT_IS_ENTITY(EntityAlias_);
+  for(Entity& entity : create_with_mask(EntityAlias_::static_mask(), num_of_entities)){
+    //We cannot use as<EntityAlias> since we dont have attached any components
+    lambda(*reinterpret_cast<EntityAlias_*>(&entity));
+    ECS_ASSERT(entity.has(EntityAlias_::static_mask()), "Entity are missing certain components.");
+  }
+}
+
+/// If EntityAlias is constructable with Args...
+template<typename T, typename ...Args>
+auto EntityManager::create(Args && ... args) ->
+typename std::enable_if<std::is_constructible<T, Args...>::value, T>::type {
+  ECS_ASSERT_IS_ENTITY(T);
+  ECS_ASSERT_ENTITY_CORRECT_SIZE(T);
+  auto mask = T::static_mask();
+  Entity entity = create_with_mask(mask);
+  T *entity_alias = new(&entity) T(std::forward<Args>(args)...);
+  ECS_ASSERT(entity.has(mask),
+             "Every required component must be added when creating an Entity Alias");
+  return *entity_alias;
+}
+
+/// If EntityAlias is not constructable with Args...
+/// Attempt to create with underlying EntityAlias
+template<typename T, typename ...Args>
+auto EntityManager::create(Args && ... args) ->
+typename std::enable_if<!std::is_constructible<T, Args...>::value, T>::type {
+  ECS_ASSERT_IS_ENTITY(T);
+  ECS_ASSERT_ENTITY_CORRECT_SIZE(T);
+  typedef typename T::Type Type;
+  auto mask = T::static_mask();
+  Entity entity = create_with_mask(mask);
+  Type *entity_alias = new(&entity) Type();
+  entity_alias->init(std::forward<Args>(args)...);
+  ECS_ASSERT(entity.has(mask),
+             "Every required component must be added when creating an Entity Alias");
+  return *reinterpret_cast<T *>(entity_alias);
+}
+
+template<typename ...Components, typename ...Args>
+auto EntityManager::create_with(Args && ... args ) ->
+typename std::conditional<(sizeof...(Components) > 0), EntityAlias<Components...>, EntityAlias<Args...>>::type{
+  using Type = typename std::conditional<(sizeof...(Components) > 0), EntityAlias<Components...>, EntityAlias<Args...>>::type;
+  Entity entity = create_with_mask(Type::static_mask());
+  Type *entity_alias = new(&entity) Type();
+  entity_alias->init(std::forward<Args>(args)...);
+  return *entity_alias;
+}
+
+template<typename ...Components>
+EntityAlias<Components...> EntityManager::create_with() {
+  using Type = EntityAlias<Components...>;
+  Entity entity = create_with_mask(details::component_mask<Components...>());
+  Type *entity_alias = new(&entity) Type();
+  entity_alias->init();
+  return *entity_alias;
+}
+
+Entity EntityManager::create_with_mask(details::ComponentMask mask)  {
+  ++count_;
+  index_t index = find_new_entity_index(mask);
+  size_t slots_required = index + 1;
+  if (entity_versions_.size() < slots_required) {
+    entity_versions_.resize(slots_required);
+    component_masks_.resize(slots_required, details::ComponentMask(0));
+  }
+  return get_entity(index);
+}
+
+std::vector<Entity> EntityManager::create_with_mask(details::ComponentMask mask, const size_t num_of_entities) {
+  std::vector<index_t> indexes;
+  indexes.reserve(num_of_entities);
+  allocate_indexes(mask, num_of_entities, indexes);
+  std::vector<Entity> new_entities;
+  new_entities.reserve(num_of_entities);
+  for (index_t index : indexes) {
+    new_entities.push_back(get_entity(index));
+  }
+  return new_entities;
+}
+
+void EntityManager::allocate_indexes(details::ComponentMask mask, size_t num_of_entities,
+                                     std::vector<index_t> &indexes) {
+  size_t entities_left = num_of_entities;
+  auto mask_as_ulong = mask.to_ulong();
+  IndexAccessor &index_accessor = component_mask_to_index_accessor_[mask_as_ulong];
+  //See if we can use old indexes for destroyed entities via free list
+  while (entities_left > 0 && !index_accessor.free_list.empty()) {
+    index_t index = index_accessor.free_list.back();
+    indexes.push_back(index);
+    index_accessor.free_list.pop_back();
+    ++block_entity_counts_[index / ECS_CACHE_LINE_SIZE];
+    --entities_left;
+  }
+  index_t block_index = 0;
+  index_t current = ECS_CACHE_LINE_SIZE; // <- if empty, create new block instantly
+  size_t slots_required;
+  // Are there any unfilled blocks?
+  if (!index_accessor.block_index.empty()) {
+    block_index = index_accessor.block_index[index_accessor.block_index.size() - 1];
+    current = next_free_indexes_[block_index];
+    slots_required = block_count_ * ECS_CACHE_LINE_SIZE + current + entities_left;
+  } else {
+    slots_required = block_count_ * ECS_CACHE_LINE_SIZE + entities_left;
+  }
+  if (entity_versions_.size() < slots_required) {
+    entity_versions_.resize(slots_required);
+    component_masks_.resize(slots_required, details::ComponentMask(0));
+  }
+
+  // Insert until no entity is left
+  while (entities_left) {
+    // Add more blocks if the current one is full
+    if (current == ECS_CACHE_LINE_SIZE) {
+      block_index = claim_block(index_accessor, mask_as_ulong, 0);
+      current = 0;
+    }
+    index_t first = current;
+    for (; current < ECS_CACHE_LINE_SIZE && entities_left; ++current) {
+      indexes.push_back(current + ECS_CACHE_LINE_SIZE * block_index);
+      entities_left--;
+    }
+    next_free_indexes_[block_index] = current;
+    block_entity_counts_[block_index] += current - first;
+  }
+  count_ += index_t(num_of_entities);
+}
+
+template<typename ...Components>
+EntityShard<Components...> EntityManager::create_shard(size_t num_of_entities) {
+  auto mask_as_ulong = details::component_mask<Components...>().to_ulong();
+  IndexAccessor &index_accessor = component_mask_to_index_accessor_[mask_as_ulong];
+  index_t num_of_blocks = index_t((num_of_entities + ECS_CACHE_LINE_SIZE - 1) / ECS_CACHE_LINE_SIZE);
+  index_t first_index = block_count_ * ECS_CACHE_LINE_SIZE;
+  for (index_t i = 0; i < num_of_blocks; ++i) {
+    create_full_block(index_accessor, mask_as_ulong);
+  }
+  size_t slots_required = block_count_ * ECS_CACHE_LINE_SIZE;
+  entity_versions_.resize(slots_required);
+  component_masks_.resize(slots_required, details::ComponentMask(0));
+  ++open_shards_;
+  return EntityShard<Components...>(*this, first_index, num_of_blocks * ECS_CACHE_LINE_SIZE);
+}
+
+template<typename ...Components>
+void EntityManager::merge(EntityShard<Components...> &shard) {
+  ECS_ASSERT(shard.manager_ == this, "EntityShard is already merged or belongs to another EntityManager");
+  details::ComponentMask mask = details::component_mask<Components...>();
+  index_t begin = shard.first_index_;
+  index_t end = begin + index_t(shard.size_);
+  for (index_t index = begin; index < end; ++index) {
+    component_masks_[index] = mask;
+    ++block_entity_counts_[index / ECS_CACHE_LINE_SIZE];
+  }
+  // Slots the shard did not use, lowest index is used first
+  IndexAccessor &index_accessor = component_mask_to_index_accessor_[mask.to_ulong()];
+  for (index_t index = begin + index_t(shard.capacity_); index > end; --index) {
+    index_accessor.free_list.push_back(index - 1);
+  }
+  count_ += index_t(shard.size_);
+  shard.manager_ = nullptr;
+  release_shard_blocks(begin, shard.capacity_);
+  for (index_t index = begin; index < end; ++index) {
+    int expand[] = {(get_component_manager_fast<Components>().aggregate_added(index), 0)...};
+    (void) expand;
+  }
+}
+
+EntityManager::IdRemap EntityManager::merge(EntityManager &&other) {
+  ECS_ASSERT(&other != this, "Cannot merge an EntityManager with itself");
+  IdRemap remap;
+  index_t first_block = block_count_;
+  index_t offset = first_block * ECS_CACHE_LINE_SIZE;
+  std::vector<bool> used = other.used_slots();
+  for (index_t index = 0; index < used.size(); ++index) {
+    if (used[index]) {
+      version_t version = other.entity_versions_[index];
+      remap.push_back(std::make_pair(Id(index, version), Id(index + offset, version)));
+    }
+  }
+  // Blocks keep their position relative to each other
+  for (auto &pair : other.component_mask_to_index_accessor_) {
+    IndexAccessor &other_accessor = pair.second;
+    IndexAccessor &index_accessor = component_mask_to_index_accessor_[pair.first];
+    if (!index_accessor.block_index.empty() && !other_accessor.block_index.empty()) {
+      // Only the last block is filled, so hand out what remains of the current one with the free list
+      index_t block_index = index_accessor.block_index.back();
+      index_t &current = next_free_indexes_[block_index];
+      for (index_t i = ECS_CACHE_LINE_SIZE; i > current; --i) {
+        index_accessor.free_list.push_back(block_index * ECS_CACHE_LINE_SIZE + i - 1);
+      }
+      current = ECS_CACHE_LINE_SIZE;
+    }
+    for (index_t block_index : other_accessor.block_index) {
+      index_accessor.block_index.push_back(block_index + first_block);
+    }
+    for (index_t index : other_accessor.free_list) {
+      index_accessor.free_list.push_back(index + offset);
+    }
+  }
+  for (index_t block_index : other.empty_blocks_) {
+    empty_blocks_.push_back(block_index + first_block);
+  }
+  for (index_t block_index : other.free_blocks_) {
+    free_blocks_.push_back(block_index + first_block);
+  }
+  block_entity_counts_.insert(block_entity_counts_.end(),
+                              other.block_entity_counts_.begin(), other.block_entity_counts_.end());
+  next_free_indexes_.insert(next_free_indexes_.end(), other.next_free_indexes_.begin(), other.next_free_indexes_.end());
+  index_to_component_mask.insert(index_to_component_mask.end(),
+                                 other.index_to_component_mask.begin(), other.index_to_component_mask.end());
+  entity_versions_.resize(offset);
+  component_masks_.resize(offset, details::ComponentMask(0));
+  entity_versions_.insert(entity_versions_.end(), other.entity_versions_.begin(), other.entity_versions_.end());
+  component_masks_.insert(component_masks_.end(), other.component_masks_.begin(), other.component_masks_.end());
+  for (size_t i = 0; i < other.component_managers_.size(); ++i) {
+    details::BaseManager *other_manager = other.component_managers_[i];
+    if (other_manager == nullptr) continue;
+    details::BaseManager &manager = get_component_manager(i, *other_manager);
+    details::BasePool &pool = manager.pool();
+    details::BasePool &other_pool = other_manager->pool();
+    if (pool.chunk_size() == other_pool.chunk_size() && offset % pool.chunk_size() == 0) {
+      pool.adopt_chunks(other_pool, offset / pool.chunk_size());
+    } else {
+      for (index_t index = 0; index < other.component_masks_.size(); ++index) {
+        if (other.component_masks_[index].test(i)) {
+          other_manager->move(index, manager, index + offset);
+        }
+      }
+    }
+  }
+  block_count_ += other.block_count_;
+  count_ += other.count_;
+  for (auto const &ids : remap) {
+    carry_expiry(other, ids.first.index(), ids.second.index());
+  }
+  // Every component is moved already, so nothing should be destroyed
+  other.component_masks_.clear();
+  other.clear_entities();
+  for (auto const &ids : remap) {
+    aggregate_added(ids.second.index());
+  }
+  return remap;
+}
+
+template<typename T>
+EntityManager::IdRemap EntityManager::move_entities(View<T> view, EntityManager &target) {
+  ECS_ASSERT(view.manager_ == this, "View does not belong to this EntityManager");
+  ECS_ASSERT(&target != this, "Cannot move entities within the same EntityManager");
+  IdRemap remap;
+  details::ComponentMask view_mask = view.mask_;
+  std::vector<bool> used = used_slots();
+  for (index_t block_index = 0; block_index < block_count_; ++block_index) {
+    index_t begin = block_index * ECS_CACHE_LINE_SIZE;
+    index_t end = std::min<index_t>(begin + ECS_CACHE_LINE_SIZE, index_t(used.size()));
+    bool whole_block = end - begin == ECS_CACHE_LINE_SIZE;
+    details::ComponentMask block_mask(0);
+    for (index_t index = begin; index < end; ++index) {
+      bool move = used[index] && (component_masks_[index] & view_mask) == view_mask;
+      whole_block = whole_block && move;
+      if (move) block_mask |= component_masks_[index];
+    }
+    // Hand over the memory of every component in the block, if possible
+    for (size_t i = 0; whole_block && i < component_managers_.size(); ++i) {
+      if (!block_mask.test(i)) continue;
+      whole_block = component_managers_[i]->pool().chunk_size() == ECS_CACHE_LINE_SIZE &&
+          (target.component_managers_.size() <= i || target.component_managers_[i] == nullptr ||
+              target.component_managers_[i]->pool().chunk_size() == ECS_CACHE_LINE_SIZE);
+    }
+    if (whole_block) {
+      unsigned long mask_as_ulong = index_to_component_mask[block_index];
+      index_t target_block = target.create_full_block(target.component_mask_to_index_accessor_[mask_as_ulong],
+                                                      mask_as_ulong);
+      index_t target_begin = target_block * ECS_CACHE_LINE_SIZE;
+      target.entity_versions_.resize(target_begin + ECS_CACHE_LINE_SIZE);
+      target.component_masks_.resize(target_begin + ECS_CACHE_LINE_SIZE, details::ComponentMask(0));
+      for (index_t index = begin; index < end; ++index) {
+        aggregate_removed(index);
+      }
+      for (size_t i = 0; i < component_managers_.size(); ++i) {
+        if (!block_mask.test(i)) continue;
+        details::BaseManager &target_manager = target.get_component_manager(i, *component_managers_[i]);
+        target_manager.pool().ensure_min_size(target_begin + ECS_CACHE_LINE_SIZE);
+        target_manager.pool().swap_chunk(target_block, component_managers_[i]->pool(), block_index);
+      }
+      for (index_t index = begin; index < end; ++index) {
+        index_t target_index = target_begin + (index - begin);
+        target.entity_versions_[target_index] = entity_versions_[index];
+        target.component_masks_[target_index] = component_masks_[index];
+        remap.push_back(std::make_pair(Id(index, entity_versions_[index]),
+                                       Id(target_index, entity_versions_[index])));
+        target.carry_expiry(*this, index, target_index);
+        release_slot(index);
+      }
+      for (index_t index = begin; index < end; ++index) {
+        target.aggregate_added(target_begin + (index - begin));
+      }
+      target.block_entity_counts_[target_block] = ECS_CACHE_LINE_SIZE;
+      target.count_ += ECS_CACHE_LINE_SIZE;
+      continue;
+    }
+    for (index_t index = begin; index < end; ++index) {
+      if (!used[index] || (component_masks_[index] & view_mask) != view_mask) continue;
+      details::ComponentMask mask = component_masks_[index];
+      Entity entity = target.create_with_mask(mask);
+      index_t target_index = entity.id().index();
+      aggregate_removed(index);
+      for (size_t i = 0; i < component_managers_.size(); ++i) {
+        if (!mask.test(i)) continue;
+        component_managers_[i]->move(index, target.get_component_manager(i, *component_managers_[i]), target_index);
+      }
+      target.component_masks_[target_index] = mask;
+      target.aggregate_added(target_index);
+      remap.push_back(std::make_pair(Id(index, entity_versions_[index]), entity.id()));
+      target.carry_expiry(*this, index, target_index);
+      release_slot(index);
+    }
+  }
+  return remap;
+}
+
+std::unique_ptr<EntityManager> EntityManager::fork() {
+  std::unique_ptr<EntityManager> copy(new EntityManager(0));
+  copy->share_state(*this);
+  return copy;
+}
+
+template<typename ...Components>
+void EntityManager::export_columns(std::ostream &out) const {
+  details::columns_t<Components...>::write(*this, details::ComponentMask(0), details::component_mask<Components...>(),
+                                           0, std::numeric_limits<index_t>::max(), out);
+}
+
+template<typename ...Components, typename T>
+void EntityManager::export_columns(std::ostream &out, View<T> const &view) const {
+  ECS_ASSERT(view.manager_ == this, "View does not belong to this EntityManager");
+  details::columns_t<Components...>::write(*this, view.mask_, ~details::ComponentMask(0),
+                                           view.first_, view.last_, out);
+}
+
+template<typename ...Components, typename Progress>
+size_t EntityManager::import_columns(std::istream &in, Progress progress) {
+  return details::columns_t<Components...>::read(*this, in, progress);
+}
+
+template<typename ...Components>
+size_t EntityManager::import_columns(std::istream &in) {
+  return import_columns<Components...>(in, [](size_t, size_t) { });
+}
+
+template<typename C>
+void EntityManager::double_buffer() {
+  get_component_manager<C>().double_buffer();
+}
+
+void EntityManager::swap_buffers() {
+  for (details::BaseManager *manager : component_managers_) {
+    if (manager) manager->swap_buffers();
+  }
+}
+
+size_t EntityManager::update_expiry(float time) {
+  size_t destroyed = 0;
+  expiry_time_ += time;
+  // Tolerate rounding errors, so that a multiple of the resolution is not rounded down
+  uint64_t ticks = uint64_t(expiry_time_ / expiry_resolution_ + 0.001);
+  expiry_time_ = std::max(0.0, expiry_time_ - double(ticks) * expiry_resolution_);
+  for (uint64_t tick = 0; tick < ticks; ++tick) {
+    uint64_t now = expiry_wheel_.now() + 1;
+    expiry_wheel_.advance([this, now, &destroyed](details::TimingWheel::Entry const &entry) {
+      // Entities that are destroyed, or set to expire at another time, are skipped
+      Entity entity = get_entity(entry.id.index());
+      if (entity.id() == entry.id && expiry_ticks_[entry.id.index()] == now) {
+        destroy(entity);
+        ++destroyed;
+      }
+    });
+  }
+  return destroyed;
+}
+
+void EntityManager::set_expiry_resolution(float seconds) {
+  ECS_ASSERT(seconds > 0, "Expiry resolution must be positive");
+  ECS_ASSERT(expiring_count_ == 0, "Can't change expiry resolution while entities are set to expire");
+  expiry_resolution_ = seconds;
+}
+
+template<typename E>
+EventChannel<E> &EntityManager::events() {
+  size_t index = details::event_index<E>();
+  if (event_channels_.size() <= index) event_channels_.resize(index + 1);
+  if (!event_channels_[index]) event_channels_[index].reset(new EventChannel<E>());
+  return static_cast<EventChannel<E> &>(*event_channels_[index]);
+}
+
+void EntityManager::swap_events() {
+  for (auto &channel : event_channels_) {
+    if (channel) channel->swap();
+  }
+}
+
+template<typename ...Components>
+View<EntityAlias<Components...>> EntityManager::with()  {
+  details::ComponentMask mask = details::component_mask<Components...>();
+  return View<EntityAlias<Components...>>(this, mask);
+}
+
+template<typename T>
+void EntityManager::with(T lambda)  {
+  ECS_ASSERT_IS_CALLABLE(T);
+  details::with_<T>::for_each(*this, lambda);
+}
+
+template<typename ...Components, typename T, typename Map, typename Combine>
+T EntityManager::reduce(T init, Map map, Combine combine, size_t threads) const {
+  T result = init;
+  using reducer = details::reduce_t<Components...>;
+  bool found = reducer::reduce(*this, reducer::range(), result,
+                               [&map](index_t, Components const &... components) { return map(components...); },
+                               combine, threads);
+  return found ? combine(init, result) : init;
+}
+
+template<typename C>
+typename details::component_value<C>::type EntityManager::sum(size_t threads) const {
+  using V = typename details::component_value<C>::type;
+  V result = V();
+  details::reduce_t<C>::reduce(*this, details::reduce_t<C>::range(), result,
+                               [](index_t, C const &component) -> V { return static_cast<V const &>(component); },
+                               [](V const &a, V const &b) -> V { return a + b; }, threads);
+  return result;
+}
+
+template<typename C>
+typename details::component_value<C>::type EntityManager::min(size_t threads) const {
+  using V = typename details::component_value<C>::type;
+  V result = V();
+  details::reduce_t<C>::reduce(*this, details::reduce_t<C>::range(), result,
+                               [](index_t, C const &component) -> V { return static_cast<V const &>(component); },
+                               [](V const &a, V const &b) -> V { return b < a ? b : a; }, threads);
+  return result;
+}
+
+template<typename C>
+typename details::component_value<C>::type EntityManager::max(size_t threads) const {
+  using V = typename details::component_value<C>::type;
+  V result = V();
+  details::reduce_t<C>::reduce(*this, details::reduce_t<C>::range(), result,
+                               [](index_t, C const &component) -> V { return static_cast<V const &>(component); },
+                               [](V const &a, V const &b) -> V { return a < b ? b : a; }, threads);
+  return result;
+}
+
+template<typename C, typename ...Components>
+size_t EntityManager::count() const {
+  details::ComponentMask mask = details::component_mask<C, Components...>();
+  return details::count_matches(component_masks_.data(), component_masks_.size(), mask);
+}
+
+template<typename ...Components, typename Key>
+MinMax<typename details::function_traits<Key>::return_type> EntityManager::minmax_by(Key key, size_t threads) const {
+  using K = typename details::function_traits<Key>::return_type;
+  MinMax<K> result = MinMax<K>{0, K(), K(), Id(0, 0), Id(0, 0)};
+  auto const &versions = entity_versions_;
+  using reducer = details::reduce_t<Components...>;
+  reducer::reduce(
+      *this, reducer::range(), result,
+      [&key, &versions](index_t index, Components const &... components) {
+        K value = key(components...);
+        Id id(index, versions[index]);
+        return MinMax<K>{1, value, value, id, id};
+      },
+      [](MinMax<K> const &a, MinMax<K> const &b) {
+        // a is always before b, so a is kept when the keys are equal
+        MinMax<K> result = a;
+        result.count += b.count;
+        if (b.min < a.min) {
+          result.min = b.min;
+          result.min_id = b.min_id;
+        }
+        if (a.max < b.max) {
+          result.max = b.max;
+          result.max_id = b.max_id;
+        }
+        return result;
+      }, threads);
+  return result;
+}
+
+template<typename C>
+std::vector<Id> EntityManager::top_k(size_t k, size_t threads) const {
+  using V = typename details::component_value<C>::type;
+  using reducer = details::reduce_t<C>;
+  return top_k_ids(reducer::template top_k<V>(
+      *this, reducer::range(), k, [](C const &component) -> V { return static_cast<V const &>(component); },
+      threads));
+}
+
+template<typename C, typename T>
+std::vector<Id> EntityManager::top_k(size_t k, View<T> const &view, size_t threads) const {
+  ECS_ASSERT(view.manager_ == this, "View does not belong to this EntityManager");
+  using V = typename details::component_value<C>::type;
+  using reducer = details::reduce_t<C>;
+  return top_k_ids(reducer::template top_k<V>(
+      *this, reducer::range(view.mask_, view.first_, view.last_), k,
+      [](C const &component) -> V { return static_cast<V const &>(component); }, threads));
+}
+
+template<typename ...Components, typename Key>
+std::vector<Id> EntityManager::top_k_by(size_t k, Key key, size_t threads) const {
+  using K = typename details::function_traits<Key>::return_type;
+  using reducer = details::reduce_t<Components...>;
+  return top_k_ids(reducer::template top_k<K>(*this, reducer::range(), k, key, threads));
+}
+
+template<typename K>
+std::vector<Id> EntityManager::top_k_ids(std::vector<std::pair<K, index_t>> const &selected) const {
+  std::vector<Id> ids;
+  ids.reserve(selected.size());
+  for (auto const &candidate : selected) {
+    ids.push_back(Id(candidate.second, entity_versions_[candidate.second]));
+  }
+  return ids;
+}
+
+template<typename C>
+typename details::component_value<C>::type EntityManager::quantile(double q, size_t threads) const {
+  return quantiles<C>(std::vector<double>(1, q), threads)[0];
+}
 
-BaseEntity::BaseEntity(const Entity &entity) : entity_(entity) { }
-BaseEntity::BaseEntity() { }
-BaseEntity::BaseEntity(EntityManager * manager) : manager_(manager){ }
-BaseEntity::BaseEntity(const BaseEntity &other) : entity_(other.entity_) { }
+template<typename C>
+std::vector<typename details::component_value<C>::type> EntityManager::quantiles(std::vector<double> const &qs,
+                                                                                 size_t threads) const {
+  using V = typename details::component_value<C>::type;
+  using reducer = details::reduce_t<C>;
+  std::vector<V> values = reducer::template quantiles<V>(
+      *this, reducer::range(), qs, [](C const &component) -> V { return static_cast<V const &>(component); },
+      threads);
+  if (values.empty()) values.resize(qs.size(), V());
+  return values;
+}
 
-} // namespace details
+template<typename C, typename T, typename Add, typename Remove>
+Aggregate<T> const &EntityManager::aggregate(T init, Add add, Remove remove) {
+  return get_component_manager<C>().aggregate(init, add, remove);
+}
 
-} // namespace ecs
-#endif //OPENECS_BASEENTITY_H
-namespace ecs{
+template<typename C>
+Aggregate<typename details::component_value<C>::type> const &EntityManager::aggregate_sum() {
+  using V = typename details::component_value<C>::type;
+  return aggregate<C>(V(),
+                      [](V &sum, C const &component) { sum = sum + static_cast<V const &>(component); },
+                      [](V &sum, C const &component) { sum = sum - static_cast<V const &>(component); });
+}
+
+template<typename C, typename Key>
+Aggregate<std::map<typename details::function_traits<Key>::return_type, size_t>> const &EntityManager::aggregate_count_by(Key key) {
+  using Counts = std::map<typename details::function_traits<Key>::return_type, size_t>;
+  return aggregate<C>(Counts(),
+                      [key](Counts &counts, C const &component) { ++counts[key(component)]; },
+                      [key](Counts &counts, C const &component) {
+                        auto it = counts.find(key(component));
+                        // The key is missing if the component was changed through a reference
+                        ECS_ASSERT(it != counts.end(), "Removed component has a key that is not counted");
+                        if (it != counts.end() && --it->second == 0) counts.erase(it);
+                      });
+}
 
-///---------------------------------------------------------------------
-/// EntityAlias is a wrapper around an Entity
-///---------------------------------------------------------------------
-///
-/// An EntityAlias makes modification of the entity and other
-/// entities much easier when performing actions. It acts solely as an
-/// abstraction layer between the entity and different actions.
-///
-///---------------------------------------------------------------------
-template<typename ...Components>
-class EntityAlias : public details::BaseEntity {
- private:
-  /// Underlying EntityAlias. Used for creating Entity alias without
-  /// a provided constructor
-  using Type = EntityAlias<Components...>;
-  template<typename C>
-  using is_component = details::is_type<C, Components...>;
+template<typename T>
+View<T> EntityManager::fetch_every()  {
+  ECS_ASSERT_IS_ENTITY(T);
+  return View<T>(this, T::static_mask());
+}
 
- public:
-  inline EntityAlias(const Entity &entity);
+template<typename T>
+void EntityManager::fetch_every(T lambda)  {
+  ECS_ASSERT_IS_CALLABLE(T);
+  typedef details::function_traits<T> function;
+  static_assert(function::arg_count == 1, "Lambda or function must only have one argument");
+  typedef typename function::template arg_remove_ref<0> entity_interface_t;
+  for (entity_interface_t entityInterface : fetch_every<entity_interface_t>()) {
+    lambda(entityInterface);
+  }
+}
 
-  /// Cast to Entity or EntityAlias
-  inline operator Entity &();
-  inline operator Entity const &() const;
+Entity EntityManager::find_guid(uint64_t guid) {
+  index_t index;
+  // The entry is stale if the Guid was changed through a reference
+  if (guid_index().find(guid, index) && index < component_masks_.size() &&
+      component_masks_[index].test(details::component_index<Guid>()) &&
+      get_component_fast<Guid>(index).value == guid) {
+    return get_entity(index);
+  }
+  // No entity has this index
+  return Entity(this, Id(std::numeric_limits<index_t>::max(), 0));
+}
 
-  inline bool operator==(const Entity &rhs) const;
-  inline bool operator!=(const Entity &rhs) const;
+details::GuidIndex &EntityManager::guid_index() {
+  if (guid_index_ == nullptr) {
+    guid_index_ = new details::GuidIndex();
+    get_component_manager<Guid>().add_aggregate(guid_index_);
+  }
+  return *guid_index_;
+}
 
-  inline Id &id();
-  inline Id const &id() const;
+Entity EntityManager::operator[](index_t index) {
+  return get_entity(index);
+}
 
-  /// Returns the requested component, or error if it doesn't exist
-  template<typename C> inline auto get()       -> typename std::enable_if< is_component<C>::value, C &>::type;
-  template<typename C> inline auto get()       -> typename std::enable_if<!is_component<C>::value, C &>::type;
-  template<typename C> inline auto get() const -> typename std::enable_if< is_component<C>::value, C const &>::type;
-  template<typename C> inline auto get() const -> typename std::enable_if<!is_component<C>::value, C const &>::type;
+Entity EntityManager::operator[](Id id)  {
+  Entity entity = get_entity(id);
+  ECS_ASSERT(id == entity.id(), "Id is no longer valid (Entity was destroyed)");
+  return entity;
+}
 
-  /// Set the requested component, if old component exist,
-  /// a new one is created. Otherwise, the assignment operator
-  /// is used.
-  template<typename C, typename ... Args> inline auto set(Args &&... args) ->
-      typename std::enable_if< is_component<C>::value, C &>::type;
-  template<typename C, typename ... Args> inline auto set(Args &&... args) ->
-      typename std::enable_if<!is_component<C>::value, C &>::type;
+Entity EntityManager::operator[](Handle handle) {
+  ECS_ASSERT(is_valid(handle), "Handle is no longer valid (Entity was destroyed)");
+  return get_entity(handle.id());
+}
 
-  /// Add the requested component, error if component of the same type exist already
-  template<typename C, typename ... Args>
-  inline C &add(Args &&... args);
+bool EntityManager::is_valid(Handle handle) const {
+  return handle.index() < entity_versions_.size() && handle.version() == entity_versions_[handle.index()];
+}
 
-  /// Access this Entity as an EntityAlias.
-  template<typename T> inline T &as();
-  template<typename T> inline T const &as() const;
+size_t EntityManager::count(){
+  return count_;
+}
 
-  /// Assume that this entity has provided Components
-  /// Use for faster component access calls
-  template<typename ...Components_>
-  inline EntityAlias<Components_...> &assume();
+index_t EntityManager::find_new_entity_index(details::ComponentMask mask) {
+  auto mask_as_ulong = mask.to_ulong();
+  IndexAccessor &index_accessor = component_mask_to_index_accessor_[mask_as_ulong];
+  index_t index;
+  //See if we can use old indexes for destroyed entities via free list
+  if (!index_accessor.free_list.empty()) {
+    index = index_accessor.free_list.back();
+    index_accessor.free_list.pop_back();
+  } else if (!index_accessor.block_index.empty() &&
+      ECS_CACHE_LINE_SIZE > next_free_indexes_[index_accessor.block_index.back()]) {
+    // EntityManager has created similar entities already. No free_indexes in
+    // free list (removed entities), so use an empty slot at the last block
+    index_t block_index = index_accessor.block_index.back();
+    index = (next_free_indexes_[block_index]++) + ECS_CACHE_LINE_SIZE * block_index;
+  } else {
+    index = claim_block(index_accessor, mask_as_ulong, 1) * ECS_CACHE_LINE_SIZE;
+  }
+  ++block_entity_counts_[index / ECS_CACHE_LINE_SIZE];
+  return index;
+}
 
-  template<typename ...Components_>
-  inline EntityAlias<Components_...> const &assume() const;
+void EntityManager::create_new_block(EntityManager::IndexAccessor &index_accessor,
+                                     unsigned long mask_as_ulong,
+                                     index_t next_free_index)  {
+  index_accessor.block_index.push_back(block_count_);
+  next_free_indexes_.resize(block_count_ + 1);
+  index_to_component_mask.resize(block_count_ + 1);
+  block_entity_counts_.resize(block_count_ + 1, 0);
+  next_free_indexes_[block_count_] = next_free_index;
+  index_to_component_mask[block_count_] = mask_as_ulong;
+}
 
-  /// Removes a component. Error of it doesn't exist. Cannot remove dependent components
-  template<typename C> inline auto remove() -> typename std::enable_if< is_component<C>::value, void>::type;
-  template<typename C> inline auto remove() -> typename std::enable_if<!is_component<C>::value, void>::type;
+index_t EntityManager::claim_block(IndexAccessor &index_accessor,
+                                   unsigned long mask_as_ulong,
+                                   index_t next_free_index) {
+  if (free_blocks_.empty()) recycle_empty_blocks();
+  if (free_blocks_.empty()) {
+    create_new_block(index_accessor, mask_as_ulong, next_free_index);
+    return block_count_++;
+  }
+  index_t block_index = free_blocks_.back();
+  free_blocks_.pop_back();
+  index_accessor.block_index.push_back(block_index);
+  next_free_indexes_[block_index] = next_free_index;
+  index_to_component_mask[block_index] = mask_as_ulong;
+  return block_index;
+}
+
+void EntityManager::recycle_empty_blocks() {
+  if (empty_blocks_.empty()) return;
+  std::vector<bool> recycled(block_count_, false);
+  std::vector<size_t> masks;
+  for (index_t block_index : empty_blocks_) {
+    // The block may have been used again since it became empty
+    if (block_entity_counts_[block_index] != 0 || recycled[block_index]) continue;
+    recycled[block_index] = true;
+    masks.push_back(index_to_component_mask[block_index]);
+    next_free_indexes_[block_index] = 0;
+    free_blocks_.push_back(block_index);
+  }
+  empty_blocks_.clear();
+  std::sort(masks.begin(), masks.end());
+  masks.erase(std::unique(masks.begin(), masks.end()), masks.end());
+  // Every slot of a recycled block is in the free list of its previous owner
+  for (size_t mask_as_ulong : masks) {
+    IndexAccessor &index_accessor = component_mask_to_index_accessor_[mask_as_ulong];
+    auto &free_list = index_accessor.free_list;
+    free_list.erase(std::remove_if(free_list.begin(), free_list.end(), [&recycled](index_t index) {
+      return recycled[index / ECS_CACHE_LINE_SIZE];
+    }), free_list.end());
+    auto &blocks = index_accessor.block_index;
+    blocks.erase(std::remove_if(blocks.begin(), blocks.end(), [&recycled](index_t block_index) {
+      return recycled[block_index];
+    }), blocks.end());
+  }
+}
 
-  /// Removes all components and call destructors
-  inline void remove_everything();
+void EntityManager::release_shard_blocks(index_t first_index, size_t capacity) {
+  index_t first_block = first_index / ECS_CACHE_LINE_SIZE;
+  index_t end_block = index_t((first_index + capacity) / ECS_CACHE_LINE_SIZE);
+  for (index_t block_index = first_block; block_index < end_block; ++block_index) {
+    if (block_entity_counts_[block_index] == 0) empty_blocks_.push_back(block_index);
+  }
+  if (empty_blocks_.size() > block_count_) recycle_empty_blocks();
+  --open_shards_;
+}
+
+index_t EntityManager::create_full_block(IndexAccessor &index_accessor, unsigned long mask_as_ulong) {
+  index_t block_index = block_count_;
+  create_new_block(index_accessor, mask_as_ulong, ECS_CACHE_LINE_SIZE);
+  ++block_count_;
+  // Keep the block that is currently being filled as the last block
+  auto &blocks = index_accessor.block_index;
+  if (blocks.size() > 1) {
+    std::iter_swap(blocks.end() - 2, blocks.end() - 1);
+  }
+  return block_index;
+}
 
-  /// Clears the component mask without destroying components (faster than remove_everything)
-  inline void clear_mask();
+std::vector<bool> EntityManager::used_slots() const {
+  std::vector<bool> used(entity_versions_.size(), false);
+  for (index_t block_index = 0; block_index < block_count_; ++block_index) {
+    index_t begin = block_index * ECS_CACHE_LINE_SIZE;
+    index_t end = std::min<index_t>(begin + next_free_indexes_[block_index], index_t(used.size()));
+    for (index_t index = begin; index < end; ++index) {
+      used[index] = true;
+    }
+  }
+  for (auto &pair : component_mask_to_index_accessor_) {
+    for (index_t index : pair.second.free_list) {
+      used[index] = false;
+    }
+  }
+  return used;
+}
 
-  /// Destroys this entity. Removes all components as well
-  inline void destroy();
-  /// Return true if entity has all specified components. False otherwise
-  template<typename... Components_> inline bool has();
-  template<typename... Components_> inline bool has() const;
+void EntityManager::set_expiry(index_t index, double seconds) {
+  // Tolerate rounding errors, so that a multiple of the resolution is not rounded up to the next tick
+  double ticks = std::ceil(seconds / expiry_resolution_ - 0.001);
+  uint64_t due_in = ticks > 1 ? uint64_t(ticks) : 1;
+  if (expiry_ticks_.size() <= index) expiry_ticks_.resize(entity_versions_.size(), 0);
+  if (expiry_ticks_[index] == 0) ++expiring_count_;
+  expiry_wheel_.insert(Id(index, entity_versions_[index]), due_in);
+  expiry_ticks_[index] = expiry_wheel_.now() + due_in;
+}
 
-  /// Returns whether an entity is an entity alias or not
-  template<typename T> inline bool is();
-  template<typename T> inline bool is() const;
+void EntityManager::clear_expiry(index_t index) {
+  // The entry in the wheel is skipped when it is due
+  if (index < expiry_ticks_.size() && expiry_ticks_[index] != 0) {
+    expiry_ticks_[index] = 0;
+    --expiring_count_;
+  }
+}
 
-  /// Returns true if entity has not been destroyed. False otherwise
-  inline bool is_valid();
-  inline bool is_valid() const;
+void EntityManager::carry_expiry(EntityManager const &from, index_t from_index, index_t index) {
+  if (from_index >= from.expiry_ticks_.size() || from.expiry_ticks_[from_index] == 0) return;
+  // Converted to seconds, since the resolutions may differ
+  double ticks = double(from.expiry_ticks_[from_index] - from.expiry_wheel_.now());
+  set_expiry(index, ticks * from.expiry_resolution_ - from.expiry_time_);
+}
 
- protected:
-  inline EntityAlias();
+void EntityManager::release_slot(index_t index) {
+  clear_expiry(index);
+  ++entity_versions_[index];
+  component_masks_[index].reset();
+  free_index(index);
+  --count_;
+}
 
- private:
-  // Recursion init components with argument
-  template<typename C0, typename Arg>
-  inline void init_components(Arg arg) {
-    add<C0>(arg);
+void EntityManager::free_index(index_t index) {
+  index_t block_index = index / ECS_CACHE_LINE_SIZE;
+  component_mask_to_index_accessor_[index_to_component_mask[block_index]].free_list.push_back(index);
+  if (--block_entity_counts_[block_index] == 0) {
+    empty_blocks_.push_back(block_index);
+    // A block may be emptied many times before a new block is needed, so don't let the list grow unbounded
+    if (empty_blocks_.size() > block_count_) recycle_empty_blocks();
   }
+}
 
-  template<typename C0, typename C1, typename ... Cs, typename Arg0, typename Arg1, typename ... Args>
-  inline void init_components(Arg0 arg0, Arg1 arg1, Args... args) {
-    init_components<C0>(arg0);
-    init_components<C1, Cs...>(arg1, args...);
+void EntityManager::clear_entities() {
+  for (details::BaseManager *manager : component_managers_) {
+    if (manager) manager->clear();
   }
-  // Recursion init components without argument
-  template<typename C>
-  inline void init_components() {
-    add<C>();
+  component_masks_.clear();
+  entity_versions_.clear();
+  next_free_indexes_.clear();
+  index_to_component_mask.clear();
+  component_mask_to_index_accessor_.clear();
+  block_entity_counts_.clear();
+  empty_blocks_.clear();
+  free_blocks_.clear();
+  expiry_wheel_.clear();
+  expiry_ticks_.clear();
+  expiring_count_ = 0;
+  block_count_ = 0;
+  count_ = 0;
+}
+
+void EntityManager::share_state(EntityManager &other) {
+  if (&other == this) return;
+  // Components that only this EntityManager has are destroyed
+  for (size_t i = 0; i < component_managers_.size(); ++i) {
+    bool shared = i < other.component_managers_.size() && other.component_managers_[i];
+    if (component_managers_[i] && !shared) component_managers_[i]->clear();
+  }
+  for (size_t i = 0; i < other.component_managers_.size(); ++i) {
+    if (other.component_managers_[i]) {
+      get_component_manager(i, *other.component_managers_[i]).share(*other.component_managers_[i]);
+    }
   }
+  component_masks_ = other.component_masks_;
+  entity_versions_ = other.entity_versions_;
+  next_free_indexes_ = other.next_free_indexes_;
+  index_to_component_mask = other.index_to_component_mask;
+  component_mask_to_index_accessor_ = other.component_mask_to_index_accessor_;
+  block_entity_counts_ = other.block_entity_counts_;
+  empty_blocks_ = other.empty_blocks_;
+  free_blocks_ = other.free_blocks_;
+  expiry_wheel_ = other.expiry_wheel_;
+  expiry_ticks_ = other.expiry_ticks_;
+  expiring_count_ = other.expiring_count_;
+  expiry_resolution_ = other.expiry_resolution_;
+  expiry_time_ = other.expiry_time_;
+  block_count_ = other.block_count_;
+  count_ = other.count_;
+  recompute_aggregates();
+}
+
+void EntityManager::aggregate_added(index_t index) {
+  details::ComponentMask const &mask = component_masks_[index];
+  for (size_t i = 0; i < component_managers_.size(); ++i) {
+    if (mask.test(i)) component_managers_[i]->aggregate_added(index);
+  }
+}
 
-  template<typename C0, typename C1, typename ... Cs>
-  inline void init_components() {
-    init_components<C0>();
-    init_components<C1, Cs...>();
+void EntityManager::aggregate_removed(index_t index) {
+  details::ComponentMask const &mask = component_masks_[index];
+  for (size_t i = 0; i < component_managers_.size(); ++i) {
+    if (mask.test(i)) component_managers_[i]->aggregate_removed(index);
   }
+}
 
-  template<typename ... Args>
-  inline void init(Args... args) {
-    init_components<Components...>(args...);
+void EntityManager::recompute_aggregates() {
+  for (details::BaseManager *manager : component_managers_) {
+    if (manager) manager->recompute_aggregates();
   }
+}
 
-  inline static details::ComponentMask static_mask();
+template<typename C, typename ...Args>
+details::ComponentManager<C> &EntityManager::create_component_manager(Args && ... args)  {
+  details::ComponentManager<C> *ptr = new details::ComponentManager<C>(std::forward<EntityManager &>(*this),
+                                                                       std::forward<Args>(args) ...);
+  component_managers_[details::component_index<C>()] = ptr;
+  return *ptr;
+}
 
-  friend class EntityManager;
-  friend class Entity;
-}; //EntityAlias
+template<typename C>
+details::ComponentManager<C> &EntityManager::get_component_manager_fast() {
+  return *reinterpret_cast<details::ComponentManager<C> *>(component_managers_[details::component_index<C>()]);
+}
 
-} // namespace ecs
+template<typename C>
+details::ComponentManager<C> const &EntityManager::get_component_manager_fast() const {
+  return *reinterpret_cast<details::ComponentManager<C> *>(component_managers_[details::component_index<C>()]);
+}
 
-// #included from: EntityAlias.inl
+template<typename C>
+bool EntityManager::has_component_manager() const {
+  size_t index = details::component_index<C>();
+  return index < component_managers_.size() && component_managers_[index] != nullptr;
+}
 
-namespace ecs{
+template<typename C>
+C *EntityManager::get_block_ptr(index_t first, index_t block_size) {
+  auto &component_manager = get_component_manager_fast<C>();
+  // Each block must be within a single chunk of memory
+  if (component_manager.pool().chunk_size() % block_size != 0) return nullptr;
+  return component_manager.get_ptr(first);
+}
 
-template<typename ...Cs>
-EntityAlias<Cs...>::EntityAlias() { }
+template<typename C>
+C const *EntityManager::get_block_ptr(index_t first, index_t block_size) const {
+  auto const &component_manager = get_component_manager_fast<C>();
+  if (component_manager.pool().chunk_size() % block_size != 0) return nullptr;
+  return component_manager.get_ptr(first);
+}
 
-template<typename ...Cs>
-EntityAlias<Cs...>::EntityAlias(const Entity &entity) : details::BaseEntity(entity) {}
+template<typename C>
+details::ComponentManager<C> &EntityManager::get_component_manager()  {
+  auto index = details::component_index<C>();
+  if (component_managers_.size() <= index) {
+    component_managers_.resize(index + 1, nullptr);
+    return create_component_manager<C>();
+  } else if (component_managers_[index] == nullptr) {
+    return create_component_manager<C>();
+  }
+  return *reinterpret_cast<details::ComponentManager<C> *>(component_managers_[index]);
+}
 
-template<typename ...Cs>
-EntityAlias<Cs...>::operator Entity &() {
-  return entity();
+template<typename C>
+details::ComponentManager<C> const &EntityManager::get_component_manager() const  {
+  auto index = details::component_index<C>();
+  ECS_ASSERT(component_managers_.size() > index && component_managers_[index] != nullptr,
+             "Component manager not created");
+  return *reinterpret_cast<details::ComponentManager<C> *>(component_managers_[index]);
+}
+
+details::BaseManager &EntityManager::get_component_manager(size_t component_index){
+  ECS_ASSERT(component_managers_.size() > component_index, "ComponentManager not created with that component index.");
+  return *component_managers_[component_index];
+}
+details::BaseManager const &EntityManager::get_component_manager(size_t component_index) const{
+  ECS_ASSERT(component_managers_.size() > component_index, "ComponentManager not created with that component index.");
+  return *component_managers_[component_index];
+}
+
+details::BaseManager &EntityManager::get_component_manager(size_t component_index,
+                                                           details::BaseManager const &other_manager) {
+  if (component_managers_.size() <= component_index) {
+    component_managers_.resize(component_index + 1, nullptr);
+  }
+  if (component_managers_[component_index] == nullptr) {
+    component_managers_[component_index] = other_manager.create_manager(*this);
+  }
+  return *component_managers_[component_index];
 }
 
-template<typename ...Cs>
-EntityAlias<Cs...>::operator Entity const &() const {
-  return entity();
+template<typename C>
+C &EntityManager::get_component(Entity &entity) {
+  ECS_ASSERT(has_component<C>(entity), "Entity doesn't have this component attached");
+  return get_component_manager<C>().get(entity.id_.index_);
 }
 
-template<typename ...Cs>
-Id &EntityAlias<Cs...>::id() {
-  return entity().id();
+template<typename C>
+C const &EntityManager::get_component(Entity const &entity) const {
+  ECS_ASSERT(has_component<C>(entity), "Entity doesn't have this component attached");
+  return get_component_manager<C>().get(entity.id_.index_);
 }
 
-template<typename ...Cs>
-Id const &EntityAlias<Cs...>::id() const {
-  return entity().id();
+template<typename C>
+C const &EntityManager::get_previous_component(Entity const &entity) const {
+  return get_component_manager<C>().previous(entity.id_.index_);
 }
 
-template<typename ...Cs> template<typename C>
-inline auto EntityAlias<Cs...>::get() ->
-typename std::enable_if<is_component<C>::value, C &>::type{
-  return entities().template get_component_fast<C>(entity());
+template<typename C>
+C &EntityManager::get_component_fast(index_t index)  {
+  return get_component_manager_fast<C>().get(index);
 }
 
-template<typename ...Cs> template<typename C>
-inline auto EntityAlias<Cs...>::get() const ->
-typename std::enable_if<is_component<C>::value, C const &>::type{
-  return entities().template get_component_fast<C>(entity());
+template<typename C>
+C const &EntityManager::get_component_fast(index_t index) const {
+  return get_component_manager_fast<C>().get(index);
 }
 
-template<typename ...Cs> template<typename C>
-inline auto EntityAlias<Cs...>::get() ->
-typename std::enable_if<!is_component<C>::value, C &>::type{
-  return entity().template get<C>();
+template<typename C>
+C &EntityManager::get_component_fast(Entity &entity)  {
+  return get_component_manager_fast<C>().get(entity.id_.index_);
 }
 
-template<typename ...Cs> template<typename C>
-inline auto EntityAlias<Cs...>::get() const ->
-typename std::enable_if<!is_component<C>::value, C const &>::type{
-  return entity().template get<C>();
+template<typename C>
+C const &EntityManager::get_component_fast(Entity const &entity) const  {
+  return get_component_manager_fast<C>().get(entity.id_.index_);
 }
 
-template<typename ...Cs> template<typename C, typename ... Args>
-inline auto EntityAlias<Cs...>::set(Args &&... args) ->
-typename std::enable_if<is_component<C>::value, C &>::type{
-  return entities().template set_component_fast<C>(entity(), std::forward<Args>(args)...);
+template<typename C, typename ...Args>
+C &EntityManager::create_component(Entity &entity, Args && ... args) {
+  ECS_ASSERT_VALID_ENTITY(entity);
+  ECS_ASSERT(!has_component<C>(entity), "Entity already has this component attached");
+  C &component = get_component_manager<C>().create(entity.id_.index_, std::forward<Args>(args) ...);
+  entity.mask().set(details::component_index<C>());
+  return component;
 }
 
-template<typename ...Cs> template<typename C, typename ... Args>
-inline auto EntityAlias<Cs...>::set(Args &&... args) ->
-typename std::enable_if<!is_component<C>::value, C &>::type{
-  return entities().template set_component<C>(entity(), std::forward<Args>(args)...);
+template<typename C>
+void EntityManager::remove_component(Entity &entity)  {
+  ECS_ASSERT_VALID_ENTITY(entity);
+  ECS_ASSERT(has_component<C>(entity), "Entity doesn't have component attached");
+  get_component_manager<C>().remove(entity.id_.index_);
 }
 
-template<typename ...Cs> template<typename C, typename ... Args>
-inline C& EntityAlias<Cs...>::add(Args &&... args) {
-  return entity().template add<C>(std::forward<Args>(args)...);
+template<typename C>
+void EntityManager::remove_component_fast(Entity &entity) {
+  ECS_ASSERT_VALID_ENTITY(entity);
+  ECS_ASSERT(has_component<C>(entity), "Entity doesn't have component attached");
+  get_component_manager_fast<C>().remove(entity.id_.index_);
 }
 
-template<typename ...Cs> template<typename C>
-C & EntityAlias<Cs...>::as() {
-  return entity().template as<C>();
+void EntityManager::remove_all_components(Entity &entity)  {
+  ECS_ASSERT_VALID_ENTITY(entity);
+  for (auto componentManager : component_managers_) {
+    if (componentManager && has_component(entity, componentManager->mask())) {
+      componentManager->remove(entity.id_.index_);
+    }
+  }
 }
 
-template<typename ...Cs> template<typename C>
-C const & EntityAlias<Cs...>::as() const {
-  return entity().template as<C>();
+void EntityManager::clear_mask(Entity &entity) {
+  ECS_ASSERT_VALID_ENTITY(entity);
+  component_masks_[entity.id_.index_].reset();
 }
 
-template<typename ...Cs> template<typename ...Components_>
-EntityAlias<Components_...> &EntityAlias<Cs...>::assume() {
-  return entity().template assume<Components_...>();
+template<typename C, typename ...Args>
+C &EntityManager::set_component(Entity &entity, Args && ... args) {
+  ECS_ASSERT_VALID_ENTITY(entity);
+  if (entity.has<C>()) {
+    return get_component_manager_fast<C>().set(entity.id_.index_, create_tmp_component<C>(std::forward<Args>(args)...));
+  }
+  else return create_component<C>(entity, std::forward<Args>(args)...);
 }
 
-template<typename ...Cs> template<typename ...Components>
-EntityAlias<Components...> const &EntityAlias<Cs...>::assume() const {
-  return entity().template assume<Components...>();
+template<typename C, typename ...Args>
+C &EntityManager::set_component_fast(Entity &entity, Args && ... args) {
+  ECS_ASSERT_VALID_ENTITY(entity);
+  ECS_ASSERT(entity.has<C>(), "Entity does not have component attached");
+  return get_component_manager_fast<C>().set(entity.id_.index_, create_tmp_component<C>(std::forward<Args>(args)...));
 }
 
-template<typename ...Cs> template<typename C>
-inline auto EntityAlias<Cs...>::remove() ->
-typename std::enable_if<!is_component<C>::value, void>::type {
-  entity().template remove<C>();
+bool EntityManager::has_component(Entity &entity, details::ComponentMask component_mask) {
+  ECS_ASSERT_VALID_ENTITY(entity);
+  return (mask(entity) & component_mask) == component_mask;
 }
 
-template<typename ...Cs> template<typename C>
-inline auto EntityAlias<Cs...>::remove() ->
-typename std::enable_if<is_component<C>::value, void>::type {
-  entities().template remove_component_fast<C>(entity());
+bool EntityManager::has_component(Entity const &entity, details::ComponentMask const &component_mask) const  {
+  ECS_ASSERT_VALID_ENTITY(entity);
+  return (mask(entity) & component_mask) == component_mask;
 }
 
-template<typename ...Cs>
-void EntityAlias<Cs...>::remove_everything() {
-  entity().remove_everything();
+template<typename ...Components>
+bool EntityManager::has_component(Entity &entity) {
+  return has_component(entity, details::component_mask<Components...>());
 }
 
-template<typename ...Cs>
-void EntityAlias<Cs...>::clear_mask() {
-  entity().clear_mask();
+template<typename ...Components>
+bool EntityManager::has_component(Entity const &entity) const  {
+  return has_component(entity, details::component_mask<Components...>());
 }
 
-template<typename ...Cs>
-void EntityAlias<Cs...>::destroy() {
-  entity().destroy();
+bool EntityManager::is_valid(Entity &entity)  {
+  return entity.id_.index_ < entity_versions_.size() &&
+      entity.id_.version_ == entity_versions_[entity.id_.index_];
 }
 
-template<typename ...Cs> template<typename... Components>
-bool EntityAlias<Cs...>::has() {
-  return entity().template has<Components...>();
+bool EntityManager::is_valid(Entity const &entity) const  {
+  return entity.id_.index_ < entity_versions_.size() &&
+      entity.id_.version_ == entity_versions_[entity.id_.index_];
 }
 
-template<typename ...Cs> template<typename... Components>
-bool EntityAlias<Cs...>::has() const {
-  return entity().template has<Components...>();
+void EntityManager::destroy(Entity &entity) {
+  index_t index = entity.id().index_;
+  remove_all_components(entity);
+  clear_expiry(index);
+  ++entity_versions_[index];
+  free_index(index);
+  --count_;
 }
 
-template<typename ...Cs> template<typename T>
-bool EntityAlias<Cs...>::is() {
-  return entity().template is<T>();
+void EntityManager::expire_in(Entity &entity, float seconds) {
+  ECS_ASSERT(is_valid(entity), "Entity is not valid");
+  set_expiry(entity.id().index_, seconds);
 }
-template<typename ...Cs> template<typename T>
-bool EntityAlias<Cs...>::is() const {
-  return entity().template is<T>();
+
+details::ComponentMask &EntityManager::mask(Entity &entity)  {
+  return mask(entity.id_.index_);
 }
 
-template<typename ...Cs>
-bool EntityAlias<Cs...>::is_valid() {
-  return entity().is_valid();
+details::ComponentMask const &EntityManager::mask(Entity const &entity) const {
+  return mask(entity.id_.index_);
 }
 
-template<typename ...Cs>
-bool EntityAlias<Cs...>::is_valid() const {
-  return entity().is_valid();
+details::ComponentMask &EntityManager::mask(index_t index) {
+  return component_masks_[index];
 }
 
-template<typename ...Cs>
-details::ComponentMask EntityAlias<Cs...>::static_mask(){
-  return details::component_mask<Cs...>();
+details::ComponentMask const &EntityManager::mask(index_t index) const {
+  return component_masks_[index];
 }
 
-template<typename ... Cs>
-inline bool EntityAlias<Cs...>::operator==(const Entity &rhs) const {
-  return entity() == rhs;
+Entity EntityManager::get_entity(Id id) {
+  return Entity(this, id);
 }
 
-template<typename ... Cs>
-inline bool EntityAlias<Cs...>::operator!=(const Entity &rhs) const {
-  return entity() != rhs;
+Entity EntityManager::get_entity(index_t index) {
+  return get_entity(Id(index, entity_versions_[index]));
+}
+
+size_t EntityManager::capacity() const  {
+  return entity_versions_.capacity();
 }
 
 } // namespace ecs
-#endif //ECS_ENTITYALIAS_H
+#endif //ECS_ENTITYMANAGER_H
 
 namespace ecs{
 
-Entity::Entity(EntityManager *manager, Id id) :
+namespace details{
+
+template<typename C>
+ComponentManager<C>::ComponentManager(EntityManager &manager, size_t chunk_size)  :
     manager_(manager),
-    id_(id)
+    pool_(chunk_size)
 { }
 
-Entity &Entity::operator=(const Entity &rhs) {
-  manager_ = rhs.manager_;
-  id_ = rhs.id_;
-  return *this;
+// Creating a component that has a defined ctor
+template<typename C, typename ...Args>
+auto create_component(void* ptr, Args && ... args) ->
+typename std::enable_if<std::is_constructible<C, Args...>::value, C&>::type {
+  return *new(ptr) C(std::forward<Args>(args)...);
+}
+
+// Creating a component that doesn't have ctor, and is not a property -> create using uniform initialization
+template<typename C, typename ...Args>
+auto create_component(void* ptr, Args && ... args) ->
+typename std::enable_if<!std::is_constructible<C, Args...>::value &&
+    !std::is_base_of<details::BaseProperty, C>::value, C&>::type {
+  return *new(ptr) C{std::forward<Args>(args)...};
+}
+
+// Creating a component that doesn't have ctor, and is a property -> create using underlying Property ctor
+template<typename C, typename ...Args>
+auto create_component(void* ptr, Args && ... args) ->
+typename std::enable_if<
+    !std::is_constructible<C, Args...>::value &&
+        std::is_base_of<details::BaseProperty, C>::value, C&>::type {
+  static_assert(sizeof...(Args) <= 1, ECS_ASSERT_MSG_ONLY_ONE_ARGS_PROPERTY_CONSTRUCTOR);
+  return *reinterpret_cast<C*>(new(ptr) typename C::ValueType(std::forward<Args>(args)...));
 }
 
 template<typename C>
-C &Entity::get() {
-  return manager_->get_component<C>(*this);
+auto copy_component(void* ptr, C const &component) ->
+typename std::enable_if<std::is_copy_constructible<C>::value, void>::type {
+  new(ptr) C(component);
 }
 
 template<typename C>
-C const &Entity::get() const {
-  return manager_->get_component<C>(*this);
+auto copy_component(void* ptr, C const &component) ->
+typename std::enable_if<!std::is_copy_constructible<C>::value, void>::type {
+  ECS_ASSERT(false, "Component can't be copied, and can't be modified while shared with a fork");
 }
 
-template<typename C, typename ... Args>
-C &Entity::set(Args && ... args){
-  return manager_->set_component<C>(*this, std::forward<Args>(args) ...);
+template<typename C> template<typename ...Args>
+C& ComponentManager<C>::create(index_t index, Args &&... args) {
+  pool_.ensure_min_size(index + 1);
+  C &component = create_component<C>(get_ptr(index), std::forward<Args>(args)...);
+  for (auto &aggregate : aggregates_) aggregate->add(index, component);
+  return component;
 }
 
-template<typename C, typename ... Args>
-C &Entity::add(Args && ... args){
-  return manager_->create_component<C>(*this, std::forward<Args>(args) ...);
+template<typename C>
+void ComponentManager<C>::remove(index_t index) {
+  C const *component = get_ptr(index);
+  for (auto &aggregate : aggregates_) aggregate->remove(index, *component);
+  pool_.destroy(index);
+  manager_.mask(index).reset(component_index<C>());
 }
 
-template<typename T>
-inline T & Entity::as(){
-  ECS_ASSERT_IS_ENTITY(T);
-  ECS_ASSERT_ENTITY_CORRECT_SIZE(T);
-  ECS_ASSERT(has(T::static_mask()), "Entity doesn't have required components for this EntityAlias");
-  return reinterpret_cast<T &>(*this);
+template<typename C> template<typename T>
+C& ComponentManager<C>::set(index_t index, T &&value) {
+  C &component = get(index);
+  for (auto &aggregate : aggregates_) aggregate->remove(index, component);
+  component = std::forward<T>(value);
+  for (auto &aggregate : aggregates_) aggregate->add(index, component);
+  return component;
+}
+
+template<typename C>
+C &ComponentManager<C>::operator[](index_t index){
+  return get(index);
 }
 
-template<typename T>
-inline T const & Entity::as() const{
-  ECS_ASSERT_IS_ENTITY(T);
-  ECS_ASSERT_ENTITY_CORRECT_SIZE(T);
-  ECS_ASSERT(has(T::static_mask()), "Entity doesn't have required components for this EntityAlias");
-  return reinterpret_cast<T const &>(*this);
+template<typename C>
+C &ComponentManager<C>::get(index_t index) {
+  return *get_ptr(index);
 }
 
-/// Assume that this entity has provided Components
-/// Use for faster component access calls
-template<typename ...Components>
-inline EntityAlias<Components...> & Entity::assume() {
-  return as<EntityAlias<Components...>>();
+template<typename C>
+C const &ComponentManager<C>::get(index_t index) const {
+  return *get_ptr(index);
 }
 
-template<typename ...Components>
-inline EntityAlias<Components...> const & Entity::assume() const {
-  return as<EntityAlias<Components...>>();
+template<typename C>
+C *ComponentManager<C>::get_ptr(index_t index)  {
+  if (pool_.has_shared()) {
+    unshare(index);
+  }
+  return pool_.get_ptr(index);
 }
 
 template<typename C>
-void Entity::remove()  {
-  manager_->remove_component<C>(*this);
+C const *ComponentManager<C>::get_ptr(index_t index) const {
+  return pool_.get_ptr(index);
 }
 
-void Entity::remove_everything() {
-  manager_->remove_all_components(*this);
+template<typename C>
+void *ComponentManager<C>::get_void_ptr(index_t index)  {
+  return get_ptr(index);
 }
 
-void Entity::clear_mask() {
-  manager_->clear_mask(*this);
+template<typename C>
+void const *ComponentManager<C>::get_void_ptr(index_t index) const {
+  return pool_.get_ptr(index);
 }
 
-void Entity::destroy() {
-  manager_->destroy(*this);
+template<typename C>
+void ComponentManager<C>::ensure_min_size(index_t size){
+  pool_.ensure_min_size(size);
 }
 
-template<typename... Components>
-bool Entity::has() {
-  return manager_->has_component<Components ...>(*this);
+template<typename C>
+BaseManager *ComponentManager<C>::create_manager(EntityManager &manager) const {
+  ComponentManager<C> *created = new ComponentManager<C>(manager, pool_.chunk_size());
+  // Only trivially copyable components are double buffered, so double_buffer is not instantiated for others
+  if (previous_) {
+    created->previous_.reset(new details::Pool<C>(pool_.chunk_size()));
+    created->previous_->share_chunks(created->pool_);
+  }
+  return created;
 }
 
-template<typename... Components>
-bool Entity::has() const {
-  return manager_->has_component<Components ...>(*this);
+template<typename C>
+void ComponentManager<C>::move(index_t index, BaseManager &target, index_t target_index) {
+  ComponentManager<C> &target_manager = static_cast<ComponentManager<C> &>(target);
+  target_manager.pool_.ensure_min_size(target_index + 1);
+  new(target_manager.get_ptr(target_index)) C(std::move(get(index)));
+  pool_.destroy(index);
 }
 
-template<typename T>
-bool Entity::is() {
-  ECS_ASSERT_IS_ENTITY(T);
-  ECS_ASSERT_ENTITY_CORRECT_SIZE(T);
-  return has(T::static_mask());
+template<typename C>
+void ComponentManager<C>::clear() {
+  if (!std::is_trivially_destructible<C>::value) {
+    size_t chunk_size = pool_.chunk_size();
+    index_t size = std::min<index_t>(pool_.size(), index_t(manager_.component_masks_.size()));
+    for (index_t index = 0; index < size; ++index) {
+      if (manager_.component_masks_[index].test(component_index<C>()) && !pool_.is_shared(index / chunk_size)) {
+        pool_.destroy(index);
+      }
+    }
+  }
+  pool_.clear();
+  if (previous_) previous_->clear();
+  previous_versions_.clear();
+  previous_owned_.clear();
+  for (auto &aggregate : aggregates_) aggregate->reset();
 }
 
-template<typename T>
-bool Entity::is() const {
-  ECS_ASSERT_IS_ENTITY(T);
-  ECS_ASSERT_ENTITY_CORRECT_SIZE(T);
-  return has(T::static_mask());
+template<typename C>
+void ComponentManager<C>::share(BaseManager &other) {
+  details::Pool<C> &other_pool = static_cast<ComponentManager<C> &>(other).pool_;
+  if (!std::is_trivially_destructible<C>::value) {
+    size_t chunk_size = pool_.chunk_size();
+    index_t size = std::min<index_t>(pool_.size(), index_t(manager_.component_masks_.size()));
+    for (size_t chunk = 0; chunk * chunk_size < size; ++chunk) {
+      // Chunks that are already shared with other are kept as they are
+      if (!pool_.chunk(chunk) || pool_.is_shared(chunk)) continue;
+      if (chunk < other_pool.chunks() && pool_.chunk(chunk) == other_pool.chunk(chunk)) continue;
+      index_t end = std::min<index_t>(size, index_t((chunk + 1) * chunk_size));
+      for (index_t index = index_t(chunk * chunk_size); index < end; ++index) {
+        if (manager_.component_masks_[index].test(component_index<C>())) pool_.destroy(index);
+      }
+    }
+  }
+  pool_.share_chunks(other_pool);
+  if (previous_) previous_->clear();
+  previous_versions_.clear();
+  previous_owned_.clear();
 }
 
-bool Entity::is_valid() {
-  return manager_->is_valid(*this);
+template<typename C>
+void ComponentManager<C>::double_buffer() {
+  // Previous values are released without calling any destructor
+  static_assert(std::is_trivially_copyable<C>::value, "Only trivially copyable components can be double buffered");
+  if (previous_) return;
+  previous_.reset(new details::Pool<C>(pool_.chunk_size()));
+  previous_->share_chunks(pool_);
+  record_previous_owners();
 }
 
-bool Entity::is_valid() const {
-  return manager_->is_valid(*this);
+template<typename C>
+void ComponentManager<C>::swap_buffers() {
+  if (!previous_) return;
+  previous_->share_chunks(pool_);
+  record_previous_owners();
 }
 
-bool Entity::has(details::ComponentMask &check_mask)  {
-  return manager_->has_component(*this, check_mask);
+template<typename C>
+void ComponentManager<C>::record_previous_owners() {
+  previous_versions_ = manager_.entity_versions_;
+  size_t size = manager_.component_masks_.size();
+  previous_owned_.resize(size);
+  for (size_t index = 0; index < size; ++index) {
+    previous_owned_[index] = manager_.component_masks_[index].test(component_index<C>());
+  }
 }
 
-bool Entity::has(details::ComponentMask const &check_mask) const  {
-  return manager_->has_component(*this, check_mask);
+template<typename C>
+C const &ComponentManager<C>::previous(index_t index) const {
+  ECS_ASSERT(is_double_buffered(), "Component is not double buffered");
+  // Entities created, or given the component, after the last swap have no previous value yet
+  bool owned = index < previous_owned_.size() && previous_owned_[index] &&
+      previous_versions_[index] == manager_.entity_versions_[index];
+  if (!owned) return *get_ptr(index);
+  return previous_->get(index);
 }
 
-details::ComponentMask &Entity::mask()  {
-  return manager_->mask(*this);
+template<typename C> template<typename T, typename Add, typename Remove>
+Aggregate<T> const &ComponentManager<C>::aggregate(T init, Add add, Remove remove) {
+  auto *aggregate = new AggregateOf<C, T, Add, Remove>(init, add, remove);
+  add_aggregate(aggregate);
+  return *aggregate;
 }
-details::ComponentMask const &Entity::mask() const {
-  return manager_->mask(*this);
+
+template<typename C>
+void ComponentManager<C>::add_aggregate(ComponentAggregate<C> *aggregate) {
+  aggregates_.push_back(std::unique_ptr<ComponentAggregate<C>>(aggregate));
+  index_t size = std::min<index_t>(pool_.size(), index_t(manager_.component_masks_.size()));
+  for (index_t index = 0; index < size; ++index) {
+    if (manager_.component_masks_[index].test(component_index<C>())) aggregate->add(index, *pool_.get_ptr(index));
+  }
 }
 
-inline bool operator==(const Entity &lhs, const Entity &rhs) {
-  return lhs.id() == rhs.id();
+template<typename C>
+void ComponentManager<C>::aggregate_added(index_t index) {
+  for (auto &aggregate : aggregates_) aggregate->add(index, *pool_.get_ptr(index));
 }
 
-inline bool operator!=(const Entity &lhs, const Entity &rhs) {
-  return lhs.id() != rhs.id();
+template<typename C>
+void ComponentManager<C>::aggregate_removed(index_t index) {
+  for (auto &aggregate : aggregates_) aggregate->remove(index, *pool_.get_ptr(index));
 }
 
-details::ComponentMask Entity::static_mask(){
-  return details::ComponentMask(0);
+template<typename C>
+void ComponentManager<C>::recompute_aggregates() {
+  if (aggregates_.empty()) return;
+  index_t size = std::min<index_t>(pool_.size(), index_t(manager_.component_masks_.size()));
+  for (auto &aggregate : aggregates_) {
+    aggregate->reset();
+    for (index_t index = 0; index < size; ++index) {
+      if (manager_.component_masks_[index].test(component_index<C>())) aggregate->add(index, *pool_.get_ptr(index));
+    }
+  }
 }
 
-} // namespace ecs
-#endif //ECS_ENTITY_H
-// #included from: UnallocatedEntity.h
-//
-// Created by Robin Grönberg on 05/12/15.
-//
+template<typename C>
+void ComponentManager<C>::unshare(index_t index) {
+  ECS_ASSERT(index < pool_.capacity(), "Pool has not allocated memory for this index.");
+  size_t chunk_size = pool_.chunk_size();
+  size_t chunk_index = index / chunk_size;
+  if (!pool_.is_shared(chunk_index)) return;
+  char *shared = pool_.detach_chunk(chunk_index);
+  index_t first = index_t(chunk_index * chunk_size);
+  index_t last = std::min<index_t>(index_t(first + chunk_size), index_t(manager_.component_masks_.size()));
+  for (index_t i = first; i < last; ++i) {
+    if (manager_.component_masks_[i].test(component_index<C>())) {
+      copy_component<C>(pool_.get_ptr(i), *reinterpret_cast<C *>(shared + (i - first) * sizeof(C)));
+    }
+  }
+  BasePool::release_chunk(shared);
+}
 
-#ifndef OPENECS_UNALLOCATEDENTITY_H
-#define OPENECS_UNALLOCATEDENTITY_H
+template<typename C>
+ComponentMask ComponentManager<C>::mask() {
+  return component_mask<C>();
+}
 
-#include <vector>
+} // namespace details
+
+} // namespace ecs
+#endif //ECS_COMPONENTMANAGER_H
+// #included from: Iterator.h
+#ifndef ECS_ITERATOR_H
+#define ECS_ITERATOR_H
 
 namespace ecs{
 
 ///---------------------------------------------------------------------
-/// UnallocatedEntity is used when creating an Entity but postponing
-/// allocation for memory in the EntityManager
-///---------------------------------------------------------------------
-///
-/// UnallocatedEntity is used when creating an Entity from the
-/// EntityManager but does not allocate memory inside the EntityManager
-/// until the UnallocatedEntity is assigned, or goes out of scope.
-///
-/// The purpose of doing this is to postpone the placement of the Entity
-/// until components have been attached. Then, the EntityManager knows
-/// what components that the entity has, and can place the entity close
-/// to similar entities in memory. This leads to better usage of the
-/// CPU cache
-///
-/// An UnallocatedEntity can always be implicitly casted to an Entity.
+/// Iterator is an iterator for iterating through the entity manager.
+/// The iterator should fulfill the c++ standards for an input iterator,
 ///
-/// Au UnallocatedEntity is assumed unallocated as long as entity_ is
-/// a nullptr
+/// The component masks are scanned up to 64 at a time, and the matching
+/// entities are then taken from the resulting bitmap. A mask is tested
+/// again before its entity is visited, so entities that lose a
+/// component during iteration are skipped. Entities that gain a
+/// component during iteration are only visited if their group of 64 is
+/// not scanned yet, so an entity after the current one in the same
+/// group is not visited. Entities created during iteration, at indexes
+/// beyond those that existed when it began, are never visited.
 ///---------------------------------------------------------------------
-class UnallocatedEntity {
- private:
-  struct ComponentHeader{
-    unsigned int index, size;
-  };
+template<typename T>
+class Iterator: public std::iterator<std::input_iterator_tag, typename std::remove_reference<T>::type> {
+  using T_no_ref = typename std::remove_reference<typename std::remove_const<T>::type>::type;
+
  public:
-  inline UnallocatedEntity(EntityManager &manager);
-  inline UnallocatedEntity &operator=(const UnallocatedEntity &rhs);
-  inline ~UnallocatedEntity();
+  /// Iterates through entities with an index within [first, last)
+  Iterator(EntityManager *manager, details::ComponentMask mask, bool begin = true,
+           index_t first = 0, index_t last = std::numeric_limits<index_t>::max());
+  Iterator(const Iterator &it);
+  Iterator &operator=(const Iterator &rhs) = default;
 
-  /// Cast to Entity or EntityAlias
-  inline operator Entity &();
+  // Get the current index (cursor)
+  index_t index() const;
+  Iterator &operator++();
 
-  inline bool operator==(const UnallocatedEntity &rhs) const;
-  inline bool operator!=(const UnallocatedEntity &rhs) const;
-  inline bool operator==(const Entity &rhs) const;
-  inline bool operator!=(const Entity &rhs) const;
+  // Move the cursor to the first entity at or after index
+  Iterator &seek(index_t index);
 
-  inline Id &id();
+  // The the current entity
+  T       entity();
+  T const entity() const;
 
-  /// Returns the requested component, or error if it doesn't exist
-  template<typename C> inline C &get();
-  template<typename C> inline C const &get() const;
+ private:
+  // find next entity withing the EntityManager which has the correct components
+  void find_next();
 
-  /// Set the requested component, if old component exist,
-  /// a new one is created. Otherwise, the assignment operator
-  /// is used.
-  template<typename C, typename ... Args> inline C &set(Args &&... args);
+  // find the first entity at or after index which has the correct components
+  void scan(index_t index);
 
-  /// Add the requested component, error if component of the same type exist already
-  template<typename C, typename ... Args> inline C &add(Args &&... args);
+  static const index_t scan_size = 64;
+
+  EntityManager         *manager_;
+  details::ComponentMask mask_;
+  index_t                first_;
+  index_t                cursor_;
+  size_t                 size_;
+  // Matching entities after the cursor, among the last scanned masks.
+  // Bit i is entity group_ + i. next_ is the index after the last scanned mask
+  uint64_t               matches_;
+  index_t                group_;
+  index_t                next_;
+}; //Iterator
+
+template<typename T> bool operator==(Iterator<T> const &lhs, Iterator<T> const &rhs);
+template<typename T> bool operator!=(Iterator<T> const &lhs, Iterator<T> const &rhs);
+template<typename T> inline T operator*(Iterator<T> &lhs);
+template<typename T> inline T const &operator*(Iterator<T> const &lhs);
+
+} // namespace ecs
+
+// #included from: Iterator.inl
+namespace ecs{
+
+template<typename T>
+Iterator<T>::Iterator(EntityManager *manager, details::ComponentMask mask, bool begin, index_t first, index_t last) :
+    manager_(manager),
+    mask_(mask),
+    matches_(0),
+    group_(0){
+  // Must be pool size because of potential holes
+  size_ = std::min<size_t>(manager_->entity_versions_.size(), last);
+  first_ = index_t(std::min<size_t>(first, size_));
+  if (begin) {
+    scan(first_);
+  } else {
+    cursor_ = next_ = index_t(size_);
+  }
+}
+
+template<typename T>
+Iterator<T>::Iterator(const Iterator &it) :
+    manager_(it.manager_),
+    mask_(it.mask_),
+    first_(it.first_),
+    cursor_(it.cursor_),
+    size_(it.size_),
+    matches_(it.matches_),
+    group_(it.group_),
+    next_(it.next_) { }
+
+template<typename T>
+index_t Iterator<T>::index() const {
+  return cursor_;
+}
+
+template<typename T>
+inline void Iterator<T>::find_next() {
+  while (matches_) {
+    index_t index = group_ + details::count_trailing_zeros(matches_);
+    matches_ &= matches_ - 1;
+    // The mask may have changed since it was scanned
+    if ((manager_->component_masks_[index] & mask_) == mask_) {
+      cursor_ = index;
+      return;
+    }
+  }
+  scan(next_);
+}
+
+template<typename T>
+inline void Iterator<T>::scan(index_t index) {
+  matches_ = 0;
+  while (index < size_) {
+    // Scan until the next multiple of scan_size, so that scans are aligned with blocks
+    index_t end = index_t(std::min<size_t>(size_, (index / scan_size + 1) * scan_size));
+    uint64_t matches = details::match_masks(&manager_->component_masks_[index], end - index, mask_);
+    if (matches) {
+      group_ = index;
+      next_ = end;
+      cursor_ = index + details::count_trailing_zeros(matches);
+      matches_ = matches & (matches - 1);
+      return;
+    }
+    index = end;
+  }
+  cursor_ = next_ = index_t(size_);
+}
+
+template<typename T>
+T Iterator<T>::entity() {
+  return manager_->get_entity(index()).template as<typename Iterator<T>::T_no_ref>();
+}
+
+template<typename T>
+const T Iterator<T>::entity() const  {
+  return manager_->get_entity(index()).template as<typename Iterator<T>::T_no_ref>();
+}
+
+template<typename T>
+Iterator<T> &Iterator<T>::operator++() {
+  find_next();
+  return *this;
+}
+
+template<typename T>
+Iterator<T> &Iterator<T>::seek(index_t index) {
+  scan(index_t(std::min<size_t>(std::max(index, first_), size_)));
+  return *this;
+}
+
+template<typename T>
+bool operator==(Iterator<T> const &lhs, Iterator<T> const &rhs) {
+  return lhs.index() == rhs.index();
+}
+
+template<typename T>
+bool operator!=(Iterator<T> const &lhs, Iterator<T> const &rhs) {
+  return !(lhs == rhs);
+}
+
+template<typename T>
+inline T operator*(Iterator<T> &lhs) {
+  return lhs.entity();
+}
 
-  /// Access this Entity as an EntityAlias.
-  template<typename T> inline T &as();
+template<typename T>
+inline T const &operator*(Iterator<T> const &lhs) {
+  return lhs.entity();
+}
 
-  /// Assume that this entity has provided Components
-  /// Use for faster component access calls
-  template<typename ...Components> inline EntityAlias<Components...> &assume();
+} // namespace ecs
+#endif //ECS_ITERATOR_H
+// #included from: BlockIterator.h
+#ifndef ECS_BLOCKITERATOR_H
+#define ECS_BLOCKITERATOR_H
 
-  /// Removes a component. Error of it doesn't exist
-  template<typename C> inline void remove();
+namespace ecs{
 
-  /// Removes all components and call destructors
-  void inline remove_everything();
+template<typename T>
+class View;
 
-  /// Clears the component mask without destroying components (faster than remove_everything)
-  void inline clear_mask();
+///---------------------------------------------------------------------
+/// BlockIterator is an iterator through the blocks of a View
+///---------------------------------------------------------------------
+///
+/// Each block is ECS_CACHE_LINE_SIZE entity indexes, and dereferencing
+/// the iterator gives a View of the entities within that block. Blocks
+/// without any matching entity give an empty View.
+///
+/// The View is returned by value, so BlockIterator is a proxy iterator,
+/// and only an input iterator to the standard library. It still has the
+/// operators of a random access iterator, so the blocks can be divided
+/// between threads by hand, in constant time.
+///
+/// @usage for (View<T> block : view.blocks()) {
+///          for (auto entity : block) { }
+///        }
+///---------------------------------------------------------------------
+template<typename T>
+class BlockIterator: public std::iterator<std::input_iterator_tag, View<T>, std::ptrdiff_t, void, View<T>> {
+ public:
+  using difference_type = std::ptrdiff_t;
+
+  BlockIterator() : manager_(nullptr), first_(0), last_(0), block_(0) { }
+  BlockIterator(EntityManager *manager, details::ComponentMask mask, index_t first, index_t last, index_t block);
+
+  /// The View of the current block
+  View<T> operator*() const;
+  View<T> operator[](difference_type n) const { return *(*this + n); }
+
+  /// The index of the current block
+  index_t block() const { return block_; }
+
+  BlockIterator &operator++() { ++block_; return *this; }
+  BlockIterator &operator--() { --block_; return *this; }
+  BlockIterator operator++(int) { BlockIterator it(*this); ++block_; return it; }
+  BlockIterator operator--(int) { BlockIterator it(*this); --block_; return it; }
+  BlockIterator &operator+=(difference_type n) { block_ = index_t(block_ + n); return *this; }
+  BlockIterator &operator-=(difference_type n) { block_ = index_t(block_ - n); return *this; }
+  BlockIterator operator+(difference_type n) const { return BlockIterator(*this) += n; }
+  BlockIterator operator-(difference_type n) const { return BlockIterator(*this) -= n; }
+  difference_type operator-(BlockIterator const &rhs) const { return difference_type(block_) - difference_type(rhs.block_); }
+
+  bool operator==(BlockIterator const &rhs) const { return block_ == rhs.block_; }
+  bool operator!=(BlockIterator const &rhs) const { return block_ != rhs.block_; }
+  bool operator<(BlockIterator const &rhs) const { return block_ < rhs.block_; }
+  bool operator>(BlockIterator const &rhs) const { return block_ > rhs.block_; }
+  bool operator<=(BlockIterator const &rhs) const { return block_ <= rhs.block_; }
+  bool operator>=(BlockIterator const &rhs) const { return block_ >= rhs.block_; }
 
-  /// Destroys this entity. Removes all components as well
-  void inline destroy();
+ private:
+  EntityManager         *manager_;
+  details::ComponentMask mask_;
+  /// The range of entity indexes of the View
+  index_t                first_;
+  index_t                last_;
+  index_t                block_;
+}; //BlockIterator
 
-  /// Return true if entity has all specified components. False otherwise
-  template<typename... Components> inline bool has() const;
+template<typename T>
+inline BlockIterator<T> operator+(typename BlockIterator<T>::difference_type n, BlockIterator<T> const &it) {
+  return it + n;
+}
 
-  /// Returns whether an entity is an entity alias or not
-  template<typename T> inline bool is() const;
+///---------------------------------------------------------------------
+/// The blocks of a View, that can be iterated with BlockIterators
+///---------------------------------------------------------------------
+template<typename T>
+class BlockRange {
+ public:
+  using iterator = BlockIterator<T>;
 
-  /// Returns true if entity has not been destroyed. False otherwise
-  bool inline is_valid() const;
+  BlockRange(iterator begin, iterator end) : begin_(begin), end_(end) { }
 
-  /// Allocates memory for this Entity. Once allocated, the Unallocated Entity function like a
-  /// normal Entity
-  void inline allocate();
+  iterator begin() const { return begin_; }
+  iterator end() const { return end_; }
+  size_t size() const { return size_t(end_ - begin_); }
+  bool empty() const { return begin_ == end_; }
 
  private:
+  iterator begin_;
+  iterator end_;
+}; //BlockRange
 
-  bool inline is_allocated() const;
+} // namespace ecs
 
-  EntityManager * manager_ = nullptr;
-  Entity entity_;
-  std::vector<char> component_data;
-  std::vector<ComponentHeader> component_headers_;
-  details::ComponentMask mask_ = details::ComponentMask(0);
+// #included from: BlockIterator.inl
+namespace ecs{
 
-}; //UnallocatedEntity
+template<typename T>
+BlockIterator<T>::BlockIterator(EntityManager *manager, details::ComponentMask mask,
+                                index_t first, index_t last, index_t block) :
+    manager_(manager),
+    mask_(mask),
+    first_(first),
+    last_(last),
+    block_(block) { }
 
-} // namespace ecs
+template<typename T>
+View<T> BlockIterator<T>::operator*() const {
+  index_t begin = std::max<index_t>(first_, block_ * ECS_CACHE_LINE_SIZE);
+  index_t end = index_t(std::min<size_t>(last_, size_t(block_ + 1) * ECS_CACHE_LINE_SIZE));
+  return View<T>(manager_, mask_, begin, end);
+}
 
-// #included from: UnallocatedEntity.inl
-#include <cstring>
+} // namespace ecs
+#endif //ECS_BLOCKITERATOR_H
+// #included from: View.h
+#ifndef ECS_VIEW_H
+#define ECS_VIEW_H
 
 namespace ecs{
 
-UnallocatedEntity::UnallocatedEntity(EntityManager& manager) : manager_(&manager), entity_(&manager, Id(index_t(-1),0)){ }
-
-UnallocatedEntity::~UnallocatedEntity(){
-  allocate();
-}
+///---------------------------------------------------------------------
+/// Helper class that is used to access the iterator
+///---------------------------------------------------------------------
+/// @usage Calling entities.with<Components>(), returns a view
+///        that can be used to access the iterator with begin() and
+///        end() that iterates through all entities with specified
+///        Components
+///
+///        A View can be limited to a range of entity indexes, and be
+///        split into several Views, or iterated block by block, to
+///        divide the work between threads.
+///---------------------------------------------------------------------
+template<typename T>
+class View {
+  ECS_ASSERT_IS_ENTITY(T)
+ public:
+  using iterator        = Iterator<T>;
+  using const_iterator = Iterator<T const &>;
 
-UnallocatedEntity& UnallocatedEntity::operator=(const UnallocatedEntity &rhs){
-  allocate();
-  manager_ = rhs.manager_;
-  entity_ = rhs.entity_;
-  component_data = rhs.component_data;
-  component_headers_ = rhs.component_headers_;
-  return *this;
-}
+  /// A View of the entities with an index within [first, last)
+  View(EntityManager *manager, details::ComponentMask mask,
+       index_t first = 0, index_t last = std::numeric_limits<index_t>::max());
 
-UnallocatedEntity::operator Entity &() {
-  allocate();
-  return entity_;
-}
+  iterator begin();
+  iterator end();
+  const_iterator begin() const;
+  const_iterator end() const;
+  index_t count();
+  template<typename ...Components>
+  View<T>&& with();
 
-Id& UnallocatedEntity::id() {
-  allocate();
-  return entity_.id();
-}
+  /// The blocks of entities within this View. The iterators can be
+  /// moved by any number of blocks at once
+  BlockRange<T> blocks() const;
 
-template<typename C>
-C& UnallocatedEntity::get() {
-  ECS_ASSERT(is_valid(), "Unallocated Entity invalid");
-  ECS_ASSERT(has<C>(), "UnallocatedEntity does not have Component Attached");
-  if(is_allocated()){
-    return entity_.get<C>();
-  }
-  int index = 0;
-  for (auto& componentHeader : component_headers_) {
-    if(componentHeader.index == details::component_index<C>()){
-      return *reinterpret_cast<C*>(&component_data[index]);
-    }
-    index += componentHeader.size;
-  }
-  //should not happen
-  return *static_cast<C*>(nullptr);
-}
+  /// Split this View into n Views that together cover it. Each View has
+  /// about the same number of entities, and starts and ends at the border
+  /// of a block. Some Views may be empty, if there are few entities.
+  std::vector<View<T>> split(size_t n) const;
 
-template<typename C>
-C const & UnallocatedEntity::get() const {
-  ECS_ASSERT(is_valid(), "Unallocated Entity invalid");
-  ECS_ASSERT(has<C>(), "UnallocatedEntity does not have Component Attached");
-  if(is_allocated()){
-    return entity_.get<C>();
-  }else{
-    int index = 0;
-    for (auto& componentHeader : component_headers_) {
-      if(componentHeader.index == details::component_index<C>()){
-        return *reinterpret_cast<C*>(&component_data[index]);
-      }
-      index += componentHeader.size;
-    }
-  }
-  //should not happen
-  return *static_cast<C*>(nullptr);
-}
+  /// The range of entity indexes this View covers
+  index_t first() const { return first_; }
+  index_t last() const { return last_; }
 
-template<typename C, typename ... Args>
-C& UnallocatedEntity::set(Args &&... args){
-  if(is_allocated()){
-    return entity_.set<C>(std::forward<Args>(args)...);
-  }
-  if(has<C>()){
-    return get<C>() = manager_->create_tmp_component<C>(std::forward<Args>(args)...);
-  }else{
-    return add<C>(std::forward<Args>(args)...);
-  }
-}
+ private:
+  /// The end of the range, limited to the entities that exists
+  index_t end_index() const;
 
-template<typename C, typename ... Args>
-C& UnallocatedEntity::add(Args &&... args){
-  if(is_allocated()){
-    return entity_.add<C>(std::forward<Args>(args)...);
-  }
-  ECS_ASSERT(!has<C>(), "Unallocated Entity cannot assign already assigned component with add. Use set instead");
-  ECS_ASSERT(is_valid(), "Unallocated Entity invalid");
-  int index = 0;
-  //Find component location in memory
-  for (auto componentHeader : component_headers_) {
-    index += componentHeader.size;
-  }
-  //Ensure that a component manager exists for C
-  manager_->get_component_manager<C>();
-  //Set component data
-  auto component_index = details::component_index<C>();
-  mask_.set(component_index);
-  component_headers_.push_back(ComponentHeader{static_cast<unsigned int>(component_index), sizeof(C)});
-  component_data.resize(index + sizeof(C));
-  return details::create_component<C>(&component_data[index], std::forward<Args>(args)...);
-}
+  EntityManager         *manager_;
+  details::ComponentMask mask_;
+  index_t                first_;
+  index_t                last_;
 
-template<typename C>
-C & UnallocatedEntity::as() {
-  allocate();
-  return entity_.as<C>();
-}
+  friend class EntityManager;
+}; //View
 
-template<typename ...Components_>
-EntityAlias<Components_...> & UnallocatedEntity::assume() {
-  allocate();
-  return entity_.assume<Components_...>();
-}
+} // namespace ecs
 
-template<typename C>
-void UnallocatedEntity::remove() {
-  if(is_allocated()){
-    entity_.remove<C>();
-  }else{
-    int index = 0;
-    auto component_index = details::component_index<C>();
-    for (auto& componentHeader : component_headers_) {
-      if(componentHeader.index == component_index){
-        C& component = *reinterpret_cast<C*>(&component_data[index]);
-        component.~C();
-        break;
-      }
-      index += componentHeader.size;
-    }
-    mask_.reset(component_index);
-  }
-}
+// #included from: View.inl
 
-void UnallocatedEntity::remove_everything() {
-  if(is_allocated()){
-    entity_.remove_everything();
-  }else{
-    //TODO: call dtors on components
-    component_headers_.clear();
-    mask_.reset();
-  }
-}
+namespace ecs{
 
-void UnallocatedEntity::clear_mask() {
-  if(is_allocated()){
-    entity_.clear_mask();
-  } else{
-    component_headers_.clear();
-    mask_.reset();
-  }
-}
+template<typename T>
+View<T>::View(EntityManager *manager, details::ComponentMask mask, index_t first, index_t last)  :
+    manager_(manager),
+    mask_(mask),
+    first_(first),
+    last_(last) { }
 
-void UnallocatedEntity::destroy() {
-  if(is_allocated()){
-    entity_.destroy();
-  }else{
-    manager_ = nullptr;
-  }
+template<typename T>
+typename View<T>::iterator View<T>::begin() {
+  return iterator(manager_, mask_, true, first_, last_);
 }
 
-template<typename... Components>
-bool UnallocatedEntity::has() const {
-  if(is_allocated()){
-    return entity_.has<Components...>();
-  }else{
-    auto component_mask = details::component_mask<Components...>();
-    return (component_mask & mask_) == component_mask;
-  }
+template<typename T>
+typename View<T>::iterator View<T>::end() {
+  return iterator(manager_, mask_, false, first_, last_);
 }
 
 template<typename T>
-bool UnallocatedEntity::is() const {
-  if(is_allocated()){
-    return entity_.is<T>();
-  }else{
-    ECS_ASSERT_IS_ENTITY(T);
-    ECS_ASSERT_ENTITY_CORRECT_SIZE(T);
-    auto component_mask = T::static_mask();
-    return (component_mask & mask_) == component_mask;
-  }
+typename View<T>::const_iterator View<T>::begin() const {
+  return const_iterator(manager_, mask_, true, first_, last_);
 }
 
-bool UnallocatedEntity::is_valid() const {
-  if(is_allocated()){
-    return entity_.is_valid();
-  }else{
-    return manager_ != nullptr;
-  }
+template<typename T>
+typename View<T>::const_iterator View<T>::end() const {
+  return const_iterator(manager_, mask_, false, first_, last_);
 }
 
-inline bool operator==(const UnallocatedEntity &lhs, const UnallocatedEntity &rhs) {
-  return &lhs == &rhs;
+template<typename T>
+inline index_t View<T>::count() {
+  index_t count = 0;
+  for (auto it = begin(); it != end(); ++it) {
+    ++count;
+  }
+  return count;
 }
 
-inline bool operator!=(const UnallocatedEntity &lhs, const UnallocatedEntity &rhs) {
-  return &lhs != &rhs;
+template<typename T> template<typename ...Components>
+View<T>&& View<T>::with() {
+  mask_ |= details::component_mask<Components...>();
+  return *this;
 }
 
-inline bool UnallocatedEntity::operator==(const Entity &rhs) const {
-  return &entity_ == &rhs;
+template<typename T>
+BlockRange<T> View<T>::blocks() const {
+  index_t end = end_index();
+  index_t begin = std::min(first_, end);
+  index_t first_block = begin / ECS_CACHE_LINE_SIZE;
+  index_t end_block = begin == end ? first_block : (end + ECS_CACHE_LINE_SIZE - 1) / ECS_CACHE_LINE_SIZE;
+  return BlockRange<T>(BlockIterator<T>(manager_, mask_, begin, end, first_block),
+                       BlockIterator<T>(manager_, mask_, begin, end, end_block));
 }
 
-inline bool UnallocatedEntity::operator!=(const Entity &rhs) const {
-  return &entity_ != &rhs;
+template<typename T>
+std::vector<View<T>> View<T>::split(size_t n) const {
+  ECS_ASSERT(n > 0, "A View must be split into at least 1 View");
+  index_t end = end_index();
+  index_t begin = std::min(first_, end);
+  // Count the entities within each block
+  std::vector<size_t> block_counts;
+  size_t total = 0;
+  for (index_t block_begin = begin; block_begin < end;) {
+    index_t block_end = std::min<index_t>(end, (block_begin / ECS_CACHE_LINE_SIZE + 1) * ECS_CACHE_LINE_SIZE);
+    size_t count = details::count_matches(&manager_->component_masks_[block_begin], block_end - block_begin, mask_);
+    block_counts.push_back(count);
+    total += count;
+    block_begin = block_end;
+  }
+  std::vector<View<T>> views;
+  views.reserve(n);
+  index_t cut = first_;
+  size_t block = 0;
+  size_t counted = 0;
+  for (size_t i = 1; i < n; ++i) {
+    index_t view_first = cut;
+    while (block < block_counts.size() && counted < total * i / n) {
+      counted += block_counts[block++];
+      cut = std::min<index_t>(end, (cut / ECS_CACHE_LINE_SIZE + 1) * ECS_CACHE_LINE_SIZE);
+    }
+    views.push_back(View<T>(manager_, mask_, view_first, cut));
+  }
+  // The last View covers the rest, including entities created after the split
+  views.push_back(View<T>(manager_, mask_, cut, last_));
+  return views;
 }
 
-bool UnallocatedEntity::is_allocated() const {
-  return manager_ == nullptr;
+template<typename T>
+index_t View<T>::end_index() const {
+  return index_t(std::min<size_t>(last_, manager_->entity_versions_.size()));
 }
 
-void UnallocatedEntity::allocate() {
-  if(!is_allocated()){
-    entity_ = manager_->create_with_mask(mask_);
-    if(component_headers_.size() > 0){
-      auto index = entity_.id().index();
-      manager_->mask(index) |= mask_;
-      unsigned int offset = 0;
-      //TODO: set mask
-      for (auto componentHeader : component_headers_) {
-        details::BaseManager& componentManager = manager_->get_component_manager(componentHeader.index);
-        componentManager.ensure_min_size(index);
-        //Copy data from tmp location to acctuial location in component manager
-        std::memcpy(componentManager.get_void_ptr(index), &component_data[offset], componentHeader.size);
-        offset+=componentHeader.size;
-      }
-    }
-    manager_ = nullptr;
+} // namespace ecs
+#endif //OPENECS_VIEW_H
+// #included from: Cursor.h
+#ifndef ECS_CURSOR_H
+#define ECS_CURSOR_H
+
+namespace ecs{
+
+///---------------------------------------------------------------------
+/// A Cursor iterates through a View over several calls
+///---------------------------------------------------------------------
+///
+/// Each call to for_each continues from where the last call stopped,
+/// and stops when its budget is spent, or when the end of the View is
+/// reached. The next call after the end starts from the beginning
+/// again. This way a system can visit every entity eventually, without
+/// doing all the work within one update.
+///
+/// The cursor is an entity index, so entities can be created and
+/// destroyed between calls. Destroyed entities are skipped, and
+/// entities created behind the cursor are visited on the next pass.
+///
+///---------------------------------------------------------------------
+template<typename T>
+class Cursor {
+  ECS_ASSERT_IS_ENTITY(T)
+ public:
+  inline Cursor() : index_(0), passes_(0) { }
+
+  /// Visit at most max_entities entities. Returns how many were visited
+  template<typename Lambda>
+  inline size_t for_each(View<T> view, size_t max_entities, Lambda lambda);
+
+  /// Visit entities until max_time has passed. The time is checked every
+  /// time_check_interval entities. Returns how many were visited
+  template<typename Rep, typename Period, typename Lambda>
+  inline size_t for_each(View<T> view, std::chrono::duration<Rep, Period> max_time, Lambda lambda);
+
+  /// The index where the next call continues
+  inline index_t index() const { return index_; }
+
+  /// How many times the end of a View has been reached
+  inline size_t passes() const { return passes_; }
+
+  /// Start from the beginning with the next call
+  inline void reset() { index_ = 0; }
+
+  static const size_t time_check_interval = 64;
+
+ private:
+  template<typename Lambda, typename Predicate>
+  inline size_t visit(View<T> &view, Lambda &lambda, Predicate has_budget);
+
+  index_t index_;
+  size_t passes_;
+}; //Cursor
+
+} // namespace ecs
+
+// #included from: Cursor.inl
+
+namespace ecs{
+
+template<typename T> template<typename Lambda>
+size_t Cursor<T>::for_each(View<T> view, size_t max_entities, Lambda lambda) {
+  return visit(view, lambda, [max_entities](size_t visited) {
+    return visited < max_entities;
+  });
+}
+
+template<typename T> template<typename Rep, typename Period, typename Lambda>
+size_t Cursor<T>::for_each(View<T> view, std::chrono::duration<Rep, Period> max_time, Lambda lambda) {
+  auto deadline = std::chrono::steady_clock::now() + max_time;
+  return visit(view, lambda, [deadline](size_t visited) {
+    return visited % time_check_interval != 0 || std::chrono::steady_clock::now() < deadline;
+  });
+}
+
+template<typename T> template<typename Lambda, typename Predicate>
+size_t Cursor<T>::visit(View<T> &view, Lambda &lambda, Predicate has_budget) {
+  auto it = view.begin();
+  auto end = view.end();
+  it.seek(index_);
+  size_t visited = 0;
+  for (; it != end && has_budget(visited); ++it, ++visited) {
+    lambda(*it);
+  }
+  if (it == end) {
+    index_ = 0;
+    ++passes_;
+  } else {
+    index_ = it.index();
   }
+  return visited;
 }
 
 } // namespace ecs
-#endif //OPENECS_UNALLOCATEDENTITY_H
+#endif //ECS_CURSOR_H
+// #included from: EntityShard.h
+#ifndef ECS_ENTITYSHARD_H
+#define ECS_ENTITYSHARD_H
 
 namespace ecs{
 
-namespace details{
+///---------------------------------------------------------------------
+/// EntityShard is used to create entities from another thread
+///---------------------------------------------------------------------
+///
+/// An EntityShard owns a range of blocks that the EntityManager has
+/// set aside for entities with the specified Components. Creating an
+/// entity through the shard only writes to memory within those blocks,
+/// so any number of shards can create entities on different threads
+/// without locking, while the EntityManager is used as normal.
+///
+/// Entities created by a shard become visible in the EntityManager once
+/// the shard is merged, which must be done from the thread that owns
+/// the EntityManager. Slots that the shard did not use are handed back
+/// to the EntityManager at that point.
+///
+/// A shard that is destroyed without being merged destroys the
+/// components it created, and gives its blocks back to the
+/// EntityManager. That must also be done from the thread that owns the
+/// EntityManager. Every shard must be merged or destroyed before the
+/// EntityManager is, which is asserted.
+///
+///---------------------------------------------------------------------
+template<typename ...Components>
+class EntityShard {
+  static_assert(sizeof...(Components) > 0, "An EntityShard must create entities with at least one component.");
+ public:
+  inline EntityShard(EntityShard &&other);
+  inline EntityShard &operator=(EntityShard &&other);
+  inline ~EntityShard() { release(); }
+  EntityShard(const EntityShard &) = delete;
+  EntityShard &operator=(const EntityShard &) = delete;
+
+  /// Create an entity with default constructed components. Returns
+  /// the Id that the entity has when the shard is merged.
+  inline Id create();
+
+  /// Create an entity with one argument for each component. Returns
+  /// the Id that the entity has when the shard is merged.
+  template<typename ...Args>
+  inline Id create(Args &&... args);
 
-template<size_t N, typename Lambda, typename... Args>
-struct with_t<N, Lambda, Args...>:
-    with_t<N - 1, Lambda,
-           typename details::function_traits<Lambda>::template arg_remove_ref<N - 1>, Args...> {
-};
+  /// How many entities that are created with this shard
+  inline size_t size() const { return size_; }
 
-template<typename Lambda, typename... Args>
-struct with_t<0, Lambda, Args...> {
-  static inline void for_each(EntityManager &manager, Lambda lambda) {
-    typedef details::function_traits <Lambda> function;
-    static_assert(function::arg_count > 0, "Lambda or function must have at least 1 argument.");
-    auto view = manager.with<Args...>();
-    auto it = view.begin();
-    auto end = view.end();
-    for (; it != end; ++it) {
-      lambda(get_arg<Args>(manager, it.index())...);
-    }
-  }
+  /// How many entities this shard can create before it is full
+  inline size_t capacity() const { return capacity_; }
+
+  inline bool full() const { return size_ == capacity_; }
+
+ private:
+  // Chunks of a component pool that covers the blocks of this shard
+  struct ComponentChunks {
+    size_t first_chunk;
+    size_t chunk_size;
+    std::vector<char *> chunks;
+  };
+
+  inline EntityShard(EntityManager &manager, index_t first_index, size_t capacity);
 
-  //When arg is component, access component
   template<typename C>
-  static inline auto get_arg(EntityManager &manager, index_t index) ->
-  typename std::enable_if<!std::is_same<C, Entity>::value, C &>::type {
-    return manager.get_component_fast<C>(index);
-  }
+  inline void add_component_chunks();
 
-  //When arg is the Entity, access the Entity
   template<typename C>
-  static inline auto get_arg(EntityManager &manager, index_t index) ->
-  typename std::enable_if<std::is_same<C, Entity>::value, Entity>::type {
-    return manager.get_entity(index);
-  }
-};
+  inline C *get_ptr(index_t index);
 
-template<typename Lambda>
-using with_ = with_t<details::function_traits<Lambda>::arg_count, Lambda>;
+  inline index_t next_index();
 
-} // namespace details
+  /// Destroy the created components and give the blocks back, if the shard is not merged
+  inline void release();
 
-EntityManager::EntityManager(size_t chunk_size) {
-  entity_versions_.reserve(chunk_size);
-  component_masks_.reserve(chunk_size);
+  EntityManager               *manager_;
+  index_t                      first_index_;
+  size_t                       size_;
+  size_t                       capacity_;
+  std::vector<version_t>       versions_;
+  std::vector<ComponentChunks> components_;
+
+  friend class EntityManager;
+}; //EntityShard
+
+} // namespace ecs
+
+// #included from: EntityShard.inl
+
+namespace ecs{
+
+template<typename ...Cs>
+EntityShard<Cs...>::EntityShard(EntityManager &manager, index_t first_index, size_t capacity) :
+    manager_(&manager),
+    first_index_(first_index),
+    size_(0),
+    capacity_(capacity),
+    versions_(manager.entity_versions_.begin() + first_index,
+              manager.entity_versions_.begin() + first_index + capacity) {
+  // Order of components_ is the same as Cs...
+  components_.reserve(sizeof...(Cs));
+  int expand[] = {(add_component_chunks<Cs>(), 0)...};
+  (void) expand;
 }
 
-EntityManager::~EntityManager()  {
-  for (details::BaseManager *manager : component_managers_) {
-    if (manager) delete manager;
+template<typename ...Cs>
+EntityShard<Cs...>::EntityShard(EntityShard &&other) :
+    manager_(other.manager_),
+    first_index_(other.first_index_),
+    size_(other.size_),
+    capacity_(other.capacity_),
+    versions_(std::move(other.versions_)),
+    components_(std::move(other.components_)) {
+  other.manager_ = nullptr;
+}
+
+template<typename ...Cs>
+EntityShard<Cs...> &EntityShard<Cs...>::operator=(EntityShard &&other) {
+  if (&other != this) {
+    release();
+    manager_ = other.manager_;
+    first_index_ = other.first_index_;
+    size_ = other.size_;
+    capacity_ = other.capacity_;
+    versions_ = std::move(other.versions_);
+    components_ = std::move(other.components_);
+    other.manager_ = nullptr;
   }
-  component_managers_.clear();
-  component_masks_.clear();
-  entity_versions_.clear();
-  next_free_indexes_.clear();
-  component_mask_to_index_accessor_.clear();
-  index_to_component_mask.clear();
+  return *this;
 }
 
-UnallocatedEntity EntityManager::create() {
-  return UnallocatedEntity(*this);
+template<typename ...Cs>
+Id EntityShard<Cs...>::create() {
+  index_t index = next_index();
+  int expand[] = {(details::create_component<Cs>(get_ptr<Cs>(index)), 0)...};
+  (void) expand;
+  return Id(index, versions_[index - first_index_]);
 }
 
-std::vector<Entity> EntityManager::create(const size_t num_of_entities)  {
-  return create_with_mask(details::ComponentMask(0), num_of_entities);
+template<typename ...Cs> template<typename ...Args>
+Id EntityShard<Cs...>::create(Args &&... args) {
+  static_assert(sizeof...(Args) == sizeof...(Cs), "Provide one argument for each component.");
+  index_t index = next_index();
+  int expand[] = {(details::create_component<Cs>(get_ptr<Cs>(index), std::forward<Args>(args)), 0)...};
+  (void) expand;
+  return Id(index, versions_[index - first_index_]);
 }
 
-template<typename T>
-inline void EntityManager::create(const size_t num_of_entities, T lambda){
-  ECS_ASSERT_IS_CALLABLE(T);
-  using EntityAlias_ = typename details::function_traits<T>::template arg_remove_ref<0>;
-  ECS_ASSERT_IS_ENTITY(EntityAlias_);
-  for(Entity& entity : create_with_mask(EntityAlias_::static_mask(), num_of_entities)){
-    //We cannot use as<EntityAlias> since we dont have attached any components
-    lambda(*reinterpret_cast<EntityAlias_*>(&entity));
-    ECS_ASSERT(entity.has(EntityAlias_::static_mask()), "Entity are missing certain components.");
+template<typename ...Cs> template<typename C>
+void EntityShard<Cs...>::add_component_chunks() {
+  details::ComponentManager<C> &component_manager = manager_->get_component_manager<C>();
+  details::BasePool &pool = component_manager.pool();
+  pool.ensure_min_size(first_index_ + capacity_);
+  ComponentChunks component;
+  component.chunk_size = pool.chunk_size();
+  component.first_chunk = first_index_ / component.chunk_size;
+  if (capacity_ > 0) {
+    size_t last_chunk = (first_index_ + capacity_ - 1) / component.chunk_size;
+    for (size_t i = component.first_chunk; i <= last_chunk; ++i) {
+      // Make sure that the chunk is not shared with a fork
+      component_manager.get_ptr(index_t(std::max(i * component.chunk_size, size_t(first_index_))));
+      component.chunks.push_back(pool.chunk(i));
+    }
   }
+  components_.push_back(component);
 }
 
-/// If EntityAlias is constructable with Args...
-template<typename T, typename ...Args>
-auto EntityManager::create(Args && ... args) ->
-typename std::enable_if<std::is_constructible<T, Args...>::value, T>::type {
-  ECS_ASSERT_IS_ENTITY(T);
-  ECS_ASSERT_ENTITY_CORRECT_SIZE(T);
-  auto mask = T::static_mask();
-  Entity entity = create_with_mask(mask);
-  T *entity_alias = new(&entity) T(std::forward<Args>(args)...);
-  ECS_ASSERT(entity.has(mask),
-             "Every required component must be added when creating an Entity Alias");
-  return *entity_alias;
+template<typename ...Cs> template<typename C>
+C *EntityShard<Cs...>::get_ptr(index_t index) {
+  ComponentChunks &component = components_[details::index_of<C, Cs...>::value];
+  return reinterpret_cast<C *>(component.chunks[index / component.chunk_size - component.first_chunk] +
+      (index % component.chunk_size) * sizeof(C));
 }
 
-/// If EntityAlias is not constructable with Args...
-/// Attempt to create with underlying EntityAlias
-template<typename T, typename ...Args>
-auto EntityManager::create(Args && ... args) ->
-typename std::enable_if<!std::is_constructible<T, Args...>::value, T>::type {
-  ECS_ASSERT_IS_ENTITY(T);
-  ECS_ASSERT_ENTITY_CORRECT_SIZE(T);
-  typedef typename T::Type Type;
-  auto mask = T::static_mask();
-  Entity entity = create_with_mask(mask);
-  Type *entity_alias = new(&entity) Type();
-  entity_alias->init(std::forward<Args>(args)...);
-  ECS_ASSERT(entity.has(mask),
-             "Every required component must be added when creating an Entity Alias");
-  return *reinterpret_cast<T *>(entity_alias);
+template<typename ...Cs>
+index_t EntityShard<Cs...>::next_index() {
+  ECS_ASSERT(manager_ != nullptr, "EntityShard is already merged");
+  ECS_ASSERT(!full(), "EntityShard is full");
+  return first_index_ + index_t(size_++);
 }
 
-template<typename ...Components, typename ...Args>
-auto EntityManager::create_with(Args && ... args ) ->
-typename std::conditional<(sizeof...(Components) > 0), EntityAlias<Components...>, EntityAlias<Args...>>::type{
-  using Type = typename std::conditional<(sizeof...(Components) > 0), EntityAlias<Components...>, EntityAlias<Args...>>::type;
-  Entity entity = create_with_mask(Type::static_mask());
-  Type *entity_alias = new(&entity) Type();
-  entity_alias->init(std::forward<Args>(args)...);
-  return *entity_alias;
+template<typename ...Cs>
+void EntityShard<Cs...>::release() {
+  if (manager_ == nullptr) return;
+  for (index_t index = first_index_; index < first_index_ + size_; ++index) {
+    int expand[] = {(get_ptr<Cs>(index)->~Cs(), 0)...};
+    (void) expand;
+  }
+  manager_->release_shard_blocks(first_index_, capacity_);
+  manager_ = nullptr;
 }
 
+} // namespace ecs
+#endif //ECS_ENTITYSHARD_H
+// #included from: Reduce.h
+#ifndef ECS_REDUCE_H
+#define ECS_REDUCE_H
+
+namespace ecs{
+
+///---------------------------------------------------------------------
+/// The smallest and largest key of a number of entities, and the
+/// entities that have them. Given by EntityManager::minmax_by.
+///---------------------------------------------------------------------
+template<typename K>
+struct MinMax {
+  /// How many entities that were compared. The other members are only
+  /// set if count > 0
+  size_t count;
+  K min;
+  K max;
+  Id min_id;
+  Id max_id;
+};
+
+namespace details{
+
+///---------------------------------------------------------------------
+/// Used to reduce the components of every entity with Components into
+/// a single value, on several threads
+///---------------------------------------------------------------------
+///
+/// The entities are divided into slices of ECS_REDUCE_SLICE_SIZE entity
+/// indexes. Each thread takes one slice at a time and reduces it into a
+/// partial result. The partial results are then combined in the order
+/// of the slices, so the result is the same no matter how many threads
+/// are used, or which thread reduced which slice.
+///
+///---------------------------------------------------------------------
 template<typename ...Components>
-EntityAlias<Components...> EntityManager::create_with() {
-  using Type = EntityAlias<Components...>;
-  Entity entity = create_with_mask(details::component_mask<Components...>());
-  Type *entity_alias = new(&entity) Type();
-  entity_alias->init();
-  return *entity_alias;
-}
+struct reduce_t {
+  static_assert(sizeof...(Components) > 0, "At least 1 component must be reduced.");
+  static_assert(ECS_REDUCE_SLICE_SIZE % ECS_CACHE_LINE_SIZE == 0,
+                "ECS_REDUCE_SLICE_SIZE must be a multiple of ECS_CACHE_LINE_SIZE");
+
+  static const index_t block_size = 64;
+  static const index_t slice_size = ECS_REDUCE_SLICE_SIZE;
+
+  /// The entities to reduce, with every component in mask and an index within [first, last)
+  struct Range {
+    ComponentMask mask;
+    index_t first;
+    index_t last;
+  };
+
+  /// Every entity with Components, and every component in mask
+  static inline Range range(ComponentMask mask = ComponentMask(0), index_t first = 0,
+                           index_t last = std::numeric_limits<index_t>::max()) {
+    return Range{mask | details::component_mask<Components...>(), first, last};
+  }
+
+  template<typename T>
+  struct Partial {
+    T value;
+    bool found;
+  };
+
+  /// Reduce every entity in range, calling map(index, Components const &...)
+  /// for each. Returns false, and leaves result as it is, if there are no
+  /// such entities.
+  template<typename T, typename Map, typename Combine>
+  static inline bool reduce(EntityManager const &manager, Range const &range, T &result,
+                            Map map, Combine combine, size_t threads) {
+    std::vector<Partial<T>> partials = fold(
+        manager, range, Partial<T>{result, false},
+        [&map, &combine](Partial<T> &partial, index_t index, Components const &... components) {
+          if (partial.found) {
+            partial.value = combine(partial.value, map(index, components...));
+          } else {
+            partial.value = map(index, components...);
+            partial.found = true;
+          }
+        }, threads);
+    bool found = false;
+    for (Partial<T> &partial : partials) {
+      if (!partial.found) continue;
+      result = found ? combine(result, partial.value) : partial.value;
+      found = true;
+    }
+    return found;
+  }
+
+  /// The slices of entity indexes within a Range
+  struct Slices {
+    index_t first;
+    index_t end;
+    index_t first_slice;
+    size_t count;
+
+    index_t slice_first(size_t slice) const {
+      return std::max<index_t>(first, index_t((first_slice + slice) * slice_size));
+    }
+    index_t slice_end(size_t slice) const {
+      return index_t(std::min<size_t>(end, (first_slice + slice + 1) * size_t(slice_size)));
+    }
+  };
+
+  static inline Slices slices(EntityManager const &manager, Range const &range) {
+    Slices slices;
+    slices.first = range.first;
+    slices.end = index_t(std::min<size_t>(range.last, manager.component_masks_.size()));
+    slices.first_slice = range.first / slice_size;
+    slices.count = 0;
+    // No entity is in range if a component has no ComponentManager
+    if (range.first < slices.end && has_managers(manager)) {
+      slices.count = (slices.end - 1) / slice_size - slices.first_slice + 1;
+    }
+    return slices;
+  }
 
-Entity EntityManager::create_with_mask(details::ComponentMask mask)  {
-  ++count_;
-  index_t index = find_new_entity_index(mask);
-  size_t slots_required = index + 1;
-  if (entity_versions_.size() < slots_required) {
-    entity_versions_.resize(slots_required);
-    component_masks_.resize(slots_required, details::ComponentMask(0));
+  /// How many threads are used for a number of slices. 0 threads means one
+  /// per core, but at most one per slices_per_thread slices, since starting a
+  /// thread costs about as much as reducing a few slices
+  static inline size_t thread_count(size_t slices, size_t threads,
+                                    size_t slices_per_thread = ECS_REDUCE_SLICES_PER_THREAD) {
+    if (threads == 0) {
+      threads = std::min<size_t>(std::thread::hardware_concurrency(), slices / slices_per_thread);
+    }
+    return std::max<size_t>(1, std::min(threads, slices));
   }
-  return get_entity(index);
-}
 
-std::vector<Entity> EntityManager::create_with_mask(details::ComponentMask mask, const size_t num_of_entities) {
-  std::vector<Entity> new_entities;
-  size_t entities_left = num_of_entities;
-  new_entities.reserve(entities_left);
-  auto mask_as_ulong = mask.to_ulong();
-  IndexAccessor &index_accessor = component_mask_to_index_accessor_[mask_as_ulong];
-  //See if we can use old indexes for destroyed entities via free list
-  while (!index_accessor.free_list.empty() && entities_left--) {
-    new_entities.push_back(get_entity(index_accessor.free_list.back()));
-    index_accessor.free_list.pop_back();
+  /// Call work(thread, slice) for every slice, on thread_count(slices, threads,
+  /// slices_per_thread) threads. Each thread takes one slice at a time, and is
+  /// numbered from 0.
+  template<typename Work>
+  static inline void run(size_t slices, size_t threads, Work work,
+                         size_t slices_per_thread = ECS_REDUCE_SLICES_PER_THREAD) {
+    threads = thread_count(slices, threads, slices_per_thread);
+    std::atomic<size_t> next_slice(0);
+    auto take_slices = [&](size_t thread) {
+      for (size_t slice = next_slice.fetch_add(1); slice < slices; slice = next_slice.fetch_add(1)) {
+        work(thread, slice);
+      }
+    };
+    std::vector<std::thread> workers;
+    for (size_t thread = 1; thread < threads; ++thread) {
+      workers.emplace_back(take_slices, thread);
+    }
+    // The calling thread does its share of the work
+    take_slices(0);
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
   }
-  index_t block_index = 0;
-  index_t current = ECS_CACHE_LINE_SIZE; // <- if empty, create new block instantly
-  size_t slots_required;
-  // Are there any unfilled blocks?
-  if (!index_accessor.block_index.empty()) {
-    block_index = index_accessor.block_index[index_accessor.block_index.size() - 1];
-    current = next_free_indexes_[block_index];
-    slots_required = block_count_ * ECS_CACHE_LINE_SIZE + current + entities_left;
-  } else {
-    slots_required = block_count_ * ECS_CACHE_LINE_SIZE + entities_left;
+
+  /// Fold the entities of each slice in range into a copy of init, calling
+  /// fold(T &, index, Components const &...) for each entity. Gives the
+  /// result of every slice, in order.
+  template<typename T, typename Fold>
+  static inline std::vector<T> fold(EntityManager const &manager, Range const &range, T const &init,
+                                    Fold fold_entity, size_t threads) {
+    Slices slices = reduce_t::slices(manager, range);
+    std::vector<T> partials(slices.count, init);
+    run(slices.count, threads, [&](size_t, size_t slice) {
+      T &partial = partials[slice];
+      for_each(manager, range.mask, slices.slice_first(slice), slices.slice_end(slice),
+               [&fold_entity, &partial](index_t index, Components const &... components) {
+                 fold_entity(partial, index, components...);
+               });
+    });
+    return partials;
   }
-  entity_versions_.resize(slots_required);
-  component_masks_.resize(slots_required, details::ComponentMask(0));
 
-  // Insert until no entity is left or no block remain
-  while (entities_left) {
-    for (; current < ECS_CACHE_LINE_SIZE && entities_left; ++current) {
-      new_entities.push_back(get_entity(current + ECS_CACHE_LINE_SIZE * block_index));
-      entities_left--;
+  /// Find the k entities in range with the largest key(Components const &...),
+  /// largest first. Each thread keeps the k best entities it has seen in a
+  /// heap, and then the best of those are selected. Larger keys are better,
+  /// and lower indexes are better for equal keys, so the same entities are
+  /// selected no matter which thread saw them.
+  template<typename K, typename Key>
+  static inline std::vector<std::pair<K, index_t>> top_k(EntityManager const &manager, Range const &range,
+                                                         size_t k, Key key, size_t threads) {
+    using Candidate = std::pair<K, index_t>;
+    auto better = [](Candidate const &a, Candidate const &b) {
+      return b.first < a.first || (!(a.first < b.first) && a.second < b.second);
+    };
+    std::vector<Candidate> result;
+    if (k == 0) return result;
+    Slices slices = reduce_t::slices(manager, range);
+    std::vector<std::vector<Candidate>> heaps(thread_count(slices.count, threads));
+    run(slices.count, threads, [&](size_t thread, size_t slice) {
+      // The worst candidate is at the front of the heap
+      std::vector<Candidate> &heap = heaps[thread];
+      for_each(manager, range.mask, slices.slice_first(slice), slices.slice_end(slice),
+               [k, &key, &better, &heap](index_t index, Components const &... components) {
+                 Candidate candidate(key(components...), index);
+                 if (heap.size() < k) {
+                   heap.push_back(candidate);
+                   std::push_heap(heap.begin(), heap.end(), better);
+                 } else if (better(candidate, heap.front())) {
+                   std::pop_heap(heap.begin(), heap.end(), better);
+                   heap.back() = candidate;
+                   std::push_heap(heap.begin(), heap.end(), better);
+                 }
+               });
+    });
+    for (std::vector<Candidate> &heap : heaps) {
+      result.insert(result.end(), heap.begin(), heap.end());
     }
-    // Add more blocks if there are entities left
-    if (entities_left) {
-      block_index = block_count_;
-      create_new_block(index_accessor, mask_as_ulong, 0);
-      ++block_count_;
-      current = 0;
+    size_t count = std::min(k, result.size());
+    std::partial_sort(result.begin(), result.begin() + count, result.end(), better);
+    result.resize(count);
+    return result;
+  }
+
+  /// At most this many keys of each slice are kept, when finding quantiles
+  static const size_t quantile_resolution = 64;
+
+  /// Find a key(Components const &...) for each quantile q in [0, 1], that
+  /// about q of the keys are less than. The keys of each slice are
+  /// summarized by quantile_resolution evenly spaced keys, which are then
+  /// merged in the order of the slices. Gives an empty vector if there are
+  /// no entities in range.
+  template<typename K, typename Key>
+  static inline std::vector<K> quantiles(EntityManager const &manager, Range const &range,
+                                         std::vector<double> const &qs, Key key, size_t threads) {
+    // Each key of a summary stands for a number of keys
+    using Summary = std::vector<std::pair<K, double>>;
+    Slices slices = reduce_t::slices(manager, range);
+    std::vector<Summary> summaries(slices.count);
+    // The keys of the current slice of each thread. Reused between slices
+    std::vector<std::vector<K>> keys(thread_count(slices.count, threads));
+    run(slices.count, threads, [&](size_t thread, size_t slice) {
+      std::vector<K> &slice_keys = keys[thread];
+      slice_keys.clear();
+      for_each(manager, range.mask, slices.slice_first(slice), slices.slice_end(slice),
+               [&key, &slice_keys](index_t, Components const &... components) {
+                 slice_keys.push_back(key(components...));
+               });
+      Summary &summary = summaries[slice];
+      size_t size = slice_keys.size();
+      if (size <= quantile_resolution) {
+        for (K const &slice_key : slice_keys) summary.push_back(std::make_pair(slice_key, 1.0));
+        return;
+      }
+      double weight = double(size) / quantile_resolution;
+      select(slice_keys, 0, quantile_resolution, 0, size, weight);
+      for (size_t i = 0; i < quantile_resolution; ++i) {
+        summary.push_back(std::make_pair(slice_keys[size_t((i + 0.5) * weight)], weight));
+      }
+    });
+    Summary merged;
+    for (Summary &summary : summaries) {
+      merged.insert(merged.end(), summary.begin(), summary.end());
+    }
+    std::vector<K> result;
+    if (merged.empty()) return result;
+    std::sort(merged.begin(), merged.end());
+    double total = 0;
+    for (auto &weighted : merged) total += weighted.second;
+    for (double q : qs) {
+      ECS_ASSERT(q >= 0 && q <= 1, "A quantile must be within [0, 1]");
+      // The first key where at least q of the keys are counted
+      double counted = 0;
+      size_t i = 0;
+      while (i + 1 < merged.size() && counted + merged[i].second < q * total) {
+        counted += merged[i++].second;
+      }
+      result.push_back(merged[i].first);
     }
+    return result;
   }
-  count_ += num_of_entities;
-  return new_entities;
-}
 
-template<typename ...Components>
-View<EntityAlias<Components...>> EntityManager::with()  {
-  details::ComponentMask mask = details::component_mask<Components...>();
-  return View<EntityAlias<Components...>>(this, mask);
-}
+  /// Move the evenly spaced keys [first, last) into their sorted position, by
+  /// selecting the middle one, and then the ones before and after it. keys
+  /// [begin, end) are the ones that can be in their positions.
+  template<typename K>
+  static inline void select(std::vector<K> &keys, size_t first, size_t last, size_t begin, size_t end, double weight) {
+    if (first >= last) return;
+    size_t middle = first + (last - first) / 2;
+    size_t position = size_t((middle + 0.5) * weight);
+    std::nth_element(keys.begin() + begin, keys.begin() + position, keys.begin() + end);
+    select(keys, first, middle, begin, position, weight);
+    select(keys, middle + 1, last, position + 1, end, weight);
+  }
 
-template<typename T>
-void EntityManager::with(T lambda)  {
-  ECS_ASSERT_IS_CALLABLE(T);
-  details::with_<T>::for_each(*this, lambda);
-}
+  /// Call visit(index, Components const &...) for every entity in [first, end) with mask
+  template<typename Visit>
+  static inline void for_each(EntityManager const &manager, ComponentMask const &mask, index_t first, index_t end,
+                              Visit visit) {
+    for (index_t block = first; block < end;) {
+      index_t block_end = std::min<index_t>(end, (block / block_size + 1) * block_size);
+      uint64_t matches = details::match_masks(&manager.component_masks_[block], block_end - block, mask);
+      if (matches) {
+        std::tuple<Components const *...> components(manager.get_block_ptr<Components>(block, block_size)...);
+        for (; matches; matches &= matches - 1) {
+          index_t index = block + details::count_trailing_zeros(matches);
+          visit(index, get_arg<Components>(manager, components, block, index)...);
+        }
+      }
+      block = block_end;
+    }
+  }
 
-template<typename T>
-View<T> EntityManager::fetch_every()  {
-  ECS_ASSERT_IS_ENTITY(T);
-  return View<T>(this, T::static_mask());
-}
+  /// If no ComponentManager exists for a component, no entity has it
+  static inline bool has_managers(EntityManager const &manager) {
+    bool has[] = {manager.has_component_manager<Components>()...};
+    return std::find(std::begin(has), std::end(has), false) == std::end(has);
+  }
 
-template<typename T>
-void EntityManager::fetch_every(T lambda)  {
-  ECS_ASSERT_IS_CALLABLE(T);
-  typedef details::function_traits<T> function;
-  static_assert(function::arg_count == 1, "Lambda or function must only have one argument");
-  typedef typename function::template arg_remove_ref<0> entity_interface_t;
-  for (entity_interface_t entityInterface : fetch_every<entity_interface_t>()) {
-    lambda(entityInterface);
+  template<typename C>
+  static inline C const &get_arg(EntityManager const &manager, std::tuple<Components const *...> const &components,
+                                 index_t first, index_t index) {
+    C const *ptr = std::get<details::index_of<C, Components...>::value>(components);
+    return ptr ? ptr[index - first] : manager.get_component_fast<C>(index);
   }
-}
+};
 
-Entity EntityManager::operator[](index_t index) {
-  return get_entity(index);
-}
+} // namespace details
 
-Entity EntityManager::operator[](Id id)  {
-  Entity entity = get_entity(id);
-  ECS_ASSERT(id == entity.id(), "Id is no longer valid (Entity was destroyed)");
-  return entity;
-}
+} // namespace ecs
 
-size_t EntityManager::count(){
-  return count_;
-}
+#endif //ECS_REDUCE_H
+// #included from: Columns.h
+#ifndef ECS_COLUMNS_H
+#define ECS_COLUMNS_H
 
-index_t EntityManager::find_new_entity_index(details::ComponentMask mask) {
-  auto mask_as_ulong = mask.to_ulong();
-  IndexAccessor &index_accessor = component_mask_to_index_accessor_[mask_as_ulong];
-  //See if we can use old indexes for destroyed entities via free list
-  if (!index_accessor.free_list.empty()) {
-    auto index = index_accessor.free_list.back();
-    index_accessor.free_list.pop_back();
-    return index;
-  }
-  // EntityManager has created similar entities already
-  if (!index_accessor.block_index.empty()) {
-    //No free_indexes in free list (removed entities), find a new index
-    //at last block, if that block has free slots
-    auto &block_index = index_accessor.block_index[index_accessor.block_index.size() - 1];
-    auto &current = next_free_indexes_[block_index];
-    // If block has empty slot, use it
-    if (ECS_CACHE_LINE_SIZE > current) {
-      return (current++) + ECS_CACHE_LINE_SIZE * block_index;
-    }
-  }
-  create_new_block(index_accessor, mask_as_ulong, 1);
-  return (block_count_++) * ECS_CACHE_LINE_SIZE;
-}
+namespace ecs{
 
-void EntityManager::create_new_block(EntityManager::IndexAccessor &index_accessor,
-                                     unsigned long mask_as_ulong,
-                                     index_t next_free_index)  {
-  index_accessor.block_index.push_back(block_count_);
-  next_free_indexes_.resize(block_count_ + 1);
-  index_to_component_mask.resize(block_count_ + 1);
-  next_free_indexes_[block_count_] = next_free_index;
-  index_to_component_mask[block_count_] = mask_as_ulong;
-}
+namespace details{
 
-template<typename C, typename ...Args>
-details::ComponentManager<C> &EntityManager::create_component_manager(Args && ... args)  {
-  details::ComponentManager<C> *ptr = new details::ComponentManager<C>(std::forward<EntityManager &>(*this),
-                                                                       std::forward<Args>(args) ...);
-  component_managers_[details::component_index<C>()] = ptr;
-  return *ptr;
-}
+///---------------------------------------------------------------------
+/// The layout of exported columns
+///---------------------------------------------------------------------
+///
+/// A ColumnsHeader is followed by one ColumnHeader per component. Then
+/// follows the index and the version of the entity in each row, and the
+/// validity bitmap and the values of each component. Each buffer starts
+/// at an offset that is a multiple of 64 bytes, and is padded with zeros
+/// to the next multiple. Numbers are written with the byte order of the
+/// machine.
+///
+/// Bit i of a validity bitmap is byte i / 8, bit i % 8, like in Apache
+/// Arrow, and is set if the entity in row i has the component. Values of
+/// entities without the component are zero.
+///---------------------------------------------------------------------
+struct ColumnsHeader {
+  char magic[8];
+  uint64_t rows;
+  uint64_t columns;
+  /// Offsets from the start of the ColumnsHeader
+  uint64_t indexes_offset;
+  uint64_t versions_offset;
+};
 
-template<typename C>
-details::ComponentManager<C> &EntityManager::get_component_manager_fast() {
-  return *reinterpret_cast<details::ComponentManager<C> *>(component_managers_[details::component_index<C>()]);
-}
+struct ColumnHeader {
+  uint64_t element_size;
+  /// How many rows that do not have the component
+  uint64_t null_count;
+  uint64_t validity_offset;
+  uint64_t data_offset;
+};
 
-template<typename C>
-details::ComponentManager<C> const &EntityManager::get_component_manager_fast() const {
-  return *reinterpret_cast<details::ComponentManager<C> *>(component_managers_[details::component_index<C>()]);
-}
+static const char columns_magic[8] = {'E', 'C', 'S', 'C', 'O', 'L', 'S', '1'};
+static const uint64_t columns_alignment = 64;
 
-template<typename C>
-details::ComponentManager<C> &EntityManager::get_component_manager()  {
-  auto index = details::component_index<C>();
-  if (component_managers_.size() <= index) {
-    component_managers_.resize(index + 1, nullptr);
-    return create_component_manager<C>();
-  } else if (component_managers_[index] == nullptr) {
-    return create_component_manager<C>();
-  }
-  return *reinterpret_cast<details::ComponentManager<C> *>(component_managers_[index]);
+/// Round size up to a multiple of columns_alignment
+inline uint64_t align_column(uint64_t size) {
+  return (size + columns_alignment - 1) / columns_alignment * columns_alignment;
 }
 
-template<typename C>
-details::ComponentManager<C> const &EntityManager::get_component_manager() const  {
-  auto index = details::component_index<C>();
-  ECS_ASSERT(component_managers_.size() > index, component_managers_[index] == nullptr &&
-      "Component manager not created");
-  return *reinterpret_cast<details::ComponentManager<C> *>(component_managers_[index]);
-}
+///---------------------------------------------------------------------
+/// Used to write Components of entities as columns, and to create
+/// entities from them. Used by EntityManager::export_columns and
+/// EntityManager::import_columns.
+///---------------------------------------------------------------------
+///
+/// The entities are scanned a block of 64 at a time. Consecutive rows
+/// with a component are written straight from the memory of the
+/// ComponentManager, without copying them anywhere first.
+///
+/// Rows are read in batches. Entities with the same components in a
+/// batch are given indexes together, and components of rows that get
+/// consecutive indexes are copied into the pool at once.
+///
+///---------------------------------------------------------------------
+template<typename ...Components>
+struct columns_t {
+  static_assert(sizeof...(Components) > 0, "At least 1 component must be exported.");
+  static_assert(ECS_IMPORT_BATCH_SIZE % ECS_CACHE_LINE_SIZE == 0,
+                "ECS_IMPORT_BATCH_SIZE must be a multiple of ECS_CACHE_LINE_SIZE");
 
-details::BaseManager &EntityManager::get_component_manager(size_t component_index){
-  ECS_ASSERT(component_managers_.size() > component_index, "ComponentManager not created with that component index.");
-  return *component_managers_[component_index];
-}
-details::BaseManager const &EntityManager::get_component_manager(size_t component_index) const{
-  ECS_ASSERT(component_managers_.size() > component_index, "ComponentManager not created with that component index.");
-  return *component_managers_[component_index];
-}
+  static const index_t block_size = 64;
+  static const size_t column_count = sizeof...(Components);
 
-template<typename C>
-C &EntityManager::get_component(Entity &entity) {
-  ECS_ASSERT(has_component<C>(entity), "Entity doesn't have this component attached");
-  return get_component_manager<C>().get(entity.id_.index_);
-}
+  /// Write every entity within [first, last) that has every component in
+  /// mask, and any component in any, as a row
+  static inline void write(EntityManager const &manager, ComponentMask const &mask, ComponentMask const &any,
+                           index_t first, index_t last, std::ostream &out);
 
-template<typename C>
-C const &EntityManager::get_component(Entity const &entity) const {
-  ECS_ASSERT(has_component<C>(entity), "Entity doesn't have this component attached");
-  return get_component_manager<C>().get(entity.id_.index_);
-}
+  /// Create an entity for each row read from in, calling progress(imported,
+  /// total) after each batch. Returns the number of rows
+  template<typename Progress>
+  static inline size_t read(EntityManager &manager, std::istream &in, Progress progress);
 
-template<typename C>
-C &EntityManager::get_component_fast(index_t index)  {
-  return get_component_manager_fast<C>().get(index);
-}
+ private:
+  /// Keeps track of the offset, so that buffers can be aligned
+  struct Writer {
+    std::ostream &out;
+    uint64_t offset;
+
+    inline void write(void const *data, size_t size);
+    inline void zeros(size_t size);
+    /// Write the lowest bits as bytes, lowest byte first
+    inline void bits(uint64_t bits, size_t bytes);
+    /// Pad with zeros up to the next multiple of columns_alignment
+    inline void align() { zeros(size_t(align_column(offset) - offset)); }
+  };
 
-template<typename C>
-C const &EntityManager::get_component_fast(index_t index) const {
-  return get_component_manager_fast<C>().get(index);
-}
+  /// Bit i is set if entity first + i is a row
+  static inline uint64_t block_rows(EntityManager const &manager, ComponentMask const &mask,
+                                    ComponentMask const &any, index_t first, index_t end);
 
-template<typename C>
-C &EntityManager::get_component_fast(Entity &entity)  {
-  return get_component_manager_fast<C>().get(entity.id_.index_);
-}
+  /// Bit i is set if entity first + i has component C
+  template<typename C>
+  static inline uint64_t block_has(EntityManager const &manager, index_t first, index_t end);
 
-template<typename C>
-C const &EntityManager::get_component_fast(Entity const &entity) const  {
-  return get_component_manager_fast<C>().get(entity.id_.index_);
-}
+  /// Write the validity bitmap and the values of component C
+  template<typename C>
+  static inline bool write_column(EntityManager const &manager, std::vector<uint64_t> const &rows,
+                                  index_t begin, index_t end, Writer &writer);
+
+  /// The rows of a batch that is read
+  struct Batch {
+    std::vector<char> values[column_count];
+    std::vector<uint8_t> validity[column_count];
+    std::vector<ComponentMask> masks;
+    /// The index of the entity of each row
+    std::vector<index_t> indexes;
+    /// Which of the distinct masks each row has, and the indexes given to each mask
+    std::vector<size_t> groups;
+    std::vector<index_t> allocated;
+  };
 
-template<typename C, typename ...Args>
-C &EntityManager::create_component(Entity &entity, Args && ... args) {
-  ECS_ASSERT_VALID_ENTITY(entity);
-  ECS_ASSERT(!has_component<C>(entity), "Entity already has this component attached");
-  C &component = get_component_manager<C>().create(entity.id_.index_, std::forward<Args>(args) ...);
-  entity.mask().set(details::component_index<C>());
-  return component;
-}
+  /// Give each row of the batch an index, for an entity with its mask
+  static inline void allocate(EntityManager &manager, Batch &batch);
 
-template<typename C>
-void EntityManager::remove_component(Entity &entity)  {
-  ECS_ASSERT_VALID_ENTITY(entity);
-  ECS_ASSERT(has_component<C>(entity), "Entity doesn't have component attached");
-  get_component_manager<C>().remove(entity.id_.index_);
-}
+  /// Copy component C of each row that has it into its entity
+  template<typename C>
+  static inline bool read_column(EntityManager &manager, Batch const &batch, index_t end);
+};
 
-template<typename C>
-void EntityManager::remove_component_fast(Entity &entity) {
-  ECS_ASSERT_VALID_ENTITY(entity);
-  ECS_ASSERT(has_component<C>(entity), "Entity doesn't have component attached");
-  get_component_manager_fast<C>().remove(entity.id_.index_);
-}
+} // namespace details
 
-void EntityManager::remove_all_components(Entity &entity)  {
-  ECS_ASSERT_VALID_ENTITY(entity);
-  for (auto componentManager : component_managers_) {
-    if (componentManager && has_component(entity, componentManager->mask())) {
-      componentManager->remove(entity.id_.index_);
+///---------------------------------------------------------------------
+/// Columns reads components that are exported with
+/// EntityManager::export_columns
+///---------------------------------------------------------------------
+///
+/// Nothing is copied, the values are read where they are, so a memory
+/// mapped file can be read without loading it first. The columns are in
+/// the same order as the components were given to export_columns.
+///
+/// @usage std::ostringstream out;
+///        entities.export_columns<Position, Health>(out);
+///        ...
+///        ecs::Columns columns(data, size);
+///        Health const *health = columns.values<Health>(1);
+///        for (size_t row = 0; row < columns.rows(); ++row) {
+///          if (columns.is_valid(1, row)) total += health[row];
+///        }
+///---------------------------------------------------------------------
+class Columns {
+ public:
+  /// data must be aligned to 8 bytes, and stay valid while Columns is used
+  inline Columns(void const *data, size_t size);
+
+  inline size_t rows() const { return size_t(header().rows); }
+  inline size_t columns() const { return size_t(header().columns); }
+
+  /// The index and version of the entity in each row
+  inline index_t const *indexes() const;
+  inline version_t const *versions() const;
+  inline Id id(size_t row) const { return Id(indexes()[row], versions()[row]); }
+
+  /// The validity bitmap of a column
+  inline uint8_t const *validity(size_t column) const;
+  /// Check if the entity in row has the component of column
+  inline bool is_valid(size_t column, size_t row) const;
+  /// How many rows that do not have the component of column
+  inline size_t null_count(size_t column) const { return size_t(column_header(column).null_count); }
+
+  /// The value in each row of a column. C must be the exported component
+  template<typename C>
+  inline C const *values(size_t column) const;
+
+ private:
+  inline details::ColumnsHeader const &header() const;
+  inline details::ColumnHeader const &column_header(size_t column) const;
+  inline void const *at(uint64_t offset) const { return data_ + offset; }
+
+  char const *data_;
+  size_t size_;
+};
+
+} // namespace ecs
+
+// #included from: Columns.inl
+namespace ecs{
+
+namespace details{
+
+template<typename ...Components>
+void columns_t<Components...>::write(EntityManager const &manager, ComponentMask const &mask,
+                                     ComponentMask const &any, index_t first, index_t last, std::ostream &out) {
+  index_t end = index_t(std::min<size_t>(manager.entity_versions_.size(), last));
+  first = std::min(first, end);
+  // Blocks start at multiples of block_size, and the rows of each block are kept as bits
+  index_t begin = first / block_size * block_size;
+  std::vector<uint64_t> rows;
+  rows.reserve((end - begin + block_size - 1) / block_size);
+  ColumnHeader columns[] = {ColumnHeader{sizeof(Components), 0, 0, 0}...};
+  uint64_t row_count = 0;
+  for (index_t block = begin; block < end; block += block_size) {
+    index_t block_first = std::max(block, first);
+    uint64_t bits = block_rows(manager, mask, any, block_first, std::min<index_t>(block + block_size, end));
+    rows.push_back(bits << (block_first - block));
+    row_count += count_bits(rows.back());
+    uint64_t valid[] = {block_has<Components>(manager, block, std::min<index_t>(block + block_size, end))...};
+    for (size_t i = 0; i < column_count; ++i) {
+      columns[i].null_count += count_bits(rows.back() & ~valid[i]);
+    }
+  }
+
+  ColumnsHeader header;
+  std::memcpy(header.magic, columns_magic, sizeof(header.magic));
+  header.rows = row_count;
+  header.columns = column_count;
+  header.indexes_offset = align_column(sizeof(ColumnsHeader) + sizeof(columns));
+  header.versions_offset = align_column(header.indexes_offset + row_count * sizeof(index_t));
+  uint64_t offset = align_column(header.versions_offset + row_count * sizeof(version_t));
+  for (size_t i = 0; i < column_count; ++i) {
+    columns[i].validity_offset = offset;
+    columns[i].data_offset = align_column(offset + (row_count + 7) / 8);
+    offset = align_column(columns[i].data_offset + row_count * columns[i].element_size);
+  }
+
+  Writer writer{out, 0};
+  writer.write(&header, sizeof(header));
+  writer.write(columns, sizeof(columns));
+  writer.align();
+
+  index_t indexes[block_size];
+  for (size_t i = 0; i < rows.size(); ++i) {
+    size_t count = 0;
+    for (uint64_t bits = rows[i]; bits; bits &= bits - 1) {
+      indexes[count++] = index_t(begin + i * block_size + count_trailing_zeros(bits));
+    }
+    writer.write(indexes, count * sizeof(index_t));
+  }
+  writer.align();
+  version_t versions[block_size];
+  for (size_t i = 0; i < rows.size(); ++i) {
+    size_t count = 0;
+    for (uint64_t bits = rows[i]; bits; bits &= bits - 1) {
+      versions[count++] = manager.entity_versions_[begin + i * block_size + count_trailing_zeros(bits)];
+    }
+    writer.write(versions, count * sizeof(version_t));
+  }
+  writer.align();
+
+  // A braced list is evaluated in order, so the columns are written in the order of Components
+  bool written[] = {write_column<Components>(manager, rows, begin, end, writer)...};
+  (void) written;
+}
+
+template<typename ...Components>
+template<typename Progress>
+size_t columns_t<Components...>::read(EntityManager &manager, std::istream &in, Progress progress) {
+  std::streampos base = in.tellg();
+  ColumnsHeader header;
+  ColumnHeader columns[column_count];
+  in.read(reinterpret_cast<char *>(&header), sizeof(header));
+  ECS_ASSERT(in && std::memcmp(header.magic, columns_magic, sizeof(columns_magic)) == 0,
+             "Stream does not contain exported columns");
+  ECS_ASSERT(header.columns == column_count, "Exported columns are not the same as the components");
+  in.read(reinterpret_cast<char *>(columns), sizeof(columns));
+  size_t element_sizes[] = {sizeof(Components)...};
+  for (size_t i = 0; i < column_count; ++i) {
+    ECS_ASSERT(in && columns[i].element_size == element_sizes[i], "Exported columns are not the same as the components");
+  }
+  // Created before any entity, since creating a ComponentManager is not possible while iterating
+  int expand[] = {(manager.get_component_manager<Components>(), 0)...};
+  (void) expand;
+
+  // Room for every row is made at once, instead of growing batch by batch
+  size_t capacity = manager.entity_versions_.size() + size_t(header.rows) + block_size;
+  manager.entity_versions_.reserve(capacity);
+  manager.component_masks_.reserve(capacity);
+
+  Batch batch;
+  ComponentMask masks[] = {component_mask<Components>()...};
+  for (uint64_t first = 0; first < header.rows; first += ECS_IMPORT_BATCH_SIZE) {
+    size_t rows = size_t(std::min<uint64_t>(ECS_IMPORT_BATCH_SIZE, header.rows - first));
+    batch.masks.assign(rows, ComponentMask(0));
+    for (size_t i = 0; i < column_count; ++i) {
+      std::vector<uint8_t> &validity = batch.validity[i];
+      validity.resize((rows + 7) / 8);
+      in.seekg(base + std::streamoff(columns[i].validity_offset + first / 8));
+      in.read(reinterpret_cast<char *>(validity.data()), std::streamsize(validity.size()));
+      batch.values[i].resize(rows * columns[i].element_size);
+      in.seekg(base + std::streamoff(columns[i].data_offset + first * columns[i].element_size));
+      in.read(batch.values[i].data(), std::streamsize(batch.values[i].size()));
+      ECS_ASSERT(in, "Exported columns are truncated");
+      for (size_t row = 0; row < rows; ++row) {
+        if ((validity[row / 8] >> (row % 8)) & 1) batch.masks[row] |= masks[i];
+      }
+    }
+    allocate(manager, batch);
+    index_t end = *std::max_element(batch.indexes.begin(), batch.indexes.end()) + 1;
+    bool copied[] = {read_column<Components>(manager, batch, end)...};
+    (void) copied;
+    for (size_t row = 0; row < rows; ++row) {
+      manager.component_masks_[batch.indexes[row]] = batch.masks[row];
     }
+    progress(size_t(first + rows), size_t(header.rows));
   }
+  // Leave the stream after the columns, in case more data follows them
+  ColumnHeader const &last = columns[column_count - 1];
+  in.seekg(base + std::streamoff(align_column(last.data_offset + header.rows * last.element_size)));
+  return size_t(header.rows);
 }
 
-void EntityManager::clear_mask(Entity &entity) {
-  ECS_ASSERT_VALID_ENTITY(entity);
-  component_masks_[entity.id_.index_].reset();
+template<typename ...Components>
+void columns_t<Components...>::allocate(EntityManager &manager, Batch &batch) {
+  // There are few different masks in a batch, so they are found by comparing with each
+  std::vector<ComponentMask> masks;
+  std::vector<size_t> counts;
+  std::vector<size_t> &group_of = batch.groups;
+  group_of.resize(batch.masks.size());
+  for (size_t row = 0; row < batch.masks.size(); ++row) {
+    size_t group = 0;
+    while (group < masks.size() && masks[group] != batch.masks[row]) ++group;
+    if (group == masks.size()) {
+      masks.push_back(batch.masks[row]);
+      counts.push_back(0);
+    }
+    ++counts[group];
+    group_of[row] = group;
+  }
+  // Indexes of each group follow each other
+  std::vector<size_t> next(masks.size());
+  batch.allocated.clear();
+  for (size_t group = 0; group < masks.size(); ++group) {
+    next[group] = batch.allocated.size();
+    manager.allocate_indexes(masks[group], counts[group], batch.allocated);
+  }
+  // Rows with the same mask get their indexes in order
+  batch.indexes.resize(batch.masks.size());
+  for (size_t row = 0; row < batch.masks.size(); ++row) {
+    batch.indexes[row] = batch.allocated[next[group_of[row]]++];
+  }
 }
 
-template<typename C, typename ...Args>
-C &EntityManager::set_component(Entity &entity, Args && ... args) {
-  ECS_ASSERT_VALID_ENTITY(entity);
-  if (entity.has<C>()) {
-    return get_component_fast<C>(entity) = create_tmp_component<C>(std::forward<Args>(args)...);
+template<typename ...Components>
+template<typename C>
+bool columns_t<Components...>::read_column(EntityManager &manager, Batch const &batch, index_t end) {
+  static_assert(std::is_trivially_copyable<C>::value, "Only trivially copyable components can be imported");
+  const size_t column = index_of<C, Components...>::value;
+  ComponentManager<C> &component_manager = manager.get_component_manager_fast<C>();
+  component_manager.ensure_min_size(end);
+  size_t chunk_size = component_manager.pool().chunk_size();
+  std::vector<index_t> const &indexes = batch.indexes;
+  uint8_t const *validity = batch.validity[column].data();
+  char const *values = batch.values[column].data();
+  auto has = [validity](size_t row) { return ((validity[row / 8] >> (row % 8)) & 1) != 0; };
+  for (size_t row = 0; row < indexes.size();) {
+    if (!has(row)) {
+      ++row;
+      continue;
+    }
+    // Rows that get consecutive indexes within the same chunk are copied at once
+    size_t length = 1;
+    while (row + length < indexes.size() && has(row + length) && indexes[row + length] == indexes[row] + length &&
+        (indexes[row] + length) % chunk_size != 0) {
+      ++length;
+    }
+    std::memcpy(static_cast<void *>(component_manager.get_ptr(indexes[row])), values + row * sizeof(C),
+                length * sizeof(C));
+    for (size_t i = 0; i < length; ++i) {
+      component_manager.aggregate_added(indexes[row + i]);
+    }
+    row += length;
   }
-  else return create_component<C>(entity, std::forward<Args>(args)...);
+  return true;
 }
 
-template<typename C, typename ...Args>
-C &EntityManager::set_component_fast(Entity &entity, Args && ... args) {
-  ECS_ASSERT_VALID_ENTITY(entity);
-  ECS_ASSERT(entity.has<C>(), "Entity does not have component attached");
-  return get_component_fast<C>(entity) = create_tmp_component<C>(std::forward<Args>(args)...);
+template<typename ...Components>
+void columns_t<Components...>::Writer::write(void const *data, size_t size) {
+  out.write(static_cast<char const *>(data), std::streamsize(size));
+  offset += size;
 }
 
-bool EntityManager::has_component(Entity &entity, details::ComponentMask component_mask) {
-  ECS_ASSERT_VALID_ENTITY(entity);
-  return (mask(entity) & component_mask) == component_mask;
+template<typename ...Components>
+void columns_t<Components...>::Writer::zeros(size_t size) {
+  static const char zero[256] = {};
+  offset += size;
+  while (size > 0) {
+    size_t count = std::min(size, sizeof(zero));
+    out.write(zero, std::streamsize(count));
+    size -= count;
+  }
 }
 
-bool EntityManager::has_component(Entity const &entity, details::ComponentMask const &component_mask) const  {
-  ECS_ASSERT_VALID_ENTITY(entity);
-  return (mask(entity) & component_mask) == component_mask;
+template<typename ...Components>
+void columns_t<Components...>::Writer::bits(uint64_t bits, size_t bytes) {
+  uint8_t data[sizeof(bits)];
+  for (size_t i = 0; i < bytes; ++i) {
+    data[i] = uint8_t(bits >> (8 * i));
+  }
+  write(data, bytes);
 }
 
 template<typename ...Components>
-bool EntityManager::has_component(Entity &entity) {
-  return has_component(entity, details::component_mask<Components...>());
+uint64_t columns_t<Components...>::block_rows(EntityManager const &manager, ComponentMask const &mask,
+                                              ComponentMask const &any, index_t first, index_t end) {
+  uint64_t matches = match_masks(&manager.component_masks_[first], end - first, mask);
+  for (uint64_t bits = matches; bits; bits &= bits - 1) {
+    unsigned i = count_trailing_zeros(bits);
+    if ((manager.component_masks_[first + i] & any).none()) matches &= ~(uint64_t(1) << i);
+  }
+  return matches;
 }
 
 template<typename ...Components>
-bool EntityManager::has_component(Entity const &entity) const  {
-  return has_component(entity, details::component_mask<Components...>());
+template<typename C>
+uint64_t columns_t<Components...>::block_has(EntityManager const &manager, index_t first, index_t end) {
+  if (!manager.has_component_manager<C>()) return 0;
+  return match_masks(&manager.component_masks_[first], end - first, component_mask<C>());
 }
 
-bool EntityManager::is_valid(Entity &entity)  {
-  return entity.id_.index_ < entity_versions_.size() &&
-      entity.id_.version_ == entity_versions_[entity.id_.index_];
+template<typename ...Components>
+template<typename C>
+bool columns_t<Components...>::write_column(EntityManager const &manager, std::vector<uint64_t> const &rows,
+                                            index_t begin, index_t end, Writer &writer) {
+  static_assert(std::is_trivially_copyable<C>::value, "Only trivially copyable components can be exported");
+  // Bits are added to the validity bitmap in the order of the rows
+  uint64_t validity = 0;
+  unsigned used = 0;
+  for (size_t i = 0; i < rows.size(); ++i) {
+    index_t block = index_t(begin + i * block_size);
+    uint64_t valid = rows[i] & block_has<C>(manager, block, std::min<index_t>(block + block_size, end));
+    for (uint64_t bits = rows[i]; bits; bits &= bits - 1) {
+      validity |= ((valid >> count_trailing_zeros(bits)) & 1) << used;
+      if (++used == 64) {
+        writer.bits(validity, sizeof(validity));
+        validity = 0;
+        used = 0;
+      }
+    }
+  }
+  // Only the bytes with bits of rows are written, the rest is padding
+  writer.bits(validity, (used + 7) / 8);
+  writer.align();
+
+  size_t zeros = 0;
+  for (size_t i = 0; i < rows.size(); ++i) {
+    index_t block = index_t(begin + i * block_size);
+    uint64_t valid = rows[i] & block_has<C>(manager, block, std::min<index_t>(block + block_size, end));
+    for (uint64_t bits = rows[i]; bits;) {
+      unsigned row = count_trailing_zeros(bits);
+      if (!((valid >> row) & 1)) {
+        zeros += sizeof(C);
+        bits &= bits - 1;
+        continue;
+      }
+      // The run of consecutive entities from row that has C
+      uint64_t run = ~(valid >> row);
+      unsigned length = run ? count_trailing_zeros(run) : 64 - row;
+      writer.zeros(zeros);
+      zeros = 0;
+      // A block is within a single chunk, so the run is in contiguous memory
+      if (C const *run_ptr = manager.get_block_ptr<C>(block + row, block_size)) {
+        writer.write(run_ptr, length * sizeof(C));
+      } else {
+        for (unsigned j = 0; j < length; ++j) {
+          writer.write(&manager.get_component_fast<C>(block + row + j), sizeof(C));
+        }
+      }
+      bits = row + length < 64 ? bits & ~((uint64_t(1) << (row + length)) - 1) : 0;
+    }
+  }
+  writer.zeros(zeros);
+  writer.align();
+  return true;
 }
 
-bool EntityManager::is_valid(Entity const &entity) const  {
-  return entity.id_.index_ < entity_versions_.size() &&
-      entity.id_.version_ == entity_versions_[entity.id_.index_];
-}
+} // namespace details
 
-void EntityManager::destroy(Entity &entity) {
-  index_t index = entity.id().index_;
-  remove_all_components(entity);
-  ++entity_versions_[index];
-  auto &mask_as_ulong = index_to_component_mask[index / ECS_CACHE_LINE_SIZE];
-  component_mask_to_index_accessor_[mask_as_ulong].free_list.push_back(index);
-  --count_;
+Columns::Columns(void const *data, size_t size) :
+    data_(static_cast<char const *>(data)),
+    size_(size) {
+  ECS_ASSERT(size_ >= sizeof(details::ColumnsHeader) &&
+                 std::memcmp(header().magic, details::columns_magic, sizeof(details::columns_magic)) == 0,
+             "Data is not exported columns");
+  ECS_ASSERT(sizeof(details::ColumnsHeader) + columns() * sizeof(details::ColumnHeader) <= size_ &&
+                 header().versions_offset + rows() * sizeof(version_t) <= size_ &&
+                 (columns() == 0 ||
+                     column_header(columns() - 1).data_offset +
+                         rows() * column_header(columns() - 1).element_size <= size_),
+             "Exported columns are truncated");
 }
 
-details::ComponentMask &EntityManager::mask(Entity &entity)  {
-  return mask(entity.id_.index_);
+index_t const *Columns::indexes() const {
+  return static_cast<index_t const *>(at(header().indexes_offset));
 }
 
-details::ComponentMask const &EntityManager::mask(Entity const &entity) const {
-  return mask(entity.id_.index_);
+version_t const *Columns::versions() const {
+  return static_cast<version_t const *>(at(header().versions_offset));
 }
 
-details::ComponentMask &EntityManager::mask(index_t index) {
-  return component_masks_[index];
+uint8_t const *Columns::validity(size_t column) const {
+  return static_cast<uint8_t const *>(at(column_header(column).validity_offset));
 }
 
-details::ComponentMask const &EntityManager::mask(index_t index) const {
-  return component_masks_[index];
+bool Columns::is_valid(size_t column, size_t row) const {
+  ECS_ASSERT(row < rows(), "Row out of range");
+  return (validity(column)[row / 8] >> (row % 8)) & 1;
 }
 
-Entity EntityManager::get_entity(Id id) {
-  return Entity(this, id);
+template<typename C>
+C const *Columns::values(size_t column) const {
+  ECS_ASSERT(column_header(column).element_size == sizeof(C), "Column has another component type");
+  return static_cast<C const *>(at(column_header(column).data_offset));
 }
 
-Entity EntityManager::get_entity(index_t index) {
-  return get_entity(Id(index, entity_versions_[index]));
+details::ColumnsHeader const &Columns::header() const {
+  return *reinterpret_cast<details::ColumnsHeader const *>(data_);
 }
 
-size_t EntityManager::capacity() const  {
-  return entity_versions_.capacity();
+details::ColumnHeader const &Columns::column_header(size_t column) const {
+  ECS_ASSERT(column < columns(), "Column out of range");
+  return reinterpret_cast<details::ColumnHeader const *>(data_ + sizeof(details::ColumnsHeader))[column];
 }
 
 } // namespace ecs
-#endif //ECS_ENTITYMANAGER_H
+#endif //ECS_COLUMNS_H
+// #included from: Replication.h
+#ifndef ECS_REPLICATION_H
+#define ECS_REPLICATION_H
 
 namespace ecs{
 
-namespace details{
-
-template<typename C>
-ComponentManager<C>::ComponentManager(EntityManager &manager, size_t chunk_size)  :
-    manager_(manager),
-    pool_(chunk_size)
-{ }
+///---------------------------------------------------------------------
+/// BitWriter appends values to a buffer, using as few bits as asked for
+///---------------------------------------------------------------------
+///
+/// Bits are written lowest bit first, and bytes are filled from their
+/// lowest bit, so the result does not depend on the byte order of the
+/// machine. The last byte is completed with zeros by flush, which is
+/// also done when the BitWriter is destroyed.
+///---------------------------------------------------------------------
+class BitWriter: details::forbid_copies {
+ public:
+  inline BitWriter(std::vector<uint8_t> &out) : out_(&out), pending_(0), pending_bits_(0), written_(0) { }
+  inline ~BitWriter() { flush(); }
 
-// Creating a component that has a defined ctor
-template<typename C, typename ...Args>
-auto create_component(void* ptr, Args && ... args) ->
-typename std::enable_if<std::is_constructible<C, Args...>::value, C&>::type {
-  return *new(ptr) C(std::forward<Args>(args)...);
-}
+  /// Write the lowest bits of value. bits must be at most 64
+  inline void write(uint64_t value, unsigned bits);
+  inline void write_bool(bool value) { write(value ? 1 : 0, 1); }
 
-// Creating a component that doesn't have ctor, and is not a property -> create using uniform initialization
-template<typename C, typename ...Args>
-auto create_component(void* ptr, Args && ... args) ->
-typename std::enable_if<!std::is_constructible<C, Args...>::value &&
-    !std::is_base_of<details::BaseProperty, C>::value, C&>::type {
-  return *new(ptr) C{std::forward<Args>(args)...};
-}
+  /// Write value 7 bits at a time, so that small values take few bits
+  inline void write_varint(uint64_t value);
 
-// Creating a component that doesn't have ctor, and is a property -> create using underlying Property ctor
-template<typename C, typename ...Args>
-auto create_component(void* ptr, Args && ... args) ->
-typename std::enable_if<
-    !std::is_constructible<C, Args...>::value &&
-        std::is_base_of<details::BaseProperty, C>::value, C&>::type {
-  static_assert(sizeof...(Args) <= 1, ECS_ASSERT_MSG_ONLY_ONE_ARGS_PROPERTY_CONSTRUCTOR);
-  return *reinterpret_cast<C*>(new(ptr) typename C::ValueType(std::forward<Args>(args)...));
-}
+  /// Write value, clamped to [min, max], as the closest of 2^bits evenly
+  /// spaced values. bits must be at most 32
+  inline void write_float(float value, float min, float max, unsigned bits);
 
-template<typename C> template<typename ...Args>
-C& ComponentManager<C>::create(index_t index, Args &&... args) {
-  pool_.ensure_min_size(index + 1);
-  create_component<C>(get_ptr(index), std::forward<Args>(args)...);
-  return get(index);
-}
+  /// Write the first bits of data, that is written by another BitWriter
+  inline void write_bits(uint8_t const *data, size_t bits);
 
-template<typename C>
-void ComponentManager<C>::remove(index_t index) {
-  pool_.destroy(index);
-  manager_.mask(index).reset(component_index<C>());
-}
+  /// Fill the last byte with zeros, so that everything is in the buffer
+  inline void flush();
 
-template<typename C>
-C &ComponentManager<C>::operator[](index_t index){
-  return get(index);
-}
+  /// How many bits that are written
+  inline size_t bit_count() const { return written_; }
 
-template<typename C>
-C &ComponentManager<C>::get(index_t index) {
-  return *get_ptr(index);
-}
+ private:
+  std::vector<uint8_t> *out_;
+  /// Bits that do not fill a whole 64 bit word yet
+  uint64_t pending_;
+  unsigned pending_bits_;
+  size_t written_;
+};
 
-template<typename C>
-C const &ComponentManager<C>::get(index_t index) const {
-  return *get_ptr(index);
-}
+///---------------------------------------------------------------------
+/// BitReader reads values that are written with a BitWriter
+///---------------------------------------------------------------------
+///
+/// Reading past the end gives zeros, and makes overflow() true.
+///---------------------------------------------------------------------
+class BitReader {
+ public:
+  inline BitReader(void const *data, size_t size) :
+      data_(static_cast<uint8_t const *>(data)), size_(size), position_(0), overflow_(false) { }
 
-template<typename C>
-C *ComponentManager<C>::get_ptr(index_t index)  {
-  return pool_.get_ptr(index);
-}
+  inline uint64_t read(unsigned bits);
+  inline bool read_bool() { return read(1) != 0; }
+  inline uint64_t read_varint();
+  inline float read_float(float min, float max, unsigned bits);
 
-template<typename C>
-C const *ComponentManager<C>::get_ptr(index_t index) const {
-  return pool_.get_ptr(index);
-}
+  /// True if more bits were read than there are
+  inline bool overflow() const { return overflow_; }
 
-template<typename C>
-void *ComponentManager<C>::get_void_ptr(index_t index)  {
-  return pool_.get_ptr(index);
-}
+ private:
+  uint8_t const *data_;
+  size_t size_;
+  /// In bits
+  size_t position_;
+  bool overflow_;
+};
 
+///---------------------------------------------------------------------
+/// Replicate<C> tells how component C is sent to clients. It must be
+/// specialized for every replicated component.
+///---------------------------------------------------------------------
+///
+/// write must always write the same number of bits for C. Fields are
+/// best quantized, with BitWriter::write_float for example, since
+/// changes that do not change the written bits are not sent. read must
+/// read what write wrote. The component that locates entities also
+/// needs position, that gives the point used to decide which observers
+/// see the entity.
+///
+/// @usage template<> struct Replicate<Position> {
+///          static void write(BitWriter &out, Position const &position) {
+///            out.write_float(position.x, -1024, 1024, 16);
+///            out.write_float(position.y, -1024, 1024, 16);
+///          }
+///          static void read(BitReader &in, Position &position) {
+///            position.x = in.read_float(-1024, 1024, 16);
+///            position.y = in.read_float(-1024, 1024, 16);
+///          }
+///          static Point position(Position const &position) {
+///            return Point{position.x, position.y, 0};
+///          }
+///        };
+///---------------------------------------------------------------------
 template<typename C>
-void const *ComponentManager<C>::get_void_ptr(index_t index) const {
-  return pool_.get_ptr(index);
-}
+struct Replicate;
 
-template<typename C>
-void ComponentManager<C>::ensure_min_size(index_t size){
-  pool_.ensure_min_size(size);
-}
+namespace details{
 
-template<typename C>
-ComponentMask ComponentManager<C>::mask() {
-  return component_mask<C>();
-}
+/// Entities are written as the distance to the index of the entity before, and the version
+inline void write_handle(BitWriter &writer, Handle handle, index_t &previous);
+inline Handle read_handle(BitReader &reader, index_t &previous);
 
 } // namespace details
 
-} // namespace ecs
-#endif //ECS_COMPONENTMANAGER_H
-// #included from: Property.h
-#ifndef ECS_PROPERTY_H
-#define ECS_PROPERTY_H
+struct Point {
+  float x, y, z;
+};
 
-namespace ecs{
+/// A client that sees every entity within radius of position
+struct Observer {
+  Point position;
+  float radius;
+};
 
-namespace details{
 ///---------------------------------------------------------------------
-/// Helper class used for compile-time checks to determine if a
-/// component is a propery.
+/// A Replicator writes, for each observer, what has happened to the
+/// entities it sees since the last tick its client acknowledged
 ///---------------------------------------------------------------------
-class BaseProperty{};
+///
+/// Entities with a Location component are replicated, together with
+/// any of Components they have. update finds the components that have
+/// changed, by comparing what Replicate<C>::write writes for each of
+/// them with what it wrote before, and puts every entity in a grid by
+/// its position. write then finds the entities within the radius of an
+/// observer, and writes a packet with the entities that the client may
+/// have but no longer sees, the entities that are new to it, and the
+/// changed components of the others.
+///
+/// Packets are written relative to the last acknowledged tick, so a
+/// lost packet is covered by the next one. Every value in a packet is
+/// absolute, so a packet can be applied by a client that has applied
+/// any of the packets written since that tick. A Replica applies the
+/// packets on the client side.
+///
+/// @usage Replicator<Position, Position, Health> replicator(entities, 64);
+///        size_t observer = replicator.add_observer(Observer{Point{0, 0, 0}, 100});
+///        ...
+///        replicator.update(tick);
+///        replicator.write(observer, packet);
+///        send(packet);
+///        ...
+///        replicator.acknowledge(observer, acknowledged_tick);
+///---------------------------------------------------------------------
+template<typename Location, typename ...Components>
+class Replicator: details::forbid_copies {
+  static_assert(sizeof...(Components) > 0, "At least 1 component must be replicated.");
+  static_assert(sizeof...(Components) <= 32, "At most 32 components can be replicated.");
 
-} // namespace details
+ public:
+  static const size_t component_count = sizeof...(Components);
+
+  /// Entities are put in a grid of squares with sides of cell_size, in
+  /// x and y. About the radius of the observers works well.
+  inline Replicator(EntityManager &entities, float cell_size);
+
+  /// Add an observer, that has not seen any entity. Returns its number
+  inline size_t add_observer(Observer const &observer);
+  inline void set_observer(size_t observer, Observer const &value) { observers_[observer].observer = value; }
+  inline Observer const &observer(size_t observer) const { return observers_[observer].observer; }
+  inline size_t observer_count() const { return observers_.size(); }
+
+  /// Find what has changed since the last update, and where each entity
+  /// is. Must be called with increasing ticks, greater than 0, before
+  /// packets of the tick are written.
+  inline void update(uint64_t tick);
+
+  /// Append the packet of the current tick for observer to out
+  inline void write(size_t observer, std::vector<uint8_t> &out);
+
+  /// Append the packet of every observer to its buffer in out, on
+  /// threads threads (0 uses one thread per core)
+  inline void write_all(std::vector<std::vector<uint8_t>> &out, size_t threads = 0);
+
+  /// The client of observer has applied the packet of tick. Later packets
+  /// are written relative to it. Unknown and old ticks are ignored.
+  inline void acknowledge(size_t observer, uint64_t tick);
+
+  /// The last tick observer acknowledged, 0 if none
+  inline uint64_t acknowledged(size_t observer) const { return observers_[observer].baseline; }
+
+ private:
+  /// A packet that is not acknowledged yet, and the entities it told the client about
+  struct Sent {
+    uint64_t tick;
+    std::vector<Handle> visible;
+  };
+
+  struct ObserverState {
+    Observer observer;
+    uint64_t baseline;
+    /// Entities the client has whichever packet since baseline it applied
+    /// last, and entities it may have
+    std::vector<Handle> known;
+    std::vector<Handle> maybe;
+    std::vector<Sent> sent;
+  };
+
+  /// What Replicate<C>::write wrote for every entity, and when it changed
+  struct Encoded {
+    size_t bits;
+    size_t bytes;
+    std::vector<uint8_t> data;
+    std::vector<uint64_t> changed;
+  };
+
+  /// Entities are compared by index first, so that lists are in the order of the entities
+  static inline bool by_index(Handle const &a, Handle const &b) {
+    return a.index() < b.index() || (a.index() == b.index() && a.version() < b.version());
+  }
+
+  inline uint64_t cell(float x, float y) const;
+
+  /// Encode component C of the entity at index, and see if it has changed
+  template<typename C>
+  inline void update_component(index_t index, uint32_t presence, uint32_t old_presence, bool is_new);
+
+  /// The entities within the radius of observer, in the order of their index
+  inline void find_visible(Observer const &observer, std::vector<Handle> &visible) const;
+
+  /// Write the components in mask of the entity at index
+  inline void write_components(BitWriter &writer, index_t index, uint32_t mask) const;
+
+  EntityManager *entities_;
+  float cell_size_;
+  uint64_t tick_;
+  std::vector<ObserverState> observers_;
+
+  /// Of each entity index, at the last update. Presence is a bit for each
+  /// of Components the entity has, and is 0 if it has no Location
+  std::vector<version_t> versions_;
+  std::vector<uint32_t> presence_;
+  /// The last tick anything was changed
+  std::vector<uint64_t> changed_;
+  std::vector<Point> positions_;
+  Encoded encoded_[component_count];
+  /// The cell and index of each located entity, sorted
+  std::vector<std::pair<uint64_t, index_t>> cells_;
+  std::vector<uint8_t> scratch_;
+};
 
 ///---------------------------------------------------------------------
-/// A Property is a helper class for Component with only one
-/// property of any type
+/// A Replica applies the packets of a Replicator to an EntityManager,
+/// on the client side
 ///---------------------------------------------------------------------
 ///
-/// A Property is a helper class for Component with only one
-/// property of any type.
-///
-/// it implements standard constructors, type conversations and
-/// operators:
-///
-///     ==, !=
-///     >=, <=, <, >
-///     +=, -=, *=, /=, %=
-///     &=, |=, ^=
-///     +, -, *; /, %
-///     &, |, ^, ~
-///     >>, <<
-///     ++, --
+/// Each replicated entity gets a local entity, that is found with the
+/// Handle it has on the server. Components must be the same as those of
+/// the Replicator, and be default constructible.
 ///
-/// TODO: Add more operators?
+/// @usage Replica<Position, Health> replica(entities);
+///        if (replica.read(packet)) send_ack(replica.tick());
 ///---------------------------------------------------------------------
-template<typename T>
-struct Property : details::BaseProperty{
-  Property() { }
-  Property(const T &value) : value(value) { }
+template<typename ...Components>
+class Replica: details::forbid_copies {
+ public:
+  static const size_t component_count = sizeof...(Components);
 
-  operator const T &() const { return value; }
-  operator T &() { return value; }
+  inline Replica(EntityManager &entities) : entities_(&entities), tick_(0) { }
 
-  T value;
-  using ValueType = T;
-};
+  /// Apply a packet. Returns false, without changing anything, if a packet
+  /// of the same or a later tick is applied already.
+  inline bool read(void const *data, size_t size);
+  inline bool read(std::vector<uint8_t> const &packet) { return read(packet.data(), packet.size()); }
 
-/// Comparision operators
-template<typename T, typename E> bool operator==(Property<T> const &lhs, const E &rhs);
-template<typename T, typename E> bool operator!=(Property<T> const &lhs, const E &rhs);
-template<typename T, typename E> bool operator>=(Property<T> const &lhs, const E &rhs);
-template<typename T, typename E> bool operator> (Property<T> const &lhs, const E &rhs);
-template<typename T, typename E> bool operator<=(Property<T> const &lhs, const E &rhs);
-template<typename T, typename E> bool operator< (Property<T> const &lhs, const E &rhs);
+  /// The tick of the last applied packet, which is the one to acknowledge
+  inline uint64_t tick() const { return tick_; }
+
+  /// The local entity of an entity on the server. Not valid if it is not replicated
+  inline Entity operator[](Handle remote);
+
+  /// How many entities that are replicated
+  inline size_t size() const { return local_.size(); }
 
-/// Compound assignment operators
-template<typename T, typename E> T& operator+=(Property<T> &lhs, const E &rhs);
-template<typename T, typename E> T& operator-=(Property<T> &lhs, const E &rhs);
-template<typename T, typename E> T& operator*=(Property<T> &lhs, const E &rhs);
-template<typename T, typename E> T& operator/=(Property<T> &lhs, const E &rhs);
-template<typename T, typename E> T& operator%=(Property<T> &lhs, const E &rhs);
-template<typename T, typename E> T& operator&=(Property<T> &lhs, const E &rhs);
-template<typename T, typename E> T& operator|=(Property<T> &lhs, const E &rhs);
-template<typename T, typename E> T& operator^=(Property<T> &lhs, const E &rhs);
+ private:
+  /// Read the components in mask into the local entity of remote, and
+  /// remove those it does not have, according to presence
+  inline void read_components(BitReader &reader, Handle remote, uint32_t presence, uint32_t mask);
 
-/// Arithmetic operators
-template<typename T, typename E> T  operator+ (Property<T> &lhs, const E &rhs);
-template<typename T, typename E> T  operator- (Property<T> &lhs, const E &rhs);
-template<typename T, typename E> T  operator* (Property<T> &lhs, const E &rhs);
-template<typename T, typename E> T  operator/ (Property<T> &lhs, const E &rhs);
-template<typename T, typename E> T  operator% (Property<T> &lhs, const E &rhs);
-template<typename T>             T& operator++(Property<T> &lhs);
-template<typename T>             T  operator++(Property<T> &lhs, int);
-template<typename T>             T& operator--(Property<T> &lhs);
-template<typename T>             T  operator--(Property<T> &lhs, int);
+  template<typename C>
+  inline void read_component(BitReader &reader, Entity &entity, uint32_t presence, uint32_t mask);
 
-/// Bitwise operators
-template<typename T, typename E> T operator&(Property<T> &lhs, const E &rhs);
-template<typename T, typename E> T operator|(Property<T> &lhs, const E &rhs);
-template<typename T, typename E> T operator^(Property<T> &lhs, const E &rhs);
-template<typename T, typename E> T operator~(Property<T> &lhs);
-template<typename T, typename E> T operator>>(Property<T> &lhs, const E &rhs);
-template<typename T, typename E> T operator<<(Property<T> &lhs, const E &rhs);
+  EntityManager *entities_;
+  uint64_t tick_;
+  std::unordered_map<Handle, Handle> local_;
+};
 
 } // namespace ecs
 
-// #included from: Property.inl
+// #included from: Replication.inl
 namespace ecs{
 
-template<typename T, typename E>
-inline bool operator==(Property<T> const &lhs, const E &rhs) {
-  return lhs.value == rhs;
+void BitWriter::write(uint64_t value, unsigned bits) {
+  if (bits == 0) return;
+  if (bits < 64) value &= (uint64_t(1) << bits) - 1;
+  written_ += bits;
+  pending_ |= value << pending_bits_;
+  unsigned total = pending_bits_ + bits;
+  if (total >= 64) {
+    for (unsigned i = 0; i < 8; ++i) {
+      out_->push_back(uint8_t(pending_ >> (8 * i)));
+    }
+    // The bits of value that did not fit
+    pending_ = pending_bits_ ? value >> (64 - pending_bits_) : 0;
+    total -= 64;
+  }
+  pending_bits_ = total;
 }
 
-template<typename T, typename E>
-inline bool operator!=(Property<T> const &lhs, const E &rhs) {
-  return lhs.value != rhs;
+void BitWriter::write_varint(uint64_t value) {
+  while (value >= 0x80) {
+    write((value & 0x7F) | 0x80, 8);
+    value >>= 7;
+  }
+  write(value, 8);
 }
 
-template<typename T, typename E>
-inline bool operator>=(Property<T> const &lhs, const E &rhs) {
-  return lhs.value >= rhs;
+void BitWriter::write_float(float value, float min, float max, unsigned bits) {
+  double steps = double((uint64_t(1) << bits) - 1);
+  double t = (double(value) - min) / (double(max) - min);
+  t = std::max(0.0, std::min(1.0, t));
+  write(uint64_t(t * steps + 0.5), bits);
 }
 
-template<typename T, typename E>
-inline bool operator>(Property<T> const &lhs, const E &rhs) {
-  return lhs.value > rhs;
+void BitWriter::write_bits(uint8_t const *data, size_t bits) {
+  for (; bits >= 64; bits -= 64, data += 8) {
+    uint64_t word = 0;
+    for (unsigned i = 0; i < 8; ++i) {
+      word |= uint64_t(data[i]) << (8 * i);
+    }
+    write(word, 64);
+  }
+  for (; bits > 0; bits -= std::min<size_t>(bits, 8), ++data) {
+    write(*data, unsigned(std::min<size_t>(bits, 8)));
+  }
 }
 
-template<typename T, typename E>
-inline bool operator<=(Property<T> const &lhs, const E &rhs) {
-  return lhs.value <= rhs;
+void BitWriter::flush() {
+  for (unsigned i = 0; i * 8 < pending_bits_; ++i) {
+    out_->push_back(uint8_t(pending_ >> (8 * i)));
+  }
+  written_ = (written_ + 7) / 8 * 8;
+  pending_ = 0;
+  pending_bits_ = 0;
+}
+
+uint64_t BitReader::read(unsigned bits) {
+  uint64_t value = 0;
+  unsigned done = 0;
+  while (done < bits) {
+    size_t byte = position_ / 8;
+    unsigned offset = unsigned(position_ % 8);
+    if (byte >= size_) {
+      overflow_ = true;
+      return value;
+    }
+    unsigned take = std::min(8 - offset, bits - done);
+    uint64_t chunk = (data_[byte] >> offset) & ((1u << take) - 1);
+    value |= chunk << done;
+    done += take;
+    position_ += take;
+  }
+  return value;
 }
 
-template<typename T, typename E>
-inline bool operator<(Property<T> const &lhs, const E &rhs) {
-  return lhs.value < rhs;
+uint64_t BitReader::read_varint() {
+  uint64_t value = 0;
+  for (unsigned shift = 0; shift < 64; shift += 7) {
+    uint64_t byte = read(8);
+    value |= (byte & 0x7F) << shift;
+    if (!(byte & 0x80)) break;
+  }
+  return value;
 }
 
-template<typename T, typename E>
-inline T &operator+=(Property<T> &lhs, const E &rhs) {
-  return lhs.value += rhs;
+float BitReader::read_float(float min, float max, unsigned bits) {
+  double steps = double((uint64_t(1) << bits) - 1);
+  return float(min + (double(max) - min) * (double(read(bits)) / steps));
 }
 
-template<typename T, typename E>
-inline T &operator-=(Property<T> &lhs, const E &rhs) {
-  return lhs.value -= rhs;
-}
+namespace details{
 
-template<typename T, typename E>
-inline T &operator*=(Property<T> &lhs, const E &rhs) {
-  return lhs.value *= rhs;
+void write_handle(BitWriter &writer, Handle handle, index_t &previous) {
+  writer.write_varint(handle.index() - previous);
+  writer.write(handle.version(), 8 * sizeof(version_t));
+  previous = handle.index();
 }
 
-template<typename T, typename E>
-inline T &operator/=(Property<T> &lhs, const E &rhs) {
-  return lhs.value /= rhs;
+Handle read_handle(BitReader &reader, index_t &previous) {
+  index_t index = previous + index_t(reader.read_varint());
+  version_t version = version_t(reader.read(8 * sizeof(version_t)));
+  previous = index;
+  return Handle(Id(index, version));
 }
 
-template<typename T, typename E>
-inline T &operator%=(Property<T> &lhs, const E &rhs) {
-  return lhs.value %= rhs;
-}
+} // namespace details
 
-template<typename T, typename E>
-inline T &operator&=(Property<T> &lhs, const E &rhs) {
-  return lhs.value &= rhs;
+template<typename Location, typename ...Components>
+Replicator<Location, Components...>::Replicator(EntityManager &entities, float cell_size) :
+    entities_(&entities),
+    cell_size_(cell_size),
+    tick_(0)
+{
+  ECS_ASSERT(cell_size > 0, "Cell size must be positive");
+  for (Encoded &encoded : encoded_) {
+    encoded.bits = 0;
+    encoded.bytes = 0;
+  }
 }
 
-template<typename T, typename E>
-inline T &operator|=(Property<T> &lhs, const E &rhs) {
-  return lhs.value |= rhs;
+template<typename Location, typename ...Components>
+size_t Replicator<Location, Components...>::add_observer(Observer const &observer) {
+  ObserverState state;
+  state.observer = observer;
+  state.baseline = 0;
+  observers_.push_back(state);
+  return observers_.size() - 1;
+}
+
+template<typename Location, typename ...Components>
+uint64_t Replicator<Location, Components...>::cell(float x, float y) const {
+  int32_t cx = int32_t(std::floor(x / cell_size_));
+  int32_t cy = int32_t(std::floor(y / cell_size_));
+  return uint64_t(uint32_t(cx)) << 32 | uint32_t(cy);
+}
+
+template<typename Location, typename ...Components>
+void Replicator<Location, Components...>::update(uint64_t tick) {
+  ECS_ASSERT(tick > tick_, "Ticks must be updated in increasing order, starting above 0");
+  tick_ = tick;
+  EntityManager &manager = *entities_;
+  size_t size = manager.component_masks_.size();
+  if (versions_.size() < size) {
+    versions_.resize(size, 0);
+    presence_.resize(size, 0);
+    changed_.resize(size, 0);
+    positions_.resize(size);
+  }
+  details::ComponentMask location_mask = details::component_mask<Location>();
+  details::ComponentMask masks[] = {details::component_mask<Components>()...};
+  cells_.clear();
+  for (index_t index = 0; index < versions_.size(); ++index) {
+    uint32_t presence = 0;
+    bool located = index < size && (manager.component_masks_[index] & location_mask) == location_mask;
+    if (located) {
+      for (size_t c = 0; c < component_count; ++c) {
+        if ((manager.component_masks_[index] & masks[c]).any()) presence |= uint32_t(1) << c;
+      }
+    }
+    // A new entity may have been given the index
+    bool is_new = index < size && manager.entity_versions_[index] != versions_[index];
+    if (is_new) versions_[index] = manager.entity_versions_[index];
+    uint32_t old_presence = presence_[index];
+    if (presence != old_presence || (is_new && presence)) changed_[index] = tick;
+    presence_[index] = presence;
+    if (!located) continue;
+    int expand[] = {(update_component<Components>(index, presence, old_presence, is_new), 0)...};
+    (void) expand;
+    Point point = Replicate<Location>::position(manager.get_component_fast<Location>(index));
+    positions_[index] = point;
+    cells_.push_back(std::make_pair(cell(point.x, point.y), index));
+  }
+  std::sort(cells_.begin(), cells_.end());
 }
 
-template<typename T, typename E>
-inline T &operator^=(Property<T> &lhs, const E &rhs) {
-  return lhs.value ^= rhs;
+template<typename Location, typename ...Components>
+template<typename C>
+void Replicator<Location, Components...>::update_component(index_t index, uint32_t presence,
+                                                           uint32_t old_presence, bool is_new) {
+  const size_t c = details::index_of<C, Components...>::value;
+  const uint32_t bit = uint32_t(1) << c;
+  if (!(presence & bit)) return;
+  Encoded &encoded = encoded_[c];
+  scratch_.clear();
+  size_t bits;
+  {
+    BitWriter writer(scratch_);
+    Replicate<C>::write(writer, entities_->get_component_fast<C>(index));
+    bits = writer.bit_count();
+  }
+  if (encoded.bytes == 0) {
+    encoded.bits = bits;
+    encoded.bytes = std::max<size_t>(1, scratch_.size());
+  }
+  ECS_ASSERT(bits == encoded.bits, "Replicate<C>::write must always write the same number of bits");
+  scratch_.resize(encoded.bytes, 0);
+  if (encoded.changed.size() < versions_.size()) {
+    encoded.changed.resize(versions_.size(), 0);
+    encoded.data.resize(versions_.size() * encoded.bytes, 0);
+  }
+  uint8_t *data = &encoded.data[index * encoded.bytes];
+  // Components that are added get a change, even if they have the same value as before
+  bool added = is_new || !(old_presence & bit);
+  if (added || std::memcmp(data, scratch_.data(), encoded.bytes) != 0) {
+    std::memcpy(data, scratch_.data(), encoded.bytes);
+    encoded.changed[index] = tick_;
+    changed_[index] = tick_;
+  }
 }
 
-template<typename T, typename E>
-inline T operator+(Property<T> &lhs, const E &rhs) {
-  return lhs.value + rhs;
+template<typename Location, typename ...Components>
+void Replicator<Location, Components...>::find_visible(Observer const &observer, std::vector<Handle> &visible) const {
+  std::vector<index_t> indexes;
+  Point const &center = observer.position;
+  float radius = observer.radius;
+  int32_t first_x = int32_t(std::floor((center.x - radius) / cell_size_));
+  int32_t last_x = int32_t(std::floor((center.x + radius) / cell_size_));
+  int32_t first_y = int32_t(std::floor((center.y - radius) / cell_size_));
+  int32_t last_y = int32_t(std::floor((center.y + radius) / cell_size_));
+  for (int32_t cx = first_x; cx <= last_x; ++cx) {
+    for (int32_t cy = first_y; cy <= last_y; ++cy) {
+      uint64_t key = uint64_t(uint32_t(cx)) << 32 | uint32_t(cy);
+      auto it = std::lower_bound(cells_.begin(), cells_.end(), std::make_pair(key, index_t(0)));
+      for (; it != cells_.end() && it->first == key; ++it) {
+        Point const &point = positions_[it->second];
+        float dx = point.x - center.x, dy = point.y - center.y, dz = point.z - center.z;
+        if (dx * dx + dy * dy + dz * dz <= radius * radius) indexes.push_back(it->second);
+      }
+    }
+  }
+  std::sort(indexes.begin(), indexes.end());
+  visible.clear();
+  visible.reserve(indexes.size());
+  for (index_t index : indexes) {
+    visible.push_back(Handle(Id(index, versions_[index])));
+  }
 }
 
-template<typename T, typename E>
-inline T operator-(Property<T> &lhs, const E &rhs) {
-  return lhs.value - rhs;
-}
+template<typename Location, typename ...Components>
+void Replicator<Location, Components...>::write(size_t observer, std::vector<uint8_t> &out) {
+  ECS_ASSERT(tick_ > 0, "update must be called before packets are written");
+  ObserverState &state = observers_[observer];
+  std::vector<Handle> visible;
+  find_visible(state.observer, visible);
+  // The client has applied the packet of the baseline, or any packet sent after it
+  std::vector<Handle> known = state.known, maybe = state.maybe, merged;
+  for (Sent const &sent : state.sent) {
+    merged.clear();
+    std::set_intersection(known.begin(), known.end(), sent.visible.begin(), sent.visible.end(),
+                          std::back_inserter(merged), by_index);
+    known.swap(merged);
+    merged.clear();
+    std::set_union(maybe.begin(), maybe.end(), sent.visible.begin(), sent.visible.end(),
+                   std::back_inserter(merged), by_index);
+    maybe.swap(merged);
+  }
+  std::vector<Handle> left, entered, kept;
+  std::set_difference(maybe.begin(), maybe.end(), visible.begin(), visible.end(), std::back_inserter(left), by_index);
+  std::set_difference(visible.begin(), visible.end(), known.begin(), known.end(),
+                      std::back_inserter(entered), by_index);
+  std::set_intersection(visible.begin(), visible.end(), known.begin(), known.end(),
+                        std::back_inserter(kept), by_index);
+  std::vector<Handle> changed;
+  for (Handle handle : kept) {
+    if (changed_[handle.index()] > state.baseline) changed.push_back(handle);
+  }
 
-template<typename T, typename E>
-inline T operator*(Property<T> &lhs, const E &rhs) {
-  return lhs.value * rhs;
+  BitWriter writer(out);
+  writer.write_varint(tick_);
+  index_t previous = 0;
+  writer.write_varint(left.size());
+  for (Handle handle : left) {
+    details::write_handle(writer, handle, previous);
+  }
+  previous = 0;
+  writer.write_varint(entered.size());
+  for (Handle handle : entered) {
+    details::write_handle(writer, handle, previous);
+    uint32_t presence = presence_[handle.index()];
+    writer.write(presence, component_count);
+    write_components(writer, handle.index(), presence);
+  }
+  previous = 0;
+  writer.write_varint(changed.size());
+  for (Handle handle : changed) {
+    details::write_handle(writer, handle, previous);
+    uint32_t presence = presence_[handle.index()];
+    uint32_t mask = 0;
+    for (size_t c = 0; c < component_count; ++c) {
+      if ((presence & (uint32_t(1) << c)) && encoded_[c].changed[handle.index()] > state.baseline) {
+        mask |= uint32_t(1) << c;
+      }
+    }
+    writer.write(presence, component_count);
+    writer.write(mask, component_count);
+    write_components(writer, handle.index(), mask);
+  }
+  writer.flush();
+
+  Sent sent;
+  sent.tick = tick_;
+  sent.visible.swap(visible);
+  state.sent.push_back(std::move(sent));
+  // A client that does not acknowledge is treated as if it could have applied any of the oldest packets
+  if (state.sent.size() > ECS_REPLICATION_HISTORY) {
+    Sent const &oldest = state.sent.front();
+    merged.clear();
+    std::set_intersection(state.known.begin(), state.known.end(), oldest.visible.begin(), oldest.visible.end(),
+                          std::back_inserter(merged), by_index);
+    state.known.swap(merged);
+    merged.clear();
+    std::set_union(state.maybe.begin(), state.maybe.end(), oldest.visible.begin(), oldest.visible.end(),
+                   std::back_inserter(merged), by_index);
+    state.maybe.swap(merged);
+    state.sent.erase(state.sent.begin());
+  }
 }
 
-template<typename T, typename E>
-inline T operator/(Property<T> &lhs, const E &rhs) {
-  return lhs.value / rhs;
+template<typename Location, typename ...Components>
+void Replicator<Location, Components...>::write_components(BitWriter &writer, index_t index, uint32_t mask) const {
+  for (size_t c = 0; c < component_count; ++c) {
+    if (mask & (uint32_t(1) << c)) {
+      Encoded const &encoded = encoded_[c];
+      writer.write_bits(&encoded.data[index * encoded.bytes], encoded.bits);
+    }
+  }
 }
 
-template<typename T, typename E>
-inline T operator%(Property<T> &lhs, const E &rhs) {
-  return lhs.value % rhs;
+template<typename Location, typename ...Components>
+void Replicator<Location, Components...>::write_all(std::vector<std::vector<uint8_t>> &out, size_t threads) {
+  out.resize(std::max(out.size(), observers_.size()));
+  // Each observer only changes its own state, and is worth a thread of its own
+  details::reduce_t<Location>::run(observers_.size(), threads, [this, &out](size_t, size_t observer) {
+    write(observer, out[observer]);
+  }, 1);
 }
 
-template<typename T>
-inline T &operator++(Property<T> &lhs) {
-  ++lhs.value;
-  return lhs.value;
+template<typename Location, typename ...Components>
+void Replicator<Location, Components...>::acknowledge(size_t observer, uint64_t tick) {
+  ObserverState &state = observers_[observer];
+  auto acknowledged = std::find_if(state.sent.begin(), state.sent.end(), [tick](Sent const &sent) {
+    return sent.tick == tick;
+  });
+  if (acknowledged == state.sent.end()) return;
+  state.baseline = tick;
+  state.known = acknowledged->visible;
+  state.maybe = acknowledged->visible;
+  state.sent.erase(state.sent.begin(), acknowledged + 1);
 }
 
-template<typename T>
-inline T operator++(Property<T> &lhs, int) {
-  T copy = lhs;
-  ++lhs;
-  return copy;
+template<typename ...Components>
+bool Replica<Components...>::read(void const *data, size_t size) {
+  BitReader reader(data, size);
+  uint64_t tick = reader.read_varint();
+  if (tick <= tick_ || reader.overflow()) return false;
+  tick_ = tick;
+  index_t previous = 0;
+  for (uint64_t left = reader.read_varint(); left > 0 && !reader.overflow(); --left) {
+    Handle remote = details::read_handle(reader, previous);
+    auto it = local_.find(remote);
+    if (it == local_.end()) continue;
+    if (entities_->is_valid(it->second)) (*entities_)[it->second].destroy();
+    local_.erase(it);
+  }
+  previous = 0;
+  for (uint64_t entered = reader.read_varint(); entered > 0 && !reader.overflow(); --entered) {
+    Handle remote = details::read_handle(reader, previous);
+    uint32_t presence = uint32_t(reader.read(component_count));
+    read_components(reader, remote, presence, presence);
+  }
+  previous = 0;
+  for (uint64_t changed = reader.read_varint(); changed > 0 && !reader.overflow(); --changed) {
+    Handle remote = details::read_handle(reader, previous);
+    uint32_t presence = uint32_t(reader.read(component_count));
+    uint32_t mask = uint32_t(reader.read(component_count));
+    read_components(reader, remote, presence, mask);
+  }
+  ECS_ASSERT(!reader.overflow(), "Packet is truncated");
+  return true;
 }
 
-template<typename T>
-inline T& operator--(Property<T> &lhs) {
-  --lhs.value;
-  return lhs.value;
+template<typename ...Components>
+void Replica<Components...>::read_components(BitReader &reader, Handle remote, uint32_t presence, uint32_t mask) {
+  Handle &local = local_[remote];
+  if (local.is_null() || !entities_->is_valid(local)) {
+    Entity created = entities_->create();
+    local = created.handle();
+  }
+  Entity entity = (*entities_)[local];
+  int expand[] = {(read_component<Components>(reader, entity, presence, mask), 0)...};
+  (void) expand;
 }
 
-template<typename T>
-inline T operator--(Property<T> &lhs, int) {
-  T copy = lhs;
-  --lhs;
-  return copy;
+template<typename ...Components>
+template<typename C>
+void Replica<Components...>::read_component(BitReader &reader, Entity &entity, uint32_t presence, uint32_t mask) {
+  const uint32_t bit = uint32_t(1) << details::index_of<C, Components...>::value;
+  if (mask & bit) {
+    C component;
+    Replicate<C>::read(reader, component);
+    entity.set<C>(component);
+  } else if (!(presence & bit) && entity.has<C>()) {
+    entity.remove<C>();
+  }
 }
 
-template<typename T, typename E>
-inline T operator&(Property<T> &lhs, const E &rhs) {
-  return lhs.value & rhs;
+template<typename ...Components>
+Entity Replica<Components...>::operator[](Handle remote) {
+  auto it = local_.find(remote);
+  return Entity(entities_, it == local_.end() ? Handle().id() : it->second.id());
 }
 
-template<typename T, typename E>
-inline T operator|(Property<T> &lhs, const E &rhs) {
-  return lhs.value | rhs;
-}
+} // namespace ecs
+#endif //ECS_REPLICATION_H
+// #included from: SharedWorld.h
+#ifndef ECS_SHAREDWORLD_H
+#define ECS_SHAREDWORLD_H
+
+/// Shared memory needs POSIX shm_open and mmap. Define
+/// ECS_NO_SHARED_MEMORY to leave SharedWorld out.
+#if !defined(ECS_NO_SHARED_MEMORY) && (defined(__unix__) || defined(__APPLE__))
+#define ECS_SHARED_MEMORY
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
-template<typename T, typename E>
-inline T operator^(Property<T> &lhs, const E &rhs) {
-  return lhs.value ^ rhs;
-}
+#ifdef ECS_SHARED_MEMORY
 
-template<typename T, typename E>
-inline T operator~(Property<T> &lhs) {
-  return ~lhs.value;
-}
+namespace ecs{
 
-template<typename T, typename E>
-inline T operator>>(Property<T> &lhs, const E &rhs) {
-  return lhs.value >> rhs;
-}
+namespace details{
 
-template<typename T, typename E>
-inline T operator<<(Property<T> &lhs, const E &rhs) {
-  return lhs.value << rhs;
+///---------------------------------------------------------------------
+/// The layout of a shared memory segment of a SharedWorld
+///---------------------------------------------------------------------
+///
+/// A SharedHeader is followed by two slots of slot_size bytes, that
+/// each start at a multiple of columns_alignment. A slot holds exported
+/// columns. The sequence of a slot is odd while the slot is written, and
+/// latest is 1 + the slot that was published last, or 0 before the
+/// first snapshot is published.
+///---------------------------------------------------------------------
+struct SharedSlot {
+  std::atomic<uint64_t> sequence;
+  std::atomic<uint64_t> epoch;
+  std::atomic<uint64_t> size;
+};
+
+struct SharedHeader {
+  char magic[8];
+  uint64_t slot_size;
+  std::atomic<uint64_t> latest;
+  SharedSlot slots[2];
+};
+
+static const char shared_magic[8] = {'E', 'C', 'S', 'S', 'H', 'M', '0', '1'};
+
+/// Where slot starts, from the start of the segment
+inline uint64_t shared_slot_offset(uint64_t slot_size, size_t slot) {
+  return align_column(sizeof(SharedHeader)) + slot * slot_size;
 }
 
-} // namespace ecs
+/// A stream buffer that writes to memory of a fixed size, and fails
+/// when it is full
+class FixedBuffer: public std::streambuf {
+ public:
+  inline FixedBuffer(char *data, size_t size) { setp(data, data + size); }
+  inline size_t size() const { return size_t(pptr() - pbase()); }
+};
+
+} // namespace details
 
 ///---------------------------------------------------------------------
-/// This will allow a property to be streamed into a input and output
-/// stream.
+/// SharedWorld publishes snapshots of components to a POSIX shared
+/// memory segment, that other processes can read with a
+/// SharedWorldReader
 ///---------------------------------------------------------------------
-namespace std {
+///
+/// Each snapshot is written as columns by EntityManager::export_columns,
+/// so the component pools and which components each entity has can be
+/// read without knowing anything about the EntityManager.
+///
+/// The segment has two slots, that snapshots are written to in turn. A
+/// snapshot is written to the slot that was not published last, and the
+/// sequence of the slot is odd while it is written, like a seqlock.
+/// Readers check the sequence before and after they copy a slot, and
+/// try again if it changed, so the writer never waits for a reader.
+/// Components must be trivially copyable.
+///
+/// The segment is removed when the SharedWorld is destroyed. Readers
+/// that have attached keep their mapping.
+///
+/// @usage SharedWorld shared("/world", 64 * 1024 * 1024);
+///        ...
+///        shared.publish<Position, Health>(entities, tick);
+///---------------------------------------------------------------------
+class SharedWorld: details::forbid_copies {
+ public:
+  /// Create the segment called name, or replace it if it exists, with
+  /// room for snapshots of slot_size bytes. Check is_open to see if it
+  /// could be created
+  inline SharedWorld(std::string const &name, size_t slot_size);
+  inline ~SharedWorld();
+
+  /// False if the segment could not be created. Nothing is published then
+  inline bool is_open() const { return data_ != nullptr; }
+
+  /// Write Components of every entity that has any of them as the next
+  /// snapshot, tagged with epoch. Returns false, and keeps the snapshot
+  /// published before, if it does not fit in a slot, or if the segment
+  /// is not open.
+  template<typename ...Components>
+  inline bool publish(EntityManager const &entities, uint64_t epoch);
 
-template<typename T>
-ostream &operator<<(ostream &os, const ecs::Property<T> &obj) {
-  return os << obj.value;
+  /// Write Components of every entity within view that has any of them
+  template<typename ...Components, typename T>
+  inline bool publish(EntityManager const &entities, View<T> const &view, uint64_t epoch);
+
+  inline std::string const &name() const { return name_; }
+  inline size_t slot_size() const { return slot_size_; }
+
+ private:
+  /// Write a snapshot to the slot that is not published, with write(out)
+  template<typename Write>
+  inline bool publish_with(uint64_t epoch, Write write);
+
+  inline details::SharedHeader &header() { return *static_cast<details::SharedHeader *>(data_); }
+
+  std::string name_;
+  size_t slot_size_;
+  size_t size_;
+  void *data_;
+};
+
+///---------------------------------------------------------------------
+/// SharedWorldReader attaches to the segment of a SharedWorld, read
+/// only, and copies consistent snapshots from it
+///---------------------------------------------------------------------
+///
+/// read copies the latest snapshot into memory of the reader, which
+/// columns() then reads. The writer may publish while a snapshot is
+/// copied, in which case the copy is made again, up to
+/// ECS_SHARED_WORLD_RETRIES times.
+///
+/// @usage SharedWorldReader reader("/world");
+///        if (reader.is_open() && reader.read()) {
+///          ecs::Columns const &columns = reader.columns();
+///          Health const *health = columns.values<Health>(1);
+///          ...
+///        }
+///---------------------------------------------------------------------
+class SharedWorldReader: details::forbid_copies {
+ public:
+  /// Attach to the segment called name. is_open() is false if there is no
+  /// such segment, or if it is not made by a SharedWorld
+  inline SharedWorldReader(std::string const &name);
+  inline ~SharedWorldReader();
+
+  inline bool is_open() const { return data_ != nullptr; }
+
+  /// Copy the latest snapshot. Returns false, and keeps the snapshot read
+  /// before, if nothing is published yet, or if the writer overwrote the
+  /// snapshot every time it was copied.
+  inline bool read();
+
+  /// True once a snapshot is read
+  inline bool has_snapshot() const { return columns_.get() != nullptr; }
+
+  /// The epoch of the snapshot that was read last
+  inline uint64_t epoch() const { return epoch_; }
+
+  /// The snapshot that was read last. Only valid if has_snapshot()
+  inline Columns const &columns() const { return *columns_; }
+
+ private:
+  inline details::SharedHeader const &header() const {
+    return *static_cast<details::SharedHeader const *>(data_);
+  }
+
+  size_t size_;
+  void *data_;
+  uint64_t epoch_;
+  /// Of uint64_t, so that the copy is aligned like Columns wants it
+  std::vector<uint64_t> buffer_;
+  std::unique_ptr<Columns> columns_;
+};
+
+} // namespace ecs
+
+// #included from: SharedWorld.inl
+namespace ecs{
+
+SharedWorld::SharedWorld(std::string const &name, size_t slot_size) :
+    name_(name),
+    slot_size_(size_t(details::align_column(slot_size))),
+    size_(size_t(details::shared_slot_offset(slot_size_, 2))),
+    data_(nullptr) {
+  // A segment left by a writer that did not exit cleanly is replaced
+  shm_unlink(name_.c_str());
+  // Failing to create the segment is reported by is_open
+  int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) return;
+  bool sized = ftruncate(fd, off_t(size_)) == 0;
+  if (sized) {
+    data_ = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (!sized || data_ == MAP_FAILED) {
+    data_ = nullptr;
+    shm_unlink(name_.c_str());
+  }
+  if (!is_open()) return;
+  details::SharedHeader &shared = header();
+  std::memcpy(shared.magic, details::shared_magic, sizeof(shared.magic));
+  shared.slot_size = slot_size_;
+  shared.latest.store(0, std::memory_order_relaxed);
+  for (details::SharedSlot &slot : shared.slots) {
+    slot.sequence.store(0, std::memory_order_relaxed);
+    slot.epoch.store(0, std::memory_order_relaxed);
+    slot.size.store(0, std::memory_order_relaxed);
+  }
+  std::atomic_thread_fence(std::memory_order_release);
 }
 
-template<typename T>
-istream &operator>>(istream &is, ecs::Property<T> &obj) {
-  return is >> obj.value;
+SharedWorld::~SharedWorld() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+    shm_unlink(name_.c_str());
+  }
+}
+
+template<typename ...Components>
+bool SharedWorld::publish(EntityManager const &entities, uint64_t epoch) {
+  return publish_with(epoch, [&entities](std::ostream &out) {
+    entities.export_columns<Components...>(out);
+  });
+}
+
+template<typename ...Components, typename T>
+bool SharedWorld::publish(EntityManager const &entities, View<T> const &view, uint64_t epoch) {
+  return publish_with(epoch, [&entities, &view](std::ostream &out) {
+    entities.export_columns<Components...>(out, view);
+  });
+}
+
+template<typename Write>
+bool SharedWorld::publish_with(uint64_t epoch, Write write) {
+  if (!is_open()) return false;
+  details::SharedHeader &shared = header();
+  // There is only one writer, so latest is what this SharedWorld stored last
+  uint64_t latest = shared.latest.load(std::memory_order_relaxed);
+  size_t target = latest == 1 ? 1 : 0;
+  details::SharedSlot &slot = shared.slots[target];
+  uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+  slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  char *data = static_cast<char *>(data_) + details::shared_slot_offset(slot_size_, target);
+  details::FixedBuffer buffer(data, slot_size_);
+  std::ostream out(&buffer);
+  write(out);
+  bool fits = bool(out);
+  slot.size.store(fits ? buffer.size() : 0, std::memory_order_relaxed);
+  slot.epoch.store(epoch, std::memory_order_relaxed);
+  slot.sequence.store(sequence + 2, std::memory_order_release);
+  if (fits) {
+    shared.latest.store(target + 1, std::memory_order_release);
+  }
+  return fits;
+}
+
+SharedWorldReader::SharedWorldReader(std::string const &name) : size_(0), data_(nullptr), epoch_(0) {
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) return;
+  struct stat status;
+  if (fstat(fd, &status) == 0 && size_t(status.st_size) >= sizeof(details::SharedHeader)) {
+    size_ = size_t(status.st_size);
+    data_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (data_ == MAP_FAILED) data_ = nullptr;
+  }
+  close(fd);
+  if (data_ == nullptr) return;
+  details::SharedHeader const &shared = header();
+  if (std::memcmp(shared.magic, details::shared_magic, sizeof(shared.magic)) != 0 ||
+      details::shared_slot_offset(shared.slot_size, 2) > size_) {
+    munmap(data_, size_);
+    data_ = nullptr;
+  }
+}
+
+SharedWorldReader::~SharedWorldReader() {
+  if (data_ != nullptr) {
+    munmap(data_, size_);
+  }
+}
+
+bool SharedWorldReader::read() {
+  if (data_ == nullptr) return false;
+  details::SharedHeader const &shared = header();
+  std::vector<uint64_t> copy;
+  for (size_t attempt = 0; attempt < ECS_SHARED_WORLD_RETRIES; ++attempt) {
+    uint64_t latest = shared.latest.load(std::memory_order_acquire);
+    if (latest == 0) return false;
+    size_t target = size_t(latest - 1) & 1;
+    details::SharedSlot const &slot = shared.slots[target];
+    uint64_t before = slot.sequence.load(std::memory_order_acquire);
+    if (before & 1) continue;
+    uint64_t size = slot.size.load(std::memory_order_relaxed);
+    uint64_t epoch = slot.epoch.load(std::memory_order_relaxed);
+    if (size < sizeof(details::ColumnsHeader) || size > shared.slot_size) continue;
+    copy.resize(size_t((size + sizeof(uint64_t) - 1) / sizeof(uint64_t)));
+    char const *data = static_cast<char const *>(data_) + details::shared_slot_offset(shared.slot_size, target);
+    std::memcpy(copy.data(), data, size_t(size));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != before) continue;
+    buffer_.swap(copy);
+    epoch_ = epoch;
+    columns_.reset(new Columns(buffer_.data(), size_t(size)));
+    return true;
+  }
+  return false;
 }
 
-} //namespace std
+} // namespace ecs
+#endif // ECS_SHARED_MEMORY
 
-///---------------------------------------------------------------------
-/// This will enable properties to be added to a string
-///---------------------------------------------------------------------
-template<typename T>
-std::string operator+(const std::string &lhs, const ecs::Property<T> &rhs) { return lhs + rhs.value; }
+#endif //ECS_SHAREDWORLD_H
+// #included from: Metrics.h
+#ifndef ECS_METRICS_H
+#define ECS_METRICS_H
 
-template<typename T>
-std::string operator+(std::string &&lhs, ecs::Property<T> &&rhs) { return lhs + rhs.value; }
+namespace ecs{
 
-template<typename T>
-std::string operator+(std::string &&lhs, const ecs::Property<T> &rhs) { return lhs + rhs.value; }
+namespace details{
 
-template<typename T>
-std::string operator+(const std::string &lhs, ecs::Property<T> &&rhs) { return lhs + rhs.value; }
-#endif //ECS_PROPERTY_H
-// #included from: Iterator.h
-#ifndef ECS_ITERATOR_H
-#define ECS_ITERATOR_H
+/// Write value as a Prometheus label value, with \, " and newlines escaped
+inline void write_label_value(std::ostream &out, std::string const &value);
 
-namespace ecs{
+} // namespace details
 
 ///---------------------------------------------------------------------
-/// Iterator is an iterator for iterating through the entity manager.
-/// The iterator should fulfill the c++ standards for an input iterator,
+/// Metrics keeps track of the health of an EntityManager, and of the
+/// systems of a SystemManager, and writes it in the Prometheus text
+/// exposition format
 ///---------------------------------------------------------------------
-template<typename T>
-class Iterator: public std::iterator<std::input_iterator_tag, typename std::remove_reference<T>::type> {
-  using T_no_ref = typename std::remove_reference<typename std::remove_const<T>::type>::type;
-
+///
+/// Nothing is counted when entities or components are used. The
+/// SystemManager that owns the Metrics counts updates, how long each
+/// system takes, how many events each EventChannel has when it is
+/// swapped, and how many entities expire, once per update. Everything
+/// else, like how many entities have each component mask and how much
+/// memory each component pool uses, is read from the EntityManager
+/// when the metrics are written. Writing must be done from the thread
+/// that owns the EntityManager.
+///
+/// Components, systems and event types are labelled by their index,
+/// unless they are given a name.
+///
+/// @usage SystemManager systems(entities);
+///        systems.metrics().name_component<Position>("position");
+///        ...
+///        systems.metrics().write_file("/var/run/game/metrics.prom");
+///---------------------------------------------------------------------
+class Metrics: details::forbid_copies {
  public:
-  Iterator(EntityManager *manager, details::ComponentMask mask, bool begin = true);
-  Iterator(const Iterator &it);
-  Iterator &operator=(const Iterator &rhs) = default;
+  inline Metrics(EntityManager &entities) :
+      entities_(&entities), updates_(0), update_seconds_(0), last_update_seconds_(0), expired_(0) { }
 
-  // Get the current index (cursor)
-  index_t index() const;
-  Iterator &operator++();
+  /// Set the label value used for component C, system S or events E
+  template<typename C>
+  inline void name_component(std::string const &name);
+  template<typename S>
+  inline void name_system(std::string const &name);
+  template<typename E>
+  inline void name_events(std::string const &name);
 
-  // The the current entity
-  T       entity();
-  T const entity() const;
+  /// Write every metric
+  inline void write(std::ostream &out) const;
+  inline std::string str() const;
+
+  /// Write every metric to a file at path. A temporary file is written
+  /// first, and then renamed, so that the file is never read half
+  /// written. Returns false if the file could not be written.
+  inline bool write_file(std::string const &path) const;
+
+  inline uint64_t updates() const { return updates_; }
 
  private:
-  // find next entity withing the EntityManager which has the correct components
-  void find_next();
+  struct SystemStats {
+    uint64_t updates = 0;
+    double seconds = 0;
+    double last_seconds = 0;
+  };
 
-  EntityManager         *manager_;
-  details::ComponentMask mask_;
-  index_t                cursor_;
-  size_t                 size_;
-}; //Iterator
+  struct EventStats {
+    uint64_t total = 0;
+    /// How many events were emitted since the swap before
+    size_t backlog = 0;
+  };
 
-template<typename T> bool operator==(Iterator<T> const &lhs, Iterator<T> const &rhs);
-template<typename T> bool operator!=(Iterator<T> const &lhs, Iterator<T> const &rhs);
-template<typename T> inline T operator*(Iterator<T> &lhs);
-template<typename T> inline T const &operator*(Iterator<T> const &lhs);
+  /// Called by SystemManager::update
+  inline void record_system(size_t system, double seconds);
+  inline void record_events();
+  inline void record_update(double seconds, size_t expired);
+
+  /// The label value of index, using names if it has one
+  static inline std::string name_of(std::vector<std::string> const &names, char const *kind, size_t index);
+  static inline void set_name(std::vector<std::string> &names, size_t index, std::string const &name);
+
+  /// Write the # HELP and # TYPE lines of a metric
+  static inline void describe(std::ostream &out, char const *name, char const *type, char const *help);
+
+  using MaskCounts = std::unordered_map<details::ComponentMask, size_t>;
+
+  /// How many entities have each mask, other than the empty one
+  inline MaskCounts count_masks() const;
+
+  inline void write_entities(std::ostream &out, MaskCounts const &counts) const;
+  inline void write_components(std::ostream &out, MaskCounts const &counts) const;
+  inline void write_events(std::ostream &out) const;
+  inline void write_systems(std::ostream &out) const;
+
+  EntityManager *entities_;
+  std::vector<std::string> component_names_;
+  std::vector<std::string> system_names_;
+  std::vector<std::string> event_names_;
+
+  /// Indexed by system and event type
+  std::vector<SystemStats> systems_;
+  std::vector<EventStats> events_;
+  uint64_t updates_;
+  double update_seconds_;
+  double last_update_seconds_;
+  uint64_t expired_;
+
+  friend class SystemManager;
+};
 
 } // namespace ecs
 
-// #included from: Iterator.inl
+// #included from: Metrics.inl
 namespace ecs{
 
-template<typename T>
-Iterator<T>::Iterator(EntityManager *manager, details::ComponentMask mask, bool begin) :
-    manager_(manager),
-    mask_(mask),
-    cursor_(0){
-  // Must be pool size because of potential holes
-  size_ = manager_->entity_versions_.size();
-  if (!begin) cursor_ = size_;
-  find_next();
+namespace details{
+
+void write_label_value(std::ostream &out, std::string const &value) {
+  out << '"';
+  for (char c : value) {
+    if (c == '\\') out << "\\\\";
+    else if (c == '"') out << "\\\"";
+    else if (c == '\n') out << "\\n";
+    else out << c;
+  }
+  out << '"';
 }
 
-template<typename T>
-Iterator<T>::Iterator(const Iterator &it) : Iterator(it.manager_, it.cursor_) { }
+} // namespace details
 
-template<typename T>
-index_t Iterator<T>::index() const {
-  return cursor_;
+template<typename C>
+void Metrics::name_component(std::string const &name) {
+  set_name(component_names_, details::component_index<C>(), name);
 }
 
-template<typename T>
-inline void Iterator<T>::find_next() {
-  while (cursor_ < size_ && (manager_->component_masks_[cursor_] & mask_) != mask_) {
-    ++cursor_;
+template<typename S>
+void Metrics::name_system(std::string const &name) {
+  set_name(system_names_, details::system_index<S>(), name);
+}
+
+template<typename E>
+void Metrics::name_events(std::string const &name) {
+  set_name(event_names_, details::event_index<E>(), name);
+}
+
+void Metrics::write(std::ostream &out) const {
+  std::streamsize precision = out.precision(9);
+  MaskCounts counts = count_masks();
+  write_entities(out, counts);
+  write_components(out, counts);
+  write_events(out);
+  write_systems(out);
+  out.precision(precision);
+}
+
+std::string Metrics::str() const {
+  std::ostringstream out;
+  write(out);
+  return out.str();
+}
+
+bool Metrics::write_file(std::string const &path) const {
+  std::string temporary = path + ".tmp";
+  {
+    std::ofstream out(temporary.c_str(), std::ios::binary | std::ios::trunc);
+    write(out);
+    out.close();
+    if (!out) {
+      std::remove(temporary.c_str());
+      return false;
+    }
+  }
+  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+    // Renaming does not replace an existing file on every platform
+    std::remove(path.c_str());
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+      std::remove(temporary.c_str());
+      return false;
+    }
   }
+  return true;
 }
 
-template<typename T>
-T Iterator<T>::entity() {
-  return manager_->get_entity(index()).template as<typename Iterator<T>::T_no_ref>();
+void Metrics::record_system(size_t system, double seconds) {
+  if (systems_.size() <= system) systems_.resize(system + 1);
+  SystemStats &stats = systems_[system];
+  ++stats.updates;
+  stats.seconds += seconds;
+  stats.last_seconds = seconds;
 }
 
-template<typename T>
-const T Iterator<T>::entity() const  {
-  return manager_->get_entity(index()).template as<typename Iterator<T>::T_no_ref>();
+void Metrics::record_events() {
+  auto const &channels = entities_->event_channels_;
+  if (events_.size() < channels.size()) events_.resize(channels.size());
+  for (size_t index = 0; index < channels.size(); ++index) {
+    // Just after a swap, the readable events are those emitted since the swap before
+    size_t backlog = channels[index] ? channels[index]->size() : 0;
+    events_[index].total += backlog;
+    events_[index].backlog = backlog;
+  }
 }
 
-template<typename T>
-Iterator<T> &Iterator<T>::operator++() {
-  ++cursor_;
-  find_next();
-  return *this;
+void Metrics::record_update(double seconds, size_t expired) {
+  ++updates_;
+  update_seconds_ += seconds;
+  last_update_seconds_ = seconds;
+  expired_ += expired;
 }
 
-template<typename T>
-bool operator==(Iterator<T> const &lhs, Iterator<T> const &rhs) {
-  return lhs.index() == rhs.index();
+std::string Metrics::name_of(std::vector<std::string> const &names, char const *kind, size_t index) {
+  if (index < names.size() && !names[index].empty()) return names[index];
+  return std::string(kind) + "_" + std::to_string(index);
 }
 
-template<typename T>
-bool operator!=(Iterator<T> const &lhs, Iterator<T> const &rhs) {
-  return !(lhs == rhs);
+void Metrics::set_name(std::vector<std::string> &names, size_t index, std::string const &name) {
+  if (names.size() <= index) names.resize(index + 1);
+  names[index] = name;
 }
 
-template<typename T>
-inline T operator*(Iterator<T> &lhs) {
-  return lhs.entity();
+void Metrics::describe(std::ostream &out, char const *name, char const *type, char const *help) {
+  out << "# HELP " << name << ' ' << help << '\n';
+  out << "# TYPE " << name << ' ' << type << '\n';
 }
 
-template<typename T>
-inline T const &operator*(Iterator<T> const &lhs) {
-  return lhs.entity();
+Metrics::MaskCounts Metrics::count_masks() const {
+  // Entities next to each other mostly have the same mask, so the last count is kept at hand
+  MaskCounts counts;
+  details::ComponentMask last;
+  size_t *count = nullptr;
+  for (details::ComponentMask const &mask : entities_->component_masks_) {
+    if (mask.none()) continue;
+    if (count == nullptr || mask != last) {
+      last = mask;
+      count = &counts[mask];
+    }
+    ++*count;
+  }
+  return counts;
+}
+
+void Metrics::write_entities(std::ostream &out, MaskCounts const &counts) const {
+  EntityManager const &entities = *entities_;
+  describe(out, "ecs_entities", "gauge", "Entities that exist.");
+  out << "ecs_entities " << entities.count_ << '\n';
+  describe(out, "ecs_entity_capacity", "gauge", "Entities there is memory for.");
+  out << "ecs_entity_capacity " << entities.capacity() << '\n';
+
+  // Sorted by label, so that the output does not change between writes
+  std::map<std::string, size_t> by_label;
+  size_t with_components = 0;
+  for (auto const &mask_count : counts) {
+    with_components += mask_count.second;
+    std::string label;
+    for (size_t component = 0; component < mask_count.first.size(); ++component) {
+      if (!mask_count.first.test(component)) continue;
+      if (!label.empty()) label += ',';
+      label += name_of(component_names_, "component", component);
+    }
+    by_label[label] += mask_count.second;
+  }
+  if (entities.count_ > with_components) by_label[""] += entities.count_ - with_components;
+  describe(out, "ecs_entities_by_mask", "gauge", "Entities with each set of components.");
+  for (auto const &label_count : by_label) {
+    out << "ecs_entities_by_mask{components=";
+    details::write_label_value(out, label_count.first);
+    out << "} " << label_count.second << '\n';
+  }
+
+  describe(out, "ecs_expiring_entities", "gauge", "Expiry times that are set and not yet passed.");
+  out << "ecs_expiring_entities " << entities.expiring_count_ << '\n';
+  describe(out, "ecs_expired_entities_total", "counter", "Entities destroyed because they expired.");
+  out << "ecs_expired_entities_total " << expired_ << '\n';
+}
+
+void Metrics::write_components(std::ostream &out, MaskCounts const &counts) const {
+  EntityManager const &entities = *entities_;
+  size_t component_count = entities.component_managers_.size();
+  std::vector<size_t> with_component(component_count, 0);
+  for (auto const &mask_count : counts) {
+    for (size_t component = 0; component < component_count; ++component) {
+      if (mask_count.first.test(component)) with_component[component] += mask_count.second;
+    }
+  }
+  describe(out, "ecs_component_entities", "gauge", "Entities with each component.");
+  for (size_t component = 0; component < component_count; ++component) {
+    if (entities.component_managers_[component] == nullptr) continue;
+    out << "ecs_component_entities{component=";
+    details::write_label_value(out, name_of(component_names_, "component", component));
+    out << "} " << with_component[component] << '\n';
+  }
+  describe(out, "ecs_component_pool_bytes", "gauge", "Memory allocated by the pool of each component.");
+  for (size_t component = 0; component < component_count; ++component) {
+    details::BaseManager *manager = entities.component_managers_[component];
+    if (manager == nullptr) continue;
+    out << "ecs_component_pool_bytes{component=";
+    details::write_label_value(out, name_of(component_names_, "component", component));
+    out << "} " << manager->pool().memory() << '\n';
+  }
+}
+
+void Metrics::write_events(std::ostream &out) const {
+  describe(out, "ecs_events_total", "counter", "Events made readable by swapping each EventChannel.");
+  for (size_t index = 0; index < events_.size(); ++index) {
+    out << "ecs_events_total{events=";
+    details::write_label_value(out, name_of(event_names_, "events", index));
+    out << "} " << events_[index].total << '\n';
+  }
+  describe(out, "ecs_event_backlog", "gauge", "Events emitted between the last two swaps of each EventChannel.");
+  for (size_t index = 0; index < events_.size(); ++index) {
+    out << "ecs_event_backlog{events=";
+    details::write_label_value(out, name_of(event_names_, "events", index));
+    out << "} " << events_[index].backlog << '\n';
+  }
+}
+
+void Metrics::write_systems(std::ostream &out) const {
+  describe(out, "ecs_updates_total", "counter", "Updates of the SystemManager.");
+  out << "ecs_updates_total " << updates_ << '\n';
+  describe(out, "ecs_update_seconds_total", "counter", "Time spent in updates of the SystemManager.");
+  out << "ecs_update_seconds_total " << update_seconds_ << '\n';
+  describe(out, "ecs_update_last_seconds", "gauge", "Time spent in the last update of the SystemManager.");
+  out << "ecs_update_last_seconds " << last_update_seconds_ << '\n';
+
+  describe(out, "ecs_system_updates_total", "counter", "Updates of each system.");
+  for (size_t index = 0; index < systems_.size(); ++index) {
+    if (systems_[index].updates == 0) continue;
+    out << "ecs_system_updates_total{system=";
+    details::write_label_value(out, name_of(system_names_, "system", index));
+    out << "} " << systems_[index].updates << '\n';
+  }
+  describe(out, "ecs_system_seconds_total", "counter", "Time spent in updates of each system.");
+  for (size_t index = 0; index < systems_.size(); ++index) {
+    if (systems_[index].updates == 0) continue;
+    out << "ecs_system_seconds_total{system=";
+    details::write_label_value(out, name_of(system_names_, "system", index));
+    out << "} " << systems_[index].seconds << '\n';
+  }
+  describe(out, "ecs_system_last_seconds", "gauge", "Time spent in the last update of each system.");
+  for (size_t index = 0; index < systems_.size(); ++index) {
+    if (systems_[index].updates == 0) continue;
+    out << "ecs_system_last_seconds{system=";
+    details::write_label_value(out, name_of(system_names_, "system", index));
+    out << "} " << systems_[index].last_seconds << '\n';
+  }
 }
 
 } // namespace ecs
-#endif //ECS_ITERATOR_H
-// #included from: View.h
-#ifndef ECS_VIEW_H
-#define ECS_VIEW_H
+#endif //ECS_METRICS_H
+// #included from: RollbackBuffer.h
+#ifndef ECS_ROLLBACKBUFFER_H
+#define ECS_ROLLBACKBUFFER_H
 
 namespace ecs{
 
+class EntityManager;
+
 ///---------------------------------------------------------------------
-/// Helper class that is used to access the iterator
+/// A RollbackBuffer keeps the state of an EntityManager for the last
+/// number of ticks, so that it can be rewound to any of them.
 ///---------------------------------------------------------------------
-/// @usage Calling entities.with<Components>(), returns a view
-///        that can be used to access the iterator with begin() and
-///        end() that iterates through all entities with specified
-///        Components
+///
+/// Each recorded tick is a fork of the EntityManager (see
+/// EntityManager::fork). Component memory is shared between ticks, so
+/// a tick only holds its own copy of the chunks that were modified
+/// after it was recorded. Recording a tick when the buffer is full
+/// reuses the memory of the oldest tick.
+///
+/// @usage Record every tick, and when a correction arrives for an old
+///        tick, restore that tick and simulate forward again:
+///
+///        history.restore(tick);
+///        for (size_t t = tick + 1; t <= current_tick; ++t) {
+///          systems.update(dt);
+///          history.record(t);
+///        }
+///
 ///---------------------------------------------------------------------
-template<typename T>
-class View {
-  ECS_ASSERT_IS_ENTITY(T)
+class RollbackBuffer: details::forbid_copies {
  public:
-  using iterator        = Iterator<T>;
-  using const_iterator = Iterator<T const &>;
+  inline RollbackBuffer(EntityManager &entities, size_t capacity);
+  inline ~RollbackBuffer();
 
-  View(EntityManager *manager, details::ComponentMask mask);
+  /// Store the current state of the EntityManager as tick. Ticks must
+  /// be recorded in increasing order.
+  inline void record(size_t tick);
 
-  iterator begin();
-  iterator end();
-  const_iterator begin() const;
-  const_iterator end() const;
-  index_t count();
-  template<typename ...Components>
-  View<T>&& with();
+  /// Rewind the EntityManager to the state recorded at tick. Every
+  /// tick recorded after that is discarded.
+  inline void restore(size_t tick);
+
+  /// Check if the state of a tick is stored
+  inline bool contains(size_t tick) const;
+
+  /// Remove every recorded tick
+  inline void clear();
+
+  /// How many ticks that are stored / can be stored
+  inline size_t size() const { return size_; }
+  inline size_t capacity() const { return snapshots_.size(); }
+  inline bool empty() const { return size_ == 0; }
+
+  /// The oldest and newest tick that are stored. Buffer must not be empty
+  inline size_t oldest() const;
+  inline size_t newest() const;
 
  private:
-  EntityManager         *manager_;
-  details::ComponentMask mask_;
+  /// Position in the ring buffer of the i:th oldest tick
+  inline size_t position(size_t i) const { return (first_ + i) % snapshots_.size(); }
 
-  friend class EntityManager;
-}; //View
+  /// Position in the ring buffer where tick is stored, or size() if not stored
+  inline size_t find(size_t tick) const;
+
+  EntityManager                              *entities_;
+  std::vector<std::unique_ptr<EntityManager>> snapshots_;
+  std::vector<size_t>                         ticks_;
+  size_t                                      first_;
+  size_t                                      size_;
+};
 
 } // namespace ecs
 
-// #included from: View.inl
+// #included from: RollbackBuffer.inl
 
 namespace ecs{
 
-template<typename T>
-View<T>::View(EntityManager *manager, details::ComponentMask mask)  :
-    manager_(manager),
-    mask_(mask) { }
+RollbackBuffer::RollbackBuffer(EntityManager &entities, size_t capacity) :
+    entities_(&entities),
+    snapshots_(capacity),
+    ticks_(capacity, 0),
+    first_(0),
+    size_(0) {
+  ECS_ASSERT(capacity > 0, "RollbackBuffer must be able to store at least one tick");
+}
 
-template<typename T>
-typename View<T>::iterator View<T>::begin() {
-  return iterator(manager_, mask_, true);
+RollbackBuffer::~RollbackBuffer() {
+  clear();
 }
 
-template<typename T>
-typename View<T>::iterator View<T>::end() {
-  return iterator(manager_, mask_, false);
+void RollbackBuffer::record(size_t tick) {
+  ECS_ASSERT((empty() || tick > newest()), "Ticks must be recorded in increasing order");
+  size_t pos;
+  if (size_ < capacity()) {
+    pos = position(size_++);
+  } else {
+    // Reuse the oldest tick
+    pos = first_;
+    first_ = position(1);
+  }
+  if (snapshots_[pos]) {
+    snapshots_[pos]->share_state(*entities_);
+  } else {
+    snapshots_[pos] = entities_->fork();
+  }
+  ticks_[pos] = tick;
 }
 
-template<typename T>
-typename View<T>::const_iterator View<T>::begin() const {
-  return const_iterator(manager_, mask_, true);
+void RollbackBuffer::restore(size_t tick) {
+  size_t i = find(tick);
+  ECS_ASSERT(i < size_, "Tick is not stored in RollbackBuffer");
+  entities_->share_state(*snapshots_[position(i)]);
+  // Newer ticks are discarded. Their memory is released first when
+  // reused by record, to keep restore fast.
+  size_ = i + 1;
 }
 
-template<typename T>
-typename View<T>::const_iterator View<T>::end() const {
-  return const_iterator(manager_, mask_, false);
+bool RollbackBuffer::contains(size_t tick) const {
+  return find(tick) < size_;
 }
 
-template<typename T>
-inline index_t View<T>::count() {
-  index_t count = 0;
-  for (auto it = begin(); it != end(); ++it) {
-    ++count;
+void RollbackBuffer::clear() {
+  for (auto &snapshot : snapshots_) {
+    if (snapshot) snapshot->clear_entities();
   }
-  return count;
+  first_ = 0;
+  size_ = 0;
 }
 
-template<typename T> template<typename ...Components>
-View<T>&& View<T>::with() {
-  mask_ |= details::component_mask<Components...>();
-  return *this;
+size_t RollbackBuffer::oldest() const {
+  ECS_ASSERT(!empty(), "RollbackBuffer is empty");
+  return ticks_[position(0)];
+}
+
+size_t RollbackBuffer::newest() const {
+  ECS_ASSERT(!empty(), "RollbackBuffer is empty");
+  return ticks_[position(size_ - 1)];
+}
+
+size_t RollbackBuffer::find(size_t tick) const {
+  // Ticks are increasing, so a binary search is possible
+  size_t low = 0, high = size_;
+  while (low < high) {
+    size_t mid = (low + high) / 2;
+    size_t mid_tick = ticks_[position(mid)];
+    if (mid_tick == tick) return mid;
+    if (mid_tick < tick) low = mid + 1;
+    else high = mid;
+  }
+  return size_;
 }
 
 } // namespace ecs
-#endif //OPENECS_VIEW_H
+#endif //ECS_ROLLBACKBUFFER_H
 // #included from: SystemManager.h
 //
 // Created by Robin Grönberg on 29/11/15.
@@ -2800,6 +8336,15 @@ namespace ecs {
 class EntityManager;
 class System;
 
+/// The phases of SystemManager::update. Every system in a phase is
+/// updated before any system in the next phase.
+enum class Phase {
+  PreUpdate,
+  FixedUpdate,
+  Update,
+  PostUpdate
+};
+
 ///---------------------------------------------------------------------
 /// A SystemManager is responsible for managing Systems.
 ///---------------------------------------------------------------------
@@ -2809,15 +8354,23 @@ class System;
 /// Each system can access the EntityManager and perform operations
 /// on the entities.
 ///
+/// Systems are updated in phases. Systems in Phase::FixedUpdate can
+/// be updated with a fixed time step. A system can also be updated
+/// only every nth update, to spread out the work of systems that
+/// don't need to run every update.
+///
+/// Each update is counted and timed, together with each system, in
+/// metrics(), which can be written for Prometheus.
+///
 ///---------------------------------------------------------------------
 class SystemManager: details::forbid_copies {
  public:
 
-  inline SystemManager(EntityManager &entities) : entities_(&entities) { }
+  inline SystemManager(EntityManager &entities) : entities_(&entities), metrics_(entities) { }
 
   inline ~SystemManager();
 
-  /// Adds a System to this SystemManager.
+  /// Adds a System to this SystemManager. It is updated in Phase::Update
   template<typename S, typename ...Args>
   inline S &add(Args &&... args);
 
@@ -2825,17 +8378,73 @@ class SystemManager: details::forbid_copies {
   template<typename S>
   inline void remove();
 
-  /// Update all attached systems. They are updated in the order they are added
+  /// Update all attached systems. They are updated phase by phase, in the
+  /// order they are added. Expired entities are destroyed first. Then double
+  /// buffered components and event channels are swapped, so that every system
+  /// reads the previous values, and the events emitted, from the last update.
   inline void update(float time);
 
   /// Check if a system is attached.
   template<typename S>
   inline bool exists();
 
+  /// Set in which phase a system is updated
+  template<typename S>
+  inline void set_phase(Phase phase);
+
+  /// Update a system only every nth update of its phase. The system gets
+  /// the time passed since it was last updated. Systems in the same phase
+  /// are staggered, so that as few as possible are updated at the same
+  /// time. The system is staggered again when its phase is set.
+  template<typename S>
+  inline void set_rate_divisor(size_t divisor);
+
+  /// Update systems in Phase::FixedUpdate with a fixed time step. They are
+  /// updated as many times as the passed time allows, but at most max_steps
+  /// times per update. Time left after max_steps is dropped. A time step of
+  /// 0 updates them once per update, with the passed time.
+  inline void set_fixed_time_step(float time_step, size_t max_steps = 8);
+
+  /// How far into the next fixed time step the simulation is, between 0 and 1.
+  /// Can be used to interpolate between fixed updates.
+  inline float fixed_time_alpha() const;
+
+  /// The metrics of the systems, and of the EntityManager
+  inline Metrics &metrics() { return metrics_; }
+  inline Metrics const &metrics() const { return metrics_; }
+
  private:
+  struct Schedule {
+    Phase phase = Phase::Update;
+    size_t divisor = 1;
+    size_t offset = 0;
+    /// Time passed since the system was last updated
+    float time = 0;
+  };
+
+  /// Update every system in a phase, that should be updated this time
+  inline void update_phase(Phase phase, float time);
+
+  template<typename S>
+  inline Schedule &schedule();
+
+  /// Choose the offset of a system, among the systems in its phase
+  inline void stagger(size_t index);
+
+  static inline double seconds_since(std::chrono::steady_clock::time_point start);
+
   std::vector<System *> systems_;
+  std::vector<Schedule> schedules_;
   std::vector<size_t> order_;
   EntityManager *entities_;
+  Metrics metrics_;
+
+  /// How many times each phase has been updated
+  size_t phase_updates_[4] = {0, 0, 0, 0};
+  float fixed_time_step_ = 0;
+  size_t max_fixed_steps_ = 8;
+  /// Time passed that is not yet used by a fixed time step
+  float fixed_time_ = 0;
 
   friend class System;
 };
@@ -2905,9 +8514,11 @@ S& SystemManager::add(Args &&... args) {
   ECS_ASSERT_IS_SYSTEM(S);
   ECS_ASSERT(!exists<S>(), "System already exists");
   systems_.resize(details::system_index<S>() + 1);
+  schedules_.resize(systems_.size());
   S *system = new S(std::forward<Args>(args) ...);
   system->manager_ = this;
   systems_[details::system_index<S>()] = system;
+  schedules_[details::system_index<S>()] = Schedule();
   order_.push_back(details::system_index<S>());
   return *system;
 }
@@ -2927,8 +8538,44 @@ void SystemManager::remove() {
 }
 
 void SystemManager::update(float time) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  size_t expired = entities_->update_expiry(time);
+  entities_->swap_buffers();
+  entities_->swap_events();
+  metrics_.record_events();
+  update_phase(Phase::PreUpdate, time);
+  if (fixed_time_step_ > 0) {
+    fixed_time_ += time;
+    size_t steps = 0;
+    for (; fixed_time_ >= fixed_time_step_ && steps < max_fixed_steps_; ++steps) {
+      update_phase(Phase::FixedUpdate, fixed_time_step_);
+      fixed_time_ -= fixed_time_step_;
+    }
+    // Catching up is capped, to not fall further behind when steps are too slow
+    if (fixed_time_ >= fixed_time_step_) {
+      fixed_time_ = std::fmod(fixed_time_, fixed_time_step_);
+    }
+  } else {
+    update_phase(Phase::FixedUpdate, time);
+  }
+  update_phase(Phase::Update, time);
+  update_phase(Phase::PostUpdate, time);
+  metrics_.record_update(seconds_since(start), expired);
+}
+
+void SystemManager::update_phase(Phase phase, float time) {
+  size_t updates = phase_updates_[static_cast<size_t>(phase)]++;
   for (auto index : order_) {
-    systems_[index]->update(time);
+    Schedule &schedule = schedules_[index];
+    if (schedule.phase != phase) continue;
+    schedule.time += time;
+    if ((updates + schedule.offset) % schedule.divisor == 0) {
+      float passed = schedule.time;
+      schedule.time = 0;
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      systems_[index]->update(passed);
+      metrics_.record_system(index, seconds_since(start));
+    }
   }
 }
 
@@ -2938,6 +8585,66 @@ inline bool SystemManager::exists() {
   return systems_.size() > details::system_index<S>() && systems_[details::system_index<S>()] != nullptr;
 }
 
+template<typename S>
+void SystemManager::set_phase(Phase phase) {
+  schedule<S>().phase = phase;
+  stagger(details::system_index<S>());
+}
+
+template<typename S>
+void SystemManager::set_rate_divisor(size_t divisor) {
+  ECS_ASSERT(divisor > 0, "Rate divisor must be at least 1");
+  schedule<S>().divisor = divisor;
+  stagger(details::system_index<S>());
+}
+
+void SystemManager::stagger(size_t index) {
+  Schedule &schedule = schedules_[index];
+  // Use the first offset where the system is updated together with the fewest other systems in its phase
+  size_t best_offset = 0;
+  size_t best_shared = std::numeric_limits<size_t>::max();
+  for (size_t offset = 0; offset < schedule.divisor; ++offset) {
+    size_t shared = 0;
+    for (auto other_index : order_) {
+      Schedule const &other = schedules_[other_index];
+      // Systems that are updated every time are shared by every offset
+      if (other_index == index || other.phase != schedule.phase || other.divisor == 1) continue;
+      // The updates of the system repeat with respect to the other system after other.divisor of them
+      for (size_t n = 1; n <= other.divisor; ++n) {
+        size_t update = n * schedule.divisor - offset;
+        if ((update + other.offset) % other.divisor == 0) ++shared;
+      }
+    }
+    if (shared < best_shared) {
+      best_offset = offset;
+      best_shared = shared;
+    }
+  }
+  schedule.offset = best_offset;
+}
+
+void SystemManager::set_fixed_time_step(float time_step, size_t max_steps) {
+  ECS_ASSERT(time_step >= 0, "Fixed time step can't be negative");
+  ECS_ASSERT(max_steps > 0, "At least one fixed step must be allowed per update");
+  fixed_time_step_ = time_step;
+  max_fixed_steps_ = max_steps;
+  fixed_time_ = 0;
+}
+
+float SystemManager::fixed_time_alpha() const {
+  return fixed_time_step_ > 0 ? fixed_time_ / fixed_time_step_ : 0;
+}
+
+double SystemManager::seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template<typename S>
+SystemManager::Schedule &SystemManager::schedule() {
+  ECS_ASSERT(exists<S>(), "System does not exist");
+  return schedules_[details::system_index<S>()];
+}
+
 } // namespace ecs
 #endif //OPENECS_SYSTEM_MANAGER_H
 #endif //ECS_MAIN_INCLUDE
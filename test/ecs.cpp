@@ -16,6 +16,10 @@
 
 #include <iostream>
 #include <stdexcept>
+#include <thread>
+#include <algorithm>
+#include <sstream>
+#include <cstring>
 #include "common/thirdparty/catch.hpp"
 
 #define ECS_ASSERT(Expr, Msg) if(!(Expr)) throw std::runtime_error(Msg);
@@ -76,6 +80,14 @@ struct Wheels {
   int number;
 };
 
+struct Damage {
+  int amount;
+};
+
+struct Target {
+  Handle entity;
+};
+
 struct Car: EntityAlias<Wheels> {
 
   Car(float x, float y) : Car() {
@@ -120,6 +132,84 @@ struct RemoveDeadEntitiesSystem: System {
   }
 };
 
+struct MoveSystem: System {
+  virtual void update(float time) {
+    entities().with([time](Position &position, Velocity &velocity) {
+      position.x += velocity.x * time;
+      position.y += velocity.y * time;
+    });
+  }
+};
+
+// Reads the positions from the last update, while MoveSystem writes the current ones
+struct TrailSystem: System {
+  std::vector<Position> trail;
+
+  virtual void update(float time) {
+    trail.clear();
+    for (auto entity : entities().with<Position, Velocity>()) {
+      trail.push_back(entity.previous<Position>());
+    }
+  }
+};
+
+// Logs its id and the time passed, every time it is updated
+template<int N>
+struct LogSystem: System {
+  std::vector<std::pair<int, float>> &log;
+
+  LogSystem(std::vector<std::pair<int, float>> &log) : log(log) { }
+
+  virtual void update(float time) {
+    log.push_back(std::make_pair(N, time));
+  }
+};
+
+// Emits two Damage events every update
+struct DamageSystem: System {
+  virtual void update(float time) {
+    entities().events<Damage>().emit(Damage{1});
+    entities().events<Damage>().emit(Damage{2});
+  }
+};
+
+template<int N>
+struct StressComponent {
+  int value;
+};
+
+template<int N>
+struct StressSystem: System {
+  int sum = 0;
+
+  virtual void update(float time) {
+    entities().with([&](StressComponent<N> &component) {
+      sum += component.value;
+    });
+  }
+};
+
+// Every call touches the component types in a different order, so that
+// threads are likely to register the same types at the same time
+template<int N>
+void run_stress_world(int seed, int &result) {
+  EntityManager entities;
+  SystemManager systems(entities);
+  auto &system = systems.add<StressSystem<N>>();
+  for (int i = 0; i < 100; ++i) {
+    Entity entity = entities.create();
+    switch ((i + seed) % 4) {
+      case 0: entity.add<StressComponent<0>>(1); break;
+      case 1: entity.add<StressComponent<1>>(1); break;
+      case 2: entity.add<StressComponent<2>>(1); break;
+      default: entity.add<StressComponent<3>>(1); break;
+    }
+    entity.add<StressComponent<N>>(1);
+  }
+  systems.update(0);
+  result = system.sum;
+}
+
 }
 
 SCENARIO("Testing ecs framework, unittests") {
@@ -806,4 +896,1991 @@ SCENARIO("Testing ecs framework, unittests") {
       }
     }
   }
-}
\ No newline at end of file
+}
+
+SCENARIO("Running independent worlds on different threads") {
+  GIVEN("Many worlds, each running on its own thread") {
+    const int num_of_worlds = 32;
+    std::vector<int> results(num_of_worlds, 0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_of_worlds; ++i) {
+      int &result = results[i];
+      switch (i % 4) {
+        case 0: threads.emplace_back([i, &result] { run_stress_world<4>(i, result); }); break;
+        case 1: threads.emplace_back([i, &result] { run_stress_world<5>(i, result); }); break;
+        case 2: threads.emplace_back([i, &result] { run_stress_world<6>(i, result); }); break;
+        default: threads.emplace_back([i, &result] { run_stress_world<7>(i, result); }); break;
+      }
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    THEN("Every world should have updated all of its entities") {
+      for (int result : results) {
+        REQUIRE(result == 100);
+      }
+    }
+    THEN("Every component type should have gotten a unique index") {
+      std::vector<size_t> indexes = {
+          details::component_index<StressComponent<0>>(), details::component_index<StressComponent<1>>(),
+          details::component_index<StressComponent<2>>(), details::component_index<StressComponent<3>>(),
+          details::component_index<StressComponent<4>>(), details::component_index<StressComponent<5>>(),
+          details::component_index<StressComponent<6>>(), details::component_index<StressComponent<7>>()
+      };
+      std::sort(indexes.begin(), indexes.end());
+      REQUIRE(std::unique(indexes.begin(), indexes.end()) == indexes.end());
+    }
+    THEN("Every system type should have gotten a unique index") {
+      std::vector<size_t> indexes = {
+          details::system_index<StressSystem<4>>(), details::system_index<StressSystem<5>>(),
+          details::system_index<StressSystem<6>>(), details::system_index<StressSystem<7>>()
+      };
+      std::sort(indexes.begin(), indexes.end());
+      REQUIRE(std::unique(indexes.begin(), indexes.end()) == indexes.end());
+    }
+  }
+}
+
+SCENARIO("Creating entities from other threads using shards") {
+  GIVEN("An EntityManager with some entities") {
+    EntityManager entities;
+    entities.create_with<Position, Velocity>(Position{0, 0}, Velocity{0, 0});
+    WHEN("Creating entities with shards on different threads") {
+      const int num_of_shards = 4;
+      const int entities_per_shard = 1000;
+      std::vector<EntityShard<Position, Velocity>> shards;
+      for (int i = 0; i < num_of_shards; ++i) {
+        shards.push_back(entities.create_shard<Position, Velocity>(entities_per_shard));
+      }
+      std::vector<Id> last_ids(num_of_shards);
+      std::vector<std::thread> threads;
+      for (int i = 0; i < num_of_shards; ++i) {
+        EntityShard<Position, Velocity> &shard = shards[i];
+        Id &last_id = last_ids[i];
+        threads.emplace_back([&shard, &last_id, i] {
+          for (int j = 0; j < entities_per_shard; ++j) {
+            last_id = shard.create(Position{float(i), float(j)}, Velocity{1, 1});
+          }
+        });
+      }
+      // The EntityManager can be used while the shards are filled
+      for (int i = 0; i < 100; ++i) {
+        entities.create_with<Position, Velocity>(Position{0, 0}, Velocity{0, 0});
+      }
+      for (auto &thread : threads) {
+        thread.join();
+      }
+      THEN("Entities are not visible before the shards are merged") {
+        REQUIRE(entities.count() == 101);
+        REQUIRE((entities.with<Position, Velocity>().count() == 101));
+      }
+      AND_WHEN("Merging the shards") {
+        for (auto &shard : shards) {
+          entities.merge(shard);
+        }
+        THEN("All entities should be visible") {
+          REQUIRE(entities.count() == 101 + num_of_shards * entities_per_shard);
+          int moving = 0;
+          entities.with([&](Position &position, Velocity &velocity) {
+            if (velocity.x == 1) ++moving;
+          });
+          REQUIRE(moving == num_of_shards * entities_per_shard);
+        }
+        THEN("Merging a shard twice should not work") {
+          REQUIRE_THROWS(entities.merge(shards[0]));
+        }
+        THEN("Unused slots should be reused by new entities") {
+          Entity entity = entities.create_with<Position, Velocity>(Position{0, 0}, Velocity{0, 0});
+          REQUIRE(entity.id().index() == last_ids.back().index() + 1);
+        }
+      }
+    }
+    WHEN("Creating an entity with a shard") {
+      auto shard = entities.create_shard<Position, Velocity>(10);
+      Id id = shard.create(Position{1, 2}, Velocity{3, 4});
+      entities.merge(shard);
+      THEN("The returned id should refer to the created entity") {
+        Entity entity = entities[id];
+        REQUIRE(entity.get<Position>().y == 2);
+        REQUIRE(entity.get<Velocity>().x == 3);
+      }
+    }
+    WHEN("A shard is destroyed without being merged") {
+      index_t first;
+      {
+        auto shard = entities.create_shard<Position, Velocity>(128);
+        first = shard.create(Position{1, 2}, Velocity{3, 4}).index();
+        auto moved = std::move(shard);
+      }
+      std::vector<Entity> created;
+      for (int i = 0; i < 128; ++i) {
+        created.push_back(entities.create_with<Height>(i));
+      }
+      THEN("Its blocks should be given to other entities") {
+        REQUIRE(entities.count() == 129);
+        for (Entity &entity : created) {
+          REQUIRE(entity.id().index() >= first);
+          REQUIRE(entity.id().index() < first + 128);
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("Moving entities between EntityManagers") {
+  GIVEN("A world and a region built in another EntityManager") {
+    EntityManager world;
+    EntityManager region;
+    for (int i = 0; i < 10; ++i) {
+      world.create_with<Position>(Position{-1, float(i)});
+    }
+    std::vector<Id> region_ids;
+    for (int i = 0; i < 200; ++i) {
+      Entity entity = region.create_with<Position, Velocity>(Position{1, float(i)}, Velocity{0, 0});
+      if (i % 2 == 0) entity.add<Name>("Region entity");
+      region_ids.push_back(entity.id());
+    }
+    region[region_ids[5]].destroy();
+    WHEN("Merging the region into the world") {
+      auto remap = world.merge(std::move(region));
+      THEN("The world should have all entities") {
+        REQUIRE(world.count() == 10 + 199);
+        REQUIRE(world.with<Position>().count() == 10 + 199);
+        REQUIRE(world.with<Name>().count() == 100);
+      }
+      THEN("The region should be empty") {
+        REQUIRE(region.count() == 0);
+        REQUIRE(region.with<Position>().count() == 0);
+      }
+      THEN("Old ids should map to entities with the same components") {
+        REQUIRE(remap.size() == 199);
+        for (auto &pair : remap) {
+          Entity entity = world[pair.second];
+          REQUIRE(entity.get<Position>().x == 1);
+          REQUIRE(entity.get<Position>().y == float(pair.first.index()));
+          if (entity.has<Name>()) {
+            REQUIRE(entity.get<Name>() == "Region entity");
+          }
+        }
+      }
+      THEN("New entities can be created in both EntityManagers") {
+        world.create_with<Position, Velocity>(Position{2, 2}, Velocity{0, 0});
+        region.create_with<Position, Velocity>(Position{2, 2}, Velocity{0, 0});
+        REQUIRE(world.count() == 10 + 199 + 1);
+        REQUIRE(region.count() == 1);
+      }
+    }
+    WHEN("Moving entities with names from the region to the world") {
+      auto remap = region.move_entities(region.with<Name>(), world);
+      THEN("Only entities with names should be moved") {
+        REQUIRE(remap.size() == 100);
+        REQUIRE(region.count() == 99);
+        REQUIRE(world.count() == 110);
+        REQUIRE(world.with<Name>().count() == 100);
+        REQUIRE(region.with<Name>().count() == 0);
+      }
+      THEN("Moved entities should keep their components") {
+        for (auto &pair : remap) {
+          Entity entity = world[pair.second];
+          REQUIRE(entity.get<Name>() == "Region entity");
+          REQUIRE(entity.get<Position>().y == float(pair.first.index()));
+        }
+      }
+    }
+    WHEN("Moving every entity with a velocity from the region to the world") {
+      Entity first = region[region_ids[0]];
+      auto remap = region.move_entities(region.with<Velocity>(), world);
+      THEN("Every entity should be moved") {
+        REQUIRE(remap.size() == 199);
+        REQUIRE(region.count() == 0);
+        REQUIRE(world.count() == 209);
+        REQUIRE(!first.is_valid());
+      }
+      THEN("Moved entities should keep their components") {
+        for (auto &pair : remap) {
+          Entity entity = world[pair.second];
+          REQUIRE(entity.get<Position>().y == float(pair.first.index()));
+          REQUIRE(entity.has<Name>() == (pair.first.index() % 2 == 0));
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("Forking an EntityManager") {
+  GIVEN("An EntityManager with entities and a fork of it") {
+    EntityManager entities;
+    std::vector<Entity> created;
+    for (int i = 0; i < 200; ++i) {
+      Entity entity = entities.create_with<Position, Velocity>(Position{float(i), 0}, Velocity{1, 1});
+      entity.add<Name>("Original");
+      created.push_back(entity);
+    }
+    auto fork = entities.fork();
+    Entity forked = (*fork)[created[10].id()];
+    THEN("The fork should have the same entities") {
+      REQUIRE(fork->count() == 200);
+      REQUIRE((fork->with<Position, Velocity, Name>().count() == 200));
+      REQUIRE(forked.get<Position>().x == 10);
+      REQUIRE(forked.get<Name>() == "Original");
+    }
+    WHEN("Modifying components in the fork") {
+      fork->with([](Position &position, Name &name) {
+        position.y = 5;
+        name.value = "Forked";
+      });
+      THEN("The fork should be modified") {
+        REQUIRE(forked.get<Position>().y == 5);
+        REQUIRE(forked.get<Name>() == "Forked");
+      }
+      THEN("The original should not be modified") {
+        REQUIRE(created[10].get<Position>().y == 0);
+        REQUIRE(created[10].get<Name>() == "Original");
+      }
+    }
+    WHEN("Modifying components in the original") {
+      created[10].get<Position>().y = 7;
+      THEN("The fork should not be modified") {
+        REQUIRE(forked.get<Position>().y == 0);
+        REQUIRE(created[10].get<Position>().y == 7);
+      }
+    }
+    WHEN("Adding, removing and destroying in the fork") {
+      forked.remove<Name>();
+      forked.add<Height>(5);
+      (*fork)[created[11].id()].destroy();
+      fork->create_with<Position>(Position{-1, -1});
+      THEN("The fork should be modified") {
+        REQUIRE(!forked.has<Name>());
+        REQUIRE(forked.get<Height>() == 5);
+        REQUIRE(fork->count() == 200);
+        REQUIRE(fork->with<Name>().count() == 198);
+      }
+      THEN("The original should not be modified") {
+        REQUIRE(created[10].get<Name>() == "Original");
+        REQUIRE(!created[10].has<Height>());
+        REQUIRE(created[11].is_valid());
+        REQUIRE(entities.count() == 200);
+        REQUIRE(entities.with<Name>().count() == 200);
+      }
+    }
+    WHEN("The original is destroyed before the fork") {
+      auto fork_of_fork = fork->fork();
+      fork.reset();
+      THEN("The remaining fork should still have all components") {
+        REQUIRE((*fork_of_fork)[created[10].id()].get<Name>() == "Original");
+        REQUIRE(fork_of_fork->with<Name>().count() == 200);
+      }
+    }
+  }
+}
+
+SCENARIO("Rolling back an EntityManager to an earlier tick") {
+  GIVEN("An EntityManager where ticks are recorded") {
+    EntityManager entities;
+    RollbackBuffer history(entities, 8);
+    std::vector<Entity> created;
+    for (int i = 0; i < 100; ++i) {
+      created.push_back(entities.create_with<Position, Name>(Position{0, 0}, "Entity"));
+    }
+    // Each tick moves every entity, and creates and destroys one entity
+    for (size_t tick = 0; tick < 10; ++tick) {
+      entities.with([tick](Position &position) {
+        position.x = float(tick);
+      });
+      entities.create_with<Position, Name>(Position{float(tick), 0}, "Created");
+      created[tick].destroy();
+      history.record(tick);
+    }
+    THEN("Only the last ticks should be stored") {
+      REQUIRE(history.size() == 8);
+      REQUIRE(history.oldest() == 2);
+      REQUIRE(history.newest() == 9);
+      REQUIRE(!history.contains(1));
+      REQUIRE(history.contains(2));
+      REQUIRE_THROWS(history.restore(1));
+    }
+    THEN("Recording an older tick should not work") {
+      REQUIRE_THROWS(history.record(5));
+    }
+    WHEN("Restoring an earlier tick") {
+      Entity entity = created[50];
+      history.restore(5);
+      THEN("The EntityManager should have the state of that tick") {
+        REQUIRE(entities.count() == 100);
+        REQUIRE(entity.get<Position>().x == 5);
+        REQUIRE(entity.get<Name>() == "Entity");
+        REQUIRE(!created[5].is_valid());
+        REQUIRE(created[6].is_valid());
+        REQUIRE(entities.with<Name>().count() == 100);
+      }
+      THEN("Newer ticks should be discarded") {
+        REQUIRE(history.newest() == 5);
+        REQUIRE(!history.contains(6));
+      }
+      AND_WHEN("Simulating forward again") {
+        for (size_t tick = 6; tick < 12; ++tick) {
+          entities.with([](Position &position) {
+            position.y = 1;
+          });
+          history.record(tick);
+        }
+        THEN("The recorded ticks should have the new state") {
+          REQUIRE(history.oldest() == 4);
+          REQUIRE(history.newest() == 11);
+          history.restore(4);
+          REQUIRE(entity.get<Position>().x == 4);
+          REQUIRE(entity.get<Position>().y == 0);
+          history.restore(4);
+          REQUIRE(entity.get<Position>().x == 4);
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("Recording ticks that only change a few entities") {
+  GIVEN("An EntityManager with small chunks, where ticks are recorded") {
+    EntityManager entities(64);
+    RollbackBuffer history(entities, 2);
+    std::vector<Entity> created;
+    for (int i = 0; i < 300; ++i) {
+      created.push_back(entities.create_with<Name>("Entity"));
+    }
+    // Each tick only renames the first entity, so the oldest tick is
+    // overwritten with chunks that are mostly shared already
+    for (size_t tick = 0; tick < 6; ++tick) {
+      created[0].get<Name>().value = "Tick " + std::to_string(tick);
+      history.record(tick);
+    }
+    WHEN("Restoring the oldest tick") {
+      history.restore(4);
+      THEN("Every entity should have the name it had at that tick") {
+        REQUIRE(created[0].get<Name>() == "Tick 4");
+        REQUIRE(created[299].get<Name>() == "Entity");
+        REQUIRE(entities.with<Name>().count() == 300);
+      }
+    }
+  }
+}
+
+SCENARIO("Double buffered components") {
+  GIVEN("An EntityManager with double buffered positions") {
+    EntityManager entities;
+    std::vector<Entity> created;
+    for (int i = 0; i < 200; ++i) {
+      created.push_back(entities.create_with<Position, Velocity>(Position{float(i), 0}, Velocity{1, 2}));
+    }
+    entities.double_buffer<Position>();
+    THEN("The previous value should be the value when double buffering started") {
+      REQUIRE(created[10].previous<Position>().x == 10);
+    }
+    THEN("Components that are not double buffered should not have previous values") {
+      REQUIRE_THROWS(created[10].previous<Velocity>());
+    }
+    WHEN("Modifying positions without swapping buffers") {
+      created[10].get<Position>().x = 100;
+      THEN("Only the current value should be modified") {
+        REQUIRE(created[10].get<Position>().x == 100);
+        REQUIRE(created[10].previous<Position>().x == 10);
+        REQUIRE(created[11].previous<Position>().x == 11);
+      }
+      AND_WHEN("Swapping buffers") {
+        entities.swap_buffers();
+        THEN("The previous value should be the modified value") {
+          REQUIRE(created[10].previous<Position>().x == 100);
+          REQUIRE(created[11].previous<Position>().x == 11);
+        }
+      }
+    }
+    WHEN("Updating systems that read previous positions, after systems that write them") {
+      SystemManager systems(entities);
+      systems.add<MoveSystem>();
+      auto &trail = systems.add<TrailSystem>().trail;
+      systems.update(1);
+      systems.update(1);
+      THEN("Positions should be moved every update") {
+        REQUIRE(created[10].get<Position>().x == 12);
+        REQUIRE(created[10].get<Position>().y == 4);
+      }
+      THEN("The reading system should see the positions from the last update") {
+        REQUIRE(trail.size() == 200);
+        REQUIRE(created[10].previous<Position>().x == 11);
+        REQUIRE(created[10].previous<Position>().y == 2);
+        REQUIRE(std::find_if(trail.begin(), trail.end(), [](Position const &position) {
+          return position.x == 11 && position.y == 2;
+        }) != trail.end());
+      }
+    }
+    WHEN("Removing and adding positions after swapping buffers") {
+      entities.swap_buffers();
+      created[10].remove<Position>();
+      created[11].set<Position>(-1.0f, -1.0f);
+      THEN("The previous values should be kept") {
+        REQUIRE(created[10].previous<Position>().x == 10);
+        REQUIRE(created[11].previous<Position>().x == 11);
+        REQUIRE(created[11].get<Position>().x == -1);
+      }
+    }
+    WHEN("Creating an entity after swapping buffers") {
+      entities.swap_buffers();
+      Entity entity = entities.create_with<Position, Velocity>(Position{1000, 0}, Velocity{1, 2});
+      THEN("Its previous value should be its current value") {
+        REQUIRE(entity.previous<Position>().x == 1000);
+      }
+    }
+    WHEN("Destroying an entity, and creating another at its index, after swapping buffers") {
+      created[10].set<Position>(111.0f, 0.0f);
+      entities.swap_buffers();
+      index_t index = created[10].id().index();
+      created[10].destroy();
+      Entity entity = entities.create_with<Position, Velocity>(Position{5, 0}, Velocity{1, 2});
+      REQUIRE(entity.id().index() == index);
+      THEN("Its previous value should be its current value") {
+        REQUIRE(entity.previous<Position>().x == 5);
+      }
+    }
+    WHEN("Adding a position to an entity after swapping buffers") {
+      Entity entity = entities.create_with<Velocity>(Velocity{1, 2});
+      entities.swap_buffers();
+      entity.add<Position>(7.0f, 0.0f);
+      THEN("Its previous value should be its current value") {
+        REQUIRE(entity.previous<Position>().x == 7);
+      }
+    }
+    WHEN("Forking the EntityManager") {
+      std::unique_ptr<EntityManager> fork = entities.fork();
+      Entity entity = (*fork)[created[10].id()];
+      entity.get<Position>().x = 100;
+      fork->swap_buffers();
+      entity.get<Position>().x = 200;
+      THEN("The fork should double buffer the positions too") {
+        REQUIRE(entity.previous<Position>().x == 100);
+        REQUIRE(created[10].previous<Position>().x == 10);
+      }
+    }
+  }
+}
+
+SCENARIO("Updating systems in phases, with fixed time steps and rate divisors") {
+  GIVEN("A SystemManager with systems in different phases") {
+    EntityManager entities;
+    SystemManager systems(entities);
+    std::vector<std::pair<int, float>> log;
+    systems.add<LogSystem<0>>(log);
+    systems.add<LogSystem<1>>(log);
+    systems.add<LogSystem<2>>(log);
+    systems.add<LogSystem<3>>(log);
+    systems.set_phase<LogSystem<0>>(Phase::PostUpdate);
+    systems.set_phase<LogSystem<1>>(Phase::FixedUpdate);
+    systems.set_phase<LogSystem<3>>(Phase::PreUpdate);
+    WHEN("Updating once") {
+      systems.update(0.5f);
+      THEN("Systems should be updated phase by phase") {
+        REQUIRE(log.size() == 4);
+        REQUIRE(log[0].first == 3);
+        REQUIRE(log[1].first == 1);
+        REQUIRE(log[2].first == 2);
+        REQUIRE(log[3].first == 0);
+        REQUIRE(log[1].second == 0.5f);
+      }
+    }
+    WHEN("Using a fixed time step") {
+      systems.set_fixed_time_step(0.25f, 4);
+      systems.update(0.6f);
+      THEN("Fixed update systems should be updated once per passed time step") {
+        REQUIRE(std::count(log.begin(), log.end(), std::make_pair(1, 0.25f)) == 2);
+        REQUIRE(systems.fixed_time_alpha() == Approx(0.4f));
+      }
+      AND_WHEN("Updating with the time that is left") {
+        log.clear();
+        systems.update(0.15f);
+        THEN("The time left from the last update should be used") {
+          REQUIRE(std::count(log.begin(), log.end(), std::make_pair(1, 0.25f)) == 1);
+          REQUIRE(systems.fixed_time_alpha() == Approx(0));
+        }
+      }
+      AND_WHEN("Updating with more time than max steps allow") {
+        log.clear();
+        systems.update(10.1f);
+        THEN("Only max steps should be updated, and the rest of the time dropped") {
+          REQUIRE(std::count(log.begin(), log.end(), std::make_pair(1, 0.25f)) == 4);
+          REQUIRE(systems.fixed_time_alpha() < 1);
+        }
+      }
+    }
+    WHEN("Updating systems with the same rate divisor") {
+      systems.set_rate_divisor<LogSystem<0>>(2);
+      systems.set_phase<LogSystem<1>>(Phase::PostUpdate);
+      systems.set_rate_divisor<LogSystem<1>>(2);
+      for (int i = 0; i < 4; ++i) {
+        systems.update(1);
+      }
+      THEN("Each system should be updated every nth time, at different updates") {
+        REQUIRE(std::count(log.begin(), log.end(), std::make_pair(0, 1.0f)) == 1);
+        REQUIRE(std::count(log.begin(), log.end(), std::make_pair(0, 2.0f)) == 1);
+        REQUIRE(std::count(log.begin(), log.end(), std::make_pair(1, 2.0f)) == 2);
+        REQUIRE(std::count(log.begin(), log.end(), std::make_pair(2, 1.0f)) == 4);
+        for (size_t i = 1; i < log.size(); ++i) {
+          REQUIRE(!(log[i - 1].first == 0 && log[i].first == 1));
+          REQUIRE(!(log[i - 1].first == 1 && log[i].first == 0));
+        }
+      }
+    }
+    WHEN("Setting the rate divisor of a system before its phase") {
+      systems.set_rate_divisor<LogSystem<0>>(2);
+      systems.set_rate_divisor<LogSystem<1>>(2);
+      systems.set_phase<LogSystem<1>>(Phase::PostUpdate);
+      for (int i = 0; i < 4; ++i) {
+        systems.update(1);
+      }
+      THEN("The systems should still be updated at different updates") {
+        REQUIRE(std::count(log.begin(), log.end(), std::make_pair(1, 2.0f)) == 2);
+        for (size_t i = 1; i < log.size(); ++i) {
+          REQUIRE(!(log[i - 1].first == 0 && log[i].first == 1));
+          REQUIRE(!(log[i - 1].first == 1 && log[i].first == 0));
+        }
+      }
+    }
+    WHEN("Updating systems with different rate divisors") {
+      systems.set_rate_divisor<LogSystem<0>>(2);
+      systems.set_phase<LogSystem<1>>(Phase::PostUpdate);
+      systems.set_rate_divisor<LogSystem<1>>(4);
+      for (int i = 0; i < 8; ++i) {
+        systems.update(1);
+      }
+      THEN("The systems should not be updated at the same time") {
+        REQUIRE(std::count(log.begin(), log.end(), std::make_pair(1, 4.0f)) == 2);
+        for (size_t i = 1; i < log.size(); ++i) {
+          REQUIRE(!(log[i - 1].first == 0 && log[i].first == 1));
+          REQUIRE(!(log[i - 1].first == 1 && log[i].first == 0));
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("Iterating through entities over several updates with a Cursor") {
+  GIVEN("An EntityManager with entities and a Cursor") {
+    EntityManager entities;
+    std::vector<Entity> created;
+    for (int i = 0; i < 100; ++i) {
+      created.push_back(entities.create_with<Position>(Position{float(i), 0}));
+    }
+    entities.create_with<Velocity>(Velocity{0, 0});
+    Cursor<EntityAlias<Position>> cursor;
+    auto visit = [](EntityAlias<Position> entity) {
+      entity.get<Position>().y += 1;
+    };
+    WHEN("Visiting a limited number of entities per call") {
+      size_t first = cursor.for_each(entities.with<Position>(), 30, visit);
+      size_t second = cursor.for_each(entities.with<Position>(), 30, visit);
+      THEN("Each call should continue where the last call stopped") {
+        REQUIRE(first == 30);
+        REQUIRE(second == 30);
+        REQUIRE(created[59].get<Position>().y == 1);
+        REQUIRE(created[60].get<Position>().y == 0);
+        REQUIRE(cursor.passes() == 0);
+      }
+      AND_WHEN("Reaching the end") {
+        size_t third = cursor.for_each(entities.with<Position>(), 30, visit);
+        size_t fourth = cursor.for_each(entities.with<Position>(), 30, visit);
+        THEN("The call should stop at the end, and the next call start from the beginning") {
+          REQUIRE(third == 30);
+          REQUIRE(fourth == 10);
+          REQUIRE(cursor.passes() == 1);
+          REQUIRE(cursor.index() == 0);
+          REQUIRE(std::all_of(created.begin(), created.end(), [](Entity entity) {
+            return entity.get<Position>().y == 1;
+          }));
+        }
+      }
+      AND_WHEN("Entities are created and destroyed between calls") {
+        created[70].destroy();
+        created[10].destroy();
+        Entity added = entities.create_with<Position>(Position{0, 0});
+        size_t visited = 0;
+        while (cursor.passes() == 0) {
+          visited += cursor.for_each(entities.with<Position>(), 30, visit);
+        }
+        THEN("Destroyed entities should be skipped and new entities visited in the next pass") {
+          size_t added_ahead = added.id().index() >= 60 ? 1 : 0;
+          REQUIRE(visited == 39 + added_ahead);
+          REQUIRE(created[99].get<Position>().y == 1);
+          cursor.for_each(entities.with<Position>(), 1000, visit);
+          REQUIRE(added.get<Position>().y >= 1);
+          REQUIRE(created[0].get<Position>().y == 2);
+        }
+      }
+    }
+    WHEN("Visiting entities with a time budget") {
+      size_t none = cursor.for_each(entities.with<Position>(), std::chrono::seconds(0), visit);
+      size_t all = cursor.for_each(entities.with<Position>(), std::chrono::seconds(60), visit);
+      THEN("Entities should be visited until the time is spent") {
+        REQUIRE(none == 0);
+        REQUIRE(all == 100);
+        REQUIRE(cursor.passes() == 1);
+      }
+    }
+  }
+}
+
+SCENARIO("Expiring entities after a time") {
+  GIVEN("An EntityManager with entities set to expire") {
+    EntityManager entities;
+    entities.set_expiry_resolution(0.1f);
+    Entity soon = entities.create_with<Position>(Position{0, 0});
+    Entity later = entities.create_with<Position>(Position{0, 0});
+    Entity much_later = entities.create_with<Position>(Position{0, 0});
+    Entity never = entities.create_with<Position>(Position{0, 0});
+    soon.expire_in(0.5f);
+    later.expire_in(1);
+    much_later.expire_in(3600);
+    THEN("Changing the resolution should not work") {
+      REQUIRE_THROWS(entities.set_expiry_resolution(1));
+    }
+    WHEN("Less time than any expiry time has passed") {
+      size_t destroyed = entities.update_expiry(0.45f);
+      THEN("No entity should be destroyed") {
+        REQUIRE(destroyed == 0);
+        REQUIRE(soon.is_valid());
+      }
+    }
+    WHEN("Time passes in small steps") {
+      size_t destroyed = 0;
+      for (int i = 0; i < 5; ++i) {
+        destroyed += entities.update_expiry(0.1f);
+      }
+      THEN("Entities should be destroyed when they expire") {
+        REQUIRE(destroyed == 1);
+        REQUIRE(!soon.is_valid());
+        REQUIRE(later.is_valid());
+      }
+    }
+    WHEN("Much time passes at once") {
+      size_t destroyed = entities.update_expiry(3600.5f);
+      THEN("Every expired entity should be destroyed") {
+        REQUIRE(destroyed == 3);
+        REQUIRE(!much_later.is_valid());
+        REQUIRE(never.is_valid());
+        REQUIRE(entities.count() == 1);
+      }
+    }
+    WHEN("An entity is destroyed before it expires, and its index is reused") {
+      soon.destroy();
+      Entity reused = entities.create_with<Position>(Position{0, 0});
+      REQUIRE(reused.id().index() == soon.id().index());
+      size_t destroyed = entities.update_expiry(0.6f);
+      THEN("The new entity should not be destroyed") {
+        REQUIRE(destroyed == 0);
+        REQUIRE(reused.is_valid());
+      }
+    }
+    WHEN("The expiry time of an entity is changed") {
+      soon.expire_in(2);
+      later.expire_in(0.2f);
+      entities.update_expiry(1.5f);
+      THEN("The entity should expire at the new time") {
+        REQUIRE(soon.is_valid());
+        REQUIRE(!later.is_valid());
+        entities.update_expiry(0.5f);
+        REQUIRE(!soon.is_valid());
+      }
+    }
+    WHEN("Every entity set to expire is destroyed") {
+      later.expire_in(2);
+      REQUIRE(entities.expiring_count() == 3);
+      soon.destroy();
+      later.destroy();
+      much_later.destroy();
+      THEN("The resolution should be possible to change") {
+        REQUIRE(entities.expiring_count() == 0);
+        REQUIRE_NOTHROW(entities.set_expiry_resolution(1));
+      }
+    }
+    WHEN("Merging the entities into an EntityManager with another resolution") {
+      EntityManager world;
+      world.set_expiry_resolution(0.05f);
+      world.update_expiry(0.3f);
+      entities.update_expiry(0.2f);
+      auto remap = world.merge(std::move(entities));
+      Entity merged_soon = world[remap[0].second];
+      Entity merged_later = world[remap[1].second];
+      THEN("The entities should expire after the time that remained") {
+        REQUIRE(entities.expiring_count() == 0);
+        REQUIRE(world.expiring_count() == 3);
+        REQUIRE(world.update_expiry(0.25f) == 0);
+        REQUIRE(world.update_expiry(0.05f) == 1);
+        REQUIRE(!merged_soon.is_valid());
+        REQUIRE(merged_later.is_valid());
+        REQUIRE(world.update_expiry(0.5f) == 1);
+        REQUIRE(!merged_later.is_valid());
+      }
+    }
+    WHEN("Moving the entities to another EntityManager, whole blocks and one at a time") {
+      EntityManager world;
+      world.update_expiry(1);
+      for (int i = 0; i < ECS_CACHE_LINE_SIZE; ++i) {
+        entities.create_with<Velocity>(Velocity{0, 0}).expire_in(0.5f);
+      }
+      entities.update_expiry(0.2f);
+      entities.move_entities(entities.with<Position>(), world);
+      entities.move_entities(entities.with<Velocity>(), world);
+      THEN("The entities should expire after the time that remained") {
+        REQUIRE(entities.expiring_count() == 0);
+        REQUIRE(world.expiring_count() == 3 + ECS_CACHE_LINE_SIZE);
+        REQUIRE(world.update_expiry(0.25f) == 0);
+        REQUIRE(world.update_expiry(0.05f) == 1 + ECS_CACHE_LINE_SIZE);
+        REQUIRE(world.with<Velocity>().count() == 0);
+        REQUIRE(world.count() == 3);
+        REQUIRE(world.expiring_count() == 2);
+      }
+    }
+    WHEN("Updating systems") {
+      SystemManager systems(entities);
+      systems.update(0.5f);
+      THEN("Expired entities should be destroyed") {
+        REQUIRE(!soon.is_valid());
+        REQUIRE(later.is_valid());
+      }
+    }
+  }
+}
+
+SCENARIO("Sending events between systems with an EventChannel") {
+  GIVEN("An EntityManager with an EventChannel and two Readers") {
+    EntityManager entities;
+    EventChannel<Damage> &channel = entities.events<Damage>();
+    auto first = channel.reader();
+    auto second = channel.reader();
+    auto sum = [](EventChannel<Damage>::Reader &reader) {
+      int total = 0;
+      reader.read([&](Damage const &damage) { total += damage.amount; });
+      return total;
+    };
+    channel.emit(Damage{1});
+    channel.emplace(Damage{2});
+    THEN("Events should not be readable before the channel is swapped") {
+      REQUIRE(channel.empty());
+      REQUIRE(first.unread() == 0);
+      REQUIRE(&entities.events<Damage>() == &channel);
+    }
+    WHEN("Swapping the channel") {
+      entities.swap_events();
+      THEN("Every Reader should read each event once") {
+        REQUIRE(channel.size() == 2);
+        REQUIRE(first.unread() == 2);
+        REQUIRE(sum(first) == 3);
+        REQUIRE(sum(first) == 0);
+        REQUIRE(sum(second) == 3);
+      }
+      AND_WHEN("Swapping again, without reading") {
+        channel.emit(Damage{4});
+        entities.swap_events();
+        THEN("The Reader should only read events that are still readable") {
+          REQUIRE(sum(first) == 4);
+          REQUIRE(first.missed() == 2);
+        }
+      }
+    }
+    WHEN("Emitting events from different threads") {
+      const int num_of_threads = 4;
+      const int events_per_thread = 10000;
+      std::vector<std::thread> threads;
+      for (int i = 0; i < num_of_threads; ++i) {
+        threads.emplace_back([&channel] {
+          auto writer = channel.writer();
+          for (int j = 0; j < events_per_thread; ++j) {
+            writer.emit(Damage{1});
+          }
+        });
+      }
+      for (auto &thread : threads) {
+        thread.join();
+      }
+      SystemManager systems(entities);
+      systems.update(1);
+      THEN("Every event should be readable after the update") {
+        REQUIRE(channel.size() == 2 + num_of_threads * events_per_thread);
+        REQUIRE(sum(first) == 3 + num_of_threads * events_per_thread);
+      }
+      AND_WHEN("Getting a new Writer") {
+        {
+          auto writer = channel.writer();
+          writer.emit(Damage{5});
+        }
+        systems.update(1);
+        THEN("Buffers of destroyed Writers should be reused") {
+          REQUIRE(channel.size() == 1);
+          REQUIRE(channel.events()[0].amount == 5);
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("Splitting a View into ranges and blocks") {
+  GIVEN("An EntityManager with entities") {
+    EntityManager entities;
+    for (int i = 0; i < 1000; ++i) {
+      if (i % 3 == 0) entities.create_with<Velocity>(Velocity{0, 0});
+      else entities.create_with<Position>(Position{0, 0});
+    }
+    size_t positions = entities.with<Position>().count();
+    WHEN("Splitting a View") {
+      auto views = entities.with<Position>().split(4);
+      THEN("The Views should cover every entity once, with about as many entities each") {
+        REQUIRE(views.size() == 4);
+        size_t total = 0;
+        for (size_t i = 0; i < views.size(); ++i) {
+          size_t count = views[i].count();
+          size_t balanced = positions / 4;
+          REQUIRE((count + ECS_CACHE_LINE_SIZE > balanced));
+          REQUIRE((count < balanced + ECS_CACHE_LINE_SIZE));
+          if (i > 0) REQUIRE(views[i].first() == views[i - 1].last());
+          total += count;
+        }
+        REQUIRE(total == positions);
+      }
+      AND_WHEN("Updating the Views from different threads") {
+        std::vector<std::thread> threads;
+        for (auto &view : views) {
+          threads.emplace_back([view]() mutable {
+            for (auto entity : view) {
+              entity.get<Position>().x += 1;
+            }
+          });
+        }
+        for (auto &thread : threads) {
+          thread.join();
+        }
+        THEN("Every entity should be updated once") {
+          entities.with([](Position &position) {
+            REQUIRE(position.x == 1);
+          });
+        }
+      }
+    }
+    WHEN("Splitting a View into more Views than there are blocks") {
+      auto views = entities.with<Position>().split(100);
+      THEN("Some Views should be empty") {
+        size_t total = 0;
+        for (auto &view : views) {
+          total += view.count();
+        }
+        REQUIRE(views.size() == 100);
+        REQUIRE(total == positions);
+      }
+    }
+    WHEN("Iterating through the blocks of a View") {
+      auto blocks = entities.with<Position>().blocks();
+      THEN("The blocks should be accessible in any order") {
+        using category = std::iterator_traits<decltype(blocks.begin())>::iterator_category;
+        REQUIRE((std::is_same<category, std::input_iterator_tag>::value));
+        REQUIRE(blocks.size() > 1000 / ECS_CACHE_LINE_SIZE);
+        REQUIRE((blocks.end() - blocks.begin()) == blocks.size());
+        REQUIRE(blocks.begin()[1].first() == ECS_CACHE_LINE_SIZE);
+        REQUIRE((*(blocks.end() - 1)).first() == (blocks.size() - 1) * ECS_CACHE_LINE_SIZE);
+        size_t total = 0;
+        std::for_each(blocks.begin(), blocks.end(), [&total](View<EntityAlias<Position>> block) {
+          total += block.count();
+        });
+        REQUIRE(total == positions);
+      }
+    }
+    WHEN("Iterating through a range of a View") {
+      auto range = View<EntityAlias<Position>>(&entities, details::component_mask<Position>(), 100, 300);
+      THEN("Only entities within the range should be visited") {
+        index_t within = 0;
+        for (auto entity : entities.with<Position>()) {
+          if (entity.id().index() >= 100 && entity.id().index() < 300) ++within;
+        }
+        REQUIRE(range.count() == within);
+        REQUIRE(range.begin().index() >= 100);
+      }
+    }
+  }
+}
+
+SCENARIO("Scanning component masks") {
+  GIVEN("Component masks with different components") {
+    std::vector<details::ComponentMask> masks;
+    for (size_t i = 0; i < 64; ++i) {
+      masks.push_back(details::ComponentMask((i * 2654435761u) >> 7));
+    }
+    details::ComponentMask mask = masks[5] & masks[9];
+    THEN("Every way of scanning should find the same masks") {
+      for (size_t count = 0; count <= masks.size(); ++count) {
+        uint64_t expected = details::match_masks_scalar(masks.data(), count, mask);
+        REQUIRE(details::match_masks(masks.data(), count, mask) == expected);
+#ifdef ECS_SSE2
+        REQUIRE(details::match_masks_sse2(masks.data(), count, mask) == expected);
+#endif
+#ifdef ECS_AVX2_DISPATCH
+        if (details::has_avx2()) {
+          REQUIRE(details::match_masks_avx2(masks.data(), count, mask) == expected);
+        }
+#endif
+      }
+      REQUIRE(details::count_matches(masks.data(), masks.size(), mask) ==
+          details::count_bits(details::match_masks_scalar(masks.data(), masks.size(), mask)));
+    }
+  }
+  GIVEN("An EntityManager with entities") {
+    EntityManager entities;
+    std::vector<Entity> created;
+    for (int i = 0; i < 200; ++i) {
+      created.push_back(entities.create_with<Position>(Position{float(i), 0}));
+    }
+    WHEN("Entities lose their components while iterating") {
+      int visited = 0;
+      for (auto entity : entities.with<Position>()) {
+        ++visited;
+        index_t next = entity.id().index() + 1;
+        if (next < created.size() && created[next].is_valid()) created[next].destroy();
+      }
+      THEN("They should not be visited") {
+        REQUIRE(visited == 100);
+      }
+    }
+    WHEN("Entities gain components while iterating") {
+      created[0].add<Velocity>(Velocity{0, 0});
+      std::vector<index_t> visited;
+      for (auto entity : entities.with<Position, Velocity>()) {
+        visited.push_back(entity.id().index());
+        if (visited.size() == 1) {
+          // One in the group of 64 that is scanned already, and one in a later group
+          created[1].add<Velocity>(Velocity{0, 0});
+          created[100].add<Velocity>(Velocity{0, 0});
+        }
+      }
+      THEN("Only those in groups that are not scanned yet should be visited") {
+        REQUIRE(visited.size() == 2);
+        REQUIRE(visited[0] == created[0].id().index());
+        REQUIRE(visited[1] == created[100].id().index());
+      }
+    }
+  }
+}
+
+SCENARIO("Prefetching components while iterating with a lambda") {
+  GIVEN("An EntityManager with entities") {
+    EntityManager entities;
+    for (int i = 0; i < 100; ++i) {
+      entities.create_with<Position, Velocity>(Position{0, 0}, Velocity{1, 1});
+    }
+    THEN("Every entity should be visited once, for any prefetch distance") {
+      size_t distances[] = {0, 1, 99, 100, 1000};
+      for (size_t distance : distances) {
+        entities.set_prefetch_distance(distance);
+        int visited = 0;
+        entities.with([&visited](Position &position, Velocity &velocity, Entity entity) {
+          position.x += velocity.x;
+          ++visited;
+        });
+        REQUIRE(visited == 100);
+      }
+      entities.with([](Position &position) {
+        REQUIRE(position.x == 5);
+      });
+    }
+  }
+}
+
+SCENARIO("Iterating with a lambda over many blocks") {
+  GIVEN("An EntityManager with entities spread over blocks with different components") {
+    EntityManager entities;
+    for (int i = 0; i < 1000; ++i) {
+      if (i % 5 == 0) entities.create_with<Position>(Position{float(i), 0});
+      else entities.create_with<Position, Velocity>(Position{float(i), 0}, Velocity{float(i), 0});
+    }
+    WHEN("Iterating with a lambda") {
+      std::vector<index_t> visited;
+      entities.with([&visited](Position &position, Velocity &velocity, Entity entity) {
+        REQUIRE(position.x == velocity.x);
+        visited.push_back(entity.id().index());
+      });
+      THEN("The same entities should be visited as with an iterator, in the same order") {
+        std::vector<index_t> expected;
+        for (auto entity : entities.with<Position, Velocity>()) {
+          expected.push_back(entity.id().index());
+        }
+        REQUIRE(visited == expected);
+        REQUIRE(visited.size() == 800);
+      }
+    }
+    WHEN("Removing components of the next entity while iterating") {
+      std::vector<Entity> moving;
+      std::map<index_t, size_t> position_of;
+      for (auto entity : entities.with<Velocity>()) {
+        position_of[entity.id().index()] = moving.size();
+        moving.push_back(entity);
+      }
+      int visited = 0;
+      entities.with([&](Velocity &velocity, Entity entity) {
+        ++visited;
+        size_t next = position_of[entity.id().index()] + 1;
+        if (next < moving.size() && moving[next].has<Velocity>()) moving[next].remove<Velocity>();
+      });
+      THEN("Entities without the component should not be visited") {
+        REQUIRE(visited == entities.with<Velocity>().count());
+      }
+    }
+  }
+}
+
+SCENARIO("Reducing components on several threads") {
+  GIVEN("An EntityManager with entities spread over many blocks") {
+    EntityManager entities;
+    for (int i = 0; i < 5000; ++i) {
+      if (i % 3 == 0) entities.create_with<Position>(Position{float(i), 0});
+      else entities.create_with<Position, Weight>(Position{float(i), 0}, (i * 37) % 1001 - 500);
+    }
+    int expected_sum = 0, expected_min = 0, expected_max = 0;
+    size_t expected_count = 0;
+    for (auto entity : entities.with<Weight>()) {
+      int weight = entity.get<Weight>();
+      if (expected_count == 0 || weight < expected_min) expected_min = weight;
+      if (expected_count == 0 || weight > expected_max) expected_max = weight;
+      expected_sum += weight;
+      ++expected_count;
+    }
+    THEN("The built-in reductions should match a reduction on one thread") {
+      size_t threads[] = {0, 1, 2, 3, 8};
+      for (size_t thread_count : threads) {
+        REQUIRE(entities.sum<Weight>(thread_count) == expected_sum);
+        REQUIRE(entities.min<Weight>(thread_count) == expected_min);
+        REQUIRE(entities.max<Weight>(thread_count) == expected_max);
+      }
+      REQUIRE(entities.count<Weight>() == expected_count);
+      size_t with_both = entities.count<Position, Weight>();
+      REQUIRE(with_both == expected_count);
+      REQUIRE(entities.count<Position>() == 5000);
+    }
+    THEN("Floating point results should not depend on the number of threads") {
+      auto map = [](Position const &position, Weight const &weight) { return position.x / (weight.value + 0.5f); };
+      auto combine = [](float a, float b) { return a + b; };
+      float one_thread = entities.reduce<Position, Weight>(1.5f, map, combine, 1);
+      size_t threads[] = {0, 2, 5, 16};
+      for (size_t thread_count : threads) {
+        float result = entities.reduce<Position, Weight>(1.5f, map, combine, thread_count);
+        REQUIRE(result == one_thread);
+      }
+    }
+    THEN("Small reductions should run on the calling thread, unless a thread count is given") {
+      using reduce = details::reduce_t<Weight>;
+      size_t cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+      REQUIRE(reduce::thread_count(5, 0) == 1);
+      REQUIRE(reduce::thread_count(5, 8) == 5);
+      REQUIRE(reduce::thread_count(ECS_REDUCE_SLICES_PER_THREAD * 2, 0) == std::min<size_t>(cores, 2));
+      REQUIRE(reduce::thread_count(5, 0, 1) == std::min<size_t>(cores, 5));
+    }
+    THEN("minmax_by should give the first entities with the smallest and largest key") {
+      auto minmax = entities.minmax_by<Weight>([](Weight const &weight) { return weight.value; }, 4);
+      REQUIRE(minmax.count == expected_count);
+      REQUIRE(minmax.min == expected_min);
+      REQUIRE(minmax.max == expected_max);
+      Entity smallest = entities[minmax.min_id];
+      Entity largest = entities[minmax.max_id];
+      REQUIRE(smallest.get<Weight>() == expected_min);
+      REQUIRE(largest.get<Weight>() == expected_max);
+      for (auto entity : entities.with<Weight>()) {
+        if (entity.get<Weight>() == expected_min) {
+          REQUIRE(entity == smallest);
+          break;
+        }
+      }
+    }
+    WHEN("No entity has the components") {
+      THEN("The initial or a default value should be given") {
+        REQUIRE(entities.sum<Height>() == 0);
+        REQUIRE(entities.count<Velocity>() == 0);
+        int reduced = entities.reduce<Weight, Velocity>(7, [](Weight const &, Velocity const &) { return 1; },
+                                                        [](int a, int b) { return a + b; });
+        REQUIRE(reduced == 7);
+        auto minmax = entities.minmax_by<Position, Velocity>(
+            [](Position const &position, Velocity const &) { return position.x; });
+        REQUIRE(minmax.count == 0);
+      }
+    }
+  }
+}
+
+SCENARIO("Keeping aggregates of components up to date") {
+  GIVEN("An EntityManager with entities that have weights") {
+    EntityManager entities;
+    std::vector<Entity> created;
+    for (int i = 0; i < 10; ++i) {
+      created.push_back(entities.create_with<Weight>(i));
+    }
+    auto &total = entities.aggregate_sum<Weight>();
+    auto &parity = entities.aggregate_count_by<Weight>([](Weight const &weight) { return weight.value % 2; });
+    auto &heaviest = entities.aggregate<Weight>(0,
+        [](int &count, Weight const &weight) { if (weight.value >= 100) ++count; },
+        [](int &count, Weight const &weight) { if (weight.value >= 100) --count; });
+    THEN("Existing components should be aggregated") {
+      REQUIRE(total.value() == 45);
+      REQUIRE(parity.value().at(0) == 5);
+      REQUIRE(parity.value().at(1) == 5);
+      REQUIRE(heaviest.value() == 0);
+    }
+    WHEN("Adding, setting, removing and destroying components") {
+      Entity entity = entities.create();
+      entity.add<Weight>(100);
+      created[1].set<Weight>(101);
+      created[2].remove<Weight>();
+      created[3].destroy();
+      entities.create().add<Weight>(1000);
+      THEN("The aggregates should be updated") {
+        REQUIRE(total.value() == 45 + 100 + 100 - 2 - 3 + 1000);
+        REQUIRE(parity.value().at(0) == 6);
+        REQUIRE(parity.value().at(1) == 4);
+        REQUIRE(heaviest.value() == 3);
+        REQUIRE(total.value() == entities.sum<Weight>());
+      }
+    }
+    WHEN("Every entity with an odd weight is removed") {
+      for (auto entity : entities.with<Weight>()) {
+        if (entity.get<Weight>() % 2) entity.destroy();
+      }
+      THEN("The key should no longer be counted") {
+        REQUIRE(parity.value().size() == 1);
+        REQUIRE(parity.value().count(1) == 0);
+      }
+    }
+    WHEN("A component is changed through a reference, so that its key is not counted") {
+      auto &by_weight = entities.aggregate_count_by<Weight>([](Weight const &weight) { return weight.value; });
+      created[2].get<Weight>().value = 3;
+      created[4].get<Weight>().value = 1001;
+      THEN("Removing the component should not work") {
+        REQUIRE_NOTHROW(created[2].remove<Weight>());
+        REQUIRE(by_weight.value().count(3) == 0);
+        REQUIRE_THROWS(created[4].remove<Weight>());
+      }
+    }
+    WHEN("Entities are moved in bulk between EntityManagers") {
+      EntityManager other;
+      auto &other_total = other.aggregate_sum<Weight>();
+      for (int i = 0; i < 100; ++i) other.create_with<Weight>(1);
+      entities.merge(std::move(other));
+      THEN("The aggregates should be computed again") {
+        REQUIRE(total.value() == 145);
+        REQUIRE(other_total.value() == 0);
+      }
+    }
+    WHEN("Entities are moved to another EntityManager, whole blocks and one at a time") {
+      for (int i = 0; i < 128; ++i) entities.create_with<Weight>(1);
+      EntityManager other;
+      other.create_with<Weight>(1000);
+      auto &other_total = other.aggregate_sum<Weight>();
+      auto &other_parity = other.aggregate_count_by<Weight>([](Weight const &weight) { return weight.value % 2; });
+      entities.move_entities(entities.with<Weight>(), other);
+      THEN("The moved entities should be aggregated by the other EntityManager only") {
+        REQUIRE(total.value() == 0);
+        REQUIRE(parity.value().empty());
+        REQUIRE(other_total.value() == 45 + 128 + 1000);
+        REQUIRE(other_total.value() == other.sum<Weight>());
+        REQUIRE(other_parity.value().at(1) == 5 + 128);
+      }
+    }
+    WHEN("Entities are created with a shard") {
+      auto shard = entities.create_shard<Weight>(10);
+      std::thread([&shard]() {
+        for (int i = 0; i < 10; ++i) shard.create(10);
+      }).join();
+      entities.merge(shard);
+      THEN("The entities should be aggregated when merged") {
+        REQUIRE(total.value() == 145);
+      }
+    }
+  }
+}
+
+SCENARIO("Selecting the top entities and quantiles of component values") {
+  GIVEN("An EntityManager with entities spread over many slices") {
+    EntityManager entities;
+    std::vector<int> weights;
+    for (int i = 0; i < 20000; ++i) {
+      int weight = (i * 7919) % 10007;
+      weights.push_back(weight);
+      Entity entity = entities.create_with<Weight>(weight);
+      if (i % 2) entity.add<Height>(i);
+    }
+    std::sort(weights.begin(), weights.end());
+    THEN("top_k should give the entities with the largest values, largest first") {
+      size_t threads[] = {1, 3, 0};
+      for (size_t thread_count : threads) {
+        std::vector<Id> top = entities.top_k<Weight>(10, thread_count);
+        REQUIRE(top.size() == 10);
+        for (size_t i = 0; i < top.size(); ++i) {
+          REQUIRE(entities[top[i]].get<Weight>() == weights[weights.size() - 1 - i]);
+        }
+      }
+    }
+    THEN("top_k should be limited by a View, and by the number of entities") {
+      std::vector<Id> top = entities.top_k<Weight>(20000, entities.with<Weight, Height>());
+      REQUIRE(top.size() == 10000);
+      for (size_t i = 0; i < top.size(); ++i) {
+        REQUIRE(entities[top[i]].has<Height>());
+        if (i > 0) REQUIRE(entities[top[i - 1]].get<Weight>() >= entities[top[i]].get<Weight>());
+      }
+      REQUIRE(entities.top_k<Weight>(0).empty());
+    }
+    THEN("top_k_by should order equal keys by index") {
+      std::vector<Id> top = entities.top_k_by<Weight>(5, [](Weight const &weight) { return weight.value % 2; });
+      for (size_t i = 1; i < top.size(); ++i) {
+        REQUIRE(top[i - 1].index() < top[i].index());
+      }
+    }
+    THEN("Quantiles should be close to the exact ones") {
+      std::vector<double> qs = {0, 0.1, 0.5, 0.9, 1};
+      std::vector<int> values = entities.quantiles<Weight>(qs, 2);
+      REQUIRE(values.size() == qs.size());
+      for (size_t i = 0; i < qs.size(); ++i) {
+        int exact = weights[size_t(qs[i] * (weights.size() - 1))];
+        REQUIRE(std::abs(values[i] - exact) <= 10007 / 64);
+      }
+      REQUIRE(entities.quantile<Weight>(0.5, 1) == values[2]);
+      REQUIRE(entities.quantile<Mana>(0.5) == 0);
+    }
+  }
+}
+
+SCENARIO("Finding entities by Guid") {
+  GIVEN("An EntityManager with entities that have Guids") {
+    EntityManager entities;
+    std::vector<Entity> created;
+    for (uint64_t i = 0; i < 1000; ++i) {
+      created.push_back(entities.create_with<Guid, Position>(i * 1000003, Position{float(i), 0}));
+    }
+    THEN("Every entity should be found by its Guid") {
+      for (uint64_t i = 0; i < 1000; ++i) {
+        Entity entity = entities.find_guid(i * 1000003);
+        REQUIRE(entity == created[i]);
+        REQUIRE(entity.get<Position>().x == float(i));
+      }
+      REQUIRE_FALSE(entities.find_guid(1).is_valid());
+    }
+    WHEN("Entities are created, destroyed and given new Guids after the first lookup") {
+      entities.find_guid(0);
+      for (uint64_t i = 0; i < 1000; i += 2) {
+        created[i].destroy();
+      }
+      for (uint64_t i = 1; i < 1000; i += 4) {
+        created[i].set<Guid>(i);
+      }
+      Entity added = entities.create();
+      added.add<Guid>(uint64_t(-1));
+      for (uint64_t i = 0; i < 10000; ++i) {
+        entities.create_with<Guid>(uint64_t(1) << 40 | i);
+      }
+      THEN("The index should be kept up to date") {
+        for (uint64_t i = 0; i < 1000; ++i) {
+          if (i % 2 == 0) {
+            REQUIRE_FALSE(entities.find_guid(i * 1000003).is_valid());
+          } else if (i % 4 == 1) {
+            REQUIRE_FALSE(entities.find_guid(i * 1000003).is_valid());
+            REQUIRE(entities.find_guid(i) == created[i]);
+          } else {
+            REQUIRE(entities.find_guid(i * 1000003) == created[i]);
+          }
+        }
+        REQUIRE(entities.find_guid(uint64_t(-1)) == added);
+        for (uint64_t i = 0; i < 10000; ++i) {
+          REQUIRE(entities.find_guid(uint64_t(1) << 40 | i).get<Guid>() == (uint64_t(1) << 40 | i));
+        }
+      }
+    }
+    WHEN("A Guid is changed through a reference") {
+      entities.find_guid(0);
+      index_t index = created[5].id().index();
+      created[5].get<Guid>().value = 7;
+      Entity unchanged = entities.find_guid(5 * 1000003);
+      created[5].destroy();
+      Entity reused = entities.create_with<Guid, Position>(8, Position{0, 0});
+      REQUIRE(reused.id().index() == index);
+      THEN("The old Guid should not find any entity") {
+        REQUIRE_FALSE(unchanged.is_valid());
+        REQUIRE_FALSE(entities.find_guid(5 * 1000003).is_valid());
+        REQUIRE_FALSE(entities.find_guid(7).is_valid());
+        REQUIRE(entities.find_guid(8) == reused);
+      }
+      THEN("The old Guid should be possible to use again") {
+        Entity entity = entities.create_with<Guid>(5 * 1000003);
+        REQUIRE(entities.find_guid(5 * 1000003) == entity);
+      }
+    }
+    WHEN("The EntityManager is forked") {
+      std::unique_ptr<EntityManager> fork = entities.fork();
+      THEN("Entities should be found in the fork") {
+        REQUIRE(fork->find_guid(5 * 1000003).get<Position>().x == 5);
+      }
+    }
+  }
+}
+
+SCENARIO("Exporting components as columns") {
+  // Columns are read where they are, so the exported data is copied to 8 byte aligned memory
+  auto read = [](std::string const &data) {
+    std::vector<uint64_t> memory((data.size() + 7) / 8);
+    std::memcpy(memory.data(), data.data(), data.size());
+    return memory;
+  };
+  GIVEN("An EntityManager with entities that have some of the components") {
+    EntityManager entities;
+    std::vector<Entity> created;
+    for (int i = 0; i < 1000; ++i) {
+      Entity entity = entities.create_with<Position>(Position{float(i), float(-i)});
+      if (i % 3 == 0) entity.add<Height>(i % 100);
+      if (i % 5 == 0) entity.add<Velocity>(Velocity{float(i), 0.f});
+      created.push_back(entity);
+    }
+    for (int i = 0; i < 1000; i += 7) {
+      created[i].destroy();
+    }
+    entities.create_with<Wheels>(4);
+    WHEN("Position and Height are exported") {
+      std::ostringstream out;
+      entities.export_columns<Position, Height>(out);
+      std::string data = out.str();
+      std::vector<uint64_t> memory = read(data);
+      Columns columns(memory.data(), data.size());
+      THEN("Each entity with any of the components should be a row") {
+        REQUIRE(columns.rows() == entities.count<Position>());
+        REQUIRE(columns.columns() == 2);
+        REQUIRE(columns.null_count(0) == 0);
+        REQUIRE(columns.null_count(1) == entities.count<Position>() - entities.count<Height>());
+        Position const *positions = columns.values<Position>(0);
+        Height const *height = columns.values<Height>(1);
+        for (size_t row = 0; row < columns.rows(); ++row) {
+          Entity entity = entities[columns.id(row)];
+          REQUIRE(entity.is_valid());
+          REQUIRE(columns.is_valid(0, row));
+          REQUIRE(positions[row].x == entity.get<Position>().x);
+          REQUIRE(positions[row].y == entity.get<Position>().y);
+          REQUIRE(columns.is_valid(1, row) == entity.has<Height>());
+          REQUIRE(height[row] == (entity.has<Height>() ? entity.get<Height>().value : 0));
+          if (row > 0) REQUIRE(columns.indexes()[row - 1] < columns.indexes()[row]);
+        }
+      }
+    }
+    WHEN("Components of the entities within a View are exported") {
+      std::ostringstream out;
+      entities.export_columns<Velocity, Wheels>(out, entities.with<Velocity>());
+      std::string data = out.str();
+      std::vector<uint64_t> memory = read(data);
+      Columns columns(memory.data(), data.size());
+      THEN("Each entity in the view should be a row") {
+        REQUIRE(columns.rows() == entities.count<Velocity>());
+        REQUIRE(columns.null_count(1) == columns.rows());
+        for (size_t row = 0; row < columns.rows(); ++row) {
+          Entity entity = entities[columns.id(row)];
+          REQUIRE(columns.values<Velocity>(0)[row].x == entity.get<Velocity>().x);
+          REQUIRE_FALSE(columns.is_valid(1, row));
+        }
+      }
+    }
+    WHEN("A component no entity has is exported") {
+      std::ostringstream out;
+      entities.export_columns<Damage>(out);
+      std::string data = out.str();
+      std::vector<uint64_t> memory = read(data);
+      Columns columns(memory.data(), data.size());
+      THEN("There should be no rows") {
+        REQUIRE(columns.rows() == 0);
+        REQUIRE(columns.columns() == 1);
+      }
+    }
+    WHEN("A fork is exported on another thread, while the EntityManager is modified") {
+      std::unique_ptr<EntityManager> fork = entities.fork();
+      std::ostringstream out;
+      std::thread exporter([&fork, &out] { fork->export_columns<Position, Height>(out); });
+      for (Entity entity : entities.with<Position>()) {
+        entity.get<Position>().x += 1;
+      }
+      exporter.join();
+      std::string data = out.str();
+      std::vector<uint64_t> memory = read(data);
+      Columns columns(memory.data(), data.size());
+      THEN("The columns should have the values from when it was forked") {
+        REQUIRE(columns.rows() == fork->count<Position>());
+        for (size_t row = 0; row < columns.rows(); ++row) {
+          REQUIRE(columns.values<Position>(0)[row].x == float(columns.indexes()[row]));
+        }
+      }
+    }
+    WHEN("Other data is read as columns") {
+      uint64_t memory[8] = {};
+      THEN("It should be rejected") {
+        REQUIRE_THROWS(Columns(memory, sizeof(memory)));
+      }
+    }
+  }
+}
+
+SCENARIO("Importing entities from exported columns") {
+  GIVEN("Exported columns of entities with some of the components") {
+    EntityManager source;
+    // More rows than are read in one batch
+    for (int i = 0; i < ECS_IMPORT_BATCH_SIZE + 5000; ++i) {
+      Entity entity = source.create_with<Position>(Position{float(i), float(-i)});
+      if (i % 3 == 0) entity.add<Height>(i);
+      if (i % 64 == 5) entity.remove<Position>();
+    }
+    std::stringstream stream;
+    source.export_columns<Position, Height>(stream);
+    stream << "after";
+    size_t rows = source.count<Position>() + source.count<Height>() - source.count<Position, Height>();
+    WHEN("They are imported into an EntityManager that already has entities") {
+      EntityManager entities;
+      std::vector<Entity> existing;
+      for (int i = 0; i < 100; ++i) {
+        existing.push_back(entities.create_with<Position>(Position{-1.f, -1.f}));
+      }
+      existing[10].destroy();
+      existing[20].destroy();
+      auto &total = entities.aggregate_sum<Height>();
+      std::vector<std::pair<size_t, size_t>> progress;
+      size_t imported = entities.import_columns<Position, Height>(stream, [&progress](size_t done, size_t total) {
+        progress.push_back(std::make_pair(done, total));
+      });
+      THEN("An entity should be created for each row, with the same components") {
+        REQUIRE(imported == rows);
+        REQUIRE(entities.count() == 98 + rows);
+        REQUIRE(entities.count<Height>() == source.count<Height>());
+        size_t both = source.count<Position, Height>();
+        size_t imported_both = entities.count<Position, Height>();
+        REQUIRE(imported_both == both);
+        REQUIRE(entities.sum<Height>() == source.sum<Height>());
+        REQUIRE(total.value() == source.sum<Height>());
+        std::vector<float> expected, found;
+        source.with([&expected](Position &position) { expected.push_back(position.x); });
+        entities.with([&found](Position &position) { if (position.x >= 0) found.push_back(position.x); });
+        std::sort(found.begin(), found.end());
+        REQUIRE(found == expected);
+        for (auto entity : entities.with<Position, Height>()) {
+          REQUIRE(int(entity.get<Position>().x) == entity.get<Height>().value);
+        }
+      }
+      THEN("Progress should be reported after each batch") {
+        REQUIRE(progress.size() > 1);
+        REQUIRE(progress.back() == std::make_pair(rows, rows));
+        REQUIRE(progress.size() == (rows + ECS_IMPORT_BATCH_SIZE - 1) / ECS_IMPORT_BATCH_SIZE);
+      }
+      THEN("The stream should be left after the columns") {
+        std::string after;
+        stream >> after;
+        REQUIRE(after == "after");
+      }
+      THEN("Existing entities should be kept") {
+        REQUIRE(existing[0].is_valid());
+        REQUIRE(existing[0].get<Position>().x == -1.f);
+        REQUIRE_FALSE(existing[10].is_valid());
+      }
+    }
+    WHEN("They are imported as other components") {
+      EntityManager entities;
+      THEN("It should fail") {
+        REQUIRE_THROWS(entities.import_columns<Velocity>(stream));
+      }
+    }
+  }
+}
+
+SCENARIO("Reusing blocks of destroyed entities for other components") {
+  GIVEN("An EntityManager where every entity with some components is destroyed") {
+    EntityManager entities;
+    std::vector<Entity> rare, common;
+    for (int i = 0; i < 200; ++i) rare.push_back(entities.create_with<Position>(Position{1.f, 1.f}));
+    for (int i = 0; i < 10; ++i) common.push_back(entities.create_with<Height>(1));
+    for (Entity &entity : rare) entity.destroy();
+    WHEN("Entities with other components are created") {
+      std::vector<Entity> created = entities.create(128);
+      for (int i = 0; i < 128; ++i) {
+        created.push_back(entities.create_with<Velocity>(Velocity{2.f, 2.f}));
+      }
+      THEN("They should use the blocks of the destroyed entities") {
+        for (Entity &entity : created) {
+          REQUIRE(entity.id().index() < 4 * 64);
+        }
+        REQUIRE(entities.count() == 266);
+        REQUIRE(entities.count<Velocity>() == 128);
+        REQUIRE(entities.count<Position>() == 0);
+        for (auto entity : entities.with<Velocity>()) {
+          REQUIRE(entity.get<Velocity>().x == 2.f);
+        }
+      }
+      THEN("Entities that were kept should be untouched") {
+        for (Entity &entity : common) {
+          REQUIRE(entity.is_valid());
+          REQUIRE(entity.get<Height>().value == 1);
+        }
+      }
+    }
+    WHEN("Entities with rotating components are created and destroyed many times") {
+      for (int round = 0; round < 100; ++round) {
+        std::vector<Entity> batch;
+        for (int i = 0; i < 100; ++i) {
+          if (round % 3 == 0) batch.push_back(entities.create_with<Position>(Position{0.f, 0.f}));
+          if (round % 3 == 1) batch.push_back(entities.create_with<Velocity>(Velocity{0.f, 0.f}));
+          if (round % 3 == 2) batch.push_back(entities.create_with<Position, Velocity>(Position{0.f, 0.f},
+                                                                                     Velocity{0.f, 0.f}));
+        }
+        // Destroy them in a different order than they were created
+        for (size_t i = 0; i < batch.size(); ++i) {
+          batch[(i * 7) % batch.size()].destroy();
+        }
+      }
+      std::vector<Entity> created = entities.create(192);
+      THEN("The number of blocks should stay bounded") {
+        for (Entity &entity : created) {
+          REQUIRE(entity.id().index() < 6 * 64);
+        }
+        REQUIRE(entities.count() == 202);
+        REQUIRE(entities.count<Height>() == 10);
+      }
+    }
+  }
+}
+
+SCENARIO("Referring to entities with compact Handles") {
+  GIVEN("An EntityManager with entities that target other entities") {
+    EntityManager entities;
+    std::vector<Entity> targets;
+    for (int i = 0; i < 100; ++i) {
+      targets.push_back(entities.create_with<Position>(Position{float(i), 0}));
+    }
+    for (int i = 0; i < 100; ++i) {
+      entities.create_with<Target, Damage>(Target{targets[i].handle()}, Damage{i});
+    }
+    THEN("A Handle should be 8 bytes, and refer to the same entity") {
+      REQUIRE(sizeof(Handle) == 8);
+      REQUIRE(sizeof(Target) == 8);
+      Handle handle = targets[10].handle();
+      REQUIRE(handle.id() == targets[10].id());
+      REQUIRE(entities[handle] == targets[10]);
+      REQUIRE(Handle::from_value(handle.value()) == handle);
+      for (auto entity : entities.with<Position>()) {
+        REQUIRE(entities[entity.handle()] == entity);
+      }
+    }
+    THEN("A default Handle should not refer to any entity") {
+      Handle handle;
+      REQUIRE(handle.is_null());
+      REQUIRE_FALSE(targets[0].handle().is_null());
+      REQUIRE_FALSE(entities.is_valid(handle));
+      REQUIRE_THROWS(entities[handle]);
+    }
+    THEN("Lambdas should be given the Handle of each entity") {
+      std::vector<Handle> handles;
+      entities.with([&handles](Handle handle, Position &position) {
+        handles.push_back(handle);
+      });
+      REQUIRE(handles.size() == 100);
+      for (size_t i = 0; i < handles.size(); ++i) {
+        REQUIRE(handles[i] == targets[i].handle());
+      }
+      int sum = 0;
+      entities.with([&sum, &entities](Target &target, Damage &damage, Handle handle) {
+        sum += int(entities[target.entity].get<Position>().x) - damage.amount;
+        REQUIRE(entities.is_valid(handle));
+      });
+      REQUIRE(sum == 0);
+    }
+    WHEN("A target is destroyed") {
+      Handle handle = targets[5].handle();
+      targets[5].destroy();
+      Entity created = entities.create_with<Position>(Position{0, 0});
+      THEN("Its Handle should no longer be valid, even if the index is reused") {
+        REQUIRE(created.id().index() == handle.index());
+        REQUIRE_FALSE(entities.is_valid(handle));
+        REQUIRE(entities.is_valid(created.handle()));
+        REQUIRE(created.handle() != handle);
+      }
+    }
+  }
+}
+
+namespace ecs{
+
+template<>
+struct Replicate<Position> {
+  static void write(BitWriter &out, Position const &position) {
+    out.write_float(position.x, -4096, 4096, 20);
+    out.write_float(position.y, -4096, 4096, 20);
+  }
+  static void read(BitReader &in, Position &position) {
+    position.x = in.read_float(-4096, 4096, 20);
+    position.y = in.read_float(-4096, 4096, 20);
+  }
+  static Point position(Position const &position) {
+    return Point{position.x, position.y, 0};
+  }
+};
+
+template<>
+struct Replicate<Height> {
+  static void write(BitWriter &out, Height const &height) {
+    out.write(uint32_t(height.value), 32);
+  }
+  static void read(BitReader &in, Height &height) {
+    height.value = int(int32_t(in.read(32)));
+  }
+};
+
+} // namespace ecs
+
+SCENARIO("Writing and reading bits") {
+  GIVEN("Values written with a BitWriter") {
+    std::vector<uint8_t> buffer;
+    {
+      BitWriter writer(buffer);
+      writer.write(5, 3);
+      writer.write_bool(true);
+      writer.write(0x123456789ABCDEFULL, 61);
+      writer.write_varint(300);
+      writer.write_float(0.25f, -1, 1, 12);
+      writer.write(uint64_t(-1), 64);
+      REQUIRE(writer.bit_count() == 3 + 1 + 61 + 16 + 12 + 64);
+    }
+    THEN("They should take as few bytes as possible") {
+      REQUIRE(buffer.size() == (3 + 1 + 61 + 16 + 12 + 64 + 7) / 8);
+    }
+    THEN("They should be read back with a BitReader") {
+      BitReader reader(buffer.data(), buffer.size());
+      REQUIRE(reader.read(3) == 5);
+      REQUIRE(reader.read_bool());
+      REQUIRE(reader.read(61) == 0x123456789ABCDEFULL);
+      REQUIRE(reader.read_varint() == 300);
+      float value = reader.read_float(-1, 1, 12);
+      REQUIRE(std::abs(value - 0.25f) < 0.001f);
+      REQUIRE(reader.read(64) == uint64_t(-1));
+      REQUIRE_FALSE(reader.overflow());
+      reader.read(8);
+      REQUIRE(reader.overflow());
+    }
+  }
+}
+
+SCENARIO("Replicating entities to observers") {
+  GIVEN("Entities in a line, and two clients that see a part of it each") {
+    EntityManager server;
+    std::vector<Entity> created;
+    for (int i = 0; i < 200; ++i) {
+      created.push_back(server.create_with<Position, Height>(Position{i * 10.f, 0}, i));
+    }
+    Replicator<Position, Position, Height> replicator(server, 50);
+    size_t near = replicator.add_observer(Observer{Point{0, 0, 0}, 100});
+    size_t far = replicator.add_observer(Observer{Point{1000, 0, 0}, 55});
+    EntityManager near_entities, far_entities;
+    Replica<Position, Height> near_replica(near_entities), far_replica(far_entities);
+    uint64_t tick = 0;
+    std::vector<uint8_t> packet;
+    // Send the packet of each client to it, and acknowledge it, as if over a network
+    auto send = [&](size_t observer, Replica<Position, Height> &replica) {
+      packet.clear();
+      replicator.write(observer, packet);
+      if (replica.read(packet)) replicator.acknowledge(observer, replica.tick());
+    };
+    auto tick_and_send = [&]() {
+      replicator.update(++tick);
+      send(near, near_replica);
+      send(far, far_replica);
+    };
+    // Check that a client has exactly the entities its observer sees
+    auto sees = [&](size_t observer, Replica<Position, Height> &replica) {
+      Observer const &o = replicator.observer(observer);
+      size_t visible = 0;
+      bool same = true;
+      for (auto entity : server.with<Position>()) {
+        Position &position = entity.get<Position>();
+        float dx = position.x - o.position.x, dy = position.y - o.position.y;
+        if (dx * dx + dy * dy > o.radius * o.radius) continue;
+        ++visible;
+        Entity local = replica[entity.handle()];
+        same = same && local.is_valid() && std::abs(local.get<Position>().x - position.x) < 0.01f &&
+            local.has<Height>() == entity.has<Height>() &&
+            (!entity.has<Height>() || local.get<Height>().value == entity.get<Height>().value);
+      }
+      return same && replica.size() == visible;
+    };
+    tick_and_send();
+    THEN("Each client should get the entities its observer sees") {
+      REQUIRE(sees(near, near_replica));
+      REQUIRE(sees(far, far_replica));
+      REQUIRE(near_entities.count() == 11);
+      REQUIRE(far_entities.count() == 11);
+      REQUIRE(replicator.acknowledged(near) == 1);
+    }
+    WHEN("Nothing changes") {
+      replicator.update(++tick);
+      packet.clear();
+      replicator.write(near, packet);
+      THEN("The packet should only have the tick") {
+        REQUIRE(packet.size() == 4);
+      }
+    }
+    WHEN("Components change, are removed, and entities are destroyed and created") {
+      created[5].set<Height>(1000);
+      created[6].get<Position>().x += 0.001f;
+      created[7].remove<Height>();
+      created[8].destroy();
+      created[1000 / 10].get<Position>().y = 30;
+      server.create_with<Position, Height>(Position{1, 1}, -1);
+      replicator.update(++tick);
+      packet.clear();
+      replicator.write(near, packet);
+      size_t size = packet.size();
+      REQUIRE(near_replica.read(packet));
+      replicator.acknowledge(near, near_replica.tick());
+      send(far, far_replica);
+      THEN("The clients should be up to date") {
+        REQUIRE(sees(near, near_replica));
+        REQUIRE(sees(far, far_replica));
+        REQUIRE_FALSE(near_replica[created[8].handle()].is_valid());
+        REQUIRE_FALSE(near_replica[created[7].handle()].has<Height>());
+        REQUIRE(near_replica[created[5].handle()].get<Height>().value == 1000);
+      }
+      THEN("Changes too small to be seen after quantization should not be sent") {
+        // Left: 1 entity, entered: 1 entity with 2 components, changed: 2 entities
+        REQUIRE(size < 4 + 3 + 2 + 10 + 3 + 2 * 6 + 3);
+      }
+    }
+    WHEN("Observers move") {
+      replicator.set_observer(near, Observer{Point{500, 0, 0}, 100});
+      replicator.set_observer(far, Observer{Point{0, 0, 0}, 1000});
+      tick_and_send();
+      THEN("Entities that are out of sight should be removed, and new ones added") {
+        REQUIRE(sees(near, near_replica));
+        REQUIRE(sees(far, far_replica));
+        REQUIRE(near_entities.count() == 21);
+        REQUIRE(far_entities.count() == 101);
+      }
+    }
+    WHEN("Packets are lost, and arrive late") {
+      std::vector<std::vector<uint8_t>> lost;
+      for (int i = 0; i < 5; ++i) {
+        created[10 + i].set<Height>(100 + i);
+        created[20 + i].destroy();
+        replicator.set_observer(near, Observer{Point{i * 50.f, 0, 0}, 100});
+        replicator.update(++tick);
+        lost.push_back(std::vector<uint8_t>());
+        replicator.write(near, lost.back());
+      }
+      REQUIRE(near_replica.read(lost[1]));
+      tick_and_send();
+      THEN("The client should be up to date after the next packet") {
+        REQUIRE(sees(near, near_replica));
+        REQUIRE(near_replica[created[13].handle()].get<Height>().value == 103);
+      }
+      THEN("Older packets should be ignored") {
+        REQUIRE_FALSE(near_replica.read(lost[4]));
+        REQUIRE(sees(near, near_replica));
+      }
+    }
+    WHEN("Packets are written for every observer at once") {
+      for (int i = 0; i < 100; ++i) {
+        replicator.add_observer(Observer{Point{i * 20.f, 0, 0}, 60});
+      }
+      created[50].set<Height>(5);
+      replicator.update(++tick);
+      std::vector<std::vector<uint8_t>> packets;
+      replicator.write_all(packets, 4);
+      THEN("Each observer should get its own packet") {
+        REQUIRE(packets.size() == 102);
+        for (size_t observer = 2; observer < packets.size(); ++observer) {
+          EntityManager client;
+          Replica<Position, Height> replica(client);
+          REQUIRE(replica.read(packets[observer]));
+          replicator.acknowledge(observer, replica.tick());
+          REQUIRE(sees(observer, replica));
+          REQUIRE(replicator.acknowledged(observer) == tick);
+        }
+      }
+    }
+  }
+}
+
+SCENARIO("Exporting metrics in the Prometheus text format") {
+  auto has_line = [](std::string const &text, std::string const &line) {
+    return ("\n" + text).find("\n" + line + "\n") != std::string::npos;
+  };
+  GIVEN("A SystemManager with a system that emits events, and entities with some components") {
+    EntityManager entities;
+    SystemManager systems(entities);
+    systems.add<DamageSystem>();
+    Metrics &metrics = systems.metrics();
+    metrics.name_component<Position>("position");
+    metrics.name_system<DamageSystem>("damage \"system\"");
+    metrics.name_events<Damage>("damage");
+    std::string height = "component_" + std::to_string(details::component_index<Height>());
+    // Components of a mask are listed in the order of their index
+    std::string both = details::component_index<Position>() < details::component_index<Height>() ?
+                       "position," + height : height + ",position";
+    for (int i = 0; i < 10; ++i) {
+      entities.create_with<Position>(Position{0, 0});
+    }
+    for (int i = 0; i < 5; ++i) {
+      entities.create_with<Position, Height>(Position{0, 0}, i);
+    }
+    std::vector<Entity> empty = entities.create(3);
+    THEN("Entities should be counted by their components") {
+      std::string text = metrics.str();
+      REQUIRE(has_line(text, "# TYPE ecs_entities gauge"));
+      REQUIRE(has_line(text, "ecs_entities 18"));
+      REQUIRE(has_line(text, "ecs_entities_by_mask{components=\"position\"} 10"));
+      REQUIRE(has_line(text, "ecs_entities_by_mask{components=\"" + both + "\"} 5"));
+      REQUIRE(has_line(text, "ecs_entities_by_mask{components=\"\"} 3"));
+      REQUIRE(has_line(text, "ecs_component_entities{component=\"position\"} 15"));
+      REQUIRE(has_line(text, "ecs_component_entities{component=\"" + height + "\"} 5"));
+      REQUIRE(text.find("ecs_component_pool_bytes{component=\"position\"} ") != std::string::npos);
+      REQUIRE(has_line(text, "ecs_updates_total 0"));
+    }
+    WHEN("The expiry time of an entity is changed, and another is destroyed") {
+      empty[0].expire_in(0.5f);
+      empty[0].expire_in(2);
+      empty[1].expire_in(1);
+      empty[1].destroy();
+      THEN("Only the entity that is still set to expire should be counted") {
+        REQUIRE(has_line(metrics.str(), "ecs_expiring_entities 1"));
+      }
+    }
+    WHEN("Updating a few times, while an entity expires") {
+      empty[0].expire_in(0.5f);
+      for (int i = 0; i < 3; ++i) {
+        systems.update(1);
+      }
+      std::string text = metrics.str();
+      THEN("Updates, systems, events and expired entities should be counted") {
+        REQUIRE(metrics.updates() == 3);
+        REQUIRE(has_line(text, "ecs_updates_total 3"));
+        REQUIRE(has_line(text, "ecs_system_updates_total{system=\"damage \\\"system\\\"\"} 3"));
+        REQUIRE(has_line(text, "ecs_events_total{events=\"damage\"} 4"));
+        REQUIRE(has_line(text, "ecs_event_backlog{events=\"damage\"} 2"));
+        REQUIRE(has_line(text, "ecs_expired_entities_total 1"));
+        REQUIRE(has_line(text, "ecs_entities 17"));
+      }
+      THEN("The same text should be written to a file") {
+        std::string path = "ecs_metrics_test.prom";
+        REQUIRE(metrics.write_file(path));
+        std::ifstream in(path.c_str());
+        std::stringstream read;
+        read << in.rdbuf();
+        REQUIRE(read.str() == text);
+        REQUIRE_FALSE(std::ifstream((path + ".tmp").c_str()).good());
+        std::remove(path.c_str());
+      }
+    }
+  }
+}
+
+#ifdef ECS_SHARED_MEMORY
+#include <sys/wait.h>
+
+SCENARIO("Sharing snapshots of the world with other processes") {
+  std::string name = "/ecs_test_" + std::to_string(getpid());
+  GIVEN("A SharedWorld with a snapshot of entities") {
+    EntityManager entities;
+    for (int i = 0; i < 1000; ++i) {
+      Entity entity = entities.create_with<Position>(Position{float(i), 0.f});
+      if (i % 4 == 0) entity.add<Height>(i);
+    }
+    SharedWorld shared(name, 64 * 1024);
+    SharedWorldReader empty(name);
+    THEN("Nothing should be read before anything is published") {
+      REQUIRE(shared.is_open());
+      REQUIRE(empty.is_open());
+      REQUIRE_FALSE(empty.read());
+      REQUIRE_FALSE(empty.has_snapshot());
+    }
+    REQUIRE((shared.publish<Position, Height>(entities, 1)));
+    WHEN("A reader attaches to it") {
+      SharedWorldReader reader(name);
+      THEN("It should read the components of the snapshot") {
+        REQUIRE(reader.is_open());
+        REQUIRE(reader.read());
+        REQUIRE(reader.epoch() == 1);
+        Columns const &columns = reader.columns();
+        REQUIRE(columns.rows() == 1000);
+        REQUIRE(columns.null_count(1) == 750);
+        Position const *positions = columns.values<Position>(0);
+        Height const *height = columns.values<Height>(1);
+        for (size_t row = 0; row < columns.rows(); ++row) {
+          Entity entity = entities[columns.id(row)];
+          REQUIRE(positions[row].x == entity.get<Position>().x);
+          REQUIRE(columns.is_valid(1, row) == entity.has<Height>());
+          if (entity.has<Height>()) REQUIRE(height[row] == entity.get<Height>().value);
+        }
+      }
+      THEN("A snapshot that does not fit should not replace the published one") {
+        for (int i = 0; i < 10000; ++i) {
+          entities.create_with<Position>(Position{0.f, 0.f});
+        }
+        REQUIRE_FALSE((shared.publish<Position, Height>(entities, 2)));
+        REQUIRE(reader.read());
+        REQUIRE(reader.epoch() == 1);
+        REQUIRE(reader.columns().rows() == 1000);
+      }
+    }
+    WHEN("Another process publishes while snapshots are read") {
+      const uint64_t last = 2000;
+      entities.with([](Position &position) { position.x = 1; });
+      REQUIRE((shared.publish<Position, Height>(entities, 1)));
+      pid_t child = fork();
+      if (child == 0) {
+        // Every position of a snapshot is its epoch
+        for (uint64_t epoch = 2; epoch <= last; ++epoch) {
+          entities.with([epoch](Position &position) {
+            position.x = float(epoch);
+          });
+          shared.publish<Position, Height>(entities, epoch);
+        }
+        _exit(0);
+      }
+      SharedWorldReader reader(name);
+      bool consistent = true;
+      uint64_t previous = 0;
+      int status = 0;
+      bool exited = false;
+      while (consistent && previous < last) {
+        // Once the child has exited, only the snapshot it published last is left to read
+        bool last_read = exited;
+        if (reader.read()) {
+          Columns const &columns = reader.columns();
+          Position const *positions = columns.values<Position>(0);
+          for (size_t row = 0; row < columns.rows(); ++row) {
+            consistent = consistent && positions[row].x == float(reader.epoch());
+          }
+          consistent = consistent && reader.epoch() >= previous;
+          previous = reader.epoch();
+        }
+        if (last_read) break;
+        exited = waitpid(child, &status, WNOHANG) == child;
+      }
+      if (!exited) waitpid(child, &status, 0);
+      THEN("Every snapshot that is read should be whole") {
+        REQUIRE(consistent);
+        REQUIRE(previous == last);
+        REQUIRE(WIFEXITED(status));
+        REQUIRE(WEXITSTATUS(status) == 0);
+      }
+    }
+  }
+  WHEN("The segment can't be created") {
+    EntityManager entities;
+    entities.create_with<Position>(Position{0.f, 0.f});
+    SharedWorld shared(name + "/invalid", 1024);
+    THEN("The SharedWorld should not be open, and nothing should be published") {
+      REQUIRE_FALSE(shared.is_open());
+      REQUIRE_FALSE(shared.publish<Position>(entities, 1));
+    }
+  }
+  WHEN("There is no such segment") {
+    SharedWorldReader reader(name + "_missing");
+    THEN("The reader should not be open") {
+      REQUIRE_FALSE(reader.is_open());
+      REQUIRE_FALSE(reader.read());
+    }
+  }
+}
+#endif // ECS_SHARED_MEMORY
@@ -16,6 +16,10 @@
 
 #include <iostream>
 #include <chrono>
+#include <thread>
+#include <queue>
+#include <unordered_map>
+#include <sstream>
 
 #include "common/thirdparty/catch.hpp"
 
@@ -40,9 +44,24 @@ struct Clothes {
   int i[16];
 };
 
+struct Score: Property<int> {
+};
+
 struct Car: EntityAlias<Wheels> {
 };
 
+struct EntityTarget {
+  Entity entity;
+};
+
+struct HandleTarget {
+  Handle entity;
+};
+
+struct Location {
+  float x, y;
+};
+
 // Used to make sure the comparator does not optimize away my for-loop
 struct BaseFoo {
   virtual void bar() = 0;
@@ -335,4 +354,582 @@ SCENARIO("TestEntityCreation_with_Entity") {
       entities.create_with<Door>();
     }
   }
-}
\ No newline at end of file
+}
+
+SCENARIO("TestEntityCreation_with_EntityShard") {
+  int count = 10000000;
+  int num_of_threads = 4;
+  EntityManager entities;
+  std::cout << "Creating " << count << " with with Doors, EntityShard on " << num_of_threads << " threads" << std::endl;
+  {
+    Timer t;
+    std::vector<EntityShard<Door>> shards;
+    for (int i = 0; i < num_of_threads; ++i) {
+      shards.push_back(entities.create_shard<Door>(count / num_of_threads));
+    }
+    std::vector<std::thread> threads;
+    for (auto &shard : shards) {
+      EntityShard<Door> *shard_ptr = &shard;
+      threads.emplace_back([shard_ptr, count, num_of_threads] {
+        for (int i = 0; i < count / num_of_threads; ++i) {
+          shard_ptr->create();
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    for (auto &shard : shards) {
+      entities.merge(shard);
+    }
+  }
+  REQUIRE(entities.count() == count);
+}
+
+SCENARIO("TestMergeEntityManagers") {
+  int count = 10000000;
+  EntityManager world;
+  EntityManager region;
+  for (int i = 0; i < count; ++i) {
+    region.create_with<Wheels, Door>();
+  }
+  std::cout << "Merging " << count << " entities with Wheels and Doors into another EntityManager" << std::endl;
+  {
+    Timer t;
+    world.merge(std::move(region));
+  }
+  REQUIRE(world.count() == count);
+}
+
+SCENARIO("TestForkEntityManager") {
+  int count = 10000000;
+  EntityManager entities;
+  for (int i = 0; i < count; ++i) {
+    entities.create_with<Wheels, Door>();
+  }
+  std::unique_ptr<EntityManager> fork;
+  {
+    std::cout << "Forking EntityManager with " << count << " entities" << std::endl;
+    Timer t;
+    fork = entities.fork();
+  }
+  {
+    std::cout << "Modifying every Wheels component in the fork after forking" << std::endl;
+    Timer t;
+    fork->with([](Wheels &wheels) { wheels.value = 1; });
+  }
+  {
+    std::cout << "Modifying every Wheels component in the fork again" << std::endl;
+    Timer t;
+    fork->with([](Wheels &wheels) { wheels.value = 2; });
+  }
+  REQUIRE(fork->count() == count);
+}
+
+SCENARIO("TestRollbackBufferRestore") {
+  int count = 100000;
+  EntityManager entities;
+  RollbackBuffer history(entities, 60);
+  for (int i = 0; i < count; ++i) {
+    entities.create_with<Wheels, Door, Hat>();
+  }
+  {
+    std::cout << "Recording 60 ticks of " << count << " entities, modifying Wheels every tick" << std::endl;
+    Timer t;
+    for (size_t tick = 0; tick < 60; ++tick) {
+      entities.with([tick](Wheels &wheels) { wheels.value = int(tick); });
+      history.record(tick);
+    }
+  }
+  {
+    std::cout << "Restoring " << count << " entities 30 ticks back" << std::endl;
+    Timer t;
+    history.restore(29);
+  }
+  int value = 0;
+  entities.with([&value](Wheels &wheels) { value = wheels.value; });
+  REQUIRE(value == 29);
+}
+
+SCENARIO("TestDoubleBufferedComponents") {
+  int count = 10000000;
+  EntityManager entities;
+  for (int i = 0; i < count; ++i) {
+    entities.create_with<Wheels, Door>();
+  }
+  entities.double_buffer<Wheels>();
+  {
+    std::cout << "Swapping buffers for " << count << " double buffered components" << std::endl;
+    Timer t;
+    entities.swap_buffers();
+  }
+  {
+    std::cout << "Modifying 1% of the double buffered components after swapping" << std::endl;
+    Timer t;
+    for (int i = 0; i < count; i += 100) {
+      entities[index_t(i)].get<Wheels>().value = 1;
+    }
+  }
+  {
+    std::cout << "Modifying every double buffered component after swapping" << std::endl;
+    Timer t;
+    entities.with([](Wheels &wheels) { wheels.value = 2; });
+  }
+  {
+    std::cout << "Modifying every double buffered component again" << std::endl;
+    Timer t;
+    entities.with([](Wheels &wheels) { wheels.value = 3; });
+  }
+  REQUIRE(entities[index_t(0)].previous<Wheels>().value == 0);
+}
+
+SCENARIO("TestEntityExpiry") {
+  int count = 1000000;
+  EntityManager entities;
+  for (int i = 0; i < count; ++i) {
+    entities.create_with<Wheels>().expire_in(float(i % 600) / 60 + 10);
+  }
+  {
+    std::cout << "Updating expiry 600 times, without expired entities among " << count << " entities" << std::endl;
+    Timer t;
+    for (int i = 0; i < 600; ++i) {
+      entities.update_expiry(1.0f / 60);
+    }
+  }
+  {
+    std::cout << "Updating expiry 600 times, destroying " << count << " entities" << std::endl;
+    Timer t;
+    for (int i = 0; i < 600; ++i) {
+      entities.update_expiry(1.0f / 60);
+    }
+  }
+  REQUIRE(entities.count() == 0);
+}
+
+SCENARIO("TestEventChannel") {
+  int count = 10000000;
+  int num_of_threads = 4;
+  EntityManager entities;
+  EventChannel<Wheels> &channel = entities.events<Wheels>();
+  auto reader = channel.reader();
+  {
+    std::cout << "Emitting " << count << " events from " << num_of_threads << " threads" << std::endl;
+    Timer t;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_of_threads; ++i) {
+      threads.emplace_back([&channel, count, num_of_threads] {
+        auto writer = channel.writer();
+        for (int j = 0; j < count / num_of_threads; ++j) {
+          writer.emit(Wheels{1});
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+  {
+    std::cout << "Swapping an EventChannel with " << count << " events" << std::endl;
+    Timer t;
+    entities.swap_events();
+  }
+  long sum = 0;
+  {
+    std::cout << "Reading " << count << " events" << std::endl;
+    Timer t;
+    reader.read([&sum](Wheels const &wheels) { sum += wheels.value; });
+  }
+  REQUIRE(sum == count);
+}
+
+SCENARIO("TestSparseEntityIteration") {
+  int count = 10000000;
+  EntityManager entities;
+  for (int i = 0; i < count; ++i) {
+    Entity entity = entities.create_with<Wheels, Door>();
+    if (i % 16 != 0) entity.remove<Door>();
+  }
+  {
+    std::cout << "Iterating over " << count / 16 << " of " << count << " entities, scattered in memory" << std::endl;
+    Timer t;
+    index_t visited = 0;
+    for (auto it = entities.with<Door>().begin(), end = entities.with<Door>().end(); it != end; ++it) {
+      ++visited;
+    }
+    REQUIRE(visited == count / 16);
+  }
+}
+
+SCENARIO("TestPrefetching") {
+  int count = 10000000;
+  EntityManager entities;
+  for (int i = 0; i < count; ++i) {
+    entities.create_with<Wheels, Clothes>();
+  }
+  // Half of the entities are destroyed, and a third of them have a Hat
+  EntityManager fragmented;
+  for (int i = 0; i < count; ++i) {
+    Entity entity = fragmented.create_with<Wheels, Clothes>();
+    if (i % 3 == 0) entity.add<Hat>();
+    if (i % 2 == 0) entity.destroy();
+  }
+  size_t distances[] = {0, ECS_PREFETCH_DISTANCE, 16};
+  for (size_t distance : distances) {
+    entities.set_prefetch_distance(distance);
+    fragmented.set_prefetch_distance(distance);
+    {
+      std::cout << "Iterating over " << count << " small components, prefetching " << distance << " entities ahead" << std::endl;
+      Timer t;
+      entities.with([](Wheels &wheels) { ++wheels.value; });
+    }
+    {
+      std::cout << "Iterating over " << count << " large components, prefetching " << distance << " entities ahead" << std::endl;
+      Timer t;
+      entities.with([](Clothes &clothes) { ++clothes.i[0]; });
+    }
+    {
+      std::cout << "Iterating over " << count / 6 << " fragmented entities with large components, prefetching "
+          << distance << " entities ahead" << std::endl;
+      Timer t;
+      fragmented.with([](Clothes &clothes, Hat &hat) { ++clothes.i[0]; });
+    }
+  }
+  int value = 0;
+  entities.with([&value](Wheels &wheels) { value = wheels.value; });
+  REQUIRE(value == 3);
+}
+
+SCENARIO("TestReduce") {
+  int count = 10000000;
+  EntityManager entities;
+  for (int i = 0; i < count; ++i) {
+    entities.create_with<Wheels>(i % 7);
+  }
+  long long expected = 0;
+  {
+    std::cout << "Summing " << count << " components with a lambda" << std::endl;
+    Timer t;
+    entities.with([&expected](Wheels &wheels) { expected += wheels.value; });
+  }
+  size_t threads[] = {1, 2, 4, 0};
+  for (size_t thread_count : threads) {
+    std::cout << "Summing " << count << " components with reduce, on " << thread_count << " threads" << std::endl;
+    Timer t;
+    long long sum = entities.reduce<Wheels>(0LL, [](Wheels const &wheels) { return (long long) wheels.value; },
+                                            [](long long a, long long b) { return a + b; }, thread_count);
+    REQUIRE(sum == expected);
+  }
+}
+
+SCENARIO("TestTopK") {
+  int count = 10000000;
+  size_t k = 100;
+  EntityManager entities;
+  for (int i = 0; i < count; ++i) {
+    entities.create_with<Score>(int((i * 7919LL) % 1000003));
+  }
+  std::vector<int> expected;
+  {
+    std::cout << "Selecting the " << k << " largest of " << count << " components with a lambda and a heap" << std::endl;
+    Timer t;
+    std::priority_queue<int, std::vector<int>, std::greater<int>> heap;
+    entities.with([&heap, k](Score &score) {
+      if (heap.size() < k) heap.push(score.value);
+      else if (score.value > heap.top()) {
+        heap.pop();
+        heap.push(score.value);
+      }
+    });
+    for (; !heap.empty(); heap.pop()) expected.insert(expected.begin(), heap.top());
+  }
+  {
+    std::cout << "Selecting the " << k << " largest of " << count << " components with top_k" << std::endl;
+    Timer t;
+    std::vector<Id> top = entities.top_k<Score>(k);
+    REQUIRE(entities[top.front()].get<Score>() == expected.front());
+    REQUIRE(entities[top.back()].get<Score>() == expected.back());
+  }
+  {
+    std::cout << "Finding the median of " << count << " components" << std::endl;
+    Timer t;
+    std::vector<int> median = entities.quantiles<Score>(std::vector<double>(1, 0.5));
+    REQUIRE(std::abs(median[0] - 500000) < 20000);
+  }
+}
+
+SCENARIO("TestGuidLookup") {
+  int count = 1000000;
+  EntityManager entities;
+  std::unordered_map<uint64_t, Id> guids;
+  std::vector<uint64_t> lookups;
+  for (int i = 0; i < count; ++i) {
+    uint64_t guid = uint64_t(i) * 0x9E3779B97F4A7C15ULL;
+    Entity entity = entities.create_with<Guid>(guid);
+    guids[guid] = entity.id();
+    lookups.push_back(guid);
+  }
+  // Look the entities up in an order that does not follow memory
+  for (size_t i = 0; i < lookups.size(); ++i) {
+    std::swap(lookups[i], lookups[(i * 7919) % lookups.size()]);
+  }
+  entities.find_guid(0);
+  index_t found = 0;
+  {
+    std::cout << "Looking up " << count << " entities by guid with std::unordered_map" << std::endl;
+    Timer t;
+    for (uint64_t guid : lookups) {
+      found += entities[guids.find(guid)->second].id().index() != 0;
+    }
+  }
+  {
+    std::cout << "Looking up " << count << " entities by guid with find_guid" << std::endl;
+    Timer t;
+    for (uint64_t guid : lookups) {
+      found += entities.find_guid(guid).id().index() != 0;
+    }
+  }
+  REQUIRE(found == 2 * (count - 1));
+}
+
+SCENARIO("TestExportColumns") {
+  int count = 1000000;
+  EntityManager entities;
+  for (int i = 0; i < count; ++i) {
+    auto entity = entities.create_with<Wheels, Score>(Wheels{i % 8}, i);
+    if (i % 4 == 0) entity.remove<Score>();
+  }
+  {
+    std::cout << "Writing " << count << " entities as CSV" << std::endl;
+    Timer t;
+    std::ostringstream out;
+    for (auto entity : entities.with<Wheels>()) {
+      out << entity.id().index() << ',' << entity.get<Wheels>().value << ',';
+      if (entity.has<Score>()) out << entity.get<Score>().value;
+      out << '\n';
+    }
+  }
+  {
+    std::cout << "Exporting " << count << " entities as columns" << std::endl;
+    Timer t;
+    std::ostringstream out;
+    entities.export_columns<Wheels, Score>(out);
+    REQUIRE(out.str().size() > count * (sizeof(Wheels) + sizeof(Score)));
+  }
+}
+
+SCENARIO("TestImportColumns") {
+  int count = 5000000;
+  std::stringstream stream;
+  {
+    EntityManager entities;
+    for (int i = 0; i < count; ++i) {
+      entities.create_with<Wheels, Score>(Wheels{i % 8}, i);
+    }
+    entities.export_columns<Wheels, Score>(stream);
+  }
+  {
+    std::cout << "Creating " << count << " entities with create_with" << std::endl;
+    Timer t;
+    EntityManager entities;
+    for (int i = 0; i < count; ++i) {
+      entities.create_with<Wheels, Score>(Wheels{i % 8}, i);
+    }
+  }
+  {
+    std::cout << "Importing " << count << " entities from columns" << std::endl;
+    Timer t;
+    EntityManager entities;
+    size_t batches = 0;
+    entities.import_columns<Wheels, Score>(stream, [&batches](size_t, size_t) { ++batches; });
+    REQUIRE(entities.count() == size_t(count));
+  }
+}
+
+SCENARIO("TestRecycleBlocks") {
+  int count = 100000;
+  int rounds = 30;
+  EntityManager entities;
+  {
+    std::cout << "Creating and destroying " << count << " entities " << rounds
+              << " times, with different components each time" << std::endl;
+    Timer t;
+    for (int round = 0; round < rounds; ++round) {
+      std::vector<Entity> batch;
+      batch.reserve(size_t(count));
+      for (int i = 0; i < count; ++i) {
+        if (round % 3 == 0) batch.push_back(entities.create_with<Wheels>(Wheels{i}));
+        if (round % 3 == 1) batch.push_back(entities.create_with<Score>(i));
+        if (round % 3 == 2) batch.push_back(entities.create_with<Wheels, Score>(Wheels{i}, i));
+      }
+      for (Entity &entity : batch) {
+        entity.destroy();
+      }
+    }
+  }
+  // The blocks of the destroyed entities are used for other components
+  Entity entity = entities.create(1)[0];
+  REQUIRE(entity.id().index() < index_t(count));
+}
+
+SCENARIO("TestHandles") {
+  int count = 2000000;
+  EntityManager entities;
+  std::vector<Entity> targets = entities.create(size_t(count));
+  for (Entity &target : targets) {
+    target.add<Wheels>(Wheels{1});
+  }
+  for (int i = 0; i < count; ++i) {
+    // Refer to targets in a different order than they were created
+    Entity target = targets[size_t(i) * 7919 % size_t(count)];
+    entities.create_with<EntityTarget, HandleTarget>(EntityTarget{target}, HandleTarget{target.handle()});
+  }
+  int sum = 0;
+  {
+    std::cout << "Following " << count << " targets stored as Entity (" << sizeof(Entity) << " bytes)" << std::endl;
+    Timer t;
+    entities.with([&sum](EntityTarget &target) {
+      sum += target.entity.get<Wheels>().value;
+    });
+  }
+  {
+    std::cout << "Following " << count << " targets stored as Handle (" << sizeof(Handle) << " bytes)" << std::endl;
+    Timer t;
+    entities.with([&sum, &entities](HandleTarget &target) {
+      sum += entities[target.entity].get<Wheels>().value;
+    });
+  }
+  {
+    std::cout << "Iterating " << count << " entities with Entity" << std::endl;
+    Timer t;
+    entities.with([&sum](HandleTarget &target, Entity entity) {
+      sum += int(entity.id().index() & 1);
+    });
+  }
+  {
+    std::cout << "Iterating " << count << " entities with Handle" << std::endl;
+    Timer t;
+    entities.with([&sum](HandleTarget &target, Handle handle) {
+      sum += int(handle.index() & 1);
+    });
+  }
+  REQUIRE(sum >= 2 * count);
+}
+
+namespace ecs{
+
+template<>
+struct Replicate<Location> {
+  static void write(BitWriter &out, Location const &location) {
+    out.write_float(location.x, 0, 4096, 16);
+    out.write_float(location.y, 0, 4096, 16);
+  }
+  static void read(BitReader &in, Location &location) {
+    location.x = in.read_float(0, 4096, 16);
+    location.y = in.read_float(0, 4096, 16);
+  }
+  static Point position(Location const &location) {
+    return Point{location.x, location.y, 0};
+  }
+};
+
+template<>
+struct Replicate<Wheels> {
+  static void write(BitWriter &out, Wheels const &wheels) {
+    out.write(uint32_t(wheels.value), 4);
+  }
+  static void read(BitReader &in, Wheels &wheels) {
+    wheels.value = int(in.read(4));
+  }
+};
+
+} // namespace ecs
+
+SCENARIO("TestReplication") {
+  int count = 100000;
+  int observers = 1000;
+  int ticks = 10;
+  EntityManager entities;
+  std::vector<Entity> created;
+  for (int i = 0; i < count; ++i) {
+    created.push_back(entities.create_with<Location, Wheels>(Location{float(i * 7919 % 4096), float(i % 4096)},
+                                                             Wheels{i % 8}));
+  }
+  Replicator<Location, Location, Wheels> replicator(entities, 100);
+  for (int i = 0; i < observers; ++i) {
+    replicator.add_observer(Observer{Point{float(i * 31 % 4096), float(i * 97 % 4096), 0}, 100});
+  }
+  std::vector<std::vector<uint8_t>> packets;
+  size_t bytes = 0;
+  {
+    std::cout << "Replicating " << count << " entities to " << observers << " observers, " << ticks
+              << " ticks, with a tenth of the entities moving" << std::endl;
+    Timer t;
+    for (int tick = 1; tick <= ticks; ++tick) {
+      for (int i = tick; i < count; i += 10) {
+        created[size_t(i)].get<Location>().x = float((i + tick * 13) % 4096);
+      }
+      replicator.update(uint64_t(tick));
+      for (std::vector<uint8_t> &packet : packets) packet.clear();
+      replicator.write_all(packets, 1);
+      for (size_t observer = 0; observer < packets.size(); ++observer) {
+        bytes += packets[observer].size();
+        replicator.acknowledge(observer, uint64_t(tick));
+      }
+    }
+  }
+  std::cout << "Bytes per observer and tick: " << bytes / size_t(observers * ticks) << std::endl;
+  REQUIRE(replicator.acknowledged(0) == uint64_t(ticks));
+}
+
+SCENARIO("TestMetrics") {
+  int count = 1000000;
+  EntityManager entities;
+  for (int i = 0; i < count; ++i) {
+    auto entity = entities.create_with<Wheels, Score>(Wheels{i % 8}, i);
+    if (i % 3 == 0) entity.add<Door>();
+    if (i % 4 == 0) entity.remove<Score>();
+  }
+  SystemManager systems(entities);
+  {
+    std::cout << "Updating with metrics 100000 times" << std::endl;
+    Timer t;
+    for (int i = 0; i < 100000; ++i) {
+      systems.update(0.01f);
+    }
+  }
+  {
+    std::cout << "Writing metrics of " << count << " entities" << std::endl;
+    Timer t;
+    std::string text = systems.metrics().str();
+    REQUIRE(text.find("ecs_entities 1000000") != std::string::npos);
+  }
+}
+
+#ifdef ECS_SHARED_MEMORY
+SCENARIO("TestSharedWorld") {
+  int count = 1000000;
+  int snapshots = 20;
+  EntityManager entities;
+  for (int i = 0; i < count; ++i) {
+    entities.create_with<Wheels, Score>(Wheels{i % 8}, i);
+  }
+  std::string name = "/ecs_performance_" + std::to_string(getpid());
+  SharedWorld shared(name, 32 * 1024 * 1024);
+  SharedWorldReader reader(name);
+  {
+    std::cout << "Publishing " << snapshots << " snapshots of " << count << " entities" << std::endl;
+    Timer t;
+    for (int i = 1; i <= snapshots; ++i) {
+      REQUIRE((shared.publish<Wheels, Score>(entities, uint64_t(i))));
+    }
+  }
+  {
+    std::cout << "Reading " << snapshots << " snapshots of " << count << " entities" << std::endl;
+    Timer t;
+    for (int i = 1; i <= snapshots; ++i) {
+      REQUIRE(reader.read());
+    }
+  }
+  REQUIRE(reader.columns().rows() == size_t(count));
+}
+#endif